@@ -202,6 +202,8 @@ gst_lcevc_enc_init(GstLcevcEnc *enc)
     enc->lcevc_context = NULL;
     enc->sink_main = NULL;
     enc->sink_secondary = NULL;
+    enc->output_pool = NULL;
+    enc->output_size = 0;
 }
 
 static void
@@ -344,6 +346,13 @@ gst_lcevc_enc_stop(GstVideoEncoder *encoder)
         enc->lcevc_context = NULL;
     }
 
+    if (enc->output_pool) {
+        gst_buffer_pool_set_active(enc->output_pool, FALSE);
+        gst_object_unref(enc->output_pool);
+        enc->output_pool = NULL;
+    }
+    enc->output_size = 0;
+
     enc->initialized = FALSE;
     return TRUE;
 }
@@ -372,6 +381,40 @@ gst_lcevc_enc_set_format(GstVideoEncoder *encoder, GstVideoCodecState *state)
     return TRUE;
 }
 
+// Get an output buffer of size bytes from the output pool. The pool is
+// replaced by a larger one, with some headroom, when a frame outgrows it.
+static GstBuffer *
+gst_lcevc_enc_acquire_output_buffer(GstLcevcEnc *enc, gsize size)
+{
+    GstBuffer *buffer = NULL;
+
+    if (!enc->output_pool || size > enc->output_size) {
+        GstBufferPool *pool = gst_buffer_pool_new();
+        GstStructure *config = gst_buffer_pool_get_config(pool);
+        gsize pool_size = GST_ROUND_UP_N(size + size / 4, 4096);
+
+        gst_buffer_pool_config_set_params(config, NULL, pool_size, 2, 0);
+        if (!gst_buffer_pool_set_config(pool, config) ||
+            !gst_buffer_pool_set_active(pool, TRUE)) {
+            gst_object_unref(pool);
+            return NULL;
+        }
+
+        if (enc->output_pool) {
+            gst_buffer_pool_set_active(enc->output_pool, FALSE);
+            gst_object_unref(enc->output_pool);
+        }
+        enc->output_pool = pool;
+        enc->output_size = pool_size;
+    }
+
+    if (gst_buffer_pool_acquire_buffer(enc->output_pool, &buffer, NULL) != GST_FLOW_OK)
+        return NULL;
+
+    gst_buffer_set_size(buffer, size);
+    return buffer;
+}
+
 static GstFlowReturn
 gst_lcevc_enc_handle_frame(GstVideoEncoder *encoder, GstVideoCodecFrame *frame)
 {
@@ -395,7 +438,7 @@ gst_lcevc_enc_handle_frame(GstVideoEncoder *encoder, GstVideoCodecFrame *frame)
     }
 
     // Create output buffer
-    output_buffer = gst_buffer_new_allocate(NULL, result.data_size, NULL);
+    output_buffer = gst_lcevc_enc_acquire_output_buffer(enc, result.data_size);
     if (!output_buffer) {
         GST_ERROR_OBJECT(enc, "Failed to allocate output buffer");
         return GST_FLOW_ERROR;
@@ -51,6 +51,10 @@ struct _GstLcevcEnc {
     GstPad *sink_main;
     GstPad *sink_secondary;
     
+    // Output buffers, recycled and sized from the largest frame so far
+    GstBufferPool *output_pool;
+    gsize output_size;
+    
     // Statistics
     guint64 frames_processed;
     GstClockTime processing_time;
@@ -0,0 +1,71 @@
+// Allocation counter of the benchmarks. The allocation functions of the C
+// library are defined again here, in the executable, which takes precedence
+// over libc for every shared object of the process as well, operator new and
+// g_malloc() included. Each one counts the call and hands it on to the glibc
+// implementation through its __libc_ alias.
+
+#include "bench_alloc.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+static std::atomic<uint64_t> allocations(0);
+
+uint64_t bench_allocations() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+static void count() {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" {
+
+void *malloc(size_t size) noexcept {
+    count();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) noexcept {
+    count();
+    return __libc_calloc(n, size);
+}
+
+// Counted even when the block only shrinks or grows in place
+void *realloc(void *ptr, size_t size) noexcept {
+    count();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) noexcept {
+    count();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+    count();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept {
+    void *block;
+
+    if (alignment % sizeof(void *) || alignment & (alignment - 1))
+        return EINVAL;
+    count();
+    block = __libc_memalign(alignment, size);
+    if (!block && size)
+        return ENOMEM;
+    *ptr = block;
+    return 0;
+}
+
+}
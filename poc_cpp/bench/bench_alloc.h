@@ -0,0 +1,11 @@
+#ifndef __BENCH_ALLOC_H__
+#define __BENCH_ALLOC_H__
+
+#include <cstdint>
+
+// Heap allocations made so far by the whole process, libraries and loaded
+// plugins included: bench_alloc.cpp replaces malloc() and its siblings in
+// the benchmark executables, and counts every call to them.
+uint64_t bench_allocations();
+
+#endif /* __BENCH_ALLOC_H__ */
@@ -0,0 +1,384 @@
+// End-to-end benchmark of the lcevcenc element. Frames are pushed through
+// appsrc ! lcevcenc ! appsink as fast as the encoder takes them. The
+// throughput, the latency of every frame from push to output, the heap
+// allocations per frame once the pipeline is running and the peak resident
+// set size are reported as JSON.
+//
+//   bench_element [--y4m=FILE] [--width=W] [--height=H] [--format=FORMAT]
+//                 [--frames=N] [--fps=N] [--set=PROPERTY=VALUE]...
+//
+// Without a y4m file the frames are synthetic. Frames are held in memory,
+// up to MAX_SOURCE_FRAMES of them, and pushed again in turn for as many as
+// asked for. The plugin is looked up in GST_PLUGIN_PATH.
+
+#include <gst/gst.h>
+#include <gst/app/app.h>
+#include <gst/video/video.h>
+
+#include <sys/resource.h>
+
+#include "bench_alloc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define MAX_SOURCE_FRAMES 64
+
+static const struct {
+    const char *tag;    // y4m colour space
+    GstVideoFormat format;
+} y4m_formats[] = {
+    { "420jpeg", GST_VIDEO_FORMAT_I420 },
+    { "420paldv", GST_VIDEO_FORMAT_I420 },
+    { "420mpeg2", GST_VIDEO_FORMAT_I420 },
+    { "420", GST_VIDEO_FORMAT_I420 },
+    { "422", GST_VIDEO_FORMAT_Y42B },
+    { "444", GST_VIDEO_FORMAT_Y444 },
+    { "420p10", GST_VIDEO_FORMAT_I420_10LE },
+    { "422p10", GST_VIDEO_FORMAT_I422_10LE },
+    { "444p10", GST_VIDEO_FORMAT_Y444_10LE },
+    { "420p12", GST_VIDEO_FORMAT_I420_12LE },
+    { "422p12", GST_VIDEO_FORMAT_I422_12LE },
+    { "444p12", GST_VIDEO_FORMAT_Y444_12LE },
+};
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    std::string y4m;
+    unsigned width;
+    unsigned height;
+    std::string format;
+    unsigned frames;
+    unsigned fps;
+    std::vector<std::string> properties;
+};
+
+// Frames going through the element; push times are indexed by frame number
+struct Run {
+    std::mutex lock;
+    GstClockTime duration;
+    std::vector<Clock::time_point> pushed;
+    std::vector<double> latency_ms;
+    guint64 bytes_out;
+};
+
+// Pictures laid out as info says, one vector per frame
+struct Source {
+    GstVideoInfo info;
+    std::vector<std::vector<uint8_t>> frames;
+};
+
+static void synthetic_frames(const Options &opts, Source *source) {
+    GstVideoFormat format = gst_video_format_from_string(opts.format.c_str());
+
+    if (format == GST_VIDEO_FORMAT_UNKNOWN) {
+        fprintf(stderr, "Unknown format %s\n", opts.format.c_str());
+        exit(1);
+    }
+    gst_video_info_set_format(&source->info, format, opts.width, opts.height);
+
+    // A ramp moving by a few samples a frame, with some noise
+    const GstVideoInfo *info = &source->info;
+    uint32_t seed = 1;
+    for (unsigned f = 0; f < std::min(opts.frames, 8u); f++) {
+        std::vector<uint8_t> frame(GST_VIDEO_INFO_SIZE(info));
+
+        for (guint c = 0; c < GST_VIDEO_INFO_N_COMPONENTS(info); c++) {
+            guint depth = GST_VIDEO_INFO_COMP_DEPTH(info, c);
+            guint pstride = GST_VIDEO_INFO_COMP_PSTRIDE(info, c);
+            uint8_t *plane = frame.data() + GST_VIDEO_INFO_COMP_OFFSET(info, c);
+
+            for (gint y = 0; y < GST_VIDEO_INFO_COMP_HEIGHT(info, c); y++) {
+                uint8_t *row = plane + (gsize) y * GST_VIDEO_INFO_COMP_STRIDE(info, c);
+
+                for (gint x = 0; x < GST_VIDEO_INFO_COMP_WIDTH(info, c); x++) {
+                    seed = seed * 1664525 + 1013904223;
+                    guint value = ((x + 4 * f + y * 2) & 255) + (seed >> 30);
+                    value = std::min(value << (depth - 8), (1u << depth) - 1);
+                    if (pstride == 1)
+                        row[x] = (uint8_t) value;
+                    else
+                        reinterpret_cast<uint16_t *>(row)[x] = (uint16_t) value;
+                }
+            }
+        }
+        source->frames.push_back(frame);
+    }
+}
+
+static bool y4m_frames(const Options &opts, Source *source, unsigned *fps) {
+    FILE *file = fopen(opts.y4m.c_str(), "rb");
+    char header[256];
+    unsigned width = 0, height = 0, fps_n = 0, fps_d = 1;
+    GstVideoFormat format = GST_VIDEO_FORMAT_I420;
+
+    if (!file || !fgets(header, sizeof(header), file) || strncmp(header, "YUV4MPEG2 ", 10)) {
+        fprintf(stderr, "Cannot read y4m file %s\n", opts.y4m.c_str());
+        if (file)
+            fclose(file);
+        return false;
+    }
+    for (char *tok = strtok(header + 10, " \n"); tok; tok = strtok(nullptr, " \n")) {
+        if (tok[0] == 'W') {
+            width = (unsigned) atoi(tok + 1);
+        } else if (tok[0] == 'H') {
+            height = (unsigned) atoi(tok + 1);
+        } else if (tok[0] == 'F') {
+            sscanf(tok + 1, "%u:%u", &fps_n, &fps_d);
+        } else if (tok[0] == 'C') {
+            format = GST_VIDEO_FORMAT_UNKNOWN;
+            for (const auto &f : y4m_formats) {
+                if (strcmp(tok + 1, f.tag) == 0)
+                    format = f.format;
+            }
+        }
+    }
+    if (!width || !height || format == GST_VIDEO_FORMAT_UNKNOWN) {
+        fprintf(stderr, "Unsupported y4m header in %s\n", opts.y4m.c_str());
+        fclose(file);
+        return false;
+    }
+    if (fps_n && fps_d)
+        *fps = (fps_n + fps_d / 2) / fps_d;
+    gst_video_info_set_format(&source->info, format, width, height);
+
+    // y4m planes are tightly packed, GstVideoInfo rows may be padded
+    const GstVideoInfo *info = &source->info;
+    char line[64];
+    while (source->frames.size() < std::min(opts.frames, (unsigned) MAX_SOURCE_FRAMES) &&
+           fgets(line, sizeof(line), file) && strncmp(line, "FRAME", 5) == 0) {
+        std::vector<uint8_t> frame(GST_VIDEO_INFO_SIZE(info));
+        bool complete = true;
+
+        for (guint c = 0; c < GST_VIDEO_INFO_N_COMPONENTS(info) && complete; c++) {
+            gsize row_size = (gsize) GST_VIDEO_INFO_COMP_WIDTH(info, c) *
+                GST_VIDEO_INFO_COMP_PSTRIDE(info, c);
+
+            for (gint y = 0; y < GST_VIDEO_INFO_COMP_HEIGHT(info, c) && complete; y++) {
+                uint8_t *row = frame.data() + GST_VIDEO_INFO_COMP_OFFSET(info, c) +
+                    (gsize) y * GST_VIDEO_INFO_COMP_STRIDE(info, c);
+                complete = fread(row, 1, row_size, file) == row_size;
+            }
+        }
+        if (!complete)
+            break;
+        source->frames.push_back(frame);
+    }
+    fclose(file);
+
+    if (source->frames.empty()) {
+        fprintf(stderr, "No frames in %s\n", opts.y4m.c_str());
+        return false;
+    }
+    return true;
+}
+
+static GstFlowReturn new_sample(GstAppSink *sink, gpointer user_data) {
+    Run *run = static_cast<Run *>(user_data);
+    GstSample *sample = gst_app_sink_pull_sample(sink);
+    Clock::time_point now = Clock::now();
+
+    if (!sample)
+        return GST_FLOW_EOS;
+
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    guint64 index = (GST_BUFFER_PTS(buffer) + run->duration / 2) / run->duration;
+
+    std::lock_guard<std::mutex> guard(run->lock);
+    if (index < run->pushed.size()) {
+        run->latency_ms.push_back(
+            std::chrono::duration<double, std::milli>(now - run->pushed[index]).count());
+    }
+    run->bytes_out += gst_buffer_get_size(buffer);
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+static double percentile(const std::vector<double> &sorted, double q) {
+    if (sorted.empty())
+        return 0;
+    size_t rank = (size_t) (q * sorted.size());
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [--y4m=FILE] [--width=W] [--height=H] [--format=FORMAT]\n"
+                    "       [--frames=N] [--fps=N] [--set=PROPERTY=VALUE]...\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    Options opts;
+    opts.width = 1920;
+    opts.height = 1080;
+    opts.format = "I420";
+    opts.frames = 300;
+    opts.fps = 30;
+
+    gst_init(&argc, &argv);
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *eq = strchr(arg, '=');
+        std::string name = eq ? std::string(arg, eq - arg) : arg;
+        const char *value = eq ? eq + 1 : "";
+
+        if (name == "--y4m")
+            opts.y4m = value;
+        else if (name == "--width")
+            opts.width = (unsigned) atoi(value);
+        else if (name == "--height")
+            opts.height = (unsigned) atoi(value);
+        else if (name == "--format")
+            opts.format = value;
+        else if (name == "--frames")
+            opts.frames = (unsigned) atoi(value);
+        else if (name == "--fps")
+            opts.fps = (unsigned) atoi(value);
+        else if (name == "--set" && strchr(value, '='))
+            opts.properties.push_back(value);
+        else
+            usage(argv[0]);
+    }
+    if (!opts.frames || !opts.fps)
+        usage(argv[0]);
+
+    Source source;
+    if (opts.y4m.empty())
+        synthetic_frames(opts, &source);
+    else if (!y4m_frames(opts, &source, &opts.fps))
+        return 1;
+
+    GError *error = nullptr;
+    GstElement *pipeline = gst_parse_launch(
+        "appsrc name=src ! lcevcenc name=enc ! appsink name=sink sync=false", &error);
+    if (!pipeline) {
+        fprintf(stderr, "Cannot create the pipeline: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+    GstElement *src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement *enc = gst_bin_get_by_name(GST_BIN(pipeline), "enc");
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+
+    for (const std::string &property : opts.properties) {
+        size_t eq = property.find('=');
+        gst_util_set_object_arg(G_OBJECT(enc), property.substr(0, eq).c_str(),
+                                property.c_str() + eq + 1);
+    }
+
+    // A single frame queued in appsrc, so the latency is that of the encoder
+    GstVideoInfo *info = &source.info;
+    GST_VIDEO_INFO_FPS_N(info) = opts.fps;
+    GST_VIDEO_INFO_FPS_D(info) = 1;
+    GstCaps *caps = gst_video_info_to_caps(info);
+    g_object_set(src, "caps", caps, "format", GST_FORMAT_TIME, "block", TRUE,
+                 "max-bytes", (guint64) GST_VIDEO_INFO_SIZE(info), nullptr);
+    gst_caps_unref(caps);
+
+    Run run;
+    run.duration = gst_util_uint64_scale_int(GST_SECOND, 1, opts.fps);
+    run.pushed.resize(opts.frames);
+    run.bytes_out = 0;
+
+    GstAppSinkCallbacks callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.new_sample = new_sample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(sink), &callbacks, &run, nullptr);
+
+    if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        fprintf(stderr, "Cannot start the pipeline, is lcevcenc in GST_PLUGIN_PATH?\n");
+        return 1;
+    }
+
+    // Allocations are counted from the middle of the stream to its end, over
+    // the frames pushed in between, once every pool and queue has settled
+    Clock::time_point start = Clock::now();
+    unsigned steady_from = opts.frames / 2;
+    uint64_t steady_allocations = 0;
+    for (unsigned i = 0; i < opts.frames; i++) {
+        if (i == steady_from)
+            steady_allocations = bench_allocations();
+
+        std::vector<uint8_t> &frame = source.frames[i % source.frames.size()];
+        GstBuffer *buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+            frame.data(), frame.size(), 0, frame.size(), nullptr, nullptr);
+
+        GST_BUFFER_PTS(buffer) = i * run.duration;
+        GST_BUFFER_DURATION(buffer) = run.duration;
+        {
+            std::lock_guard<std::mutex> guard(run.lock);
+            run.pushed[i] = Clock::now();
+        }
+        if (gst_app_src_push_buffer(GST_APP_SRC(src), buffer) != GST_FLOW_OK)
+            break;
+    }
+    gst_app_src_end_of_stream(GST_APP_SRC(src));
+
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+        (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    steady_allocations = bench_allocations() - steady_allocations;
+    int status = 0;
+
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+        gst_message_parse_error(msg, &error, nullptr);
+        fprintf(stderr, "Encoding failed: %s\n", error->message);
+        g_error_free(error);
+        status = 1;
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    guint64 dropped = 0, pool_misses = 0, copy_fallbacks = 0;
+    g_object_get(enc, "frames-dropped", &dropped, "pool-misses", &pool_misses,
+                 "copy-fallbacks", &copy_fallbacks, nullptr);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::vector<double> &latency = run.latency_ms;
+    std::sort(latency.begin(), latency.end());
+    double mean = 0;
+    for (double l : latency)
+        mean += l;
+    mean = latency.empty() ? 0 : mean / latency.size();
+
+    printf("{\n");
+    printf("  \"source\": \"%s\",\n", opts.y4m.empty() ? "synthetic" : "y4m");
+    printf("  \"width\": %d,\n", GST_VIDEO_INFO_WIDTH(info));
+    printf("  \"height\": %d,\n", GST_VIDEO_INFO_HEIGHT(info));
+    printf("  \"format\": \"%s\",\n", gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(info)));
+    printf("  \"frames_in\": %u,\n", opts.frames);
+    printf("  \"frames_out\": %zu,\n", latency.size());
+    printf("  \"elapsed_s\": %.3f,\n", elapsed);
+    printf("  \"fps\": %.2f,\n", latency.size() / elapsed);
+    printf("  \"latency_ms\": { \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+           "\"p99\": %.3f, \"max\": %.3f },\n", mean, percentile(latency, 0.5),
+           percentile(latency, 0.9), percentile(latency, 0.99),
+           latency.empty() ? 0 : latency.back());
+    printf("  \"bytes_out\": %" G_GUINT64_FORMAT ",\n", run.bytes_out);
+    printf("  \"bitrate_kbps\": %.1f,\n",
+           latency.empty() ? 0 : run.bytes_out * 8.0 * opts.fps / latency.size() / 1000);
+    printf("  \"frames_dropped\": %" G_GUINT64_FORMAT ",\n", dropped);
+    printf("  \"pool_misses\": %" G_GUINT64_FORMAT ",\n", pool_misses);
+    printf("  \"copy_fallbacks\": %" G_GUINT64_FORMAT ",\n", copy_fallbacks);
+    printf("  \"allocations_per_frame\": %.2f,\n",
+           (double) steady_allocations / (opts.frames - steady_from));
+    printf("  \"peak_rss_kb\": %ld\n", usage.ru_maxrss);
+    printf("}\n");
+
+    gst_object_unref(src);
+    gst_object_unref(enc);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+    return status;
+}
@@ -0,0 +1,304 @@
+// Kernel benchmarks: every stage of the enhancement encoder, for each
+// instruction set the CPU supports, at a few resolutions and depths, and the
+// whole encode of a frame. Each case is repeated until it has run for
+// --min-time seconds, doubling the iterations, and the time of one iteration
+// is reported as JSON in the layout of Google Benchmark, along with the heap
+// allocations it made.
+//
+//   bench_kernels [--min-time=SECONDS] [--filter=SUBSTRING] [--isa=NAME]
+
+#include "bench_alloc.h"
+#include "lcevcdsp.h"
+#include "lcevcenhancement.h"
+#include "lcevcentropy.h"
+#include "lcevcsurface.h"
+#include "lcevcworkers.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char *isa_names[] = { "c", "sse4.1", "avx2", "avx512", "neon" };
+
+static const struct {
+    unsigned width;
+    unsigned height;
+} resolutions[] = {
+    { 1280, 720 },
+    { 1920, 1080 },
+    { 3840, 2160 },
+};
+
+static const unsigned depths[] = { 8, 10 };
+
+struct Options {
+    double min_time;
+    std::string filter;
+    std::string isa;
+};
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double ns_per_iteration;
+    double pixels_per_second;
+    double allocations_per_iteration;
+};
+
+// Run body until min_time has passed, doubling the iterations every round
+static Result run_case(const Options &opts, const std::string &name, double pixels,
+                       const std::function<void()> &body) {
+    typedef std::chrono::steady_clock clock;
+    uint64_t iterations = 1;
+    uint64_t allocated = 0;
+    double elapsed = 0;
+
+    body();     // warm up the caches and the page tables
+    for (;;) {
+        uint64_t allocated_before = bench_allocations();
+        clock::time_point start = clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            body();
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        allocated = bench_allocations() - allocated_before;
+        if (elapsed >= opts.min_time || iterations >= (1ull << 30))
+            break;
+        iterations *= 2;
+    }
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.ns_per_iteration = elapsed * 1e9 / iterations;
+    result.pixels_per_second = pixels * iterations / elapsed;
+    result.allocations_per_iteration = (double) allocated / iterations;
+    return result;
+}
+
+// Source plane of a diagonal ramp with a little noise, so residuals and
+// coefficients are about as sparse as on real content
+struct SourcePlane {
+    std::vector<uint8_t> data;
+    LcevcSourcePlane view;
+
+    SourcePlane(unsigned width, unsigned height, unsigned depth) {
+        unsigned bytes_per_sample = depth > 8 ? 2 : 1;
+        uint32_t seed = 1;
+
+        data.resize((size_t) width * height * bytes_per_sample);
+        for (unsigned y = 0; y < height; y++) {
+            for (unsigned x = 0; x < width; x++) {
+                seed = seed * 1664525 + 1013904223;
+                unsigned value = ((x * 3 + y * 2) & 255) + (seed >> 30);
+                value = std::min(value << (depth - 8), (1u << depth) - 1);
+
+                size_t i = (size_t) y * width + x;
+                if (bytes_per_sample == 1)
+                    data[i] = (uint8_t) value;
+                else
+                    reinterpret_cast<uint16_t *>(data.data())[i] = (uint16_t) value;
+            }
+        }
+        view.data = data.data();
+        view.stride = (ptrdiff_t) width * bytes_per_sample;
+        view.width = width;
+        view.height = height;
+        view.bytes_per_sample = bytes_per_sample;
+        view.shift = LCEVC_INTERNAL_DEPTH - depth;
+        view.step = 1;
+        view.drop = 0;
+    }
+};
+
+static void bench_isa(const Options &opts, const char *isa, std::vector<Result> &results) {
+    LcevcDsp dsp;
+    LcevcQuantizer quant;
+    const LcevcUpsampleKernel &kernel = *lcevc_upsample_kernel(LCEVC_UPSAMPLE_MODIFIED_CUBIC);
+
+    if (!lcevc_dsp_init(&dsp, isa))
+        return;
+    lcevc_quantizer_init(&quant, 1500);     // the default LOQ-0 step width
+
+    for (const auto &res : resolutions) {
+        for (unsigned depth : depths) {
+            char suffix[64];
+            snprintf(suffix, sizeof(suffix), "/%ux%u/%ubit/%s", res.width, res.height, depth, isa);
+
+            SourcePlane source(res.width, res.height, depth);
+            LcevcSurfaceBuffer intermediate, residual;
+            const double pixels = (double) res.width * res.height;
+            auto add = [&](const char *kernel_name, const std::function<void()> &body) {
+                std::string name = std::string(kernel_name) + suffix;
+                if (name.find(opts.filter) == std::string::npos)
+                    return;
+                results.push_back(run_case(opts, name, pixels, body));
+                fprintf(stderr, "%-48s %12.0f ns\n", name.c_str(),
+                        results.back().ns_per_iteration);
+            };
+
+            intermediate.allocate(res.width / 2, res.height / 2);
+            residual.allocate(res.width, res.height);
+            lcevc_dsp_downsample(&dsp, LCEVC_SCALING_2D, source.view, intermediate.view(),
+                                 0, res.height / 2);
+
+            add("downsample_2d", [&]() {
+                lcevc_dsp_downsample(&dsp, LCEVC_SCALING_2D, source.view, intermediate.view(),
+                                     0, res.height / 2);
+            });
+            add("upsample_residual_2d", [&]() {
+                lcevc_dsp_upsample_residual(&dsp, LCEVC_SCALING_2D, intermediate.view(),
+                                            source.view, residual.view(), 0, res.width,
+                                            0, res.height, kernel);
+            });
+
+            for (unsigned t = 0; t < 2; t++) {
+                LcevcTransformType type = (LcevcTransformType) t;
+                unsigned block_size = lcevc_transform_block_size(type);
+                unsigned num_layers = lcevc_transform_num_layers(type);
+                std::vector<LcevcSurfaceBuffer> layer_buffers(num_layers);
+                std::vector<LcevcSurface> layers;
+                std::vector<LcevcEncodedLayer> encoded(num_layers);
+                const char *tname = type == LCEVC_TRANSFORM_DDS ? "dds" : "dd";
+                unsigned block_rows = res.height / block_size;
+
+                for (LcevcSurfaceBuffer &buffer : layer_buffers)
+                    layers.push_back(buffer.allocate(res.width / block_size, block_rows));
+
+                add((std::string("transform_quantize_") + tname).c_str(), [&]() {
+                    dsp.transform_quantize[type](residual.view(), layers.data(), 0, block_rows,
+                                                 quant);
+                });
+                add((std::string("dequantize_inverse_") + tname).c_str(), [&]() {
+                    dsp.dequantize_inverse[type](layers.data(), residual.view(), 0, block_rows,
+                                                 quant);
+                });
+
+                // The inverse left the residual as decoded; code the layers
+                // of the residual itself
+                lcevc_dsp_upsample_residual(&dsp, LCEVC_SCALING_2D, intermediate.view(),
+                                            source.view, residual.view(), 0, res.width,
+                                            0, res.height, kernel);
+                dsp.transform_quantize[type](residual.view(), layers.data(), 0, block_rows,
+                                             quant);
+                add((std::string("entropy_") + tname).c_str(), [&]() {
+                    for (unsigned l = 0; l < num_layers; l++)
+                        lcevc_entropy_encode_layer(&dsp, layers[l], block_size, &encoded[l]);
+                });
+            }
+        }
+    }
+}
+
+// Steady-state encode of a whole 4:2:0 frame on one thread, with the default
+// instruction set. Past the first frames it should not allocate at all.
+static void bench_encode(const Options &opts, std::vector<Result> &results) {
+    LcevcWorkerPool pool(1);
+
+    for (const auto &res : resolutions) {
+        for (unsigned depth : depths) {
+            char name[96];
+            snprintf(name, sizeof(name), "encode_frame/%ux%u/%ubit/%s", res.width, res.height,
+                     depth, lcevc_dsp_isa());
+            if (std::string(name).find(opts.filter) == std::string::npos)
+                continue;
+
+            SourcePlane luma(res.width, res.height, depth);
+            SourcePlane chroma(res.width / 2, res.height / 2, depth);
+            LcevcPicture picture = LcevcPicture();
+            LcevcEnhancementConfig config = LcevcEnhancementConfig();
+
+            picture.planes[0] = luma.view;
+            picture.planes[1] = chroma.view;
+            picture.planes[2] = chroma.view;
+            config.width = res.width;
+            config.height = res.height;
+            config.num_planes = 3;
+            config.chroma_shift_x = 1;
+            config.chroma_shift_y = 1;
+            config.bit_depth = depth;
+            config.base_depth = depth;
+            config.enhancement_depth = depth;
+            config.transform = LCEVC_TRANSFORM_DDS;
+            config.scaling = LCEVC_SCALING_2D;
+            config.upsample = LCEVC_UPSAMPLE_MODIFIED_CUBIC;
+            config.step_width_loq0 = 1500;
+            config.step_width_loq1 = 32767;
+            config.enhancement_enabled = true;
+
+            LcevcEnhancementEncoder encoder(config, &pool);
+            encoder.encode(picture, true);
+            results.push_back(run_case(opts, name, (double) res.width * res.height, [&]() {
+                encoder.encode(picture, false);
+            }));
+            fprintf(stderr, "%-48s %12.0f ns %8.2f allocations\n", name,
+                    results.back().ns_per_iteration, results.back().allocations_per_iteration);
+        }
+    }
+}
+
+static std::string json_string(const std::string &value) {
+    std::string out = "\"";
+
+    for (char c : value) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+int main(int argc, char **argv) {
+    Options opts = { 0.5, "", "" };
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--min-time=", 11) == 0) {
+            opts.min_time = atof(argv[i] + 11);
+        } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+            opts.filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--isa=", 6) == 0) {
+            opts.isa = argv[i] + 6;
+        } else {
+            fprintf(stderr, "usage: %s [--min-time=SECONDS] [--filter=SUBSTRING] [--isa=NAME]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<Result> results;
+    for (const char *isa : isa_names) {
+        if (opts.isa.empty() || opts.isa == isa)
+            bench_isa(opts, isa, results);
+    }
+    if (opts.isa.empty() || opts.isa == lcevc_dsp_isa())
+        bench_encode(opts, results);
+
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    printf("{\n  \"context\": {\n");
+    printf("    \"date\": %s,\n", json_string(date).c_str());
+    printf("    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+    printf("    \"default_isa\": %s\n", json_string(lcevc_dsp_isa()).c_str());
+    printf("  },\n  \"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        printf("%s\n    {\n", i ? "," : "");
+        printf("      \"name\": %s,\n", json_string(r.name).c_str());
+        printf("      \"iterations\": %llu,\n", (unsigned long long) r.iterations);
+        printf("      \"real_time\": %.1f,\n", r.ns_per_iteration);
+        printf("      \"time_unit\": \"ns\",\n");
+        printf("      \"items_per_second\": %.0f,\n", r.pixels_per_second);
+        printf("      \"allocations_per_iteration\": %.2f\n", r.allocations_per_iteration);
+        printf("    }");
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,459 @@
+#include "gstlcevcbase.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_lcevc_base_debug);
+#define GST_CAT_DEFAULT gst_lcevc_base_debug
+
+// What the mux can append LCEVC NAL units to: Annex B access units
+#define BASE_OUTPUT_CAPS \
+    "video/x-h264, stream-format = (string) byte-stream, alignment = (string) au; " \
+    "video/x-h265, stream-format = (string) byte-stream, alignment = (string) au"
+
+static const struct {
+    const gchar *codec;
+    const gchar *factory;
+} base_factories[] = {
+    { "avc", "x264enc" },
+    { "hevc", "x265enc" },
+};
+
+// A picture to encode, or a drain request when picture is nullptr. Items are
+// queued by their own link and recycled through free_items, so a steady
+// stream allocates none.
+typedef struct {
+    GList link;             // data points back to the item
+    GstBuffer *picture;
+    gboolean keyframe;
+    guint qp;
+} GstLcevcBaseItem;
+
+struct _GstLcevcBase {
+    GstElement *parent;
+    GstElement *element;
+    GstPad *srcpad;         // linked to the sink pad of element
+    GstPad *sinkpad;        // linked to its source pad
+    GstBus *bus;
+    GstLcevcBaseOutputFunc output;
+    GstLcevcBaseCapsFunc caps_func;
+    GstLcevcBaseLatencyFunc latency_func;
+    gpointer user_data;
+
+    guint qp;               // set on element, used on the base thread
+
+    GThread *thread;
+    GMutex lock;
+    GCond cond;
+    GQueue queue;
+    GQueue free_items;
+    GstCaps *caps;          // of the pictures
+    gboolean need_start;    // stream-start, caps and segment before the next picture
+    gboolean busy;
+    gboolean stop;
+    GstFlowReturn flow;
+};
+
+const gchar *gst_lcevc_base_factory_for_codec(const gchar *codec) {
+    for (guint i = 0; i < G_N_ELEMENTS(base_factories); i++) {
+        if (g_strcmp0(codec, base_factories[i].codec) == 0)
+            return base_factories[i].factory;
+    }
+    return nullptr;
+}
+
+// Constant quantizer, which suits the base of an LCEVC stream. x264enc takes
+// it in "quantizer" once "pass" selects it, x265enc in "qp". Only the
+// quantizer itself can change once the element is running.
+static void gst_lcevc_base_set_qp(GstElement *element, guint qp) {
+    GObjectClass *klass = G_OBJECT_GET_CLASS(element);
+    gchar *value = g_strdup_printf("%u", qp);
+
+    if (g_object_class_find_property(klass, "pass") &&
+        g_object_class_find_property(klass, "quantizer")) {
+        if (GST_STATE(element) < GST_STATE_PAUSED)
+            gst_util_set_object_arg(G_OBJECT(element), "pass", "quant");
+        gst_util_set_object_arg(G_OBJECT(element), "quantizer", value);
+    } else if (g_object_class_find_property(klass, "qp")) {
+        gst_util_set_object_arg(G_OBJECT(element), "qp", value);
+    } else {
+        GST_WARNING_OBJECT(element, "No known quantizer property, base-qp ignored");
+    }
+    g_free(value);
+}
+
+static GstFlowReturn gst_lcevc_base_chain(GstPad *pad, GstObject *, GstBuffer *au) {
+    GstLcevcBase *base = static_cast<GstLcevcBase *>(gst_pad_get_element_private(pad));
+
+    return base->output(au, base->user_data);
+}
+
+// Everything the base encoder sends downstream stops here; only its caps
+// are passed on
+static gboolean gst_lcevc_base_sink_event(GstPad *pad, GstObject *, GstEvent *event) {
+    GstLcevcBase *base = static_cast<GstLcevcBase *>(gst_pad_get_element_private(pad));
+
+    if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+        GstCaps *caps;
+
+        gst_event_parse_caps(event, &caps);
+        GST_DEBUG_OBJECT(base->element, "Base output caps %" GST_PTR_FORMAT, caps);
+        base->caps_func(caps, base->user_data);
+    }
+
+    gst_event_unref(event);
+    return TRUE;
+}
+
+static gboolean gst_lcevc_base_sink_query(GstPad *, GstObject *, GstQuery *query) {
+    switch (GST_QUERY_TYPE(query)) {
+        case GST_QUERY_CAPS: {
+            GstCaps *filter;
+            GstCaps *caps = gst_caps_from_string(BASE_OUTPUT_CAPS);
+
+            gst_query_parse_caps(query, &filter);
+            if (filter) {
+                GstCaps *intersection = gst_caps_intersect_full(filter, caps,
+                    GST_CAPS_INTERSECT_FIRST);
+                gst_caps_unref(caps);
+                caps = intersection;
+            }
+            gst_query_set_caps_result(query, caps);
+            gst_caps_unref(caps);
+            return TRUE;
+        }
+        case GST_QUERY_ACCEPT_CAPS: {
+            GstCaps *caps;
+            GstCaps *allowed = gst_caps_from_string(BASE_OUTPUT_CAPS);
+
+            gst_query_parse_accept_caps(query, &caps);
+            gst_query_set_accept_caps_result(query, gst_caps_is_subset(caps, allowed));
+            gst_caps_unref(allowed);
+            return TRUE;
+        }
+        default:
+            return FALSE;
+    }
+}
+
+// The base encoder asking what it will be fed, and how late, which it adds
+// its own latency to
+static gboolean gst_lcevc_base_src_query(GstPad *pad, GstObject *, GstQuery *query) {
+    GstLcevcBase *base = static_cast<GstLcevcBase *>(gst_pad_get_element_private(pad));
+
+    switch (GST_QUERY_TYPE(query)) {
+        case GST_QUERY_CAPS: {
+            g_mutex_lock(&base->lock);
+            GstCaps *caps = base->caps ? gst_caps_ref(base->caps) : gst_caps_new_any();
+            g_mutex_unlock(&base->lock);
+
+            gst_query_set_caps_result(query, caps);
+            gst_caps_unref(caps);
+            return TRUE;
+        }
+        case GST_QUERY_LATENCY:
+            gst_query_set_latency(query, FALSE, 0, 0);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+// Latency of the base encoder once it has taken the caps
+static void gst_lcevc_base_report_latency(GstLcevcBase *base) {
+    GstQuery *query = gst_query_new_latency();
+    GstClockTime latency = GST_CLOCK_TIME_NONE;
+
+    if (gst_pad_peer_query(base->sinkpad, query))
+        gst_query_parse_latency(query, nullptr, &latency, nullptr);
+    gst_query_unref(query);
+
+    GST_DEBUG_OBJECT(base->element, "Base encoder latency %" GST_TIME_FORMAT,
+        GST_TIME_ARGS(latency));
+    base->latency_func(latency, base->user_data);
+}
+
+// Errors and warnings of the base encoder show up as if the parent posted
+// them; it has no bus of its own otherwise
+static GstBusSyncReply gst_lcevc_base_bus_sync(GstBus *, GstMessage *message, gpointer data) {
+    GstLcevcBase *base = static_cast<GstLcevcBase *>(data);
+
+    switch (GST_MESSAGE_TYPE(message)) {
+        case GST_MESSAGE_ERROR:
+        case GST_MESSAGE_WARNING:
+        case GST_MESSAGE_INFO:
+            gst_element_post_message(base->parent, gst_message_ref(message));
+            break;
+        default:
+            break;
+    }
+    return GST_BUS_DROP;
+}
+
+static GstFlowReturn gst_lcevc_base_encode(GstLcevcBase *base, GstBuffer *picture,
+    gboolean keyframe, guint qp) {
+    if (qp != base->qp) {
+        GST_DEBUG_OBJECT(base->element, "QP %u from %" GST_TIME_FORMAT, qp,
+            GST_TIME_ARGS(GST_BUFFER_PTS(picture)));
+        gst_lcevc_base_set_qp(base->element, qp);
+        base->qp = qp;
+    }
+
+    if (base->need_start) {
+        GstSegment segment;
+
+        g_mutex_lock(&base->lock);
+        GstCaps *caps = gst_caps_ref(base->caps);
+        g_mutex_unlock(&base->lock);
+
+        gst_segment_init(&segment, GST_FORMAT_TIME);
+        gst_pad_push_event(base->srcpad, gst_event_new_stream_start("lcevcenc-base"));
+        gst_pad_push_event(base->srcpad, gst_event_new_caps(caps));
+        gst_pad_push_event(base->srcpad, gst_event_new_segment(&segment));
+        gst_caps_unref(caps);
+        base->need_start = FALSE;
+        gst_lcevc_base_report_latency(base);
+    }
+
+    if (keyframe)
+        gst_pad_push_event(base->srcpad, gst_video_event_new_downstream_force_key_unit(
+            GST_BUFFER_PTS(picture), GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, TRUE, 0));
+
+    return gst_pad_push(base->srcpad, picture);
+}
+
+// Take the base encoder down to READY and back, dropping whatever it holds,
+// so it takes a new stream
+static GstFlowReturn gst_lcevc_base_restart(GstLcevcBase *base) {
+    base->need_start = TRUE;
+    if (gst_element_set_state(base->element, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE ||
+        gst_element_set_state(base->element, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        GST_ERROR_OBJECT(base->element, "Failed to restart base encoder");
+        return GST_FLOW_ERROR;
+    }
+    return GST_FLOW_OK;
+}
+
+// The base encoder outputs everything it holds on EOS, before forwarding it.
+// Nothing to do when it has not been given a picture since it was started.
+static GstFlowReturn gst_lcevc_base_finish(GstLcevcBase *base) {
+    if (base->need_start)
+        return GST_FLOW_OK;
+    gst_pad_push_event(base->srcpad, gst_event_new_eos());
+    return gst_lcevc_base_restart(base);
+}
+
+static gpointer gst_lcevc_base_thread(gpointer data) {
+    GstLcevcBase *base = static_cast<GstLcevcBase *>(data);
+
+    g_mutex_lock(&base->lock);
+    while (TRUE) {
+        while (g_queue_is_empty(&base->queue) && !base->stop)
+            g_cond_wait(&base->cond, &base->lock);
+        if (base->stop)
+            break;
+
+        GstLcevcBaseItem *item =
+            static_cast<GstLcevcBaseItem *>(g_queue_pop_head_link(&base->queue)->data);
+        base->busy = TRUE;
+        g_mutex_unlock(&base->lock);
+
+        GstFlowReturn ret = item->picture ?
+            gst_lcevc_base_encode(base, item->picture, item->keyframe, item->qp) :
+            gst_lcevc_base_finish(base);
+
+        g_mutex_lock(&base->lock);
+        g_queue_push_tail_link(&base->free_items, &item->link);
+        if (ret != GST_FLOW_OK && base->flow == GST_FLOW_OK) {
+            GST_DEBUG_OBJECT(base->element, "Base encoder returned %s", gst_flow_get_name(ret));
+            base->flow = ret;
+        }
+        base->busy = FALSE;
+        g_cond_broadcast(&base->cond);
+    }
+    g_mutex_unlock(&base->lock);
+
+    return nullptr;
+}
+
+GstLcevcBase *gst_lcevc_base_new(GstElement *parent, const gchar *factory, guint qp,
+    GstLcevcBaseOutputFunc output, GstLcevcBaseCapsFunc caps, GstLcevcBaseLatencyFunc latency,
+    gpointer user_data) {
+    static gsize debug_init = 0;
+
+    if (g_once_init_enter(&debug_init)) {
+        GST_DEBUG_CATEGORY_INIT(gst_lcevc_base_debug, "lcevcbase", 0, "LCEVC base encoder");
+        g_once_init_leave(&debug_init, 1);
+    }
+
+    GstElement *element = gst_element_factory_make(factory, nullptr);
+    if (!element) {
+        GST_WARNING_OBJECT(parent, "No %s element", factory);
+        return nullptr;
+    }
+
+    GstLcevcBase *base = g_new0(GstLcevcBase, 1);
+    base->parent = parent;
+    base->element = GST_ELEMENT(gst_object_ref_sink(element));
+    base->output = output;
+    base->caps_func = caps;
+    base->latency_func = latency;
+    base->user_data = user_data;
+    base->need_start = TRUE;
+    base->flow = GST_FLOW_OK;
+    g_mutex_init(&base->lock);
+    g_cond_init(&base->cond);
+    g_queue_init(&base->queue);
+    g_queue_init(&base->free_items);
+
+    gst_lcevc_base_set_qp(element, qp);
+    base->qp = qp;
+
+    base->srcpad = gst_pad_new("base_src", GST_PAD_SRC);
+    gst_pad_set_element_private(base->srcpad, base);
+    gst_pad_set_query_function(base->srcpad, gst_lcevc_base_src_query);
+
+    base->sinkpad = gst_pad_new("base_sink", GST_PAD_SINK);
+    gst_pad_set_element_private(base->sinkpad, base);
+    gst_pad_set_chain_function(base->sinkpad, gst_lcevc_base_chain);
+    gst_pad_set_event_function(base->sinkpad, gst_lcevc_base_sink_event);
+    gst_pad_set_query_function(base->sinkpad, gst_lcevc_base_sink_query);
+
+    base->bus = gst_bus_new();
+    gst_bus_set_sync_handler(base->bus, gst_lcevc_base_bus_sync, base, nullptr);
+    gst_element_set_bus(element, base->bus);
+
+    GstPad *element_sink = gst_element_get_static_pad(element, "sink");
+    GstPad *element_src = gst_element_get_static_pad(element, "src");
+    gboolean linked = element_sink && element_src &&
+        gst_pad_link(base->srcpad, element_sink) == GST_PAD_LINK_OK &&
+        gst_pad_link(element_src, base->sinkpad) == GST_PAD_LINK_OK;
+    if (element_sink)
+        gst_object_unref(element_sink);
+    if (element_src)
+        gst_object_unref(element_src);
+    if (!linked) {
+        GST_WARNING_OBJECT(parent, "Failed to link %s", factory);
+        gst_lcevc_base_free(base);
+        return nullptr;
+    }
+
+    gst_pad_set_active(base->srcpad, TRUE);
+    gst_pad_set_active(base->sinkpad, TRUE);
+    if (gst_element_set_state(element, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        GST_WARNING_OBJECT(parent, "Failed to start %s", factory);
+        gst_lcevc_base_free(base);
+        return nullptr;
+    }
+
+    base->thread = g_thread_new("lcevcenc-base", gst_lcevc_base_thread, base);
+    return base;
+}
+
+// Under lock, or once the thread is gone
+static void gst_lcevc_base_clear_queue(GstLcevcBase *base) {
+    GList *link;
+
+    while ((link = g_queue_pop_head_link(&base->queue))) {
+        GstLcevcBaseItem *item = static_cast<GstLcevcBaseItem *>(link->data);
+
+        if (item->picture)
+            gst_buffer_unref(item->picture);
+        g_queue_push_tail_link(&base->free_items, link);
+    }
+}
+
+void gst_lcevc_base_free(GstLcevcBase *base) {
+    if (base->thread) {
+        g_mutex_lock(&base->lock);
+        base->stop = TRUE;
+        g_cond_broadcast(&base->cond);
+        g_mutex_unlock(&base->lock);
+        g_thread_join(base->thread);
+    }
+    gst_lcevc_base_clear_queue(base);
+    while (!g_queue_is_empty(&base->free_items))
+        g_free(g_queue_pop_head_link(&base->free_items)->data);
+
+    gst_element_set_state(base->element, GST_STATE_NULL);
+    gst_pad_set_active(base->srcpad, FALSE);
+    gst_pad_set_active(base->sinkpad, FALSE);
+    gst_element_set_bus(base->element, nullptr);
+
+    gst_object_unref(base->element);
+    gst_object_unref(base->srcpad);
+    gst_object_unref(base->sinkpad);
+    gst_object_unref(base->bus);
+    if (base->caps)
+        gst_caps_unref(base->caps);
+
+    g_mutex_clear(&base->lock);
+    g_cond_clear(&base->cond);
+    g_free(base);
+}
+
+gboolean gst_lcevc_base_set_format(GstLcevcBase *base, GstCaps *caps) {
+    GstPad *peer = gst_pad_get_peer(base->srcpad);
+    gboolean accepted = peer && gst_pad_query_accept_caps(peer, caps);
+
+    if (peer)
+        gst_object_unref(peer);
+    if (!accepted) {
+        GST_DEBUG_OBJECT(base->element, "Base encoder refuses %" GST_PTR_FORMAT, caps);
+        return FALSE;
+    }
+
+    g_mutex_lock(&base->lock);
+    gst_caps_replace(&base->caps, caps);
+    base->need_start = TRUE;
+    g_mutex_unlock(&base->lock);
+    return TRUE;
+}
+
+GstFlowReturn gst_lcevc_base_push(GstLcevcBase *base, GstBuffer *picture, gboolean keyframe,
+    guint qp) {
+    GstLcevcBaseItem *item;
+    GstFlowReturn ret;
+
+    g_mutex_lock(&base->lock);
+    if (g_queue_is_empty(&base->free_items)) {
+        item = g_new0(GstLcevcBaseItem, 1);
+        item->link.data = item;
+    } else {
+        item = static_cast<GstLcevcBaseItem *>(g_queue_pop_head_link(&base->free_items)->data);
+    }
+    item->picture = picture;
+    item->keyframe = keyframe;
+    item->qp = qp;
+    g_queue_push_tail_link(&base->queue, &item->link);
+    g_cond_broadcast(&base->cond);
+    ret = base->flow;
+    g_mutex_unlock(&base->lock);
+
+    return ret;
+}
+
+GstFlowReturn gst_lcevc_base_drain(GstLcevcBase *base) {
+    GstFlowReturn ret;
+
+    // A drain request travels the queue like a picture
+    gst_lcevc_base_push(base, nullptr, FALSE, 0);
+
+    g_mutex_lock(&base->lock);
+    while (!g_queue_is_empty(&base->queue) || base->busy)
+        g_cond_wait(&base->cond, &base->lock);
+    ret = base->flow;
+    base->flow = GST_FLOW_OK;
+    g_mutex_unlock(&base->lock);
+
+    return ret;
+}
+
+void gst_lcevc_base_flush(GstLcevcBase *base) {
+    g_mutex_lock(&base->lock);
+    gst_lcevc_base_clear_queue(base);
+    while (base->busy)
+        g_cond_wait(&base->cond, &base->lock);
+    base->flow = GST_FLOW_OK;
+    g_mutex_unlock(&base->lock);
+
+    // The base thread is idle until the next picture
+    gst_lcevc_base_restart(base);
+}
@@ -0,0 +1,59 @@
+#ifndef __GST_LCEVC_BASE_H__
+#define __GST_LCEVC_BASE_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+// Base codec child element, driven through pads of our own from a thread of
+// its own. Pictures at the base resolution are queued with
+// gst_lcevc_base_push() and encoded while the caller goes on with the
+// enhancement of the next frames; the access units come back through the
+// output callback in decode order, on the base thread.
+typedef struct _GstLcevcBase GstLcevcBase;
+
+// Takes ownership of au
+typedef GstFlowReturn (*GstLcevcBaseOutputFunc)(GstBuffer *au, gpointer user_data);
+
+// The base encoder settled on these output caps
+typedef void (*GstLcevcBaseCapsFunc)(GstCaps *caps, gpointer user_data);
+
+// Latency the base encoder reports for the caps of the pictures, how long
+// it holds a picture before its access unit comes out, or
+// GST_CLOCK_TIME_NONE when it does not answer. Called on the base thread
+// every time the caps change, before it is given a picture with them.
+typedef void (*GstLcevcBaseLatencyFunc)(GstClockTime latency, gpointer user_data);
+
+// Element factory for a base-encoder codec name (avc, hevc, ...), or
+// nullptr when there is none
+const gchar *gst_lcevc_base_factory_for_codec(const gchar *codec);
+
+// Create and start the factory element. Messages it posts are forwarded to
+// parent. Returns nullptr when the element cannot be created.
+GstLcevcBase *gst_lcevc_base_new(GstElement *parent, const gchar *factory, guint qp,
+    GstLcevcBaseOutputFunc output, GstLcevcBaseCapsFunc caps, GstLcevcBaseLatencyFunc latency,
+    gpointer user_data);
+
+void gst_lcevc_base_free(GstLcevcBase *base);
+
+// Input caps of the pictures pushed from now on. Returns FALSE when the base
+// encoder does not accept them. Only call it drained.
+gboolean gst_lcevc_base_set_format(GstLcevcBase *base, GstCaps *caps);
+
+// Queue a picture, taking ownership of it. keyframe asks the base encoder to
+// start a new GOP with it, and it is encoded at qp, which may differ from one
+// picture to the next. Returns the last error of the base encoder, if any.
+GstFlowReturn gst_lcevc_base_push(GstLcevcBase *base, GstBuffer *picture, gboolean keyframe,
+    guint qp);
+
+// Encode everything queued and wait until the base encoder has output all
+// of it
+GstFlowReturn gst_lcevc_base_drain(GstLcevcBase *base);
+
+// Drop everything queued or held by the base encoder
+void gst_lcevc_base_flush(GstLcevcBase *base);
+
+G_END_DECLS
+
+#endif /* __GST_LCEVC_BASE_H__ */
@@ -4,6 +4,7 @@
 
 // Add the correct GStreamer video encoder header
 #include <gst/video/gstvideoencoder.h>
+#include <gst/video/gstvideopool.h>
 
 GST_DEBUG_CATEGORY_STATIC(gst_lcevc_enc_debug);
 #define GST_CAT_DEFAULT gst_lcevc_enc_debug
@@ -16,13 +17,45 @@ enum {
     PROP_STEP_WIDTH_LOQ1,
     PROP_STEP_WIDTH_LOQ2,
     PROP_BASE_ENCODER,
+    PROP_BASE_ENCODER_FACTORY,
+    PROP_ENCODE_BASE,
     PROP_TRANSFORM_TYPE,
+    PROP_SCALING_MODE,
     PROP_PRIORITY_MODE,
     PROP_TEMPORAL_ENABLED,
     PROP_ENHANCEMENT_ENABLED,
     PROP_BASE_DEPTH,
     PROP_ENHANCEMENT_DEPTH,
-    PROP_FPS
+    PROP_FPS,
+    PROP_THREADS,
+    PROP_MAX_FRAMES_IN_FLIGHT,
+    PROP_BASE_PTS_TOLERANCE,
+    PROP_LOOKAHEAD,
+    PROP_LOW_LATENCY,
+    PROP_RATE_CONTROL,
+    PROP_BITRATE,
+    PROP_VBV_BUFFER_SIZE,
+    PROP_VBV_MAX_BITRATE,
+    PROP_PASS,
+    PROP_STATS_FILE,
+    PROP_STATIC_THRESHOLD,
+    PROP_REPORT_INTERVAL,
+    PROP_METRICS_FILE,
+    PROP_METRICS_INTERVAL,
+    PROP_CPU_SET,
+    PROP_NUMA_NODE,
+    PROP_INHERIT_PLACEMENT,
+    PROP_FRAMES_ENCODED,
+    PROP_FRAMES_DROPPED,
+    PROP_POOL_MISSES,
+    PROP_COPY_FALLBACKS,
+    PROP_LATENCY_MEAN,
+    PROP_LATENCY_P50,
+    PROP_LATENCY_P99,
+    PROP_LATENCY_MAX,
+    PROP_BYTES_LOQ0,
+    PROP_BYTES_LOQ1,
+    PROP_BYTES_BASE
 };
 
 // Default values
@@ -31,25 +64,67 @@ enum {
 #define DEFAULT_STEP_WIDTH_LOQ1 32767
 #define DEFAULT_STEP_WIDTH_LOQ2 1500
 #define DEFAULT_BASE_ENCODER "hevc"
+#define DEFAULT_ENCODE_BASE FALSE
 #define DEFAULT_TRANSFORM_TYPE "dds"
+#define DEFAULT_SCALING_MODE "2d"
 #define DEFAULT_PRIORITY_MODE "mode_2_0"
 #define DEFAULT_TEMPORAL_ENABLED TRUE
 #define DEFAULT_ENHANCEMENT_ENABLED TRUE
 #define DEFAULT_BASE_DEPTH 10
-#define DEFAULT_ENHANCEMENT_DEPTH 10
+#define DEFAULT_ENHANCEMENT_DEPTH 0
 #define DEFAULT_FPS 30
+#define DEFAULT_THREADS 0
+#define DEFAULT_MAX_FRAMES_IN_FLIGHT 0
+#define DEFAULT_BASE_PTS_TOLERANCE 0
+#define DEFAULT_LOOKAHEAD 0
+#define DEFAULT_LOW_LATENCY FALSE
+#define DEFAULT_RATE_CONTROL "cqp"
+#define DEFAULT_BITRATE 2000
+#define DEFAULT_VBV_BUFFER_SIZE 0
+#define DEFAULT_VBV_MAX_BITRATE 0
+#define DEFAULT_PASS 0
+#define DEFAULT_STATS_FILE "lcevcenc.stats"
+#define DEFAULT_STATIC_THRESHOLD 0
+#define DEFAULT_REPORT_INTERVAL 0
+#define DEFAULT_METRICS_FILE nullptr
+#define DEFAULT_METRICS_INTERVAL 10
+#define DEFAULT_CPU_SET nullptr
+#define DEFAULT_NUMA_NODE -1
+#define DEFAULT_INHERIT_PLACEMENT FALSE
+
+// Frames queued ahead of the encode worker when frames are encoded one at
+// a time
+#define DEFAULT_QUEUE_DEPTH 4
+
+// Decoded base pictures queued on sink_secondary before it blocks
+#define DEFAULT_BASE_QUEUE_DEPTH 8
+
+// Base PTS tolerance when the frame rate is unknown
+#define DEFAULT_BASE_PTS_JITTER (20 * GST_MSECOND)
+
+#define SINK_CAPS \
+    "video/x-raw, " \
+    "format = (string) { I420, YV12, NV12, NV21, I422, I444, Y42B, Y444, " \
+        "I420_10LE, I422_10LE, Y444_10LE, I420_12LE, I422_12LE, Y444_12LE, " \
+        "P010_10LE, P016_LE }, " \
+    "width = (int) [ 16, 7680 ], " \
+    "height = (int) [ 16, 4320 ], " \
+    "framerate = (fraction) [ 0/1, 2147483647/1 ]"
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
     "sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS(
-        "video/x-raw, "
-        "format = (string) { I420, I422, I444, Y42B, Y444 }, "
-        "width = (int) [ 16, 7680 ], "
-        "height = (int) [ 16, 4320 ], "
-        "framerate = (fraction) [ 0/1, 2147483647/1 ]"
-    )
+    GST_STATIC_CAPS(SINK_CAPS)
+);
+
+// Output of the base encoder's decoder, at the LOQ-1 resolution: half the
+// source width, and half its height with 2D scaling
+static GstStaticPadTemplate sink_secondary_template = GST_STATIC_PAD_TEMPLATE(
+    "sink_secondary",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS(SINK_CAPS)
 );
 
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
@@ -59,8 +134,28 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
     GST_STATIC_CAPS("video/x-lcevc")
 );
 
+// Renditions of an ABR ladder, see GstLcevcRenditionPad
+static GstStaticPadTemplate src_rendition_template = GST_STATIC_PAD_TEMPLATE(
+    "src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS("video/x-lcevc")
+);
+
+// Rendition pad properties
+enum {
+    PROP_RENDITION_0,
+    PROP_RENDITION_LEVEL,
+    PROP_RENDITION_STEP_WIDTH_LOQ1,
+    PROP_RENDITION_STEP_WIDTH_LOQ2
+};
+
+#define DEFAULT_RENDITION_LEVEL 1
+#define MAX_RENDITION_LEVEL 5
+
 #define gst_lcevc_enc_parent_class parent_class
 G_DEFINE_TYPE(GstLcevcEnc, gst_lcevc_enc, GST_TYPE_VIDEO_ENCODER);
+G_DEFINE_TYPE(GstLcevcRenditionPad, gst_lcevc_rendition_pad, GST_TYPE_PAD);
 
 // Forward declarations for static functions
 static void gst_lcevc_enc_set_property(GObject *obj, guint prop_id,
@@ -75,8 +170,48 @@ static gboolean gst_lcevc_enc_set_format(GstVideoEncoder *enc,
 static GstFlowReturn gst_lcevc_enc_handle_frame(GstVideoEncoder *enc,
     GstVideoCodecFrame *frame);
 static GstFlowReturn gst_lcevc_enc_finish(GstVideoEncoder *enc);
+static gboolean gst_lcevc_enc_flush(GstVideoEncoder *enc);
+static gboolean gst_lcevc_enc_create_workers(GstLcevcEnc *enc,
+    const LcevcEnhancementConfig &config, guint n_workers);
+static gboolean gst_lcevc_enc_configure_workers(GstLcevcEnc *enc,
+    const LcevcEnhancementConfig &config, guint n_workers);
+static void gst_lcevc_enc_free_workers(GstLcevcEnc *enc);
+static void gst_lcevc_enc_start_workers(GstLcevcEnc *enc);
+static void gst_lcevc_enc_stop_workers(GstLcevcEnc *enc);
+static void gst_lcevc_enc_submit_held_frames(GstLcevcEnc *enc);
+static GstFlowReturn gst_lcevc_enc_drain(GstLcevcEnc *enc);
 static gboolean gst_lcevc_enc_propose_allocation(GstVideoEncoder *encoder,
     GstQuery *query);
+static gboolean gst_lcevc_enc_sink_event(GstVideoEncoder *encoder, GstEvent *event);
+static GstStateChangeReturn gst_lcevc_enc_change_state(GstElement *element,
+    GstStateChange transition);
+static GstPad *gst_lcevc_enc_request_new_pad(GstElement *element, GstPadTemplate *templ,
+    const gchar *name, const GstCaps *caps);
+static void gst_lcevc_enc_release_pad(GstElement *element, GstPad *pad);
+static void gst_lcevc_enc_clear_base_queue(GstLcevcEnc *enc);
+static void gst_lcevc_enc_clear_base_enc_frames(GstLcevcEnc *enc);
+static void gst_lcevc_enc_clear_lookahead(GstLcevcEnc *enc);
+static void gst_lcevc_enc_free_inputs(GstLcevcEnc *enc);
+static void gst_lcevc_output_pool_init(GstLcevcOutputPool *output);
+static void gst_lcevc_output_pool_reset(GstObject *owner, GstLcevcOutputPool *output);
+static void gst_lcevc_output_pool_clear(GstLcevcOutputPool *output);
+static GstFlowReturn gst_lcevc_enc_base_output(GstBuffer *au, gpointer user_data);
+static void gst_lcevc_enc_base_caps(GstCaps *caps, gpointer user_data);
+static void gst_lcevc_enc_base_latency(GstClockTime latency, gpointer user_data);
+static void gst_lcevc_enc_reset_report(GstLcevcEnc *enc);
+static void gst_lcevc_enc_start_metrics(GstLcevcEnc *enc);
+static void gst_lcevc_enc_stop_metrics(GstLcevcEnc *enc);
+static gboolean gst_lcevc_enc_setup_placement(GstLcevcEnc *enc);
+static gboolean gst_lcevc_enc_configure_renditions(GstLcevcEnc *enc,
+    const LcevcEnhancementConfig &config, const GstVideoInfo *info);
+static void gst_lcevc_enc_free_renditions(GstLcevcEnc *enc);
+static void gst_lcevc_enc_start_renditions(GstLcevcEnc *enc);
+static void gst_lcevc_enc_stop_renditions(GstLcevcEnc *enc);
+static void gst_lcevc_enc_queue_renditions(GstLcevcEnc *enc, GstVideoCodecFrame *frame);
+static gboolean gst_lcevc_enc_renditions_full(GstLcevcEnc *enc);
+static gboolean gst_lcevc_enc_renditions_pending(GstLcevcEnc *enc);
+static void gst_lcevc_enc_drain_renditions(GstLcevcEnc *enc);
+static void gst_lcevc_enc_push_rendition_event(GstLcevcEnc *enc, GstEvent *event);
 
 static void gst_lcevc_enc_class_init(GstLcevcEncClass *klass) {
     GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
@@ -87,46 +222,79 @@ static void gst_lcevc_enc_class_init(GstLcevcEncClass *klass) {
     gobject_class->get_property = gst_lcevc_enc_get_property;
     gobject_class->finalize = gst_lcevc_enc_finalize;
     
+    element_class->change_state = GST_DEBUG_FUNCPTR(gst_lcevc_enc_change_state);
+    element_class->request_new_pad = GST_DEBUG_FUNCPTR(gst_lcevc_enc_request_new_pad);
+    element_class->release_pad = GST_DEBUG_FUNCPTR(gst_lcevc_enc_release_pad);
+    
     encoder_class->start = GST_DEBUG_FUNCPTR(gst_lcevc_enc_start);
     encoder_class->stop = GST_DEBUG_FUNCPTR(gst_lcevc_enc_stop);
     encoder_class->set_format = GST_DEBUG_FUNCPTR(gst_lcevc_enc_set_format);
     encoder_class->handle_frame = GST_DEBUG_FUNCPTR(gst_lcevc_enc_handle_frame);
     encoder_class->finish = GST_DEBUG_FUNCPTR(gst_lcevc_enc_finish);
+    encoder_class->flush = GST_DEBUG_FUNCPTR(gst_lcevc_enc_flush);
     encoder_class->propose_allocation = GST_DEBUG_FUNCPTR(gst_lcevc_enc_propose_allocation);
+    encoder_class->sink_event = GST_DEBUG_FUNCPTR(gst_lcevc_enc_sink_event);
     
     // Install properties
     g_object_class_install_property(gobject_class, PROP_QP,
-        g_param_spec_uint("qp", "QP", "Quantization parameter",
-            0, 51, DEFAULT_QP, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+        g_param_spec_uint("qp", "QP",
+            "Quantization parameter (deprecated, has no effect: use base-qp and the "
+            "step widths)", 0, 51, DEFAULT_QP,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_DEPRECATED)));
     
     g_object_class_install_property(gobject_class, PROP_BASE_QP,
         g_param_spec_uint("base-qp", "Base QP", "Base encoder QP",
-            0, 51, DEFAULT_BASE_QP, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+            0, 51, DEFAULT_BASE_QP,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_PLAYING)));
     
     g_object_class_install_property(gobject_class, PROP_STEP_WIDTH_LOQ1,
         g_param_spec_uint("step-width-loq1", "Step Width LOQ1", 
             "Step width for level 1", 200, 32767, DEFAULT_STEP_WIDTH_LOQ1,
-            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_PLAYING)));
     
     g_object_class_install_property(gobject_class, PROP_STEP_WIDTH_LOQ2,
         g_param_spec_uint("step-width-loq2", "Step Width LOQ2",
             "Step width for level 2", 200, 32767, DEFAULT_STEP_WIDTH_LOQ2,
-            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_PLAYING)));
     
     g_object_class_install_property(gobject_class, PROP_BASE_ENCODER,
         g_param_spec_string("base-encoder", "Base Encoder",
             "Base codec (avc, hevc, vvc, evc)", DEFAULT_BASE_ENCODER,
             (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
     
+    g_object_class_install_property(gobject_class, PROP_BASE_ENCODER_FACTORY,
+        g_param_spec_string("base-encoder-factory", "Base Encoder Factory",
+            "Element encoding the base when encode-base is set (NULL = x264enc for "
+            "avc, x265enc for hevc)", nullptr,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_ENCODE_BASE,
+        g_param_spec_boolean("encode-base", "Encode Base",
+            "Encode the base with a child encoder and output it muxed with the "
+            "enhancement", DEFAULT_ENCODE_BASE,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
     g_object_class_install_property(gobject_class, PROP_TRANSFORM_TYPE,
         g_param_spec_string("transform-type", "Transform Type",
             "Transform type (dd, dds)", DEFAULT_TRANSFORM_TYPE,
             (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
     
+    g_object_class_install_property(gobject_class, PROP_SCALING_MODE,
+        g_param_spec_string("scaling-mode", "Scaling Mode",
+            "Scaling from the base to the source (1d: width only, 2d: width and height). "
+            "Renditions need 2d", DEFAULT_SCALING_MODE,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
     g_object_class_install_property(gobject_class, PROP_PRIORITY_MODE,
         g_param_spec_string("priority-mode", "Priority Mode",
-            "Priority map mode", DEFAULT_PRIORITY_MODE,
-            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+            "Priority map mode (deprecated, has no effect)", DEFAULT_PRIORITY_MODE,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_DEPRECATED)));
     
     g_object_class_install_property(gobject_class, PROP_TEMPORAL_ENABLED,
         g_param_spec_boolean("temporal-enabled", "Temporal Enabled",
@@ -145,13 +313,191 @@ static void gst_lcevc_enc_class_init(GstLcevcEncClass *klass) {
     
     g_object_class_install_property(gobject_class, PROP_ENHANCEMENT_DEPTH,
         g_param_spec_uint("enhancement-depth", "Enhancement Depth",
-            "Enhancement bit depth", 8, 14, DEFAULT_ENHANCEMENT_DEPTH,
+            "Enhancement bit depth, the unit of the step widths, rounded up to 8, 10, 12 "
+            "or 14 (0 = source depth)", 0, 14, DEFAULT_ENHANCEMENT_DEPTH,
             (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
     
     g_object_class_install_property(gobject_class, PROP_FPS,
         g_param_spec_uint("fps", "FPS", "Frame rate",
             1, 120, DEFAULT_FPS, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
     
+    g_object_class_install_property(gobject_class, PROP_THREADS,
+        g_param_spec_uint("threads", "Threads",
+            "Number of encoding threads (0 = number of cores)", 0, 128, DEFAULT_THREADS,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_MAX_FRAMES_IN_FLIGHT,
+        g_param_spec_uint("max-frames-in-flight", "Max Frames In Flight",
+            "Frames encoded in parallel or waiting to be pushed when temporal "
+            "prediction is disabled (0 = one per thread)", 0, 64,
+            DEFAULT_MAX_FRAMES_IN_FLIGHT,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_BASE_PTS_TOLERANCE,
+        g_param_spec_uint64("base-pts-tolerance", "Base PTS Tolerance",
+            "Largest PTS difference in nanoseconds between a source frame and the "
+            "decoded base picture paired with it on sink_secondary "
+            "(0 = half a frame duration)", 0, G_MAXUINT64, DEFAULT_BASE_PTS_TOLERANCE,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+    
+    g_object_class_install_property(gobject_class, PROP_LOOKAHEAD,
+        g_param_spec_uint("lookahead", "Lookahead",
+            "Frames analysed ahead of the one being encoded to place temporal "
+            "refreshes and base keyframes on scene cuts (0 = disabled)", 0, 250,
+            DEFAULT_LOOKAHEAD,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_LOW_LATENCY,
+        g_param_spec_boolean("low-latency", "Low Latency",
+            "Encode one frame at a time on every thread, without lookahead. With "
+            "encode-base the base access unit is pushed as a subframe as soon as "
+            "it is out, ahead of the enhancement.", DEFAULT_LOW_LATENCY,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_RATE_CONTROL,
+        g_param_spec_string("rate-control", "Rate Control",
+            "Enhancement rate control (cqp = fixed step widths, abr = average "
+            "bitrate, cbr = constant bitrate)", DEFAULT_RATE_CONTROL,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_BITRATE,
+        g_param_spec_uint("bitrate", "Bitrate",
+            "Target enhancement bitrate in kbit/s with abr or cbr", 1, 2000000,
+            DEFAULT_BITRATE,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_PLAYING)));
+    
+    g_object_class_install_property(gobject_class, PROP_VBV_BUFFER_SIZE,
+        g_param_spec_uint("vbv-buffer-size", "VBV Buffer Size",
+            "Size of the enhancement buffer model in kbit (0 = none with abr, "
+            "one second of bitrate with cbr)", 0, G_MAXUINT, DEFAULT_VBV_BUFFER_SIZE,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_VBV_MAX_BITRATE,
+        g_param_spec_uint("vbv-max-bitrate", "VBV Max Bitrate",
+            "Rate at which the buffer model fills in kbit/s with abr "
+            "(0 = bitrate)", 0, 2000000, DEFAULT_VBV_MAX_BITRATE,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_PASS,
+        g_param_spec_uint("pass", "Pass",
+            "Two-pass encoding (0 = single pass, 1 = analyse into stats-file "
+            "and output nothing, 2 = spread the bitrate with stats-file, with "
+            "abr or cbr)", 0, 2, DEFAULT_PASS,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_STATS_FILE,
+        g_param_spec_string("stats-file", "Stats File",
+            "First pass stats written with pass 1 and read with pass 2",
+            DEFAULT_STATS_FILE,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_STATIC_THRESHOLD,
+        g_param_spec_uint("static-threshold", "Static Threshold",
+            "Largest mean difference with the picture it was last coded from, in "
+            "1/16 of an 8-bit step, for which a tile is skipped as static with "
+            "temporal prediction (0 = unchanged tiles only)", 0, 4080,
+            DEFAULT_STATIC_THRESHOLD,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_REPORT_INTERVAL,
+        g_param_spec_uint("report-interval", "Report Interval",
+            "Frames between lcevcenc-report element messages summing up the stage "
+            "times, sizes and queue depths of the frames encoded (0 = none)",
+            0, G_MAXUINT, DEFAULT_REPORT_INTERVAL,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_PLAYING)));
+    
+    g_object_class_install_property(gobject_class, PROP_METRICS_FILE,
+        g_param_spec_string("metrics-file", "Metrics File",
+            "File the statistics are written to in the Prometheus text format, "
+            "labelled with the element name (NULL = none)",
+            DEFAULT_METRICS_FILE,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_METRICS_INTERVAL,
+        g_param_spec_uint("metrics-interval", "Metrics Interval",
+            "Seconds between two writes of the metrics file", 1, 3600,
+            DEFAULT_METRICS_INTERVAL,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_CPU_SET,
+        g_param_spec_string("cpu-set", "CPU Set",
+            "CPUs the encoding threads are pinned to, as a list like \"0-7,16\" "
+            "(NULL = those of numa-node, or any)",
+            DEFAULT_CPU_SET,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_NUMA_NODE,
+        g_param_spec_int("numa-node", "NUMA Node",
+            "NUMA node the encoding threads take their memory from, and run on "
+            "when cpu-set is not set (-1 = any)",
+            -1, 1023, DEFAULT_NUMA_NODE,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    g_object_class_install_property(gobject_class, PROP_INHERIT_PLACEMENT,
+        g_param_spec_boolean("inherit-placement", "Inherit Placement",
+            "Without cpu-set and numa-node, run the encoding threads on the CPUs "
+            "and NUMA node of the upstream streaming thread",
+            DEFAULT_INHERIT_PLACEMENT,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+    
+    // Statistics since the encoder was started; latencies in nanoseconds
+    // from a frame coming in to it going out
+    g_object_class_install_property(gobject_class, PROP_FRAMES_ENCODED,
+        g_param_spec_uint64("frames-encoded", "Frames Encoded", "Frames output",
+            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_FRAMES_DROPPED,
+        g_param_spec_uint64("frames-dropped", "Frames Dropped",
+            "Frames that could not be encoded",
+            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_POOL_MISSES,
+        g_param_spec_uint64("pool-misses", "Pool Misses",
+            "Output buffers allocated outside of the buffer pool",
+            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_COPY_FALLBACKS,
+        g_param_spec_uint64("copy-fallbacks", "Copy Fallbacks",
+            "Input frames copied on ingest",
+            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_LATENCY_MEAN,
+        g_param_spec_uint64("latency-mean", "Mean Latency", "Mean encode latency",
+            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_LATENCY_P50,
+        g_param_spec_uint64("latency-p50", "Median Latency", "Median encode latency",
+            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_LATENCY_P99,
+        g_param_spec_uint64("latency-p99", "99th Percentile Latency",
+            "99th percentile of the encode latency",
+            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_LATENCY_MAX,
+        g_param_spec_uint64("latency-max", "Maximum Latency", "Longest encode latency",
+            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_BYTES_LOQ0,
+        g_param_spec_uint64("bytes-loq0", "LOQ-0 Bytes", "Bytes of LOQ-0 coded layers output",
+            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_BYTES_LOQ1,
+        g_param_spec_uint64("bytes-loq1", "LOQ-1 Bytes", "Bytes of LOQ-1 coded layers output",
+            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_BYTES_BASE,
+        g_param_spec_uint64("bytes-base", "Base Bytes",
+            "Bytes of base access units output with encode-base",
+            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+    
     gst_element_class_set_static_metadata(element_class,
         "LCEVC Encoder",
         "Codec/Encoder/Video",
@@ -159,47 +505,149 @@ static void gst_lcevc_enc_class_init(GstLcevcEncClass *klass) {
         "Erwan Le Blond <erwanleblond@gmail.com>");
     
     gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &sink_secondary_template);
     gst_element_class_add_static_pad_template(element_class, &src_template);
+    gst_element_class_add_pad_template(element_class,
+        gst_pad_template_new_from_static_pad_template_with_gtype(&src_rendition_template,
+            GST_TYPE_LCEVC_RENDITION_PAD));
     
     GST_DEBUG_CATEGORY_INIT(gst_lcevc_enc_debug, "lcevcenc", 0, "LCEVC Encoder");
 }
 
 static void gst_lcevc_enc_init(GstLcevcEnc *enc) {
-    enc->encoder = nullptr;
     enc->params = nullptr;
+    enc->pool = nullptr;
     enc->qp = DEFAULT_QP;
     enc->base_qp = DEFAULT_BASE_QP;
     enc->step_width_loq1 = DEFAULT_STEP_WIDTH_LOQ1;
     enc->step_width_loq2 = DEFAULT_STEP_WIDTH_LOQ2;
     enc->base_encoder = g_strdup(DEFAULT_BASE_ENCODER);
+    enc->base_encoder_factory = nullptr;
+    enc->encode_base = DEFAULT_ENCODE_BASE;
     enc->transform_type = g_strdup(DEFAULT_TRANSFORM_TYPE);
+    enc->scaling_mode = g_strdup(DEFAULT_SCALING_MODE);
     enc->priority_mode = g_strdup(DEFAULT_PRIORITY_MODE);
     enc->temporal_enabled = DEFAULT_TEMPORAL_ENABLED;
     enc->enhancement_enabled = DEFAULT_ENHANCEMENT_ENABLED;
     enc->base_depth = DEFAULT_BASE_DEPTH;
     enc->enhancement_depth = DEFAULT_ENHANCEMENT_DEPTH;
     enc->fps = DEFAULT_FPS;
+    enc->threads = DEFAULT_THREADS;
+    enc->max_frames_in_flight = DEFAULT_MAX_FRAMES_IN_FLIGHT;
     enc->input_state = nullptr;
     enc->frame_count = 0;
+    enc->copy_pool = nullptr;
+    gst_lcevc_output_pool_init(&enc->output);
+    g_mutex_init(&enc->input_lock);
+    g_queue_init(&enc->free_inputs);
+    enc->workers = nullptr;
+    enc->n_workers = 0;
+    g_mutex_init(&enc->queue_lock);
+    g_cond_init(&enc->queue_cond);
+    g_queue_init(&enc->frame_queue);
+    g_queue_init(&enc->reorder_queue);
+    enc->base_pts_tolerance = DEFAULT_BASE_PTS_TOLERANCE;
+    enc->sink_secondary = nullptr;
+    g_mutex_init(&enc->base_lock);
+    g_cond_init(&enc->base_cond);
+    g_queue_init(&enc->base_queue);
+    enc->base_info_valid = FALSE;
+    enc->base_eos = FALSE;
+    enc->base_flushing = FALSE;
+    enc->base_interrupted = FALSE;
+    enc->base_missing = 0;
+    enc->base_enc = nullptr;
+    enc->base_enc_pool = nullptr;
+    g_queue_init(&enc->base_enc_frames);
+    enc->lookahead_depth = DEFAULT_LOOKAHEAD;
+    enc->low_latency = DEFAULT_LOW_LATENCY;
+    enc->lookahead = nullptr;
+    g_queue_init(&enc->lookahead_queue);
+    enc->lookahead_frames = nullptr;
+    enc->lookahead_frames_size = 0;
+    enc->renditions = nullptr;
+    enc->rendition_serial = 0;
+    enc->pyramid = nullptr;
+    enc->pyramid_pool = nullptr;
+    enc->rate_control = g_strdup(DEFAULT_RATE_CONTROL);
+    enc->bitrate = DEFAULT_BITRATE;
+    enc->vbv_buffer_size = DEFAULT_VBV_BUFFER_SIZE;
+    enc->vbv_max_bitrate = DEFAULT_VBV_MAX_BITRATE;
+    enc->rate_controller = nullptr;
+    enc->pass = DEFAULT_PASS;
+    enc->stats_file = g_strdup(DEFAULT_STATS_FILE);
+    enc->stats_writer = nullptr;
+    enc->stats_reader = nullptr;
+    enc->static_threshold = DEFAULT_STATIC_THRESHOLD;
+    enc->report_interval = DEFAULT_REPORT_INTERVAL;
+    enc->metrics_file = g_strdup(DEFAULT_METRICS_FILE);
+    enc->metrics_interval = DEFAULT_METRICS_INTERVAL;
+    enc->cpu_set = g_strdup(DEFAULT_CPU_SET);
+    enc->numa_node = DEFAULT_NUMA_NODE;
+    enc->inherit_placement = DEFAULT_INHERIT_PLACEMENT;
+    enc->placement = nullptr;
+    enc->metrics = new LcevcEncoderMetrics();
+    enc->metrics_thread = nullptr;
+    enc->metrics_path = nullptr;
+    g_mutex_init(&enc->metrics_lock);
+    g_cond_init(&enc->metrics_cond);
 }
 
 static void gst_lcevc_enc_finalize(GObject *obj) {
     GstLcevcEnc *enc = GST_LCEVC_ENC(obj);
     
     g_free(enc->base_encoder);
+    g_free(enc->base_encoder_factory);
     g_free(enc->transform_type);
+    g_free(enc->scaling_mode);
     g_free(enc->priority_mode);
+    g_free(enc->rate_control);
+    gst_lcevc_enc_stop_metrics(enc);
+    g_free(enc->stats_file);
+    g_free(enc->metrics_file);
+    g_free(enc->cpu_set);
     
-    if (enc->encoder) {
-        delete enc->encoder;
-        enc->encoder = nullptr;
-    }
+    delete enc->metrics;
+    g_mutex_clear(&enc->metrics_lock);
+    g_cond_clear(&enc->metrics_cond);
+    
+    g_mutex_clear(&enc->queue_lock);
+    g_cond_clear(&enc->queue_cond);
+    gst_lcevc_output_pool_clear(&enc->output);
+
+    gst_lcevc_enc_free_inputs(enc);
+    g_mutex_clear(&enc->input_lock);
+    
+    gst_lcevc_enc_clear_base_queue(enc);
+    g_mutex_clear(&enc->base_lock);
+    g_cond_clear(&enc->base_cond);
+    
+    gst_lcevc_enc_free_workers(enc);
     
     if (enc->params) {
         delete enc->params;
         enc->params = nullptr;
     }
     
+    if (enc->pool) {
+        delete enc->pool;
+        enc->pool = nullptr;
+    }
+    delete enc->placement;
+    enc->placement = nullptr;
+    
+    if (enc->pyramid_pool)
+        gst_object_unref(enc->pyramid_pool);
+    delete enc->pyramid;
+    
+    gst_lcevc_enc_clear_lookahead(enc);
+    delete enc->lookahead;
+    g_free(enc->lookahead_frames);
+    delete enc->rate_controller;
+    delete enc->stats_writer;
+    delete enc->stats_reader;
+    g_list_free_full(enc->renditions, gst_object_unref);
+    
     G_OBJECT_CLASS(parent_class)->finalize(obj);
 }
 
@@ -212,22 +660,41 @@ static void gst_lcevc_enc_set_property(GObject *obj, guint prop_id,
             enc->qp = g_value_get_uint(val);
             break;
         case PROP_BASE_QP:
+            g_mutex_lock(&enc->queue_lock);
             enc->base_qp = g_value_get_uint(val);
+            g_mutex_unlock(&enc->queue_lock);
             break;
         case PROP_STEP_WIDTH_LOQ1:
+            g_mutex_lock(&enc->queue_lock);
             enc->step_width_loq1 = g_value_get_uint(val);
+            enc->retune = TRUE;
+            g_mutex_unlock(&enc->queue_lock);
             break;
         case PROP_STEP_WIDTH_LOQ2:
+            g_mutex_lock(&enc->queue_lock);
             enc->step_width_loq2 = g_value_get_uint(val);
+            enc->retune = TRUE;
+            g_mutex_unlock(&enc->queue_lock);
             break;
         case PROP_BASE_ENCODER:
             g_free(enc->base_encoder);
             enc->base_encoder = g_value_dup_string(val);
             break;
+        case PROP_BASE_ENCODER_FACTORY:
+            g_free(enc->base_encoder_factory);
+            enc->base_encoder_factory = g_value_dup_string(val);
+            break;
+        case PROP_ENCODE_BASE:
+            enc->encode_base = g_value_get_boolean(val);
+            break;
         case PROP_TRANSFORM_TYPE:
             g_free(enc->transform_type);
             enc->transform_type = g_value_dup_string(val);
             break;
+        case PROP_SCALING_MODE:
+            g_free(enc->scaling_mode);
+            enc->scaling_mode = g_value_dup_string(val);
+            break;
         case PROP_PRIORITY_MODE:
             g_free(enc->priority_mode);
             enc->priority_mode = g_value_dup_string(val);
@@ -247,6 +714,70 @@ static void gst_lcevc_enc_set_property(GObject *obj, guint prop_id,
         case PROP_FPS:
             enc->fps = g_value_get_uint(val);
             break;
+        case PROP_THREADS:
+            enc->threads = g_value_get_uint(val);
+            break;
+        case PROP_MAX_FRAMES_IN_FLIGHT:
+            enc->max_frames_in_flight = g_value_get_uint(val);
+            break;
+        case PROP_BASE_PTS_TOLERANCE:
+            enc->base_pts_tolerance = g_value_get_uint64(val);
+            break;
+        case PROP_LOOKAHEAD:
+            enc->lookahead_depth = g_value_get_uint(val);
+            break;
+        case PROP_LOW_LATENCY:
+            enc->low_latency = g_value_get_boolean(val);
+            break;
+        case PROP_RATE_CONTROL:
+            g_free(enc->rate_control);
+            enc->rate_control = g_value_dup_string(val);
+            break;
+        case PROP_BITRATE:
+            g_mutex_lock(&enc->queue_lock);
+            enc->bitrate = g_value_get_uint(val);
+            enc->retune = TRUE;
+            g_mutex_unlock(&enc->queue_lock);
+            break;
+        case PROP_VBV_BUFFER_SIZE:
+            enc->vbv_buffer_size = g_value_get_uint(val);
+            break;
+        case PROP_VBV_MAX_BITRATE:
+            enc->vbv_max_bitrate = g_value_get_uint(val);
+            break;
+        case PROP_PASS:
+            enc->pass = g_value_get_uint(val);
+            break;
+        case PROP_STATS_FILE:
+            g_free(enc->stats_file);
+            enc->stats_file = g_value_dup_string(val);
+            break;
+        case PROP_STATIC_THRESHOLD:
+            enc->static_threshold = g_value_get_uint(val);
+            break;
+        case PROP_REPORT_INTERVAL:
+            g_mutex_lock(&enc->queue_lock);
+            enc->report_interval = g_value_get_uint(val);
+            gst_lcevc_enc_reset_report(enc);
+            g_mutex_unlock(&enc->queue_lock);
+            break;
+        case PROP_METRICS_FILE:
+            g_free(enc->metrics_file);
+            enc->metrics_file = g_value_dup_string(val);
+            break;
+        case PROP_METRICS_INTERVAL:
+            enc->metrics_interval = g_value_get_uint(val);
+            break;
+        case PROP_CPU_SET:
+            g_free(enc->cpu_set);
+            enc->cpu_set = g_value_dup_string(val);
+            break;
+        case PROP_NUMA_NODE:
+            enc->numa_node = g_value_get_int(val);
+            break;
+        case PROP_INHERIT_PLACEMENT:
+            enc->inherit_placement = g_value_get_boolean(val);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, prop_id, pspec);
             break;
@@ -273,9 +804,18 @@ static void gst_lcevc_enc_get_property(GObject *obj, guint prop_id,
         case PROP_BASE_ENCODER:
             g_value_set_string(val, enc->base_encoder);
             break;
+        case PROP_BASE_ENCODER_FACTORY:
+            g_value_set_string(val, enc->base_encoder_factory);
+            break;
+        case PROP_ENCODE_BASE:
+            g_value_set_boolean(val, enc->encode_base);
+            break;
         case PROP_TRANSFORM_TYPE:
             g_value_set_string(val, enc->transform_type);
             break;
+        case PROP_SCALING_MODE:
+            g_value_set_string(val, enc->scaling_mode);
+            break;
         case PROP_PRIORITY_MODE:
             g_value_set_string(val, enc->priority_mode);
             break;
@@ -294,18 +834,258 @@ static void gst_lcevc_enc_get_property(GObject *obj, guint prop_id,
         case PROP_FPS:
             g_value_set_uint(val, enc->fps);
             break;
+        case PROP_THREADS:
+            g_value_set_uint(val, enc->threads);
+            break;
+        case PROP_MAX_FRAMES_IN_FLIGHT:
+            g_value_set_uint(val, enc->max_frames_in_flight);
+            break;
+        case PROP_BASE_PTS_TOLERANCE:
+            g_value_set_uint64(val, enc->base_pts_tolerance);
+            break;
+        case PROP_LOOKAHEAD:
+            g_value_set_uint(val, enc->lookahead_depth);
+            break;
+        case PROP_LOW_LATENCY:
+            g_value_set_boolean(val, enc->low_latency);
+            break;
+        case PROP_RATE_CONTROL:
+            g_value_set_string(val, enc->rate_control);
+            break;
+        case PROP_BITRATE:
+            g_value_set_uint(val, enc->bitrate);
+            break;
+        case PROP_VBV_BUFFER_SIZE:
+            g_value_set_uint(val, enc->vbv_buffer_size);
+            break;
+        case PROP_VBV_MAX_BITRATE:
+            g_value_set_uint(val, enc->vbv_max_bitrate);
+            break;
+        case PROP_PASS:
+            g_value_set_uint(val, enc->pass);
+            break;
+        case PROP_STATS_FILE:
+            g_value_set_string(val, enc->stats_file);
+            break;
+        case PROP_STATIC_THRESHOLD:
+            g_value_set_uint(val, enc->static_threshold);
+            break;
+        case PROP_REPORT_INTERVAL:
+            g_value_set_uint(val, enc->report_interval);
+            break;
+        case PROP_METRICS_FILE:
+            g_value_set_string(val, enc->metrics_file);
+            break;
+        case PROP_METRICS_INTERVAL:
+            g_value_set_uint(val, enc->metrics_interval);
+            break;
+        case PROP_CPU_SET:
+            g_value_set_string(val, enc->cpu_set);
+            break;
+        case PROP_NUMA_NODE:
+            g_value_set_int(val, enc->numa_node);
+            break;
+        case PROP_INHERIT_PLACEMENT:
+            g_value_set_boolean(val, enc->inherit_placement);
+            break;
+        case PROP_FRAMES_ENCODED:
+            g_value_set_uint64(val, enc->metrics->frames_encoded);
+            break;
+        case PROP_FRAMES_DROPPED:
+            g_value_set_uint64(val, enc->metrics->frames_dropped);
+            break;
+        case PROP_POOL_MISSES:
+            g_value_set_uint64(val, enc->metrics->pool_misses);
+            break;
+        case PROP_COPY_FALLBACKS:
+            g_value_set_uint64(val, enc->metrics->copy_fallbacks);
+            break;
+        case PROP_LATENCY_MEAN:
+            g_value_set_uint64(val, enc->metrics->latency.mean());
+            break;
+        case PROP_LATENCY_P50:
+            g_value_set_uint64(val, enc->metrics->latency.percentile(0.5));
+            break;
+        case PROP_LATENCY_P99:
+            g_value_set_uint64(val, enc->metrics->latency.percentile(0.99));
+            break;
+        case PROP_LATENCY_MAX:
+            g_value_set_uint64(val, enc->metrics->latency.max());
+            break;
+        case PROP_BYTES_LOQ0:
+            g_value_set_uint64(val, enc->metrics->bytes_out[LCEVC_METRICS_LOQ0]);
+            break;
+        case PROP_BYTES_LOQ1:
+            g_value_set_uint64(val, enc->metrics->bytes_out[LCEVC_METRICS_LOQ1]);
+            break;
+        case PROP_BYTES_BASE:
+            g_value_set_uint64(val, enc->metrics->bytes_out[LCEVC_METRICS_BASE]);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_lcevc_rendition_pad_set_property(GObject *obj, guint prop_id,
+    const GValue *val, GParamSpec *pspec) {
+    GstLcevcRenditionPad *rendition = GST_LCEVC_RENDITION_PAD(obj);
+
+    switch (prop_id) {
+        case PROP_RENDITION_LEVEL:
+            rendition->level = g_value_get_uint(val);
+            break;
+        case PROP_RENDITION_STEP_WIDTH_LOQ1:
+            rendition->step_width_loq1 = g_value_get_uint(val);
+            break;
+        case PROP_RENDITION_STEP_WIDTH_LOQ2:
+            rendition->step_width_loq2 = g_value_get_uint(val);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, prop_id, pspec);
+            break;
+    }
+}
+
+static void gst_lcevc_rendition_pad_get_property(GObject *obj, guint prop_id,
+    GValue *val, GParamSpec *pspec) {
+    GstLcevcRenditionPad *rendition = GST_LCEVC_RENDITION_PAD(obj);
+
+    switch (prop_id) {
+        case PROP_RENDITION_LEVEL:
+            g_value_set_uint(val, rendition->level);
+            break;
+        case PROP_RENDITION_STEP_WIDTH_LOQ1:
+            g_value_set_uint(val, rendition->step_width_loq1);
+            break;
+        case PROP_RENDITION_STEP_WIDTH_LOQ2:
+            g_value_set_uint(val, rendition->step_width_loq2);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, prop_id, pspec);
             break;
     }
 }
 
+static void gst_lcevc_rendition_pad_finalize(GObject *obj) {
+    GstLcevcRenditionPad *rendition = GST_LCEVC_RENDITION_PAD(obj);
+
+    delete rendition->enhancement;
+    gst_lcevc_output_pool_clear(&rendition->output);
+    G_OBJECT_CLASS(gst_lcevc_rendition_pad_parent_class)->finalize(obj);
+}
+
+static void gst_lcevc_rendition_pad_class_init(GstLcevcRenditionPadClass *klass) {
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+    gobject_class->set_property = gst_lcevc_rendition_pad_set_property;
+    gobject_class->get_property = gst_lcevc_rendition_pad_get_property;
+    gobject_class->finalize = gst_lcevc_rendition_pad_finalize;
+
+    g_object_class_install_property(gobject_class, PROP_RENDITION_LEVEL,
+        g_param_spec_uint("level", "Level",
+            "Times the input is halved in each dimension for this rendition",
+            0, MAX_RENDITION_LEVEL, DEFAULT_RENDITION_LEVEL,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+
+    g_object_class_install_property(gobject_class, PROP_RENDITION_STEP_WIDTH_LOQ1,
+        g_param_spec_uint("step-width-loq1", "Step Width LOQ1",
+            "Step width for level 1 of this rendition", 200, 32767, DEFAULT_STEP_WIDTH_LOQ1,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+
+    g_object_class_install_property(gobject_class, PROP_RENDITION_STEP_WIDTH_LOQ2,
+        g_param_spec_uint("step-width-loq2", "Step Width LOQ2",
+            "Step width for level 2 of this rendition", 200, 32767, DEFAULT_STEP_WIDTH_LOQ2,
+            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                GST_PARAM_MUTABLE_READY)));
+}
+
+static void gst_lcevc_rendition_pad_init(GstLcevcRenditionPad *rendition) {
+    rendition->level = DEFAULT_RENDITION_LEVEL;
+    rendition->step_width_loq1 = DEFAULT_STEP_WIDTH_LOQ1;
+    rendition->step_width_loq2 = DEFAULT_STEP_WIDTH_LOQ2;
+    rendition->enc = nullptr;
+    rendition->enhancement = nullptr;
+    rendition->thread = nullptr;
+    g_queue_init(&rendition->frames);
+    gst_lcevc_output_pool_init(&rendition->output);
+    rendition->stop = FALSE;
+    rendition->started = FALSE;
+    rendition->flow = GST_FLOW_OK;
+}
+
+// Rewrite the metrics file every metrics_interval seconds, and a last time
+// when stopped
+static gpointer gst_lcevc_enc_metrics_thread(gpointer data) {
+    GstLcevcEnc *enc = GST_LCEVC_ENC(data);
+    gchar *name = gst_object_get_name(GST_OBJECT(enc));
+    std::string instance = name ? name : "";
+    gint64 deadline = g_get_monotonic_time();
+    gboolean stop = FALSE;
+
+    g_free(name);
+    while (!stop) {
+        deadline += (gint64) enc->metrics_interval * G_TIME_SPAN_SECOND;
+        g_mutex_lock(&enc->metrics_lock);
+        while (!enc->metrics_stop &&
+               g_cond_wait_until(&enc->metrics_cond, &enc->metrics_lock, deadline))
+            ;
+        stop = enc->metrics_stop;
+        g_mutex_unlock(&enc->metrics_lock);
+
+        if (!lcevc_metrics_write_file(enc->metrics_path, enc->metrics->exposition(instance)))
+            GST_WARNING_OBJECT(enc, "Failed to write metrics file %s", enc->metrics_path);
+    }
+
+    return nullptr;
+}
+
+static void gst_lcevc_enc_start_metrics(GstLcevcEnc *enc) {
+    if (!enc->metrics_file || !enc->metrics_file[0])
+        return;
+
+    // The property can be set again while the thread runs
+    enc->metrics_path = g_strdup(enc->metrics_file);
+    enc->metrics_stop = FALSE;
+    enc->metrics_thread = g_thread_new("lcevcenc-metrics", gst_lcevc_enc_metrics_thread, enc);
+}
+
+static void gst_lcevc_enc_stop_metrics(GstLcevcEnc *enc) {
+    if (!enc->metrics_thread)
+        return;
+
+    g_mutex_lock(&enc->metrics_lock);
+    enc->metrics_stop = TRUE;
+    g_cond_signal(&enc->metrics_cond);
+    g_mutex_unlock(&enc->metrics_lock);
+
+    g_thread_join(enc->metrics_thread);
+    enc->metrics_thread = nullptr;
+    g_free(enc->metrics_path);
+    enc->metrics_path = nullptr;
+}
+
 static gboolean gst_lcevc_enc_start(GstVideoEncoder *encoder) {
     GstLcevcEnc *enc = GST_LCEVC_ENC(encoder);
     
     GST_DEBUG_OBJECT(enc, "Starting encoder");
     enc->frame_count = 0;
-    enc->frame_buffer.clear();
+    enc->base_missing = 0;
+    g_mutex_lock(&enc->queue_lock);
+    gst_lcevc_enc_reset_report(enc);
+    g_mutex_unlock(&enc->queue_lock);
+    enc->metrics->reset();
+    gst_lcevc_enc_start_metrics(enc);
+    
+    // The encode workers drive the pool and take part in every batch, so
+    // the pool only adds threads - 1 helpers. The workers themselves are
+    // created once the format is known.
+    guint threads = enc->threads ? enc->threads : g_get_num_processors();
+    enc->pool = new LcevcWorkerPool(threads);
+    GST_DEBUG_OBJECT(enc, "Using %u encoding threads, %s kernels", threads,
+        lcevc_dsp_isa());
     
     return TRUE;
 }
@@ -315,53 +1095,383 @@ static gboolean gst_lcevc_enc_stop(GstVideoEncoder *encoder) {
     
     GST_DEBUG_OBJECT(enc, "Stopping encoder");
     
-    if (enc->encoder) {
-        delete enc->encoder;
-        enc->encoder = nullptr;
+    gst_lcevc_enc_stop_metrics(enc);
+    
+    gst_lcevc_enc_clear_lookahead(enc);
+    delete enc->lookahead;
+    enc->lookahead = nullptr;
+    
+    if (enc->rate_controller) {
+        if (enc->rate_controller->vbv_underflows())
+            GST_WARNING_OBJECT(enc, "%" G_GUINT64_FORMAT " frames did not fit in the VBV buffer",
+                enc->rate_controller->vbv_underflows());
+        delete enc->rate_controller;
+        enc->rate_controller = nullptr;
+    }
+    
+    if (enc->stats_writer) {
+        if (!enc->stats_writer->close())
+            GST_ELEMENT_ERROR(enc, RESOURCE, WRITE, (nullptr),
+                ("Failed to complete stats file %s", enc->stats_file));
+        delete enc->stats_writer;
+        enc->stats_writer = nullptr;
+    }
+    delete enc->stats_reader;
+    enc->stats_reader = nullptr;
+    
+    if (enc->base_enc) {
+        gst_lcevc_base_free(enc->base_enc);
+        enc->base_enc = nullptr;
+    }
+    gst_lcevc_enc_clear_base_enc_frames(enc);
+    if (enc->base_enc_pool) {
+        gst_buffer_pool_set_active(enc->base_enc_pool, FALSE);
+        gst_object_unref(enc->base_enc_pool);
+        enc->base_enc_pool = nullptr;
     }
     
+    gst_lcevc_enc_free_workers(enc);
+    gst_lcevc_enc_free_renditions(enc);
+    
     if (enc->params) {
         delete enc->params;
         enc->params = nullptr;
     }
     
+    if (enc->pool) {
+        delete enc->pool;
+        enc->pool = nullptr;
+    }
+    delete enc->placement;
+    enc->placement = nullptr;
+    
     if (enc->input_state) {
         gst_video_codec_state_unref(enc->input_state);
         enc->input_state = nullptr;
     }
     
-    enc->frame_buffer.clear();
+    if (enc->copy_pool) {
+        gst_buffer_pool_set_active(enc->copy_pool, FALSE);
+        gst_object_unref(enc->copy_pool);
+        enc->copy_pool = nullptr;
+    }
+    
+    gst_lcevc_output_pool_reset(GST_OBJECT(enc), &enc->output);
+    
+    if (enc->metrics->copy_fallbacks)
+        GST_INFO_OBJECT(enc, "%" G_GUINT64_FORMAT " of %d frames needed a copy on ingest",
+            (guint64) enc->metrics->copy_fallbacks, enc->frame_count);
+    
+    gst_lcevc_enc_clear_base_queue(enc);
+    if (enc->base_missing)
+        GST_INFO_OBJECT(enc, "%" G_GUINT64_FORMAT " of %d frames had no base picture",
+            enc->base_missing, enc->frame_count);
     
     return TRUE;
 }
 
+// Video buffer pool laid out for the encoder kernels: planes start on
+// LCEVC_SURFACE_ALIGN boundaries and strides are padded to a multiple of
+// it, so every frame from it can be viewed in place
+static GstBufferPool *gst_lcevc_enc_create_input_pool(GstLcevcEnc *enc, GstCaps *caps,
+    GstVideoInfo *info, guint min_buffers, guint *size) {
+    GstBufferPool *pool = gst_video_buffer_pool_new();
+    GstStructure *config = gst_buffer_pool_get_config(pool);
+    GstVideoAlignment align;
+    GstAllocationParams params;
+
+    gst_video_alignment_reset(&align);
+    for (guint i = 0; i < GST_VIDEO_MAX_PLANES; i++)
+        align.stride_align[i] = LCEVC_SURFACE_ALIGN - 1;
+
+    gst_allocation_params_init(&params);
+    params.align = LCEVC_SURFACE_ALIGN - 1;
+
+    gst_buffer_pool_config_set_params(config, caps, GST_VIDEO_INFO_SIZE(info), min_buffers, 0);
+    gst_buffer_pool_config_set_allocator(config, nullptr, &params);
+    gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+    gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+    gst_buffer_pool_config_set_video_alignment(config, &align);
+
+    if (!gst_buffer_pool_set_config(pool, config)) {
+        GST_ERROR_OBJECT(enc, "Failed to configure input buffer pool");
+        gst_object_unref(pool);
+        return nullptr;
+    }
+
+    // The padded frames are larger than the caps size
+    config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_get_params(config, nullptr, size, nullptr, nullptr);
+    gst_structure_free(config);
+
+    return pool;
+}
+
 static gboolean gst_lcevc_enc_propose_allocation(GstVideoEncoder *encoder,
     GstQuery *query) {
-    // Propose input buffer pool - use the base class implementation
+    GstLcevcEnc *enc = GST_LCEVC_ENC(encoder);
+    GstCaps *caps;
+    gboolean need_pool;
+    GstVideoInfo info;
+
+    gst_query_parse_allocation(query, &caps, &need_pool);
+    if (!caps || !gst_video_info_from_caps(&info, caps))
+        return GST_VIDEO_ENCODER_CLASS(parent_class)->propose_allocation(encoder, query);
+
+    // Every frame in flight keeps its input buffer until it is finished
+    guint min_buffers = enc->in_flight_limit ? enc->in_flight_limit : DEFAULT_QUEUE_DEPTH + 1;
+
+    if (need_pool) {
+        guint size;
+        GstBufferPool *pool = gst_lcevc_enc_create_input_pool(enc, caps, &info,
+            min_buffers, &size);
+        if (pool) {
+            GstAllocationParams params;
+
+            gst_allocation_params_init(&params);
+            params.align = LCEVC_SURFACE_ALIGN - 1;
+            gst_query_add_allocation_pool(query, pool, size, min_buffers, 0);
+            gst_query_add_allocation_param(query, nullptr, &params);
+            gst_object_unref(pool);
+        }
+    } else {
+        gst_query_add_allocation_pool(query, nullptr, GST_VIDEO_INFO_SIZE(&info), min_buffers, 0);
+    }
+
+    // The base class adds GstVideoMeta, which lets upstream use the padded
+    // strides
     return GST_VIDEO_ENCODER_CLASS(parent_class)->propose_allocation(encoder, query);
 }
 
 // Function to convert GstVideoFormat to ImageFormat
+// Semi-planar formats are read in place and described by their planar
+// equivalent.
 lctm::ImageFormat gst_video_format_to_image_format(GstVideoFormat format) {
     switch (format) {
         case GST_VIDEO_FORMAT_I420:
+        case GST_VIDEO_FORMAT_YV12:
+        case GST_VIDEO_FORMAT_NV12:
+        case GST_VIDEO_FORMAT_NV21:
             return lctm::IMAGE_FORMAT_YUV420P8;
         case GST_VIDEO_FORMAT_Y42B:
             return lctm::IMAGE_FORMAT_YUV422P8;
         case GST_VIDEO_FORMAT_Y444:
             return lctm::IMAGE_FORMAT_YUV444P8;
         case GST_VIDEO_FORMAT_I420_10LE:
+        case GST_VIDEO_FORMAT_P010_10LE:
             return lctm::IMAGE_FORMAT_YUV420P10;
         case GST_VIDEO_FORMAT_I422_10LE:
             return lctm::IMAGE_FORMAT_YUV422P10;
         case GST_VIDEO_FORMAT_Y444_10LE:
             return lctm::IMAGE_FORMAT_YUV444P10;
+        case GST_VIDEO_FORMAT_I420_12LE:
+            return lctm::IMAGE_FORMAT_YUV420P12;
+        case GST_VIDEO_FORMAT_I422_12LE:
+            return lctm::IMAGE_FORMAT_YUV422P12;
+        case GST_VIDEO_FORMAT_Y444_12LE:
+            return lctm::IMAGE_FORMAT_YUV444P12;
+        case GST_VIDEO_FORMAT_P016_LE:
+            return lctm::IMAGE_FORMAT_YUV420P16;
         default:
             GST_WARNING("Unsupported video format: %s", gst_video_format_to_string(format));
             return lctm::IMAGE_FORMAT_NONE;
     }
 }
 
+// Planar format of the source's chroma layout holding depth bits, or
+// GST_VIDEO_FORMAT_UNKNOWN
+static GstVideoFormat base_video_format(const GstVideoInfo *info, guint depth) {
+    static const GstVideoFormat formats[3][3] = {
+        { GST_VIDEO_FORMAT_I420, GST_VIDEO_FORMAT_I420_10LE, GST_VIDEO_FORMAT_I420_12LE },
+        { GST_VIDEO_FORMAT_Y42B, GST_VIDEO_FORMAT_I422_10LE, GST_VIDEO_FORMAT_I422_12LE },
+        { GST_VIDEO_FORMAT_Y444, GST_VIDEO_FORMAT_Y444_10LE, GST_VIDEO_FORMAT_Y444_12LE },
+    };
+    guint chroma = GST_VIDEO_FORMAT_INFO_H_SUB(info->finfo, 1) ? 0 :
+        GST_VIDEO_FORMAT_INFO_W_SUB(info->finfo, 1) ? 1 : 2;
+
+    if (depth > 12)
+        return GST_VIDEO_FORMAT_UNKNOWN;
+    return formats[chroma][depth <= 8 ? 0 : depth <= 10 ? 1 : 2];
+}
+
+static LcevcScalingMode gst_lcevc_enc_scaling_mode(GstLcevcEnc *enc) {
+    return g_strcmp0(enc->scaling_mode, "1d") == 0 ? LCEVC_SCALING_1D : LCEVC_SCALING_2D;
+}
+
+// Resolution of the base, the LOQ-1 of the enhancement
+static void gst_lcevc_enc_base_size(GstLcevcEnc *enc, const GstVideoInfo *info,
+    guint *width, guint *height) {
+    *width = (GST_VIDEO_INFO_WIDTH(info) + 1) / 2;
+    *height = gst_lcevc_enc_scaling_mode(enc) == LCEVC_SCALING_2D ?
+        (GST_VIDEO_INFO_HEIGHT(info) + 1) / 2 : GST_VIDEO_INFO_HEIGHT(info);
+}
+
+// Create the base encoder on first use and give it the downsampled source
+// format, at base-depth or at 8 bits when it does not take that. Returns the
+// depth in use in depth.
+static gboolean gst_lcevc_enc_setup_base(GstLcevcEnc *enc, GstVideoCodecState *state,
+    guint *depth) {
+    GstVideoInfo *info = &state->info;
+
+    if (!enc->base_enc) {
+        const gchar *factory = enc->base_encoder_factory ? enc->base_encoder_factory :
+            gst_lcevc_base_factory_for_codec(enc->base_encoder);
+
+        if (!factory) {
+            GST_ELEMENT_ERROR(enc, CORE, MISSING_PLUGIN, (nullptr),
+                ("No base encoder element for %s, set base-encoder-factory", enc->base_encoder));
+            return FALSE;
+        }
+        g_mutex_lock(&enc->queue_lock);
+        enc->base_enc_latency = 0;
+        g_mutex_unlock(&enc->queue_lock);
+        enc->base_enc = gst_lcevc_base_new(GST_ELEMENT(enc), factory, enc->base_qp,
+            gst_lcevc_enc_base_output, gst_lcevc_enc_base_caps, gst_lcevc_enc_base_latency, enc);
+        if (!enc->base_enc) {
+            GST_ELEMENT_ERROR(enc, CORE, MISSING_PLUGIN, (nullptr),
+                ("Failed to start base encoder %s", factory));
+            return FALSE;
+        }
+    }
+
+    if (enc->base_enc_pool) {
+        gst_buffer_pool_set_active(enc->base_enc_pool, FALSE);
+        gst_object_unref(enc->base_enc_pool);
+        enc->base_enc_pool = nullptr;
+    }
+
+    const guint depths[] = { enc->base_depth, 8 };
+    guint base_width, base_height;
+    gst_lcevc_enc_base_size(enc, info, &base_width, &base_height);
+    for (guint i = 0; i < G_N_ELEMENTS(depths); i++) {
+        GstVideoFormat format = base_video_format(info, depths[i]);
+        GstVideoInfo base_info;
+
+        if (format == GST_VIDEO_FORMAT_UNKNOWN)
+            continue;
+        gst_video_info_set_format(&base_info, format, base_width, base_height);
+        GST_VIDEO_INFO_FPS_N(&base_info) = GST_VIDEO_INFO_FPS_N(info);
+        GST_VIDEO_INFO_FPS_D(&base_info) = GST_VIDEO_INFO_FPS_D(info);
+
+        GstCaps *caps = gst_video_info_to_caps(&base_info);
+        if (gst_lcevc_base_set_format(enc->base_enc, caps)) {
+            guint size;
+
+            // Pictures stay with the base encoder for its whole lookahead, so
+            // the pool only takes its bound from the frames waiting for their
+            // access unit, see gst_lcevc_enc_base_full()
+            enc->base_enc_pool = gst_lcevc_enc_create_input_pool(enc, caps, &base_info, 2, &size);
+            gst_caps_unref(caps);
+            if (!enc->base_enc_pool || !gst_buffer_pool_set_active(enc->base_enc_pool, TRUE)) {
+                GST_ERROR_OBJECT(enc, "Failed to configure base picture pool");
+                return FALSE;
+            }
+            enc->base_enc_info = base_info;
+            *depth = depths[i];
+            GST_DEBUG_OBJECT(enc, "Base pictures: %dx%d %s", GST_VIDEO_INFO_WIDTH(&base_info),
+                GST_VIDEO_INFO_HEIGHT(&base_info), GST_VIDEO_INFO_NAME(&base_info));
+            return TRUE;
+        }
+        gst_caps_unref(caps);
+    }
+
+    GST_ELEMENT_ERROR(enc, CORE, NEGOTIATION, (nullptr),
+        ("Base encoder does not take the downsampled source format"));
+    return FALSE;
+}
+
+// Frames held back for the lookahead. Low-latency mode holds none, so scene
+// cuts only refresh the temporal buffer when a keyframe is forced.
+static guint gst_lcevc_enc_lookahead_depth(GstLcevcEnc *enc) {
+    return enc->low_latency ? 0 : enc->lookahead_depth;
+}
+
+// Work out once per run where the encoding threads go, and move the pool
+// there. Without cpu-set or numa-node, inherit-placement takes the CPUs and
+// node of the streaming thread calling set_format, the one upstream hands
+// frames in from; numa-node alone runs them on the CPUs of the node.
+static gboolean gst_lcevc_enc_setup_placement(GstLcevcEnc *enc) {
+    if (enc->placement)
+        return TRUE;
+
+    LcevcPlacement *placement = new LcevcPlacement();
+    if (enc->cpu_set && !lcevc_parse_cpu_list(enc->cpu_set, &placement->cpus)) {
+        GST_ELEMENT_ERROR(enc, LIBRARY, SETTINGS, (nullptr),
+            ("Invalid cpu-set \"%s\"", enc->cpu_set));
+        delete placement;
+        return FALSE;
+    }
+    placement->node = enc->numa_node;
+
+    if (!enc->cpu_set && placement->node >= 0 &&
+        !lcevc_node_cpus(placement->node, &placement->cpus))
+        GST_WARNING_OBJECT(enc, "No CPUs found for NUMA node %d", placement->node);
+    if (!enc->cpu_set && enc->numa_node < 0 && enc->inherit_placement &&
+        !lcevc_current_placement(placement))
+        GST_WARNING_OBJECT(enc, "Failed to read the placement of the streaming thread");
+
+    enc->placement = placement;
+    if (placement->empty())
+        return TRUE;
+
+    enc->pool->set_placement(*placement);
+    GST_DEBUG_OBJECT(enc, "Encoding threads on CPUs %s, NUMA node %d",
+        placement->cpus.empty() ? "any" : lcevc_format_cpu_list(placement->cpus).c_str(),
+        placement->node);
+    return TRUE;
+}
+
+// Open the stats file of a first or second pass, once for the whole stream
+static gboolean gst_lcevc_enc_setup_stats(GstLcevcEnc *enc, const GstVideoInfo *info) {
+    if (enc->pass == 1 && !enc->stats_writer) {
+        LcevcStatsHeader header = LcevcStatsHeader();
+
+        header.width = GST_VIDEO_INFO_WIDTH(info);
+        header.height = GST_VIDEO_INFO_HEIGHT(info);
+        header.fps_n = GST_VIDEO_INFO_FPS_N(info);
+        header.fps_d = GST_VIDEO_INFO_FPS_D(info);
+        header.analysis_step_width = LCEVC_ANALYSIS_STEP_WIDTH;
+        header.step_width_loq0 = enc->step_width_loq2;
+        header.step_width_loq1 = enc->step_width_loq1;
+
+        enc->stats_writer = new LcevcStatsWriter();
+        if (!enc->stats_writer->open(enc->stats_file, header)) {
+            GST_ELEMENT_ERROR(enc, RESOURCE, OPEN_WRITE, (nullptr),
+                ("Failed to create stats file %s", enc->stats_file));
+            delete enc->stats_writer;
+            enc->stats_writer = nullptr;
+            return FALSE;
+        }
+    } else if (enc->pass == 2 && !enc->stats_reader) {
+        std::string error;
+
+        enc->stats_reader = new LcevcStatsReader();
+        if (!enc->stats_reader->open(enc->stats_file, &error)) {
+            GST_ELEMENT_ERROR(enc, RESOURCE, OPEN_READ, (nullptr),
+                ("Failed to read stats file %s: %s", enc->stats_file, error.c_str()));
+            delete enc->stats_reader;
+            enc->stats_reader = nullptr;
+            return FALSE;
+        }
+        GST_DEBUG_OBJECT(enc, "Second pass over %" G_GUINT64_FORMAT " frames",
+            enc->stats_reader->num_frames());
+    }
+
+    if (enc->stats_reader) {
+        const LcevcStatsHeader &header = enc->stats_reader->header();
+
+        if (header.width != (guint) GST_VIDEO_INFO_WIDTH(info) ||
+            header.height != (guint) GST_VIDEO_INFO_HEIGHT(info)) {
+            GST_ELEMENT_ERROR(enc, STREAM, FORMAT, (nullptr),
+                ("Stats file %s is for %ux%u, not %dx%d", enc->stats_file,
+                    header.width, header.height,
+                    GST_VIDEO_INFO_WIDTH(info), GST_VIDEO_INFO_HEIGHT(info)));
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
 static gboolean gst_lcevc_enc_set_format(GstVideoEncoder *encoder,
     GstVideoCodecState *state) {
     GstLcevcEnc *enc = GST_LCEVC_ENC(encoder);
@@ -377,6 +1487,16 @@ static gboolean gst_lcevc_enc_set_format(GstVideoEncoder *encoder,
         GST_VIDEO_INFO_WIDTH(info), GST_VIDEO_INFO_HEIGHT(info),
         GST_VIDEO_INFO_FPS_N(info), GST_VIDEO_INFO_FPS_D(info));
     
+    // Frames queued against the previous format must be encoded with the
+    // encoder that is about to be reconfigured
+    gst_lcevc_enc_drain(enc);
+    
+    // Buffers of the ingest pool only depend on the layout of the frames
+    gboolean same_layout = enc->input_state &&
+        GST_VIDEO_INFO_FORMAT(&enc->input_state->info) == GST_VIDEO_INFO_FORMAT(info) &&
+        GST_VIDEO_INFO_WIDTH(&enc->input_state->info) == GST_VIDEO_INFO_WIDTH(info) &&
+        GST_VIDEO_INFO_HEIGHT(&enc->input_state->info) == GST_VIDEO_INFO_HEIGHT(info);
+    
     if (enc->input_state)
         gst_video_codec_state_unref(enc->input_state);
     enc->input_state = gst_video_codec_state_ref(state);
@@ -388,6 +1508,31 @@ static gboolean gst_lcevc_enc_set_format(GstVideoEncoder *encoder,
         return FALSE;
     }
     
+    // Pool for the frames that cannot be wrapped in place
+    if (enc->copy_pool && !same_layout) {
+        gst_buffer_pool_set_active(enc->copy_pool, FALSE);
+        gst_object_unref(enc->copy_pool);
+        enc->copy_pool = nullptr;
+    }
+    if (!enc->copy_pool) {
+        guint pool_size;
+        enc->copy_pool = gst_lcevc_enc_create_input_pool(enc, state->caps, info, 2, &pool_size);
+        if (!enc->copy_pool || !gst_buffer_pool_set_active(enc->copy_pool, TRUE)) {
+            GST_ERROR_OBJECT(enc, "Failed to configure ingest copy pool");
+            if (enc->copy_pool)
+                gst_object_unref(enc->copy_pool);
+            enc->copy_pool = nullptr;
+            return FALSE;
+        }
+    }
+    
+    // Base codec input, which also decides the base depth signalled in the
+    // enhancement. A first pass outputs nothing and has no use for it.
+    guint base_depth = enc->base_depth;
+    if (enc->encode_base && enc->pass != 1 &&
+        !gst_lcevc_enc_setup_base(enc, state, &base_depth))
+        return FALSE;
+    
     // Create image description
     enc->src_desc = lctm::ImageDescription(
         image_format,
@@ -415,108 +1560,2137 @@ static gboolean gst_lcevc_enc_set_format(GstVideoEncoder *encoder,
     enc->params = new lctm::Parameters(pb.finish());
     
     // Create encoder
-    try {
-        if (enc->encoder)
-            delete enc->encoder;
-        enc->encoder = new lctm::Encoder(enc->src_desc, *enc->params);
-    } catch (const std::exception &e) {
-        GST_ERROR_OBJECT(enc, "Failed to create encoder: %s", e.what());
+    LcevcEnhancementConfig enh_config;
+    enh_config.width = GST_VIDEO_INFO_WIDTH(info);
+    enh_config.height = GST_VIDEO_INFO_HEIGHT(info);
+    enh_config.num_planes = GST_VIDEO_INFO_N_COMPONENTS(info);
+    enh_config.chroma_shift_x = GST_VIDEO_FORMAT_INFO_W_SUB(info->finfo, 1);
+    enh_config.chroma_shift_y = GST_VIDEO_FORMAT_INFO_H_SUB(info->finfo, 1);
+    enh_config.bit_depth = GST_VIDEO_INFO_COMP_DEPTH(info, 0);
+    enh_config.base_depth = base_depth;
+    enh_config.enhancement_depth = enc->enhancement_depth ?
+        enc->enhancement_depth : enh_config.bit_depth;
+    enh_config.transform = g_strcmp0(enc->transform_type, "dd") == 0 ?
+        LCEVC_TRANSFORM_DD : LCEVC_TRANSFORM_DDS;
+    enh_config.scaling = gst_lcevc_enc_scaling_mode(enc);
+    enh_config.upsample = LCEVC_UPSAMPLE_MODIFIED_CUBIC;
+    enh_config.step_width_loq0 = enc->step_width_loq2;
+    enh_config.step_width_loq1 = enc->step_width_loq1;
+    enh_config.temporal_enabled = enc->temporal_enabled;
+    enh_config.enhancement_enabled = enc->enhancement_enabled;
+    enh_config.static_threshold = enc->static_threshold;
+    enh_config.internal_source = false;
+    
+    // Frames only depend on each other through temporal prediction. Without
+    // it every worker gets its own encoder context and frames are encoded in
+    // parallel, bounded by max-frames-in-flight. Low-latency mode encodes one
+    // frame at a time, on every thread of the pool.
+    guint n_workers;
+    if (enc->low_latency) {
+        n_workers = 1;
+        enc->in_flight_limit = 1;
+    } else if (enc->temporal_enabled) {
+        n_workers = 1;
+        enc->in_flight_limit = DEFAULT_QUEUE_DEPTH + 1;
+    } else {
+        guint threads = enc->pool->num_threads();
+        enc->in_flight_limit = enc->max_frames_in_flight ?
+            enc->max_frames_in_flight : threads;
+        n_workers = MIN(enc->in_flight_limit, threads);
+    }
+    
+    if (!gst_lcevc_enc_setup_placement(enc))
+        return FALSE;
+    if (!gst_lcevc_enc_configure_workers(enc, enh_config, n_workers))
+        return FALSE;
+    GST_DEBUG_OBJECT(enc, "%u encode workers, up to %u frames in flight",
+        n_workers, enc->in_flight_limit);
+    const LcevcArena &arena = enc->workers[0].enhancement->surface_arena();
+    GST_DEBUG_OBJECT(enc, "%" G_GSIZE_FORMAT " bytes of surfaces per worker%s",
+        arena.size(), arena.huge_pages() ? ", on huge pages" : "");
+    if (!gst_lcevc_enc_configure_renditions(enc, enh_config, info))
+        return FALSE;
+    
+    if (!gst_lcevc_enc_setup_stats(enc, info))
+        return FALSE;
+    
+    if (enc->pass == 2 && g_strcmp0(enc->rate_control, "cqp") == 0) {
+        GST_ELEMENT_ERROR(enc, LIBRARY, SETTINGS, (nullptr),
+            ("The second pass needs abr or cbr rate control"));
         return FALSE;
     }
+    if (enc->pass != 1 && g_strcmp0(enc->rate_control, "cqp") != 0) {
+        LcevcRateControlConfig rc_config;
+
+        if (g_strcmp0(enc->rate_control, "abr") == 0) {
+            rc_config.mode = LCEVC_RATE_CONTROL_ABR;
+        } else if (g_strcmp0(enc->rate_control, "cbr") == 0) {
+            rc_config.mode = LCEVC_RATE_CONTROL_CBR;
+        } else {
+            GST_ERROR_OBJECT(enc, "Unknown rate control: %s", enc->rate_control);
+            return FALSE;
+        }
+        rc_config.bitrate = enc->bitrate;
+        rc_config.vbv_max_bitrate = enc->vbv_max_bitrate;
+        rc_config.vbv_buffer_size = enc->vbv_buffer_size;
+        rc_config.fps = GST_VIDEO_INFO_FPS_N(info) > 0 ?
+            (double) GST_VIDEO_INFO_FPS_N(info) / GST_VIDEO_INFO_FPS_D(info) : enc->fps;
+        rc_config.step_width_loq0 = enc->step_width_loq2;
+        rc_config.step_width_loq1 = enc->step_width_loq1;
+
+        // The model fitted so far still holds at another resolution or frame
+        // rate, only its targets change
+        if (enc->rate_controller && enc->rate_controller->config().mode == rc_config.mode) {
+            enc->rate_controller->reconfigure(rc_config);
+        } else {
+            delete enc->rate_controller;
+            enc->rate_controller = new LcevcRateControl(rc_config, enc->stats_reader);
+        }
+        GST_DEBUG_OBJECT(enc, "Rate control %s at %u kbit/s", enc->rate_control, enc->bitrate);
+    } else {
+        delete enc->rate_controller;
+        enc->rate_controller = nullptr;
+    }
+    enc->retune = FALSE;
     
-    // Set output caps
-    GstCaps *outcaps = gst_caps_new_simple("video/x-lcevc",
-        "width", G_TYPE_INT, GST_VIDEO_INFO_WIDTH(info),
-        "height", G_TYPE_INT, GST_VIDEO_INFO_HEIGHT(info),
-        "framerate", GST_TYPE_FRACTION, 
-            GST_VIDEO_INFO_FPS_N(info), GST_VIDEO_INFO_FPS_D(info),
-        nullptr);
+    delete enc->lookahead;
+    enc->lookahead = nullptr;
+    if (enc->low_latency && enc->lookahead_depth)
+        GST_WARNING_OBJECT(enc, "Lookahead of %u frames ignored in low-latency mode",
+            enc->lookahead_depth);
+    if (gst_lcevc_enc_lookahead_depth(enc) || enc->rate_controller || enc->stats_writer)
+        enc->lookahead = new LcevcLookahead(GST_VIDEO_INFO_WIDTH(info),
+            GST_VIDEO_INFO_HEIGHT(info));
     
-    GstVideoCodecState *output_state = 
-        gst_video_encoder_set_output_state(encoder, outcaps, state);
-    gst_video_codec_state_unref(output_state);
+    // Set output caps. With a base codec they follow its output, see
+    // gst_lcevc_enc_base_caps().
+    if (!enc->base_enc) {
+        GstCaps *outcaps = gst_caps_new_simple("video/x-lcevc",
+            "width", G_TYPE_INT, GST_VIDEO_INFO_WIDTH(info),
+            "height", G_TYPE_INT, GST_VIDEO_INFO_HEIGHT(info),
+            "framerate", GST_TYPE_FRACTION,
+                GST_VIDEO_INFO_FPS_N(info), GST_VIDEO_INFO_FPS_D(info),
+            nullptr);
+
+        GstVideoCodecState *output_state =
+            gst_video_encoder_set_output_state(encoder, outcaps, state);
+        gst_video_codec_state_unref(output_state);
+    }
+    
+    // A frame can wait behind every other frame in flight, and before that
+    // behind the lookahead
+    if (GST_VIDEO_INFO_FPS_N(info) > 0) {
+        guint frames = enc->in_flight_limit + gst_lcevc_enc_lookahead_depth(enc);
+        GstClockTime latency = gst_util_uint64_scale(frames,
+            GST_VIDEO_INFO_FPS_D(info) * GST_SECOND, GST_VIDEO_INFO_FPS_N(info));
+        gst_video_encoder_set_latency(encoder, latency, latency);
+    }
     
     return TRUE;
 }
 
-// Create a simple image using the available constructors
-std::shared_ptr<lctm::Image> create_simple_image(const std::string& name, 
-                                                GstVideoCodecFrame* frame, 
-                                                GstVideoInfo* video_info,
-                                                uint64_t timestamp) {
+// Bytes of one sample of component c. The pixel stride of the interleaved
+// chroma of semi-planar formats spans the samples of both planes.
+static guint frame_comp_sample_size(const GstVideoFrame *vframe, guint c) {
+    guint bits = GST_VIDEO_FRAME_COMP_DEPTH(vframe, c) +
+        GST_VIDEO_FORMAT_INFO_SHIFT(vframe->info.finfo, c);
+
+    return bits > 8 ? 2 : 1;
+}
+
+// A plane can be viewed in place when its stride and start address are
+// whole samples; anything else has to go through the copy pool
+static gboolean frame_planes_are_wrappable(const GstVideoFrame *vframe) {
+    for (guint c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS(vframe); c++) {
+        gint size = (gint) frame_comp_sample_size(vframe, c);
+        gint stride = GST_VIDEO_FRAME_COMP_STRIDE(vframe, c);
+        guintptr data = (guintptr) GST_VIDEO_FRAME_COMP_DATA(vframe, c);
+
+        if (stride <= 0 || stride % size != 0 || data % size != 0)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+// Copy the input into a buffer from the ingest pool and map it. When the
+// input is split over several memories without a GstVideoMeta, extract it
+// row by row from the default layout of the caps, so it is not merged by
+// gst_buffer_map first and lands at the padded strides of the pool.
+static gboolean copy_frame_to_pool(GstLcevcEnc *enc, GstBuffer *inbuf,
+                                   const GstVideoFrame *src, GstVideoInfo *video_info,
+                                   GstVideoFrame *out) {
+    GstBuffer *copy = nullptr;
+
+    if (!enc->copy_pool ||
+        gst_buffer_pool_acquire_buffer(enc->copy_pool, &copy, nullptr) != GST_FLOW_OK) {
+        GST_ERROR_OBJECT(enc, "Failed to acquire buffer from ingest pool");
+        return FALSE;
+    }
+
+    GstVideoFrame dst;
+    if (!gst_video_frame_map(&dst, video_info, copy, GST_MAP_WRITE)) {
+        gst_buffer_unref(copy);
+        return FALSE;
+    }
+    if (src) {
+        gst_video_frame_copy(&dst, src);
+    } else {
+        guint copied = 0;   // planes, as a mask
+
+        for (guint c = 0; c < GST_VIDEO_INFO_N_COMPONENTS(video_info); c++) {
+            guint plane = GST_VIDEO_INFO_COMP_PLANE(video_info, c);
+            gsize offset = GST_VIDEO_INFO_PLANE_OFFSET(video_info, plane);
+            gint stride = GST_VIDEO_INFO_PLANE_STRIDE(video_info, plane);
+            gsize row_size = (gsize) GST_VIDEO_INFO_COMP_WIDTH(video_info, c) *
+                GST_VIDEO_INFO_COMP_PSTRIDE(video_info, c);
+            guint8 *data = static_cast<guint8 *>(GST_VIDEO_FRAME_PLANE_DATA(&dst, plane));
+
+            // Interleaved components share their plane, which holds all of them
+            if (copied & (1u << plane))
+                continue;
+            copied |= 1u << plane;
+            for (gint y = 0; y < GST_VIDEO_INFO_COMP_HEIGHT(video_info, c); y++) {
+                gst_buffer_extract(inbuf, offset + (gsize) y * stride,
+                    data + (gsize) y * GST_VIDEO_FRAME_PLANE_STRIDE(&dst, plane), row_size);
+            }
+        }
+    }
+    gst_video_frame_unmap(&dst);
+
+    // The mapped frame keeps its own reference on the pooled buffer
+    gboolean ret = gst_video_frame_map(out, video_info, copy, GST_MAP_READ);
+    gst_buffer_unref(copy);
+
+    if (ret)
+        enc->metrics->copy_fallbacks++;
+    return ret;
+}
+
+// Input of the encoder: the mapped input frame, the decoded base picture when
+// there is one, and the plane views into them
+struct LcevcInputFrame {
+    GstLcevcEnc *enc;
+    GList link;         // in free_inputs once released, data points back here
+    GstVideoFrame vframe;
+    GstVideoFrame base_vframe;  // mapped when picture.has_base is set
+    LcevcPicture picture;
+    GstBuffer *base_picture;    // for the base encoder, once encoded
+    GstBuffer *pyramid;         // mapped into pyramid_map, with renditions
+    GstMapInfo pyramid_map;
+    guint64 seq;        // output order
+    gboolean idr;
+    LcevcFrameAnalysis analysis;    // with a lookahead
+    LcevcRateControlFrame rc;       // step widths
+    guint base_qp;                  // of the base picture
+    gsize size;                     // of the enhancement, once encoded
+    LcevcEnhancementStats stats;    // first pass
+    GstLcevcEncodeInfo info;        // instrumentation
+    GstClockTime base_pushed;       // when the picture went to the base encoder
+    GstClockTime arrival;           // when handle_frame got the frame
+
+    // Low latency: the base picture went to the base encoder during the
+    // encode, and the enhancement is held here until the frame is finished.
+    // The flags after base_early are used under queue_lock.
+    GstBuffer *enhancement;
+    gboolean base_early;
+    gboolean base_sending;          // its access unit is being pushed as a subframe
+    gboolean base_sent;             // and has been
+    gboolean encoded;               // the enhancement waits for the access unit
+};
+
+// View the planes of a frame as they are: semi-planar chroma is read
+// interleaved, and MSB-aligned or 16-bit samples are shifted down by the
+// kernels as they read them
+static void view_frame_planes(const GstVideoFrame *vframe, LcevcSourcePlane *planes) {
+    for (guint c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS(vframe); c++) {
+        LcevcSourcePlane &plane = planes[c];
+        guint depth = GST_VIDEO_FRAME_COMP_DEPTH(vframe, c);
+        guint excess = depth > LCEVC_INTERNAL_DEPTH ? depth - LCEVC_INTERNAL_DEPTH : 0;
+
+        plane.data = GST_VIDEO_FRAME_COMP_DATA(vframe, c);
+        plane.stride = GST_VIDEO_FRAME_COMP_STRIDE(vframe, c);
+        plane.width = GST_VIDEO_FRAME_COMP_WIDTH(vframe, c);
+        plane.height = GST_VIDEO_FRAME_COMP_HEIGHT(vframe, c);
+        plane.bytes_per_sample = frame_comp_sample_size(vframe, c);
+        plane.shift = LCEVC_INTERNAL_DEPTH - (depth - excess);
+        plane.step = GST_VIDEO_FRAME_COMP_PSTRIDE(vframe, c) / plane.bytes_per_sample;
+        plane.drop = GST_VIDEO_FORMAT_INFO_SHIFT(vframe->info.finfo, c) + excess;
+    }
+}
+
+// A cleared input frame, from free_inputs when there is one. The static map
+// of the analysis keeps its storage.
+static LcevcInputFrame *gst_lcevc_enc_take_input(GstLcevcEnc *enc) {
+    LcevcInputFrame *input;
+    GList *link;
+
+    g_mutex_lock(&enc->input_lock);
+    link = g_queue_pop_head_link(&enc->free_inputs);
+    g_mutex_unlock(&enc->input_lock);
+
+    if (link) {
+        std::vector<uint8_t> static_map;
+
+        input = static_cast<LcevcInputFrame *>(link->data);
+        static_map.swap(input->analysis.static_map);
+        static_map.clear();
+        *input = LcevcInputFrame();
+        input->analysis.static_map.swap(static_map);
+    } else {
+        input = new LcevcInputFrame();
+    }
+    input->enc = enc;
+    input->link.data = input;
+    return input;
+}
+
+static void gst_lcevc_enc_recycle_input(LcevcInputFrame *input) {
+    GstLcevcEnc *enc = input->enc;
+
+    g_mutex_lock(&enc->input_lock);
+    g_queue_push_tail_link(&enc->free_inputs, &input->link);
+    g_mutex_unlock(&enc->input_lock);
+}
+
+static void gst_lcevc_enc_free_inputs(GstLcevcEnc *enc) {
+    GList *link;
+
+    while ((link = g_queue_pop_head_link(&enc->free_inputs)))
+        delete static_cast<LcevcInputFrame *>(link->data);
+}
+
+// Map the input frame and view its planes in place. The returned frame keeps
+// the input buffer mapped and referenced until it is released.
+static LcevcInputFrame *gst_lcevc_enc_ingest_frame(GstLcevcEnc *enc,
+    GstVideoCodecFrame *frame, GstVideoInfo *video_info) {
     if (!frame || !video_info || !frame->input_buffer) {
         return nullptr;
     }
 
-    // Convert GStreamer format to LCEVC format
-    lctm::ImageFormat image_format = gst_video_format_to_image_format(video_info->finfo->format);
-    if (image_format == lctm::IMAGE_FORMAT_NONE) {
+    GstBuffer *inbuf = frame->input_buffer;
+    LcevcInputFrame *input = gst_lcevc_enc_take_input(enc);
+    GstVideoFrame *vframe = &input->vframe;
+
+    // Mapping a multi-memory buffer without a video meta merges it, which is
+    // a hidden copy of its own
+    gboolean contiguous = gst_buffer_n_memory(inbuf) == 1 ||
+        gst_buffer_get_video_meta(inbuf) != nullptr;
+
+    if (contiguous) {
+        if (!gst_video_frame_map(vframe, video_info, inbuf, GST_MAP_READ)) {
+            GST_ERROR_OBJECT(enc, "Failed to map input frame");
+            gst_lcevc_enc_recycle_input(input);
+            return nullptr;
+        }
+
+        if (!frame_planes_are_wrappable(vframe)) {
+            GstVideoFrame src = *vframe;
+            gboolean copied = copy_frame_to_pool(enc, inbuf, &src, video_info, vframe);
+            gst_video_frame_unmap(&src);
+            if (!copied) {
+                GST_ERROR_OBJECT(enc, "Failed to copy input frame");
+                gst_lcevc_enc_recycle_input(input);
+                return nullptr;
+            }
+            GST_LOG_OBJECT(enc, "Input strides not sample aligned, copied frame");
+        }
+    } else {
+        if (!copy_frame_to_pool(enc, inbuf, nullptr, video_info, vframe)) {
+            GST_ERROR_OBJECT(enc, "Failed to copy input frame");
+            gst_lcevc_enc_recycle_input(input);
+            return nullptr;
+        }
+        GST_LOG_OBJECT(enc, "Input spread over %u memories, copied frame",
+            gst_buffer_n_memory(inbuf));
+    }
+
+    view_frame_planes(vframe, input->picture.planes);
+
+    return input;
+}
+
+static void release_input_frame(gpointer data) {
+    LcevcInputFrame *input = static_cast<LcevcInputFrame *>(data);
+
+    gst_video_frame_unmap(&input->vframe);
+    if (input->picture.has_base)
+        gst_video_frame_unmap(&input->base_vframe);
+    if (input->base_picture)
+        gst_buffer_unref(input->base_picture);
+    if (input->pyramid) {
+        gst_buffer_unmap(input->pyramid, &input->pyramid_map);
+        gst_buffer_unref(input->pyramid);
+    }
+    if (input->enhancement)
+        gst_buffer_unref(input->enhancement);
+    gst_lcevc_enc_recycle_input(input);
+}
+
+// Downsample the frame into a pyramid for the renditions, once for all of
+// them, and take the intermediate picture of the encode workers from it
+static gboolean gst_lcevc_enc_build_pyramid(GstLcevcEnc *enc, LcevcInputFrame *input) {
+    GstClockTime start = gst_util_get_timestamp();
+
+    if (gst_buffer_pool_acquire_buffer(enc->pyramid_pool, &input->pyramid, nullptr) !=
+        GST_FLOW_OK)
+        return FALSE;
+    if (!gst_buffer_map(input->pyramid, &input->pyramid_map, GST_MAP_WRITE)) {
+        gst_buffer_unref(input->pyramid);
+        input->pyramid = nullptr;
+        return FALSE;
+    }
+
+    enc->pyramid->build(input->picture.planes, input->pyramid_map.data, enc->pool);
+    enc->pyramid->picture(input->picture.planes, input->pyramid_map.data, 0, &input->picture);
+    input->info.stage_time[GST_LCEVC_ENCODE_STAGE_DOWNSCALE] = gst_util_get_timestamp() - start;
+    return TRUE;
+}
+
+// Largest PTS distance between a source frame and its base picture
+static GstClockTime gst_lcevc_enc_base_tolerance(GstLcevcEnc *enc) {
+    GstVideoInfo *info = &enc->input_state->info;
+
+    if (enc->base_pts_tolerance)
+        return enc->base_pts_tolerance;
+    if (GST_VIDEO_INFO_FPS_N(info) > 0)
+        return gst_util_uint64_scale(GST_VIDEO_INFO_FPS_D(info), GST_SECOND,
+            2 * GST_VIDEO_INFO_FPS_N(info));
+    return DEFAULT_BASE_PTS_JITTER;
+}
+
+// Take the base picture queued for the source frame at pts, or nullptr when
+// there is none. Base pictures further than the tolerance behind pts are
+// dropped; one further ahead is left for a later frame. We only wait for the
+// next one while sink_secondary can still deliver it. Called without the
+// stream lock.
+static GstBuffer *gst_lcevc_enc_pop_base(GstLcevcEnc *enc, GstClockTime pts,
+    GstClockTime tolerance) {
+    GstBuffer *base = nullptr;
+
+    if (!GST_CLOCK_TIME_IS_VALID(pts))
         return nullptr;
+
+    g_mutex_lock(&enc->base_lock);
+    while (enc->sink_secondary && !enc->base_flushing && !enc->base_interrupted) {
+        GstBuffer *head = static_cast<GstBuffer *>(g_queue_peek_head(&enc->base_queue));
+
+        if (head) {
+            GstClockTime base_pts = GST_BUFFER_PTS(head);
+
+            if (base_pts < pts && pts - base_pts > tolerance) {
+                GST_LOG_OBJECT(enc, "Dropping base picture %" GST_TIME_FORMAT
+                    ", source is at %" GST_TIME_FORMAT,
+                    GST_TIME_ARGS(base_pts), GST_TIME_ARGS(pts));
+                gst_buffer_unref(static_cast<GstBuffer *>(g_queue_pop_head(&enc->base_queue)));
+                g_cond_broadcast(&enc->base_cond);
+                continue;
+            }
+            if (base_pts <= pts || base_pts - pts <= tolerance) {
+                base = static_cast<GstBuffer *>(g_queue_pop_head(&enc->base_queue));
+                g_cond_broadcast(&enc->base_cond);
+            }
+            break;
+        }
+
+        if (enc->base_eos || !gst_pad_is_linked(enc->sink_secondary))
+            break;
+        g_cond_wait(&enc->base_cond, &enc->base_lock);
+    }
+    g_mutex_unlock(&enc->base_lock);
+
+    return base;
+}
+
+// View the decoded base picture as the base of the frame's LOQ-1. It must be
+// the source format at the LOQ-1 resolution of the scaling mode; anything
+// else is dropped and the frame is coded against its own downsampled
+// picture. Takes ownership of base.
+static void gst_lcevc_enc_attach_base(GstLcevcEnc *enc, LcevcInputFrame *input,
+    GstBuffer *base) {
+    const GstVideoInfo *info = &enc->input_state->info;
+    GstVideoInfo base_info;
+    guint base_width, base_height;
+    gboolean valid;
+
+    g_mutex_lock(&enc->base_lock);
+    valid = enc->base_info_valid;
+    base_info = enc->base_info;
+    g_mutex_unlock(&enc->base_lock);
+
+    gst_lcevc_enc_base_size(enc, info, &base_width, &base_height);
+    if (!valid ||
+        GST_VIDEO_INFO_WIDTH(&base_info) != (gint) base_width ||
+        GST_VIDEO_INFO_HEIGHT(&base_info) != (gint) base_height ||
+        GST_VIDEO_INFO_N_COMPONENTS(&base_info) != GST_VIDEO_INFO_N_COMPONENTS(info) ||
+        GST_VIDEO_FORMAT_INFO_W_SUB(base_info.finfo, 1) !=
+            GST_VIDEO_FORMAT_INFO_W_SUB(info->finfo, 1) ||
+        GST_VIDEO_FORMAT_INFO_H_SUB(base_info.finfo, 1) !=
+            GST_VIDEO_FORMAT_INFO_H_SUB(info->finfo, 1)) {
+        GST_WARNING_OBJECT(enc, "Base picture does not match the source downsampled to LOQ-1");
+        gst_buffer_unref(base);
+        return;
+    }
+
+    if (!gst_video_frame_map(&input->base_vframe, &base_info, base, GST_MAP_READ)) {
+        GST_WARNING_OBJECT(enc, "Failed to map base picture");
+        gst_buffer_unref(base);
+        return;
+    }
+    gst_buffer_unref(base);
+
+    if (!frame_planes_are_wrappable(&input->base_vframe)) {
+        GST_WARNING_OBJECT(enc, "Base picture strides not sample aligned, ignored");
+        gst_video_frame_unmap(&input->base_vframe);
+        return;
+    }
+
+    view_frame_planes(&input->base_vframe, input->picture.base);
+    input->picture.has_base = true;
+}
+
+static void gst_lcevc_output_pool_init(GstLcevcOutputPool *output) {
+    g_mutex_init(&output->lock);
+    output->pool = nullptr;
+    output->size = 0;
+}
+
+// Drop the pool once its stream has stopped. Its buffers are freed as
+// downstream releases them.
+static void gst_lcevc_output_pool_reset(GstObject *owner, GstLcevcOutputPool *output) {
+    if (output->pool) {
+        gst_buffer_pool_set_active(output->pool, FALSE);
+        gst_object_unref(output->pool);
+        output->pool = nullptr;
+    }
+    if (output->size)
+        GST_DEBUG_OBJECT(owner, "Output buffer high-water mark: %" G_GSIZE_FORMAT " bytes",
+            output->size);
+    output->size = 0;
+}
+
+static void gst_lcevc_output_pool_clear(GstLcevcOutputPool *output) {
+    if (output->pool) {
+        gst_buffer_pool_set_active(output->pool, FALSE);
+        gst_object_unref(output->pool);
+    }
+    g_mutex_clear(&output->lock);
+}
+
+// Get an output buffer of at least size bytes from output. Pooled buffers are
+// as large as the biggest frame so far; a bigger frame replaces the pool, with
+// some headroom so a slowly growing frame size does not replace it every time.
+// Buffers of the old pool are freed as downstream releases them.
+static GstBuffer *gst_lcevc_enc_acquire_output_buffer(GstLcevcEnc *enc,
+    GstLcevcOutputPool *output, gsize size) {
+    GstBuffer *buf = nullptr;
+
+    g_mutex_lock(&output->lock);
+    if (!output->pool || size > output->size) {
+        GstBufferPool *pool = gst_buffer_pool_new();
+        GstStructure *config = gst_buffer_pool_get_config(pool);
+        gsize pool_size = GST_ROUND_UP_N(size + size / 4, 4096);
+
+        gst_buffer_pool_config_set_params(config, nullptr, pool_size, enc->in_flight_limit, 0);
+        if (gst_buffer_pool_set_config(pool, config) && gst_buffer_pool_set_active(pool, TRUE)) {
+            GST_DEBUG_OBJECT(enc, "Output buffers grown to %" G_GSIZE_FORMAT " bytes", pool_size);
+            if (output->pool) {
+                gst_buffer_pool_set_active(output->pool, FALSE);
+                gst_object_unref(output->pool);
+            }
+            output->pool = pool;
+            output->size = pool_size;
+        } else {
+            GST_WARNING_OBJECT(enc, "Failed to configure output buffer pool");
+            gst_object_unref(pool);
+        }
+    }
+
+    if (output->pool && size <= output->size &&
+        gst_buffer_pool_acquire_buffer(output->pool, &buf, nullptr) == GST_FLOW_OK)
+        gst_buffer_set_size(buf, size);
+    g_mutex_unlock(&output->lock);
+
+    if (!buf) {
+        buf = gst_buffer_new_allocate(nullptr, size, nullptr);
+        enc->metrics->pool_misses++;
     }
+    return buf;
+}
+
+// Downsampled picture of the frame just encoded by enhancement, for the base
+// encoder
+static GstBuffer *gst_lcevc_enc_write_base_picture(GstLcevcEnc *enc,
+    LcevcEnhancementEncoder *enhancement, GstVideoCodecFrame *frame) {
+    LcevcInputFrame *input = static_cast<LcevcInputFrame *>(
+        gst_video_codec_frame_get_user_data(frame));
+    LcevcOutputPlane planes[LCEVC_MAX_PLANES];
+    GstBuffer *buf = nullptr;
+    GstVideoFrame vframe;
 
-    // Map the GStreamer buffer
-    GstMapInfo map_info;
-    if (!gst_buffer_map(frame->input_buffer, &map_info, GST_MAP_READ)) {
-        GST_ERROR("Failed to map GStreamer buffer");
+    if (gst_buffer_pool_acquire_buffer(enc->base_enc_pool, &buf, nullptr) != GST_FLOW_OK)
         return nullptr;
+    if (!gst_video_frame_map(&vframe, &enc->base_enc_info, buf, GST_MAP_WRITE)) {
+        gst_buffer_unref(buf);
+        return nullptr;
+    }
+
+    for (guint c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS(&vframe); c++) {
+        LcevcOutputPlane &plane = planes[c];
+
+        plane.data = static_cast<uint8_t *>(GST_VIDEO_FRAME_COMP_DATA(&vframe, c));
+        plane.stride = GST_VIDEO_FRAME_COMP_STRIDE(&vframe, c);
+        plane.width = GST_VIDEO_FRAME_COMP_WIDTH(&vframe, c);
+        plane.height = GST_VIDEO_FRAME_COMP_HEIGHT(&vframe, c);
+        plane.bytes_per_sample = GST_VIDEO_FRAME_COMP_PSTRIDE(&vframe, c);
+        plane.shift = LCEVC_INTERNAL_DEPTH - GST_VIDEO_FRAME_COMP_DEPTH(&vframe, c);
     }
+    enhancement->write_base(input->picture, planes);
+    gst_video_frame_unmap(&vframe);
+
+    GST_BUFFER_PTS(buf) = frame->pts;
+    GST_BUFFER_DURATION(buf) = frame->duration;
+    return buf;
+}
+
+// Low latency: hand the base picture to the base encoder as soon as the
+// downsampled picture is complete, so that it is encoded during the LOQ-0
+// stages. The frame waits for its access unit in base_enc_frames from then
+// on, with a reference of its own. Called from the encode of the frame.
+static void gst_lcevc_enc_push_base_early(GstLcevcEnc *enc,
+    LcevcEnhancementEncoder *enhancement, GstVideoCodecFrame *frame) {
+    LcevcInputFrame *input = static_cast<LcevcInputFrame *>(
+        gst_video_codec_frame_get_user_data(frame));
+    GstClockTime start = gst_util_get_timestamp();
+    GstBuffer *picture = gst_lcevc_enc_write_base_picture(enc, enhancement, frame);
+    GstFlowReturn ret;
+
+    // Tried again, and reported, once the encode is done
+    if (!picture)
+        return;
+    input->info.stage_time[GST_LCEVC_ENCODE_STAGE_BASE] = gst_util_get_timestamp() - start;
+
+    // The access unit may come back before the encode is done
+    if (input->idr)
+        GST_VIDEO_CODEC_FRAME_SET_SYNC_POINT(frame);
+
+    g_mutex_lock(&enc->queue_lock);
+    input->base_early = TRUE;
+    input->base_pushed = gst_util_get_timestamp();
+    g_queue_push_tail(&enc->base_enc_frames, gst_video_codec_frame_ref(frame));
+    ret = gst_lcevc_base_push(enc->base_enc, picture, input->idr, input->base_qp);
+    if (ret != GST_FLOW_OK)
+        enc->worker_flow = ret;
+    g_mutex_unlock(&enc->queue_lock);
+}
+
+// Run an encoder context on one frame and attach the result to it. Called
+// from a worker thread without the stream lock held.
+static GstFlowReturn gst_lcevc_enc_encode_frame(GstLcevcEnc *enc,
+    LcevcEnhancementEncoder *enhancement, GstVideoCodecFrame *frame) {
+    LcevcInputFrame *input = static_cast<LcevcInputFrame *>(
+        gst_video_codec_frame_get_user_data(frame));
 
     try {
-        // Create image description
-        lctm::ImageDescription desc(image_format, video_info->width, video_info->height);
-        
-        // For now, create a simple image without planes
-        // This will need to be adapted based on the actual LCEVC API
-        auto image = std::make_shared<lctm::Image>();
-        
-        gst_buffer_unmap(frame->input_buffer, &map_info);
-        return image;
-        
-    } catch (const std::exception& e) {
-        GST_ERROR("Error creating image: %s", e.what());
-        gst_buffer_unmap(frame->input_buffer, &map_info);
+        // The first pass stops at the stats, the frame is dropped
+        if (enc->stats_writer) {
+            enhancement->analyse(input->picture, &input->stats);
+            return GST_FLOW_OK;
+        }
+
+        if (input->rc.step_width_loq0)
+            enhancement->set_step_widths(input->rc.step_width_loq0, input->rc.step_width_loq1);
+        if (enc->low_latency && enc->base_enc_pool) {
+            enhancement->encode(input->picture, input->idr, [&]() {
+                gst_lcevc_enc_push_base_early(enc, enhancement, frame);
+            });
+        } else {
+            enhancement->encode(input->picture, input->idr);
+        }
+        if (enc->temporal_enabled)
+            GST_LOG_OBJECT(enc, "%u static tiles skipped", enhancement->skipped_tiles());
+
+        GstClockTime *stage_time = input->info.stage_time;
+        GstClockTime start = gst_util_get_timestamp();
+        stage_time[GST_LCEVC_ENCODE_STAGE_DOWNSCALE] +=
+            enhancement->stage_time(LCEVC_STAGE_DOWNSAMPLE);
+        stage_time[GST_LCEVC_ENCODE_STAGE_UPSAMPLE] =
+            enhancement->stage_time(LCEVC_STAGE_UPSAMPLE);
+        stage_time[GST_LCEVC_ENCODE_STAGE_RESIDUAL] =
+            enhancement->stage_time(LCEVC_STAGE_RESIDUAL);
+        stage_time[GST_LCEVC_ENCODE_STAGE_TRANSFORM] =
+            enhancement->stage_time(LCEVC_STAGE_TRANSFORM);
+        stage_time[GST_LCEVC_ENCODE_STAGE_ENTROPY] =
+            enhancement->stage_time(LCEVC_STAGE_ENTROPY);
+        input->info.loq_bytes[0] = enhancement->loq_bytes(0);
+        input->info.loq_bytes[1] = enhancement->loq_bytes(1);
+
+        gsize size = enhancement->nal_size();
+        input->size = size;
+        GstBuffer *outbuf = gst_lcevc_enc_acquire_output_buffer(enc, &enc->output, size);
+        GstMapInfo map;
+        if (!gst_buffer_map(outbuf, &map, GST_MAP_WRITE)) {
+            gst_buffer_unref(outbuf);
+            GST_ELEMENT_ERROR(enc, RESOURCE, WRITE, (nullptr),
+                ("Failed to map output buffer"));
+            return GST_FLOW_ERROR;
+        }
+        enhancement->write_nal(map.data);
+        gst_buffer_unmap(outbuf, &map);
+
+        // Once the base picture is out the base thread may be pushing the frame
+        if (input->base_early) {
+            input->enhancement = outbuf;
+        } else {
+            frame->output_buffer = outbuf;
+            frame->dts = frame->pts;
+        }
+        stage_time[GST_LCEVC_ENCODE_STAGE_OUTPUT] = gst_util_get_timestamp() - start;
+
+        if (enc->base_enc_pool && !input->base_early) {
+            start = gst_util_get_timestamp();
+            input->base_picture = gst_lcevc_enc_write_base_picture(enc, enhancement, frame);
+            stage_time[GST_LCEVC_ENCODE_STAGE_BASE] = gst_util_get_timestamp() - start;
+            if (!input->base_picture) {
+                GST_ELEMENT_ERROR(enc, RESOURCE, WRITE, (nullptr),
+                    ("Failed to write base picture"));
+                return GST_FLOW_ERROR;
+            }
+        }
+        if (input->idr && !input->base_early)
+            GST_VIDEO_CODEC_FRAME_SET_SYNC_POINT(frame);
+
+        GST_LOG_OBJECT(enc, "Encoded frame %" G_GUINT64_FORMAT ": %" G_GSIZE_FORMAT " bytes",
+            input->seq, size);
+
+    } catch (const std::exception &e) {
+        GST_ELEMENT_ERROR(enc, STREAM, ENCODE, (nullptr),
+            ("Encoding failed: %s", e.what()));
+        return GST_FLOW_ERROR;
+    }
+
+    return GST_FLOW_OK;
+}
+
+static gint compare_frame_seq(gconstpointer a, gconstpointer b, gpointer) {
+    const LcevcInputFrame *ia = static_cast<const LcevcInputFrame *>(
+        gst_video_codec_frame_get_user_data((GstVideoCodecFrame *) a));
+    const LcevcInputFrame *ib = static_cast<const LcevcInputFrame *>(
+        gst_video_codec_frame_get_user_data((GstVideoCodecFrame *) b));
+
+    return ia->seq < ib->seq ? -1 : ia->seq > ib->seq ? 1 : 0;
+}
+
+// Append the record of a frame to the stats file of a first pass
+static gboolean gst_lcevc_enc_write_stats(GstLcevcEnc *enc, GstVideoCodecFrame *frame) {
+    LcevcInputFrame *input = static_cast<LcevcInputFrame *>(
+        gst_video_codec_frame_get_user_data(frame));
+    LcevcStatsRecord record = LcevcStatsRecord();
+
+    record.pts = frame->pts;
+    record.flags = input->idr ? LCEVC_STATS_REFRESH : 0;
+    record.detail_cost = input->analysis.detail_cost;
+    record.intra_cost = input->analysis.intra_cost;
+    record.inter_cost = input->analysis.inter_cost;
+    for (unsigned loq = 0; loq < 2; loq++) {
+        record.residual_energy[loq] = input->stats.residual_energy[loq];
+        for (unsigned k = 0; k < LCEVC_COEFFICIENT_CLASSES; k++)
+            record.coefficients[loq][k] = input->stats.coefficients[loq][k];
+    }
+
+    if (!enc->stats_writer->append(record)) {
+        GST_ELEMENT_ERROR(enc, RESOURCE, WRITE, (nullptr),
+            ("Failed to write stats file %s", enc->stats_file));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void gst_lcevc_enc_reset_report(GstLcevcEnc *enc) {
+    enc->report_frames = 0;
+    memset(enc->report_time, 0, sizeof(enc->report_time));
+    memset(enc->report_time_max, 0, sizeof(enc->report_time_max));
+    memset(enc->report_bytes, 0, sizeof(enc->report_bytes));
+    memset(enc->report_depth_max, 0, sizeof(enc->report_depth_max));
+}
+
+// Attach the instrumentation of a frame about to be finished to its output
+// buffer and add it to the statistics and the report. Returns the report
+// message once it holds report_interval frames, to be posted without
+// queue_lock, which must be held.
+static GstMessage *gst_lcevc_enc_report_frame(GstLcevcEnc *enc, GstVideoCodecFrame *frame) {
+    LcevcInputFrame *input = static_cast<LcevcInputFrame *>(
+        gst_video_codec_frame_get_user_data(frame));
+    const GstLcevcEncodeInfo &info = input->info;
+
+    // The first pass outputs nothing on purpose
+    if (!frame->output_buffer) {
+        if (!enc->stats_writer)
+            enc->metrics->frames_dropped++;
+        return nullptr;
+    }
+    gst_buffer_add_lcevc_encode_meta(frame->output_buffer, &info);
+
+    enc->metrics->frames_encoded++;
+    enc->metrics->latency.record(gst_util_get_timestamp() - input->arrival);
+    enc->metrics->bytes_out[LCEVC_METRICS_LOQ0] += info.loq_bytes[0];
+    enc->metrics->bytes_out[LCEVC_METRICS_LOQ1] += info.loq_bytes[1];
+    if (!enc->report_interval)
         return nullptr;
+
+    for (guint s = 0; s < GST_LCEVC_ENCODE_STAGE_COUNT; s++) {
+        enc->report_time[s] += info.stage_time[s];
+        enc->report_time_max[s] = MAX(enc->report_time_max[s], info.stage_time[s]);
+    }
+    for (guint loq = 0; loq < 2; loq++)
+        enc->report_bytes[loq] += info.loq_bytes[loq];
+    for (guint q = 0; q < GST_LCEVC_ENCODE_QUEUE_COUNT; q++)
+        enc->report_depth_max[q] = MAX(enc->report_depth_max[q], info.queue_depth[q]);
+    if (++enc->report_frames < enc->report_interval)
+        return nullptr;
+
+    // Stage times and sizes are means over the frames, queue depths maxima
+    guint frames = enc->report_frames;
+    GstStructure *s = gst_structure_new("lcevcenc-report",
+        "frames", G_TYPE_UINT, frames,
+        "loq0-bytes", G_TYPE_UINT64, enc->report_bytes[0] / frames,
+        "loq1-bytes", G_TYPE_UINT64, enc->report_bytes[1] / frames,
+        nullptr);
+
+    for (guint i = 0; i < GST_LCEVC_ENCODE_STAGE_COUNT; i++) {
+        const gchar *name = gst_lcevc_encode_stage_get_name((GstLcevcEncodeStage) i);
+        gchar *mean_field = g_strdup_printf("%s-time", name);
+        gchar *max_field = g_strdup_printf("%s-time-max", name);
+
+        gst_structure_set(s,
+            mean_field, G_TYPE_UINT64, enc->report_time[i] / frames,
+            max_field, G_TYPE_UINT64, enc->report_time_max[i],
+            nullptr);
+        g_free(mean_field);
+        g_free(max_field);
+    }
+    for (guint i = 0; i < GST_LCEVC_ENCODE_QUEUE_COUNT; i++) {
+        gchar *field = g_strdup_printf("%s-depth-max",
+            gst_lcevc_encode_queue_get_name((GstLcevcEncodeQueue) i));
+
+        gst_structure_set(s, field, G_TYPE_UINT, enc->report_depth_max[i], nullptr);
+        g_free(field);
+    }
+
+    gst_lcevc_enc_reset_report(enc);
+    return gst_message_new_element(GST_OBJECT(enc), s);
+}
+
+// Finish the encoded frames that are next in output order. Called with
+// queue_lock held, which is dropped around finish_frame; only one worker
+// pushes at a time so frames leave in the order they came in.
+static void gst_lcevc_enc_push_ready_frames(GstLcevcEnc *enc) {
+    GstVideoEncoder *encoder = GST_VIDEO_ENCODER(enc);
+
+    if (enc->pushing)
+        return;
+    enc->pushing = TRUE;
+
+    while (!g_queue_is_empty(&enc->reorder_queue)) {
+        GstVideoCodecFrame *frame =
+            static_cast<GstVideoCodecFrame *>(g_queue_peek_head(&enc->reorder_queue));
+        LcevcInputFrame *input = static_cast<LcevcInputFrame *>(
+            gst_video_codec_frame_get_user_data(frame));
+        if (input->seq != enc->push_seq)
+            break;
+
+        g_queue_pop_head(&enc->reorder_queue);
+        enc->push_seq++;
+        if (enc->rate_controller)
+            enc->rate_controller->frame_done(input->rc, input->size);
+        if (enc->stats_writer && !gst_lcevc_enc_write_stats(enc, frame))
+            enc->worker_flow = GST_FLOW_ERROR;
+
+        // In low-latency mode the frame already waits for its access unit.
+        // When that was pushed as a subframe the enhancement follows it here,
+        // otherwise it is muxed behind the access unit when it comes.
+        if (input->base_early) {
+            while (input->base_sending)
+                g_cond_wait(&enc->queue_cond, &enc->queue_lock);
+
+            frame->output_buffer = input->enhancement;
+            input->enhancement = nullptr;
+            if (!input->base_sent) {
+                input->encoded = TRUE;
+                gst_video_codec_frame_unref(frame);     // base_enc_frames has its own
+                enc->in_flight--;
+                g_cond_broadcast(&enc->queue_cond);
+                continue;
+            }
+            g_queue_remove(&enc->base_enc_frames, frame);
+            gst_video_codec_frame_unref(frame);
+        }
+
+        // With a base codec the frame goes on to wait for its access unit.
+        // It no longer counts as in flight: the base encoder can hold more
+        // frames than that before its first output. submit_frame bounds
+        // them by its latency instead.
+        if (input->base_picture) {
+            GstBuffer *picture = input->base_picture;
+            GstFlowReturn ret;
+
+            input->base_picture = nullptr;
+            input->base_pushed = gst_util_get_timestamp();
+            g_queue_push_tail(&enc->base_enc_frames, frame);
+            enc->in_flight--;
+            g_cond_broadcast(&enc->queue_cond);
+
+            ret = gst_lcevc_base_push(enc->base_enc, picture, input->idr, input->base_qp);
+            if (ret != GST_FLOW_OK)
+                enc->worker_flow = ret;
+            continue;
+        }
+
+        GstMessage *report = gst_lcevc_enc_report_frame(enc, frame);
+        g_mutex_unlock(&enc->queue_lock);
+
+        if (report)
+            gst_element_post_message(GST_ELEMENT(enc), report);
+
+        // A frame that failed to encode has no output buffer and is dropped
+        GST_VIDEO_ENCODER_STREAM_LOCK(encoder);
+        GstFlowReturn ret = gst_video_encoder_finish_frame(encoder, frame);
+        GST_VIDEO_ENCODER_STREAM_UNLOCK(encoder);
+
+        g_mutex_lock(&enc->queue_lock);
+        if (ret != GST_FLOW_OK) {
+            GST_DEBUG_OBJECT(enc, "Worker got flow %s", gst_flow_get_name(ret));
+            enc->worker_flow = ret;
+        }
+        enc->in_flight--;
+        g_cond_broadcast(&enc->queue_cond);
+    }
+
+    enc->pushing = FALSE;
+}
+
+// Low latency: push the access unit of a frame whose enhancement is still
+// being encoded as the first subframe of the frame. base_sending is set, the
+// worker waits for it to clear before it pushes the enhancement. Called on
+// the base thread.
+static GstFlowReturn gst_lcevc_enc_push_base_subframe(GstLcevcEnc *enc,
+    GstVideoCodecFrame *frame, GstBuffer *au) {
+    GstVideoEncoder *encoder = GST_VIDEO_ENCODER(enc);
+    LcevcInputFrame *input = static_cast<LcevcInputFrame *>(
+        gst_video_codec_frame_get_user_data(frame));
+    GstFlowReturn ret;
+
+    if (!input->idr || GST_BUFFER_FLAG_IS_SET(au, GST_BUFFER_FLAG_DELTA_UNIT))
+        GST_VIDEO_CODEC_FRAME_UNSET_SYNC_POINT(frame);
+
+    enc->metrics->bytes_out[LCEVC_METRICS_BASE] += gst_buffer_get_size(au);
+    input->info.stage_time[GST_LCEVC_ENCODE_STAGE_BASE] +=
+        gst_util_get_timestamp() - input->base_pushed;
+
+    GST_VIDEO_ENCODER_STREAM_LOCK(encoder);
+    frame->output_buffer = au;
+    frame->dts = GST_CLOCK_TIME_NONE;
+    ret = gst_video_encoder_finish_subframe(encoder, frame);
+    GST_VIDEO_ENCODER_STREAM_UNLOCK(encoder);
+
+    g_mutex_lock(&enc->queue_lock);
+    input->base_sending = FALSE;
+    input->base_sent = TRUE;
+    if (ret != GST_FLOW_OK)
+        enc->worker_flow = ret;
+    g_cond_broadcast(&enc->queue_cond);
+    g_mutex_unlock(&enc->queue_lock);
+
+    return ret;
+}
+
+// Access unit from the base encoder, in its decode order: mux it ahead of the
+// enhancement of the frame with the same PTS and finish that frame. Called
+// on the base thread.
+static GstFlowReturn gst_lcevc_enc_base_output(GstBuffer *au, gpointer user_data) {
+    GstLcevcEnc *enc = GST_LCEVC_ENC(user_data);
+    GstVideoEncoder *encoder = GST_VIDEO_ENCODER(enc);
+    GstVideoCodecFrame *frame = nullptr;
+    GstMessage *report;
+    GstFlowReturn ret;
+
+    g_mutex_lock(&enc->queue_lock);
+    for (GList *l = enc->base_enc_frames.head; l; l = l->next) {
+        GstVideoCodecFrame *pending = static_cast<GstVideoCodecFrame *>(l->data);
+        LcevcInputFrame *pending_input = static_cast<LcevcInputFrame *>(
+            gst_video_codec_frame_get_user_data(pending));
+
+        if (pending->pts != GST_BUFFER_PTS(au))
+            continue;
+
+        // Low latency, the enhancement is not ready yet: the access unit
+        // goes ahead of it
+        if (pending_input->base_early && !pending_input->encoded) {
+            pending_input->base_sending = TRUE;
+            g_mutex_unlock(&enc->queue_lock);
+            return gst_lcevc_enc_push_base_subframe(enc, pending, au);
+        }
+        frame = pending;
+        g_queue_delete_link(&enc->base_enc_frames, l);
+        g_cond_broadcast(&enc->queue_cond);
+        break;
+    }
+    g_mutex_unlock(&enc->queue_lock);
+
+    if (!frame) {
+        GST_WARNING_OBJECT(enc, "No frame for base access unit at %" GST_TIME_FORMAT,
+            GST_TIME_ARGS(GST_BUFFER_PTS(au)));
+        gst_buffer_unref(au);
+        return GST_FLOW_OK;
     }
+
+    // A frame can only be decoded on its own when both layers are
+    LcevcInputFrame *input = static_cast<LcevcInputFrame *>(
+        gst_video_codec_frame_get_user_data(frame));
+    if (!input->idr || GST_BUFFER_FLAG_IS_SET(au, GST_BUFFER_FLAG_DELTA_UNIT))
+        GST_VIDEO_CODEC_FRAME_UNSET_SYNC_POINT(frame);
+
+    enc->metrics->bytes_out[LCEVC_METRICS_BASE] += gst_buffer_get_size(au);
+
+    // The base encoder may reorder frames; the base class works out the DTS
+    frame->output_buffer = gst_buffer_append(au, frame->output_buffer);
+    frame->dts = GST_CLOCK_TIME_NONE;
+
+    input->info.stage_time[GST_LCEVC_ENCODE_STAGE_BASE] +=
+        gst_util_get_timestamp() - input->base_pushed;
+    g_mutex_lock(&enc->queue_lock);
+    report = gst_lcevc_enc_report_frame(enc, frame);
+    g_mutex_unlock(&enc->queue_lock);
+    if (report)
+        gst_element_post_message(GST_ELEMENT(enc), report);
+
+    GST_VIDEO_ENCODER_STREAM_LOCK(encoder);
+    ret = gst_video_encoder_finish_frame(encoder, frame);
+    GST_VIDEO_ENCODER_STREAM_UNLOCK(encoder);
+
+    if (ret != GST_FLOW_OK) {
+        g_mutex_lock(&enc->queue_lock);
+        enc->worker_flow = ret;
+        g_mutex_unlock(&enc->queue_lock);
+    }
+    return ret;
+}
+
+// Output caps are those of the base encoder, at the source resolution and
+// marked as carrying LCEVC. Called on the base thread.
+static void gst_lcevc_enc_base_caps(GstCaps *caps, gpointer user_data) {
+    GstLcevcEnc *enc = GST_LCEVC_ENC(user_data);
+    GstVideoEncoder *encoder = GST_VIDEO_ENCODER(enc);
+    GstCaps *outcaps = gst_caps_copy(caps);
+
+    GST_VIDEO_ENCODER_STREAM_LOCK(encoder);
+    gst_caps_set_simple(outcaps,
+        "width", G_TYPE_INT, GST_VIDEO_INFO_WIDTH(&enc->input_state->info),
+        "height", G_TYPE_INT, GST_VIDEO_INFO_HEIGHT(&enc->input_state->info),
+        "lcevc", G_TYPE_BOOLEAN, TRUE,
+        nullptr);
+    GstVideoCodecState *output_state =
+        gst_video_encoder_set_output_state(encoder, outcaps, enc->input_state);
+    gst_video_codec_state_unref(output_state);
+    GST_VIDEO_ENCODER_STREAM_UNLOCK(encoder);
+}
+
+// The base encoder took new caps and holds this long on to a picture. The
+// frames waiting for their access unit are bounded from now on by as many
+// frames at the source frame rate, and not at all when it cannot tell.
+// Called on the base thread.
+static void gst_lcevc_enc_base_latency(GstClockTime latency, gpointer user_data) {
+    GstLcevcEnc *enc = GST_LCEVC_ENC(user_data);
+    const GstVideoInfo *info = &enc->base_enc_info;
+    guint frames = G_MAXUINT;
+
+    if (GST_CLOCK_TIME_IS_VALID(latency)) {
+        gboolean known = GST_VIDEO_INFO_FPS_N(info) > 0;
+        gint fps_n = known ? GST_VIDEO_INFO_FPS_N(info) : (gint) enc->fps;
+        gint fps_d = known ? GST_VIDEO_INFO_FPS_D(info) : 1;
+
+        frames = (guint) MIN(gst_util_uint64_scale_ceil(latency, fps_n, fps_d * GST_SECOND),
+            G_MAXUINT);
+    } else {
+        GST_WARNING_OBJECT(enc, "Base encoder reports no latency, frames waiting for it "
+            "are not bounded");
+    }
+
+    g_mutex_lock(&enc->queue_lock);
+    enc->base_enc_latency = frames;
+    g_cond_broadcast(&enc->queue_cond);
+    g_mutex_unlock(&enc->queue_lock);
+}
+
+// As many frames are waiting for a base access unit as the base encoder and
+// the workers hold, under queue_lock
+static gboolean gst_lcevc_enc_base_full(GstLcevcEnc *enc) {
+    guint waiting = enc->base_enc_frames.length;
+
+    return waiting >= enc->in_flight_limit &&
+        waiting - enc->in_flight_limit >= enc->base_enc_latency;
+}
+
+// Release the frames still waiting for a base access unit
+static void gst_lcevc_enc_clear_base_enc_frames(GstLcevcEnc *enc) {
+    GstVideoCodecFrame *frame;
+
+    g_mutex_lock(&enc->queue_lock);
+    while ((frame = static_cast<GstVideoCodecFrame *>(g_queue_pop_head(&enc->base_enc_frames))))
+        gst_video_codec_frame_unref(frame);
+    g_cond_broadcast(&enc->queue_cond);
+    g_mutex_unlock(&enc->queue_lock);
+}
+
+// Encode worker: pops frames in arrival order and hands them to the reorder
+// queue, so output stays in PTS order whichever worker finishes first
+static gpointer gst_lcevc_enc_worker(gpointer data) {
+    GstLcevcEncWorker *worker = static_cast<GstLcevcEncWorker *>(data);
+    GstLcevcEnc *enc = worker->enc;
+
+    // Output buffers are first touched here, so they come from the node of
+    // the pool along with the surfaces
+    if (!enc->placement->empty() && !lcevc_apply_placement(*enc->placement))
+        GST_WARNING_OBJECT(enc, "Failed to pin encode worker");
+
+    g_mutex_lock(&enc->queue_lock);
+    while (TRUE) {
+        while (g_queue_is_empty(&enc->frame_queue) && !enc->worker_stop)
+            g_cond_wait(&enc->queue_cond, &enc->queue_lock);
+        if (enc->worker_stop)
+            break;
+
+        GstVideoCodecFrame *frame =
+            static_cast<GstVideoCodecFrame *>(g_queue_pop_head(&enc->frame_queue));
+        g_mutex_unlock(&enc->queue_lock);
+
+        GstFlowReturn ret = gst_lcevc_enc_encode_frame(enc, worker->enhancement, frame);
+
+        g_mutex_lock(&enc->queue_lock);
+        if (ret != GST_FLOW_OK)
+            enc->worker_flow = ret;
+        g_queue_insert_sorted(&enc->reorder_queue, frame, compare_frame_seq, nullptr);
+        gst_lcevc_enc_push_ready_frames(enc);
+    }
+    g_mutex_unlock(&enc->queue_lock);
+
+    return nullptr;
+}
+
+// Replace the workers with n_workers new ones, each with its own encoder
+// context for config
+static gboolean gst_lcevc_enc_create_workers(GstLcevcEnc *enc,
+    const LcevcEnhancementConfig &config, guint n_workers) {
+    gst_lcevc_enc_free_workers(enc);
+
+    enc->workers = g_new0(GstLcevcEncWorker, n_workers);
+    enc->n_workers = n_workers;
+
+    try {
+        for (guint i = 0; i < n_workers; i++) {
+            enc->workers[i].enc = enc;
+            enc->workers[i].enhancement = new LcevcEnhancementEncoder(config, enc->pool);
+        }
+    } catch (const std::exception &e) {
+        GST_ERROR_OBJECT(enc, "Failed to create encoder: %s", e.what());
+        gst_lcevc_enc_free_workers(enc);
+        return FALSE;
+    }
+
+    gst_lcevc_enc_start_workers(enc);
+    return TRUE;
+}
+
+// Give drained workers a new configuration. As long as their number is the
+// same the threads keep running and the encoder contexts keep the buffers
+// they have, otherwise they are created again.
+static gboolean gst_lcevc_enc_configure_workers(GstLcevcEnc *enc,
+    const LcevcEnhancementConfig &config, guint n_workers) {
+    if (n_workers != enc->n_workers)
+        return gst_lcevc_enc_create_workers(enc, config, n_workers);
+
+    try {
+        for (guint i = 0; i < n_workers; i++)
+            enc->workers[i].enhancement->configure(config);
+    } catch (const std::exception &e) {
+        GST_WARNING_OBJECT(enc, "Failed to reconfigure encoder: %s", e.what());
+        return gst_lcevc_enc_create_workers(enc, config, n_workers);
+    }
+
+    g_mutex_lock(&enc->queue_lock);
+    enc->worker_flow = GST_FLOW_OK;
+    g_mutex_unlock(&enc->queue_lock);
+    return TRUE;
+}
+
+static void gst_lcevc_enc_free_workers(GstLcevcEnc *enc) {
+    gst_lcevc_enc_stop_workers(enc);
+
+    for (guint i = 0; i < enc->n_workers; i++)
+        delete enc->workers[i].enhancement;
+    g_free(enc->workers);
+    enc->workers = nullptr;
+    enc->n_workers = 0;
+}
+
+static void gst_lcevc_enc_start_workers(GstLcevcEnc *enc) {
+    enc->worker_stop = FALSE;
+    enc->worker_flow = GST_FLOW_OK;
+    enc->pushing = FALSE;
+    enc->in_flight = 0;
+    enc->next_seq = 0;
+    enc->push_seq = 0;
+
+    for (guint i = 0; i < enc->n_workers; i++)
+        enc->workers[i].thread = g_thread_new("lcevcenc-worker",
+            gst_lcevc_enc_worker, &enc->workers[i]);
+}
+
+// Stop the workers and drop whatever is still queued or waiting for its
+// turn. The base class owns the frames themselves, we only release our
+// references.
+static void gst_lcevc_enc_stop_workers(GstLcevcEnc *enc) {
+    if (!enc->n_workers || !enc->workers[0].thread)
+        return;
+
+    g_mutex_lock(&enc->queue_lock);
+    enc->worker_stop = TRUE;
+    g_cond_broadcast(&enc->queue_cond);
+    g_mutex_unlock(&enc->queue_lock);
+
+    for (guint i = 0; i < enc->n_workers; i++) {
+        g_thread_join(enc->workers[i].thread);
+        enc->workers[i].thread = nullptr;
+    }
+
+    GstVideoCodecFrame *frame;
+    while ((frame = static_cast<GstVideoCodecFrame *>(g_queue_pop_head(&enc->frame_queue))))
+        gst_video_codec_frame_unref(frame);
+    while ((frame = static_cast<GstVideoCodecFrame *>(g_queue_pop_head(&enc->reorder_queue))))
+        gst_video_codec_frame_unref(frame);
+    enc->in_flight = 0;
+}
+
+// Renditions of the element, each with a reference of its own, to go
+// through without queue_lock
+static GList *gst_lcevc_enc_list_renditions(GstLcevcEnc *enc) {
+    GList *renditions = nullptr;
+
+    g_mutex_lock(&enc->queue_lock);
+    for (GList *l = enc->renditions; l; l = l->next)
+        renditions = g_list_prepend(renditions, gst_object_ref(l->data));
+    g_mutex_unlock(&enc->queue_lock);
+    return g_list_reverse(renditions);
+}
+
+// Encode a frame of a rendition from its level of the pyramid and push it.
+// Called from the rendition thread without any lock held.
+static GstFlowReturn gst_lcevc_enc_encode_rendition(GstLcevcEnc *enc,
+    GstLcevcRenditionPad *rendition, GstVideoCodecFrame *frame) {
+    LcevcInputFrame *input = static_cast<LcevcInputFrame *>(
+        gst_video_codec_frame_get_user_data(frame));
+    LcevcEnhancementEncoder *enhancement = rendition->enhancement;
+    LcevcPicture picture = LcevcPicture();
+    GstBuffer *buf;
+    GstMapInfo map;
+
+    enc->pyramid->picture(input->picture.planes, input->pyramid_map.data, rendition->level,
+        &picture);
+    try {
+        enhancement->encode(picture, input->idr);
+    } catch (const std::exception &e) {
+        GST_ELEMENT_ERROR(enc, STREAM, ENCODE, (nullptr),
+            ("Encoding rendition %s failed: %s", GST_PAD_NAME(rendition), e.what()));
+        return GST_FLOW_ERROR;
+    }
+
+    buf = gst_lcevc_enc_acquire_output_buffer(enc, &rendition->output, enhancement->nal_size());
+    if (!gst_buffer_map(buf, &map, GST_MAP_WRITE)) {
+        gst_buffer_unref(buf);
+        GST_ELEMENT_ERROR(enc, RESOURCE, WRITE, (nullptr),
+            ("Failed to map output buffer"));
+        return GST_FLOW_ERROR;
+    }
+    enhancement->write_nal(map.data);
+    gst_buffer_unmap(buf, &map);
+
+    GST_BUFFER_PTS(buf) = frame->pts;
+    GST_BUFFER_DTS(buf) = frame->pts;
+    GST_BUFFER_DURATION(buf) = frame->duration;
+    if (!input->idr)
+        GST_BUFFER_FLAG_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+    GST_LOG_OBJECT(rendition, "Encoded frame %" G_GUINT64_FORMAT ": %" G_GSIZE_FORMAT " bytes",
+        input->seq, gst_buffer_get_size(buf));
+
+    return gst_pad_push(GST_PAD(rendition), buf);
+}
+
+// Rendition thread: encodes and pushes the frames queued to the rendition,
+// in order. Once downstream stops taking them, frames are dropped until the
+// next flush; an error stops the whole element.
+static gpointer gst_lcevc_enc_rendition_worker(gpointer data) {
+    GstLcevcRenditionPad *rendition = static_cast<GstLcevcRenditionPad *>(data);
+    GstLcevcEnc *enc = rendition->enc;
+
+    if (!enc->placement->empty() && !lcevc_apply_placement(*enc->placement))
+        GST_WARNING_OBJECT(rendition, "Failed to pin rendition thread");
+
+    g_mutex_lock(&enc->queue_lock);
+    while (TRUE) {
+        while (g_queue_is_empty(&rendition->frames) && !rendition->stop)
+            g_cond_wait(&enc->queue_cond, &enc->queue_lock);
+        if (rendition->stop)
+            break;
+
+        GstVideoCodecFrame *frame =
+            static_cast<GstVideoCodecFrame *>(g_queue_peek_head(&rendition->frames));
+        GstFlowReturn ret = rendition->flow;
+        g_mutex_unlock(&enc->queue_lock);
+
+        if (ret == GST_FLOW_OK || ret == GST_FLOW_NOT_LINKED)
+            ret = gst_lcevc_enc_encode_rendition(enc, rendition, frame);
+
+        g_mutex_lock(&enc->queue_lock);
+        g_queue_pop_head(&rendition->frames);
+        gst_video_codec_frame_unref(frame);
+        if (ret != rendition->flow)
+            GST_DEBUG_OBJECT(rendition, "Got flow %s", gst_flow_get_name(ret));
+        rendition->flow = ret;
+        if (ret <= GST_FLOW_NOT_NEGOTIATED)
+            enc->worker_flow = ret;
+        g_cond_broadcast(&enc->queue_cond);
+    }
+    g_mutex_unlock(&enc->queue_lock);
+
+    return nullptr;
+}
+
+static void gst_lcevc_enc_start_rendition(GstLcevcRenditionPad *rendition) {
+    if (rendition->thread || !rendition->enhancement)
+        return;
+
+    rendition->stop = FALSE;
+    rendition->flow = GST_FLOW_OK;
+    gchar *name = g_strdup_printf("lcevcenc-%s", GST_PAD_NAME(rendition));
+    rendition->thread = g_thread_new(name, gst_lcevc_enc_rendition_worker, rendition);
+    g_free(name);
+}
+
+// Stop the thread of a rendition and drop the frames queued to it
+static void gst_lcevc_enc_stop_rendition(GstLcevcEnc *enc, GstLcevcRenditionPad *rendition) {
+    GstVideoCodecFrame *frame;
+
+    if (!rendition->thread)
+        return;
+
+    g_mutex_lock(&enc->queue_lock);
+    rendition->stop = TRUE;
+    g_cond_broadcast(&enc->queue_cond);
+    g_mutex_unlock(&enc->queue_lock);
+
+    g_thread_join(rendition->thread);
+    rendition->thread = nullptr;
+
+    g_mutex_lock(&enc->queue_lock);
+    while ((frame = static_cast<GstVideoCodecFrame *>(g_queue_pop_head(&rendition->frames))))
+        gst_video_codec_frame_unref(frame);
+    g_cond_broadcast(&enc->queue_cond);
+    g_mutex_unlock(&enc->queue_lock);
+}
+
+static void gst_lcevc_enc_start_renditions(GstLcevcEnc *enc) {
+    GList *renditions = gst_lcevc_enc_list_renditions(enc);
+
+    for (GList *l = renditions; l; l = l->next)
+        gst_lcevc_enc_start_rendition(GST_LCEVC_RENDITION_PAD(l->data));
+    g_list_free_full(renditions, gst_object_unref);
+}
+
+static void gst_lcevc_enc_stop_renditions(GstLcevcEnc *enc) {
+    GList *renditions = gst_lcevc_enc_list_renditions(enc);
+
+    for (GList *l = renditions; l; l = l->next)
+        gst_lcevc_enc_stop_rendition(enc, GST_LCEVC_RENDITION_PAD(l->data));
+    g_list_free_full(renditions, gst_object_unref);
+}
+
+// Stop the renditions and drop their encoder contexts and the pyramid. The
+// next run starts their streams again.
+static void gst_lcevc_enc_free_renditions(GstLcevcEnc *enc) {
+    GList *renditions = gst_lcevc_enc_list_renditions(enc);
+
+    for (GList *l = renditions; l; l = l->next) {
+        GstLcevcRenditionPad *rendition = GST_LCEVC_RENDITION_PAD(l->data);
+
+        gst_lcevc_enc_stop_rendition(enc, rendition);
+        delete rendition->enhancement;
+        rendition->enhancement = nullptr;
+        gst_lcevc_output_pool_reset(GST_OBJECT(rendition), &rendition->output);
+        rendition->started = FALSE;
+    }
+    g_list_free_full(renditions, gst_object_unref);
+
+    if (enc->pyramid_pool) {
+        gst_buffer_pool_set_active(enc->pyramid_pool, FALSE);
+        gst_object_unref(enc->pyramid_pool);
+        enc->pyramid_pool = nullptr;
+    }
+    delete enc->pyramid;
+    enc->pyramid = nullptr;
+}
+
+// Pool of pyramid blocks, one per frame from ingest until every rendition
+// has pushed it. Kept as long as the layout of the pyramid is the same.
+static gboolean gst_lcevc_enc_setup_pyramid_pool(GstLcevcEnc *enc) {
+    guint size = (guint) enc->pyramid->size();
+    GstAllocationParams params;
+    GstStructure *config;
+    GstBufferPool *pool;
+
+    if (enc->pyramid_pool) {
+        guint pool_size = 0;
+
+        config = gst_buffer_pool_get_config(enc->pyramid_pool);
+        gst_buffer_pool_config_get_params(config, nullptr, &pool_size, nullptr, nullptr);
+        gst_structure_free(config);
+        if (pool_size == size)
+            return TRUE;
+        gst_buffer_pool_set_active(enc->pyramid_pool, FALSE);
+        gst_object_unref(enc->pyramid_pool);
+        enc->pyramid_pool = nullptr;
+    }
+
+    gst_allocation_params_init(&params);
+    params.align = LCEVC_SURFACE_ALIGN - 1;
+
+    pool = gst_buffer_pool_new();
+    config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, nullptr, size, 0, 0);
+    gst_buffer_pool_config_set_allocator(config, nullptr, &params);
+    if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE)) {
+        gst_object_unref(pool);
+        return FALSE;
+    }
+    enc->pyramid_pool = pool;
+    return TRUE;
+}
+
+// Start the stream of a rendition, or carry on with it in a new format. A
+// rendition started mid-stream joins the current segment.
+static void gst_lcevc_enc_announce_rendition(GstLcevcEnc *enc, GstLcevcRenditionPad *rendition,
+    const GstVideoInfo *info) {
+    GstPad *pad = GST_PAD(rendition);
+    gboolean starting = !rendition->started;
+
+    if (starting) {
+        gchar *stream_id = gst_pad_create_stream_id(pad, GST_ELEMENT(enc), GST_PAD_NAME(pad));
+
+        gst_pad_push_event(pad, gst_event_new_stream_start(stream_id));
+        g_free(stream_id);
+        rendition->started = TRUE;
+    }
+
+    GstCaps *caps = gst_caps_new_simple("video/x-lcevc",
+        "width", G_TYPE_INT, (gint) enc->pyramid->width(rendition->level),
+        "height", G_TYPE_INT, (gint) enc->pyramid->height(rendition->level),
+        "framerate", GST_TYPE_FRACTION, GST_VIDEO_INFO_FPS_N(info), GST_VIDEO_INFO_FPS_D(info),
+        nullptr);
+    gst_pad_push_event(pad, gst_event_new_caps(caps));
+    gst_caps_unref(caps);
+
+    if (starting) {
+        GstEvent *segment = gst_pad_get_sticky_event(GST_VIDEO_ENCODER_SINK_PAD(enc),
+            GST_EVENT_SEGMENT, 0);
+        if (segment)
+            gst_pad_push_event(pad, segment);
+    }
+}
+
+// Encoder contexts of the renditions and the pyramid they share, for the
+// format of config, once the renditions are drained. A first pass outputs
+// nothing and leaves them out.
+static gboolean gst_lcevc_enc_configure_renditions(GstLcevcEnc *enc,
+    const LcevcEnhancementConfig &config, const GstVideoInfo *info) {
+    GList *renditions = gst_lcevc_enc_list_renditions(enc);
+    guint levels = 0;
+
+    if (renditions && enc->pass == 1)
+        GST_WARNING_OBJECT(enc, "Renditions output nothing in a first pass");
+    if (!renditions || enc->pass == 1) {
+        g_list_free_full(renditions, gst_object_unref);
+        gst_lcevc_enc_free_renditions(enc);
+        return TRUE;
+    }
+
+    // The pyramid halves both dimensions, and its first level is the
+    // intermediate picture of the source encode too
+    if (config.scaling != LCEVC_SCALING_2D) {
+        GST_ELEMENT_ERROR(enc, LIBRARY, SETTINGS, (nullptr),
+            ("Renditions need scaling-mode 2d"));
+        g_list_free_full(renditions, gst_object_unref);
+        return FALSE;
+    }
+
+    for (GList *l = renditions; l; l = l->next)
+        levels = MAX(levels, GST_LCEVC_RENDITION_PAD(l->data)->level + 1);
+    if (!enc->pyramid)
+        enc->pyramid = new LcevcPyramid();
+    enc->pyramid->configure(config.width, config.height, config.num_planes,
+        config.chroma_shift_x, config.chroma_shift_y, levels);
+    if (enc->pyramid->width(levels - 1) < 16 || enc->pyramid->height(levels - 1) < 16) {
+        GST_ELEMENT_ERROR(enc, LIBRARY, SETTINGS, (nullptr),
+            ("Rendition level %u is below 16x16 at %ux%u", levels - 1,
+                config.width, config.height));
+        g_list_free_full(renditions, gst_object_unref);
+        return FALSE;
+    }
+    if (!gst_lcevc_enc_setup_pyramid_pool(enc)) {
+        GST_ERROR_OBJECT(enc, "Failed to configure pyramid buffer pool");
+        g_list_free_full(renditions, gst_object_unref);
+        return FALSE;
+    }
+
+    gboolean ok = TRUE;
+    for (GList *l = renditions; l && ok; l = l->next) {
+        GstLcevcRenditionPad *rendition = GST_LCEVC_RENDITION_PAD(l->data);
+        LcevcEnhancementConfig rendition_config = config;
+
+        rendition_config.width = enc->pyramid->width(rendition->level);
+        rendition_config.height = enc->pyramid->height(rendition->level);
+        rendition_config.step_width_loq0 = rendition->step_width_loq2;
+        rendition_config.step_width_loq1 = rendition->step_width_loq1;
+        rendition_config.internal_source = rendition->level > 0;
+
+        try {
+            if (rendition->enhancement)
+                rendition->enhancement->configure(rendition_config);
+            else
+                rendition->enhancement = new LcevcEnhancementEncoder(rendition_config,
+                    enc->pool);
+        } catch (const std::exception &e) {
+            GST_ELEMENT_ERROR(enc, LIBRARY, INIT, (nullptr),
+                ("Failed to create encoder for rendition %s: %s", GST_PAD_NAME(rendition),
+                    e.what()));
+            ok = FALSE;
+            break;
+        }
+
+        gst_lcevc_enc_announce_rendition(enc, rendition, info);
+        gst_lcevc_enc_start_rendition(rendition);
+        GST_DEBUG_OBJECT(rendition, "Level %u, %ux%u", rendition->level,
+            rendition_config.width, rendition_config.height);
+    }
+    g_list_free_full(renditions, gst_object_unref);
+
+    GST_DEBUG_OBJECT(enc, "%u pyramid levels, %" G_GSIZE_FORMAT " bytes per frame", levels,
+        enc->pyramid->size());
+    return ok;
+}
+
+// Queue a frame about to be encoded to every running rendition, under
+// queue_lock
+static void gst_lcevc_enc_queue_renditions(GstLcevcEnc *enc, GstVideoCodecFrame *frame) {
+    for (GList *l = enc->renditions; l; l = l->next) {
+        GstLcevcRenditionPad *rendition = GST_LCEVC_RENDITION_PAD(l->data);
+
+        if (rendition->thread && !rendition->stop)
+            g_queue_push_tail(&rendition->frames, gst_video_codec_frame_ref(frame));
+    }
+}
+
+// A rendition has as many frames waiting as the workers may have in flight,
+// under queue_lock
+static gboolean gst_lcevc_enc_renditions_full(GstLcevcEnc *enc) {
+    for (GList *l = enc->renditions; l; l = l->next) {
+        if (GST_LCEVC_RENDITION_PAD(l->data)->frames.length >= enc->in_flight_limit)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+// A rendition has frames left to push, under queue_lock
+static gboolean gst_lcevc_enc_renditions_pending(GstLcevcEnc *enc) {
+    for (GList *l = enc->renditions; l; l = l->next) {
+        if (!g_queue_is_empty(&GST_LCEVC_RENDITION_PAD(l->data)->frames))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+// Wait until the renditions have pushed every frame before a serialized
+// event, those held in the lookahead included. Must be called with the
+// stream lock held; the encode workers carry on.
+static void gst_lcevc_enc_drain_renditions(GstLcevcEnc *enc) {
+    gst_lcevc_enc_submit_held_frames(enc);
+
+    g_mutex_lock(&enc->queue_lock);
+    while (gst_lcevc_enc_renditions_pending(enc) && !enc->worker_stop)
+        g_cond_wait(&enc->queue_cond, &enc->queue_lock);
+    g_mutex_unlock(&enc->queue_lock);
+}
+
+// Push a copy of an event of the sink pad on every rendition pad
+static void gst_lcevc_enc_push_rendition_event(GstLcevcEnc *enc, GstEvent *event) {
+    GList *renditions = gst_lcevc_enc_list_renditions(enc);
+
+    for (GList *l = renditions; l; l = l->next)
+        gst_pad_push_event(GST_PAD(l->data), gst_event_ref(event));
+    g_list_free_full(renditions, gst_object_unref);
+}
+
+// Settings of a frame about to be handed to the workers, under queue_lock.
+// Changes made while playing take effect here, between two frames: the step
+// widths directly with cqp, otherwise through the rate control, which keeps
+// what it has learnt of the stream.
+static void gst_lcevc_enc_take_tuning(GstLcevcEnc *enc, LcevcInputFrame *input) {
+    input->base_qp = enc->base_qp;
+
+    if (enc->rate_controller && enc->retune) {
+        LcevcRateControlConfig config = enc->rate_controller->config();
+
+        config.bitrate = enc->bitrate;
+        config.step_width_loq0 = enc->step_width_loq2;
+        config.step_width_loq1 = enc->step_width_loq1;
+        enc->rate_controller->reconfigure(config);
+        GST_DEBUG_OBJECT(enc, "Rate control retuned to %u kbit/s", enc->bitrate);
+    }
+    enc->retune = FALSE;
+
+    if (enc->rate_controller) {
+        enc->rate_controller->frame_start(input->analysis.detail_cost, &input->rc);
+    } else {
+        input->rc.step_width_loq0 = enc->step_width_loq2;
+        input->rc.step_width_loq1 = enc->step_width_loq1;
+    }
+}
+
+// Hand a frame to the workers, as a temporal refresh when refresh is set.
+// The stream lock is dropped while too many frames are in flight or waiting
+// for a base access unit, the workers and the base thread need it to finish
+// frames.
+static GstFlowReturn gst_lcevc_enc_submit_frame(GstLcevcEnc *enc, GstVideoCodecFrame *frame,
+    gboolean refresh) {
+    LcevcInputFrame *input = static_cast<LcevcInputFrame *>(
+        gst_video_codec_frame_get_user_data(frame));
+    guint *depth = input->info.queue_depth;
+    GstFlowReturn ret;
+
+    depth[GST_LCEVC_ENCODE_QUEUE_LOOKAHEAD] = enc->lookahead_queue.length;
+    g_mutex_lock(&enc->base_lock);
+    depth[GST_LCEVC_ENCODE_QUEUE_BASE_INPUT] = enc->base_queue.length;
+    g_mutex_unlock(&enc->base_lock);
+
+    GST_VIDEO_ENCODER_STREAM_UNLOCK(enc);
+    g_mutex_lock(&enc->queue_lock);
+    while ((enc->in_flight >= enc->in_flight_limit || gst_lcevc_enc_base_full(enc) ||
+            gst_lcevc_enc_renditions_full(enc)) &&
+           enc->worker_flow == GST_FLOW_OK && !enc->worker_stop)
+        g_cond_wait(&enc->queue_cond, &enc->queue_lock);
+
+    ret = enc->worker_stop ? GST_FLOW_FLUSHING : enc->worker_flow;
+    if (ret == GST_FLOW_OK) {
+        input->seq = enc->next_seq++;
+        input->idr = enc->frame_count++ == 0 || refresh ||
+            GST_VIDEO_CODEC_FRAME_IS_FORCE_KEYFRAME(frame);
+        gst_lcevc_enc_take_tuning(enc, input);
+        depth[GST_LCEVC_ENCODE_QUEUE_INPUT] = enc->frame_queue.length;
+        depth[GST_LCEVC_ENCODE_QUEUE_IN_FLIGHT] = enc->in_flight;
+        depth[GST_LCEVC_ENCODE_QUEUE_BASE] = enc->base_enc_frames.length;
+        enc->in_flight++;
+        gst_lcevc_enc_queue_renditions(enc, frame);
+        g_queue_push_tail(&enc->frame_queue, frame);
+        g_cond_broadcast(&enc->queue_cond);
+        frame = nullptr;
+    }
+    g_mutex_unlock(&enc->queue_lock);
+    GST_VIDEO_ENCODER_STREAM_LOCK(enc);
+
+    if (frame) {
+        enc->metrics->frames_dropped++;
+        gst_video_encoder_finish_frame(GST_VIDEO_ENCODER(enc), frame);
+    }
+
+    return ret;
+}
+
+// Submit the oldest frame of the lookahead, deciding its type from the
+// frames queued behind it
+static GstFlowReturn gst_lcevc_enc_submit_lookahead(GstLcevcEnc *enc) {
+    const LcevcFrameAnalysis **frames;
+    guint n = 0;
+
+    // The array only grows with the depth
+    if (enc->lookahead_queue.length > enc->lookahead_frames_size) {
+        g_free(enc->lookahead_frames);
+        enc->lookahead_frames_size = enc->lookahead_queue.length;
+        enc->lookahead_frames = g_new(const LcevcFrameAnalysis *, enc->lookahead_frames_size);
+    }
+    frames = enc->lookahead_frames;
+    for (GList *l = enc->lookahead_queue.head; l; l = l->next) {
+        GstVideoCodecFrame *frame = static_cast<GstVideoCodecFrame *>(l->data);
+        LcevcInputFrame *input = static_cast<LcevcInputFrame *>(
+            gst_video_codec_frame_get_user_data(frame));
+        frames[n++] = &input->analysis;
+    }
+
+    LcevcFrameDecision decision = lcevc_lookahead_decide(frames, n);
+    GstVideoCodecFrame *frame = static_cast<GstVideoCodecFrame *>(
+        g_queue_pop_head(&enc->lookahead_queue));
+    if (decision.refresh)
+        GST_DEBUG_OBJECT(enc, "Scene cut at %" GST_TIME_FORMAT ", intra %u inter %u",
+            GST_TIME_ARGS(frame->pts), frames[0]->intra_cost, frames[0]->inter_cost);
+
+    return gst_lcevc_enc_submit_frame(enc, frame, decision.refresh);
+}
+
+// Drop the frames held in the lookahead. The next frame starts a new scene.
+static void gst_lcevc_enc_clear_lookahead(GstLcevcEnc *enc) {
+    GstVideoCodecFrame *frame;
+
+    while ((frame = static_cast<GstVideoCodecFrame *>(g_queue_pop_head(&enc->lookahead_queue))))
+        gst_video_codec_frame_unref(frame);
+    if (enc->lookahead)
+        enc->lookahead->reset();
+}
+
+// Submit the frames held in the lookahead, deciding on what is left of it.
+// Once the workers fail the rest is dropped.
+static void gst_lcevc_enc_submit_held_frames(GstLcevcEnc *enc) {
+    while (enc->lookahead_queue.length > 0) {
+        if (gst_lcevc_enc_submit_lookahead(enc) != GST_FLOW_OK) {
+            gst_lcevc_enc_clear_lookahead(enc);
+            break;
+        }
+    }
+}
+
+// Wait until every frame in flight has been pushed. Must be called with the
+// stream lock held; it is released while waiting so the workers can finish
+// frames.
+static GstFlowReturn gst_lcevc_enc_drain(GstLcevcEnc *enc) {
+    GstFlowReturn ret;
+
+    gst_lcevc_enc_submit_held_frames(enc);
+
+    GST_VIDEO_ENCODER_STREAM_UNLOCK(enc);
+    g_mutex_lock(&enc->queue_lock);
+    while ((enc->in_flight > 0 || gst_lcevc_enc_renditions_pending(enc)) && !enc->worker_stop)
+        g_cond_wait(&enc->queue_cond, &enc->queue_lock);
+    ret = enc->worker_flow;
+    g_mutex_unlock(&enc->queue_lock);
+
+    // The base encoder holds on to the last frames until it is drained too.
+    // Frames it never output are dropped.
+    if (enc->base_enc) {
+        GstFlowReturn base_ret = gst_lcevc_base_drain(enc->base_enc);
+        GstVideoCodecFrame *frame;
+
+        if (ret == GST_FLOW_OK)
+            ret = base_ret;
+        g_mutex_lock(&enc->queue_lock);
+        while ((frame = static_cast<GstVideoCodecFrame *>(
+                    g_queue_pop_head(&enc->base_enc_frames)))) {
+            g_mutex_unlock(&enc->queue_lock);
+            GST_WARNING_OBJECT(enc, "No base access unit for %" GST_TIME_FORMAT,
+                GST_TIME_ARGS(frame->pts));
+            gst_buffer_replace(&frame->output_buffer, nullptr);
+            enc->metrics->frames_dropped++;
+            GST_VIDEO_ENCODER_STREAM_LOCK(enc);
+            gst_video_encoder_finish_frame(GST_VIDEO_ENCODER(enc), frame);
+            GST_VIDEO_ENCODER_STREAM_UNLOCK(enc);
+            g_mutex_lock(&enc->queue_lock);
+        }
+        g_mutex_unlock(&enc->queue_lock);
+    }
+    GST_VIDEO_ENCODER_STREAM_LOCK(enc);
+
+    return ret;
 }
 
 static GstFlowReturn gst_lcevc_enc_handle_frame(GstVideoEncoder *encoder,
     GstVideoCodecFrame *frame) {
     GstLcevcEnc *enc = GST_LCEVC_ENC(encoder);
-    
-    if (!enc->encoder) {
+    GstFlowReturn ret;
+
+    if (!enc->n_workers) {
         GST_ERROR_OBJECT(enc, "Encoder not initialized");
+        enc->metrics->frames_dropped++;
         gst_video_encoder_finish_frame(encoder, frame);
         return GST_FLOW_ERROR;
     }
-    
-    // For now, create a minimal implementation that passes through data
-    // This is a placeholder until we figure out the correct LCEVC API usage
-    
-    try {
-        // Create output buffer - for now just copy input to output
-        GstBuffer *outbuf = gst_buffer_copy(frame->input_buffer);
-        
-        // Set output frame properties
-        frame->output_buffer = outbuf;
-        frame->dts = frame->pts;
-        
-        GST_LOG_OBJECT(enc, "Pass-through frame %d", enc->frame_count++);
-        
-    } catch (const std::exception &e) {
-        GST_ERROR_OBJECT(enc, "Processing failed: %s", e.what());
+
+    // View the input planes; the frame owns the mapping until it is finished
+    GstClockTime start = gst_util_get_timestamp();
+    LcevcInputFrame *input = gst_lcevc_enc_ingest_frame(enc, frame,
+        &enc->input_state->info);
+    if (!input) {
+        GST_ERROR_OBJECT(enc, "Failed to ingest frame");
+        enc->metrics->frames_dropped++;
         gst_video_encoder_finish_frame(encoder, frame);
         return GST_FLOW_ERROR;
     }
-    
-    return gst_video_encoder_finish_frame(encoder, frame);
+    gst_video_codec_frame_set_user_data(frame, input, release_input_frame);
+    input->arrival = start;
+    input->info.stage_time[GST_LCEVC_ENCODE_STAGE_INGEST] = gst_util_get_timestamp() - start;
+
+    // Pair the frame with its decoded base picture. The stream lock is
+    // dropped while waiting for it, like for the workers below.
+    g_mutex_lock(&enc->base_lock);
+    gboolean dual_input = enc->sink_secondary != nullptr;
+    g_mutex_unlock(&enc->base_lock);
+    if (dual_input) {
+        GstClockTime tolerance = gst_lcevc_enc_base_tolerance(enc);
+
+        GST_VIDEO_ENCODER_STREAM_UNLOCK(encoder);
+        GstBuffer *base = gst_lcevc_enc_pop_base(enc, frame->pts, tolerance);
+        GST_VIDEO_ENCODER_STREAM_LOCK(encoder);
+        start = gst_util_get_timestamp();
+        if (base)
+            gst_lcevc_enc_attach_base(enc, input, base);
+        input->info.stage_time[GST_LCEVC_ENCODE_STAGE_INGEST] +=
+            gst_util_get_timestamp() - start;
+        if (!input->picture.has_base) {
+            GST_LOG_OBJECT(enc, "No base picture for %" GST_TIME_FORMAT,
+                GST_TIME_ARGS(frame->pts));
+            enc->base_missing++;
+        }
+    }
+
+    if (enc->pyramid_pool && !gst_lcevc_enc_build_pyramid(enc, input)) {
+        GST_ELEMENT_ERROR(enc, RESOURCE, FAILED, (nullptr),
+            ("Failed to get a buffer for the rendition pyramid"));
+        enc->metrics->frames_dropped++;
+        gst_video_encoder_finish_frame(encoder, frame);
+        return GST_FLOW_ERROR;
+    }
+
+    if (!enc->lookahead)
+        return gst_lcevc_enc_submit_frame(enc, frame, FALSE);
+
+    start = gst_util_get_timestamp();
+    enc->lookahead->analyse(input->picture.planes[0], &input->analysis);
+    input->info.stage_time[GST_LCEVC_ENCODE_STAGE_INGEST] += gst_util_get_timestamp() - start;
+    g_queue_push_tail(&enc->lookahead_queue, frame);
+
+    ret = GST_FLOW_OK;
+    while (ret == GST_FLOW_OK &&
+           enc->lookahead_queue.length > gst_lcevc_enc_lookahead_depth(enc))
+        ret = gst_lcevc_enc_submit_lookahead(enc);
+
+    return ret;
+}
+
+static gboolean gst_lcevc_enc_flush(GstVideoEncoder *encoder) {
+    GstLcevcEnc *enc = GST_LCEVC_ENC(encoder);
+
+    GST_DEBUG_OBJECT(enc, "Flushing encoder");
+
+    gst_lcevc_enc_clear_lookahead(enc);
+    GST_VIDEO_ENCODER_STREAM_UNLOCK(encoder);
+    gst_lcevc_enc_stop_workers(enc);
+    gst_lcevc_enc_stop_renditions(enc);
+    if (enc->rate_controller)
+        enc->rate_controller->flush();
+    if (enc->base_enc)
+        gst_lcevc_base_flush(enc->base_enc);
+    gst_lcevc_enc_clear_base_enc_frames(enc);
+    gst_lcevc_enc_start_workers(enc);
+    gst_lcevc_enc_start_renditions(enc);
+    GST_VIDEO_ENCODER_STREAM_LOCK(encoder);
+
+    return TRUE;
 }
 
 static GstFlowReturn gst_lcevc_enc_finish(GstVideoEncoder *encoder) {
     GstLcevcEnc *enc = GST_LCEVC_ENC(encoder);
-    
+
     GST_DEBUG_OBJECT(enc, "Finish encoding");
-    
-    return GST_FLOW_OK;
+
+    return gst_lcevc_enc_drain(enc);
+}
+
+static void gst_lcevc_enc_clear_base_queue(GstLcevcEnc *enc) {
+    GstBuffer *buf;
+
+    g_mutex_lock(&enc->base_lock);
+    while ((buf = static_cast<GstBuffer *>(g_queue_pop_head(&enc->base_queue))))
+        gst_buffer_unref(buf);
+    g_cond_broadcast(&enc->base_cond);
+    g_mutex_unlock(&enc->base_lock);
+}
+
+// Wake handle_frame up while it waits for a base picture, so the main sink
+// pad can flush. Flushes, segments and EOS go on to the renditions too; a
+// segment once the frames before it are out, EOS once the base class has
+// drained them, and the end of a flush once it has restarted them.
+static gboolean gst_lcevc_enc_sink_event(GstVideoEncoder *encoder, GstEvent *event) {
+    GstLcevcEnc *enc = GST_LCEVC_ENC(encoder);
+    GstEventType type = GST_EVENT_TYPE(event);
+    gboolean ret;
+
+    if (type == GST_EVENT_FLUSH_START || type == GST_EVENT_FLUSH_STOP) {
+        g_mutex_lock(&enc->base_lock);
+        enc->base_interrupted = type == GST_EVENT_FLUSH_START;
+        g_cond_broadcast(&enc->base_cond);
+        g_mutex_unlock(&enc->base_lock);
+    }
+
+    if (type == GST_EVENT_FLUSH_START)
+        gst_lcevc_enc_push_rendition_event(enc, event);
+    if (type == GST_EVENT_SEGMENT) {
+        GST_VIDEO_ENCODER_STREAM_LOCK(encoder);
+        gst_lcevc_enc_drain_renditions(enc);
+        GST_VIDEO_ENCODER_STREAM_UNLOCK(encoder);
+        gst_lcevc_enc_push_rendition_event(enc, event);
+    }
+
+    gst_event_ref(event);
+    ret = GST_VIDEO_ENCODER_CLASS(parent_class)->sink_event(encoder, event);
+    if (type == GST_EVENT_FLUSH_STOP || type == GST_EVENT_EOS)
+        gst_lcevc_enc_push_rendition_event(enc, event);
+    gst_event_unref(event);
+
+    return ret;
+}
+
+// Queue a decoded base picture, blocking while the queue is full
+static GstFlowReturn gst_lcevc_enc_base_chain(GstPad *pad, GstObject *parent,
+    GstBuffer *buf) {
+    GstLcevcEnc *enc = GST_LCEVC_ENC(parent);
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    if (!GST_BUFFER_PTS_IS_VALID(buf)) {
+        GST_WARNING_OBJECT(pad, "Dropping base picture without PTS");
+        gst_buffer_unref(buf);
+        return GST_FLOW_OK;
+    }
+
+    g_mutex_lock(&enc->base_lock);
+    while (g_queue_get_length(&enc->base_queue) >= DEFAULT_BASE_QUEUE_DEPTH &&
+           !enc->base_flushing && enc->sink_secondary == pad)
+        g_cond_wait(&enc->base_cond, &enc->base_lock);
+
+    if (enc->base_flushing || enc->sink_secondary != pad) {
+        gst_buffer_unref(buf);
+        ret = GST_FLOW_FLUSHING;
+    } else {
+        g_queue_push_tail(&enc->base_queue, buf);
+        g_cond_broadcast(&enc->base_cond);
+    }
+    g_mutex_unlock(&enc->base_lock);
+
+    return ret;
+}
+
+// Events of the base stream stop here; only its caps, EOS and flushes matter
+static gboolean gst_lcevc_enc_base_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+    GstLcevcEnc *enc = GST_LCEVC_ENC(parent);
+    gboolean ret = TRUE;
+
+    switch (GST_EVENT_TYPE(event)) {
+        case GST_EVENT_CAPS: {
+            GstCaps *caps;
+            GstVideoInfo info;
+
+            gst_event_parse_caps(event, &caps);
+            ret = gst_video_info_from_caps(&info, caps);
+            if (ret) {
+                GST_DEBUG_OBJECT(pad, "Base format: %dx%d %s", GST_VIDEO_INFO_WIDTH(&info),
+                    GST_VIDEO_INFO_HEIGHT(&info), GST_VIDEO_INFO_NAME(&info));
+                g_mutex_lock(&enc->base_lock);
+                enc->base_info = info;
+                enc->base_info_valid = TRUE;
+                g_mutex_unlock(&enc->base_lock);
+            }
+            break;
+        }
+        case GST_EVENT_EOS:
+            g_mutex_lock(&enc->base_lock);
+            enc->base_eos = TRUE;
+            g_cond_broadcast(&enc->base_cond);
+            g_mutex_unlock(&enc->base_lock);
+            break;
+        case GST_EVENT_FLUSH_START:
+            g_mutex_lock(&enc->base_lock);
+            enc->base_flushing = TRUE;
+            g_cond_broadcast(&enc->base_cond);
+            g_mutex_unlock(&enc->base_lock);
+            break;
+        case GST_EVENT_FLUSH_STOP:
+            gst_lcevc_enc_clear_base_queue(enc);
+            g_mutex_lock(&enc->base_lock);
+            enc->base_flushing = FALSE;
+            enc->base_eos = FALSE;
+            g_mutex_unlock(&enc->base_lock);
+            break;
+        default:
+            break;
+    }
+
+    gst_event_unref(event);
+    return ret;
+}
+
+static gboolean gst_lcevc_enc_base_query(GstPad *pad, GstObject *parent, GstQuery *query) {
+    switch (GST_QUERY_TYPE(query)) {
+        case GST_QUERY_CAPS: {
+            GstCaps *filter;
+            GstCaps *caps = gst_pad_get_pad_template_caps(pad);
+
+            gst_query_parse_caps(query, &filter);
+            if (filter) {
+                GstCaps *intersection = gst_caps_intersect_full(filter, caps,
+                    GST_CAPS_INTERSECT_FIRST);
+                gst_caps_unref(caps);
+                caps = intersection;
+            }
+            gst_query_set_caps_result(query, caps);
+            gst_caps_unref(caps);
+            return TRUE;
+        }
+        case GST_QUERY_ACCEPT_CAPS: {
+            GstCaps *caps;
+            GstCaps *templ = gst_pad_get_pad_template_caps(pad);
+
+            gst_query_parse_accept_caps(query, &caps);
+            gst_query_set_accept_caps_result(query, gst_caps_is_subset(caps, templ));
+            gst_caps_unref(templ);
+            return TRUE;
+        }
+        default:
+            // Nothing downstream of the encoder answers for the base stream
+            return FALSE;
+    }
+}
+
+// A new rendition, encoded from the next format on
+static GstPad *gst_lcevc_enc_request_rendition_pad(GstLcevcEnc *enc, GstPadTemplate *templ,
+    const gchar *name) {
+    gchar *pad_name = name ? g_strdup(name) : nullptr;
+    GstLcevcRenditionPad *rendition;
+
+    g_mutex_lock(&enc->queue_lock);
+    if (!pad_name)
+        pad_name = g_strdup_printf("src_%u", enc->rendition_serial);
+    enc->rendition_serial++;
+    g_mutex_unlock(&enc->queue_lock);
+
+    rendition = GST_LCEVC_RENDITION_PAD(g_object_new(GST_TYPE_LCEVC_RENDITION_PAD,
+        "name", pad_name, "direction", GST_PAD_SRC, "template", templ, nullptr));
+    g_free(pad_name);
+    rendition->enc = enc;
+    gst_pad_use_fixed_caps(GST_PAD(rendition));
+
+    if (!gst_element_add_pad(GST_ELEMENT(enc), GST_PAD(rendition))) {
+        gst_object_unref(rendition);
+        return nullptr;
+    }
+    g_mutex_lock(&enc->queue_lock);
+    enc->renditions = g_list_append(enc->renditions, gst_object_ref(rendition));
+    g_mutex_unlock(&enc->queue_lock);
+    return GST_PAD(rendition);
+}
+
+static GstPad *gst_lcevc_enc_request_new_pad(GstElement *element, GstPadTemplate *templ,
+    const gchar *name, const GstCaps *caps) {
+    GstLcevcEnc *enc = GST_LCEVC_ENC(element);
+    GstPad *pad;
+
+    if (GST_PAD_TEMPLATE_DIRECTION(templ) == GST_PAD_SRC)
+        return gst_lcevc_enc_request_rendition_pad(enc, templ, name);
+
+    g_mutex_lock(&enc->base_lock);
+    if (enc->sink_secondary) {
+        g_mutex_unlock(&enc->base_lock);
+        GST_WARNING_OBJECT(enc, "sink_secondary already requested");
+        return nullptr;
+    }
+
+    pad = gst_pad_new_from_template(templ, "sink_secondary");
+    gst_pad_set_chain_function(pad, GST_DEBUG_FUNCPTR(gst_lcevc_enc_base_chain));
+    gst_pad_set_event_function(pad, GST_DEBUG_FUNCPTR(gst_lcevc_enc_base_event));
+    gst_pad_set_query_function(pad, GST_DEBUG_FUNCPTR(gst_lcevc_enc_base_query));
+    enc->sink_secondary = pad;
+    enc->base_info_valid = FALSE;
+    enc->base_eos = FALSE;
+    g_mutex_unlock(&enc->base_lock);
+
+    gst_element_add_pad(element, pad);
+    return pad;
+}
+
+// A released rendition no longer gets frames, the one being encoded is the
+// last one it pushes
+static void gst_lcevc_enc_release_rendition_pad(GstLcevcEnc *enc,
+    GstLcevcRenditionPad *rendition) {
+    g_mutex_lock(&enc->queue_lock);
+    GList *link = g_list_find(enc->renditions, rendition);
+    if (link)
+        enc->renditions = g_list_delete_link(enc->renditions, link);
+    g_cond_broadcast(&enc->queue_cond);
+    g_mutex_unlock(&enc->queue_lock);
+    if (!link)
+        return;
+
+    gst_lcevc_enc_stop_rendition(enc, rendition);
+    delete rendition->enhancement;
+    rendition->enhancement = nullptr;
+    gst_element_remove_pad(GST_ELEMENT(enc), GST_PAD(rendition));
+    gst_object_unref(rendition);
+}
+
+static void gst_lcevc_enc_release_pad(GstElement *element, GstPad *pad) {
+    GstLcevcEnc *enc = GST_LCEVC_ENC(element);
+
+    if (GST_IS_LCEVC_RENDITION_PAD(pad)) {
+        gst_lcevc_enc_release_rendition_pad(enc, GST_LCEVC_RENDITION_PAD(pad));
+        return;
+    }
+
+    g_mutex_lock(&enc->base_lock);
+    if (enc->sink_secondary != pad) {
+        g_mutex_unlock(&enc->base_lock);
+        return;
+    }
+    enc->sink_secondary = nullptr;
+    g_cond_broadcast(&enc->base_cond);
+    g_mutex_unlock(&enc->base_lock);
+
+    gst_lcevc_enc_clear_base_queue(enc);
+    gst_element_remove_pad(element, pad);
+}
+
+// Both sink pads can be blocked on the base queue, from either side; they
+// are woken up before the base class deactivates them
+static GstStateChangeReturn gst_lcevc_enc_change_state(GstElement *element,
+    GstStateChange transition) {
+    GstLcevcEnc *enc = GST_LCEVC_ENC(element);
+    GstStateChangeReturn ret;
+
+    switch (transition) {
+        case GST_STATE_CHANGE_READY_TO_PAUSED:
+            g_mutex_lock(&enc->base_lock);
+            enc->base_flushing = FALSE;
+            enc->base_interrupted = FALSE;
+            enc->base_eos = FALSE;
+            g_mutex_unlock(&enc->base_lock);
+            break;
+        case GST_STATE_CHANGE_PAUSED_TO_READY:
+            g_mutex_lock(&enc->base_lock);
+            enc->base_flushing = TRUE;
+            enc->base_interrupted = TRUE;
+            g_cond_broadcast(&enc->base_cond);
+            g_mutex_unlock(&enc->base_lock);
+            break;
+        default:
+            break;
+    }
+
+    ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY)
+        gst_lcevc_enc_clear_base_queue(enc);
+
+    return ret;
 }
 
 // Plugin registration
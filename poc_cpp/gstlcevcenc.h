@@ -6,10 +6,19 @@
 #include <gst/video/gstvideoencoder.h>
 
 // Use only system LCEVC headers
-#include <Encoder.hpp>
 #include <Parameters.hpp>
 #include <Image.hpp>
-#include <Surface.hpp>
+
+#include "gstlcevcbase.h"
+#include "gstlcevcmeta.h"
+#include "lcevcenhancement.h"
+#include "lcevclookahead.h"
+#include "lcevcmetrics.h"
+#include "lcevcplacement.h"
+#include "lcevcpyramid.h"
+#include "lcevcratecontrol.h"
+#include "lcevcstats.h"
+#include "lcevcworkers.h"
 
 #include <memory>
 #include <vector>
@@ -23,15 +32,67 @@ G_BEGIN_DECLS
 #define GST_IS_LCEVC_ENC(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_LCEVC_ENC))
 #define GST_IS_LCEVC_ENC_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_LCEVC_ENC))
 
+#define GST_TYPE_LCEVC_RENDITION_PAD (gst_lcevc_rendition_pad_get_type())
+#define GST_LCEVC_RENDITION_PAD(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_LCEVC_RENDITION_PAD,GstLcevcRenditionPad))
+#define GST_IS_LCEVC_RENDITION_PAD(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_LCEVC_RENDITION_PAD))
+
 typedef struct _GstLcevcEnc GstLcevcEnc;
 typedef struct _GstLcevcEncClass GstLcevcEncClass;
+typedef struct _GstLcevcRenditionPad GstLcevcRenditionPad;
+typedef struct _GstLcevcRenditionPadClass GstLcevcRenditionPadClass;
+
+// Output buffers of a stream, written straight into from a pool whose
+// buffer size follows the largest frame so far
+typedef struct {
+    GMutex lock;
+    GstBufferPool *pool;
+    gsize size;
+} GstLcevcOutputPool;
+
+// Encode worker thread and the encoder context it owns
+typedef struct {
+    GstLcevcEnc *enc;
+    GThread *thread;
+    LcevcEnhancementEncoder *enhancement;
+} GstLcevcEncWorker;
+
+// Rendition of an ABR ladder, on a src_%u request pad: the source
+// downscaled level times by two, encoded with step widths of its own by an
+// encoder context and thread of its own, into output buffers of its own.
+// Its frames come from the shared pyramid and it runs its stages on the
+// worker pool of the element.
+struct _GstLcevcRenditionPad {
+    GstPad parent;
+
+    // Configuration, taken when the format is set
+    guint level;
+    guint step_width_loq1;
+    guint step_width_loq2;
+
+    // State, under the queue_lock of the element. The frame being encoded
+    // stays at the head of frames until it is pushed.
+    GstLcevcEnc *enc;
+    LcevcEnhancementEncoder *enhancement;
+    GThread *thread;
+    GQueue frames;
+    GstLcevcOutputPool output;  // under its own lock
+    gboolean stop;
+    gboolean started;           // stream-start sent
+    GstFlowReturn flow;
+};
+
+struct _GstLcevcRenditionPadClass {
+    GstPadClass parent_class;
+};
 
 struct _GstLcevcEnc {
     GstVideoEncoder parent;
     
     // LCEVC encoder
-    lctm::Encoder *encoder;
     lctm::Parameters *params;
+    LcevcWorkerPool *pool;
     
     // Configuration
     guint qp;
@@ -39,19 +100,159 @@ struct _GstLcevcEnc {
     guint step_width_loq1;
     guint step_width_loq2;
     gchar *base_encoder;
+    gchar *base_encoder_factory;
+    gboolean encode_base;
     gchar *transform_type;
+    gchar *scaling_mode;
     gchar *priority_mode;
     gboolean temporal_enabled;
     gboolean enhancement_enabled;
     guint base_depth;
     guint enhancement_depth;
     guint fps;
+    guint threads;
+    guint max_frames_in_flight;
+    GstClockTime base_pts_tolerance;
+    guint lookahead_depth;
+    gboolean low_latency;
+    gchar *rate_control;
+    guint bitrate;
+    guint vbv_buffer_size;
+    guint vbv_max_bitrate;
+    guint pass;
+    gchar *stats_file;
+    guint static_threshold;
+    guint report_interval;
+    gchar *metrics_file;
+    guint metrics_interval;
+    gchar *cpu_set;
+    gint numa_node;
+    gboolean inherit_placement;
+
+    // Where the encoding threads run and take their memory from, resolved
+    // by the first set_format of a run
+    LcevcPlacement *placement;
+
+    // Live tuning: bitrate, base-qp and the step widths can change while
+    // playing. They are set under queue_lock, and retune tells the rate
+    // control to pick them up with the next frame it starts.
+    gboolean retune;
     
     // State
     GstVideoCodecState *input_state;
     lctm::ImageDescription src_desc;
     gint frame_count;
-    std::vector<std::unique_ptr<lctm::Image>> frame_buffer;
+
+    // Ingest: frames that cannot be wrapped in place are copied once into
+    // buffers from this pool
+    GstBufferPool *copy_pool;
+
+    // Input frames of finished frames, reused by the next ones. Frames are
+    // released on any thread, under queue_lock or not, hence a lock of its own.
+    GMutex input_lock;
+    GQueue free_inputs;
+
+    // Output of the workers
+    GstLcevcOutputPool output;
+
+    // Encode workers: handle_frame queues frames, the workers encode them
+    // and put them back in order in the reorder queue before finishing them.
+    // Without temporal prediction frames are independent and several
+    // workers encode them in parallel, otherwise there is a single worker.
+    GstLcevcEncWorker *workers;
+    guint n_workers;
+    guint in_flight_limit;
+    GMutex queue_lock;
+    GCond queue_cond;
+    GQueue frame_queue;
+    GQueue reorder_queue;
+    guint in_flight;
+    guint64 next_seq;
+    guint64 push_seq;
+    gboolean pushing;
+    gboolean worker_stop;
+    GstFlowReturn worker_flow;
+
+    // Decoded base pictures from the sink_secondary request pad, queued
+    // until the source frame with the matching PTS is ingested. The LOQ-1
+    // residual is then coded against them rather than against the
+    // downsampled source.
+    GstPad *sink_secondary;
+    GMutex base_lock;
+    GCond base_cond;
+    GQueue base_queue;
+    GstVideoInfo base_info;
+    gboolean base_info_valid;
+    gboolean base_eos;
+    gboolean base_flushing;     // sink_secondary is flushing or stopping
+    gboolean base_interrupted;  // the main sink pad is
+    guint64 base_missing;
+
+    // Base codec: with encode-base set, the downsampled pictures are encoded
+    // by a child encoder on a thread of its own and its access units are
+    // muxed with the enhancement of the same frame. Encoded frames wait in
+    // base_enc_frames, under queue_lock, for their access unit. In low-latency
+    // mode they wait there from the end of their LOQ-1 stage on, and an
+    // access unit that comes back before the enhancement is pushed on its own
+    // as a subframe. handle_frame blocks once in_flight_limit plus
+    // base_enc_latency frames are waiting, the latency of the base encoder in
+    // frames as it last reported it, G_MAXUINT when it could not tell.
+    GstLcevcBase *base_enc;
+    GstBufferPool *base_enc_pool;
+    GstVideoInfo base_enc_info;
+    GQueue base_enc_frames;
+    guint base_enc_latency;
+
+    // ABR ladder: with renditions requested, handle_frame downsamples each
+    // frame once into a pyramid, in a buffer from pyramid_pool, before it
+    // is submitted. The encode workers take the intermediate picture from
+    // it, and every frame is queued to each rendition along with them, with
+    // the same frame type. The list is changed under queue_lock.
+    GList *renditions;
+    guint rendition_serial;
+    LcevcPyramid *pyramid;
+    GstBufferPool *pyramid_pool;
+
+    // Lookahead: with a depth set, ingested frames are analysed and held
+    // back in lookahead_queue, under the stream lock, until that many frames
+    // follow them. Temporal refresh and base keyframes are placed from what
+    // the analysis of those frames shows. Low-latency mode holds none back.
+    LcevcLookahead *lookahead;
+    GQueue lookahead_queue;
+    const LcevcFrameAnalysis **lookahead_frames;    // the queue, for the decision
+    guint lookahead_frames_size;
+
+    // Rate control: outside of cqp the step widths of each frame are chosen
+    // when it is handed to the workers, from the analysis of the lookahead,
+    // which then runs even with no depth. Frames are accounted for when they
+    // are pushed. Used under queue_lock.
+    LcevcRateControl *rate_controller;
+
+    // Two-pass encoding: the first pass only analyses the enhancement and
+    // writes a record per frame, in order as frames are pushed; the second
+    // hands the mapped records to the rate control
+    LcevcStatsWriter *stats_writer;
+    LcevcStatsReader *stats_reader;
+
+    // Instrumentation: each output buffer carries a GstLcevcEncodeMeta with
+    // the stage times of its frame. With an interval set they are also
+    // gathered here, under queue_lock, and posted as an element message
+    // every report_interval frames.
+    guint report_frames;
+    guint64 report_time[GST_LCEVC_ENCODE_STAGE_COUNT];
+    GstClockTime report_time_max[GST_LCEVC_ENCODE_STAGE_COUNT];
+    guint64 report_bytes[2];
+    guint report_depth_max[GST_LCEVC_ENCODE_QUEUE_COUNT];
+
+    // Statistics: lock-free counters behind the read-only properties. With a
+    // metrics file set, metrics_thread rewrites it every metrics_interval
+    // seconds in the Prometheus text format.
+    LcevcEncoderMetrics *metrics;
+    GThread *metrics_thread;
+    gchar *metrics_path;            // metrics_file when the thread started
+    GMutex metrics_lock;
+    GCond metrics_cond;
+    gboolean metrics_stop;
 };
 
 struct _GstLcevcEncClass {
@@ -59,13 +260,10 @@ struct _GstLcevcEncClass {
 };
 
 GType gst_lcevc_enc_get_type(void);
+GType gst_lcevc_rendition_pad_get_type(void);
 
 // Helper function declarations
 lctm::ImageFormat gst_video_format_to_image_format(GstVideoFormat format);
-std::shared_ptr<lctm::Image> create_image_from_gst_frame(const std::string& name, 
-                                                       GstVideoCodecFrame* frame, 
-                                                       GstVideoInfo* video_info,
-                                                       uint64_t timestamp);
 
 G_END_DECLS
 
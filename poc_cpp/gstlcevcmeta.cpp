@@ -0,0 +1,80 @@
+#include "gstlcevcmeta.h"
+#include <string.h>
+
+static const gchar *stage_names[GST_LCEVC_ENCODE_STAGE_COUNT] = {
+    "ingest",
+    "downscale",
+    "base",
+    "upsample",
+    "residual",
+    "transform",
+    "entropy",
+    "output",
+};
+
+static const gchar *queue_names[GST_LCEVC_ENCODE_QUEUE_COUNT] = {
+    "input",
+    "in-flight",
+    "lookahead",
+    "base",
+    "base-input",
+};
+
+GType gst_lcevc_encode_meta_api_get_type(void) {
+    static gsize type = 0;
+    static const gchar *tags[] = { nullptr };
+
+    if (g_once_init_enter(&type)) {
+        GType api = gst_meta_api_type_register("GstLcevcEncodeMetaAPI", tags);
+        g_once_init_leave(&type, api);
+    }
+    return (GType) type;
+}
+
+static gboolean gst_lcevc_encode_meta_init(GstMeta *meta, gpointer, GstBuffer *) {
+    GstLcevcEncodeMeta *encode_meta = (GstLcevcEncodeMeta *) meta;
+
+    memset(&encode_meta->info, 0, sizeof(encode_meta->info));
+    return TRUE;
+}
+
+// The timings describe the frame, not the memory: they follow copies of the
+// buffer whatever is copied
+static gboolean gst_lcevc_encode_meta_transform(GstBuffer *dest, GstMeta *meta,
+    GstBuffer *, GQuark type, gpointer) {
+    GstLcevcEncodeMeta *encode_meta = (GstLcevcEncodeMeta *) meta;
+
+    if (!GST_META_TRANSFORM_IS_COPY(type))
+        return FALSE;
+    return gst_buffer_add_lcevc_encode_meta(dest, &encode_meta->info) != nullptr;
+}
+
+const GstMetaInfo *gst_lcevc_encode_meta_get_info(void) {
+    static gsize info = 0;
+
+    if (g_once_init_enter(&info)) {
+        const GstMetaInfo *registered = gst_meta_register(GST_LCEVC_ENCODE_META_API_TYPE,
+            "GstLcevcEncodeMeta", sizeof(GstLcevcEncodeMeta), gst_lcevc_encode_meta_init,
+            nullptr, gst_lcevc_encode_meta_transform);
+        g_once_init_leave(&info, (gsize) registered);
+    }
+    return (const GstMetaInfo *) info;
+}
+
+GstLcevcEncodeMeta *gst_buffer_add_lcevc_encode_meta(GstBuffer *buffer,
+    const GstLcevcEncodeInfo *info) {
+    GstLcevcEncodeMeta *meta = (GstLcevcEncodeMeta *) gst_buffer_add_meta(buffer,
+        GST_LCEVC_ENCODE_META_INFO, nullptr);
+
+    if (meta)
+        meta->info = *info;
+    return meta;
+}
+
+const gchar *gst_lcevc_encode_stage_get_name(GstLcevcEncodeStage stage) {
+    return stage < GST_LCEVC_ENCODE_STAGE_COUNT ? stage_names[stage] : nullptr;
+}
+
+const gchar *gst_lcevc_encode_queue_get_name(GstLcevcEncodeQueue queue) {
+    return queue < GST_LCEVC_ENCODE_QUEUE_COUNT ? queue_names[queue] : nullptr;
+}
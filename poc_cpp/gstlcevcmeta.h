@@ -0,0 +1,64 @@
+#ifndef __GST_LCEVC_META_H__
+#define __GST_LCEVC_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Stages of the encode of one frame
+typedef enum {
+    GST_LCEVC_ENCODE_STAGE_INGEST,      // mapping, base picture pairing, lookahead analysis
+    GST_LCEVC_ENCODE_STAGE_DOWNSCALE,
+    GST_LCEVC_ENCODE_STAGE_BASE,        // base picture, then waiting for its access unit
+    GST_LCEVC_ENCODE_STAGE_UPSAMPLE,
+    GST_LCEVC_ENCODE_STAGE_RESIDUAL,
+    GST_LCEVC_ENCODE_STAGE_TRANSFORM,
+    GST_LCEVC_ENCODE_STAGE_ENTROPY,
+    GST_LCEVC_ENCODE_STAGE_OUTPUT,      // output buffer and NAL unit
+    GST_LCEVC_ENCODE_STAGE_COUNT
+} GstLcevcEncodeStage;
+
+// Queues of the encoder, sampled as a frame is handed to the workers
+typedef enum {
+    GST_LCEVC_ENCODE_QUEUE_INPUT,       // frames waiting for a worker
+    GST_LCEVC_ENCODE_QUEUE_IN_FLIGHT,   // frames queued, encoding or waiting to be pushed
+    GST_LCEVC_ENCODE_QUEUE_LOOKAHEAD,
+    GST_LCEVC_ENCODE_QUEUE_BASE,        // frames waiting for their base access unit
+    GST_LCEVC_ENCODE_QUEUE_BASE_INPUT,  // decoded base pictures from sink_secondary
+    GST_LCEVC_ENCODE_QUEUE_COUNT
+} GstLcevcEncodeQueue;
+
+// Instrumentation of the encode of one frame. Stage times are in
+// nanoseconds, summed over the threads a stage ran on.
+typedef struct {
+    GstClockTime stage_time[GST_LCEVC_ENCODE_STAGE_COUNT];
+    guint32 loq_bytes[2];       // coded layers of LOQ-0 and LOQ-1
+    guint queue_depth[GST_LCEVC_ENCODE_QUEUE_COUNT];
+} GstLcevcEncodeInfo;
+
+// Output buffer meta carrying the instrumentation of the frame it was
+// encoded from
+typedef struct {
+    GstMeta meta;
+    GstLcevcEncodeInfo info;
+} GstLcevcEncodeMeta;
+
+#define GST_LCEVC_ENCODE_META_API_TYPE (gst_lcevc_encode_meta_api_get_type())
+#define GST_LCEVC_ENCODE_META_INFO (gst_lcevc_encode_meta_get_info())
+
+#define gst_buffer_get_lcevc_encode_meta(b) \
+    ((GstLcevcEncodeMeta *) gst_buffer_get_meta((b), GST_LCEVC_ENCODE_META_API_TYPE))
+
+GType gst_lcevc_encode_meta_api_get_type(void);
+const GstMetaInfo *gst_lcevc_encode_meta_get_info(void);
+
+GstLcevcEncodeMeta *gst_buffer_add_lcevc_encode_meta(GstBuffer *buffer,
+    const GstLcevcEncodeInfo *info);
+
+// Names of stages and queues, as used in the fields of report messages
+const gchar *gst_lcevc_encode_stage_get_name(GstLcevcEncodeStage stage);
+const gchar *gst_lcevc_encode_queue_get_name(GstLcevcEncodeQueue queue);
+
+G_END_DECLS
+
+#endif /* __GST_LCEVC_META_H__ */
@@ -0,0 +1,71 @@
+#include "lcevcarena.h"
+#include "lcevcplacement.h"
+
+#include <new>
+#include <sys/mman.h>
+
+#define PAGE_SIZE_BYTES ((size_t) 4096)
+#define HUGE_PAGE_SIZE ((size_t) 2 << 20)
+
+static size_t round_up(size_t value, size_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+void LcevcArena::reserve(size_t bytes, int node) {
+    offset = 0;
+    if (bytes <= capacity)
+        return;
+    release();
+
+#ifdef MAP_HUGETLB
+    // Explicit huge pages only exist when the administrator set some aside;
+    // a block smaller than one would waste most of it
+    if (bytes >= HUGE_PAGE_SIZE) {
+        size_t size = round_up(bytes, HUGE_PAGE_SIZE);
+        void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (ptr != MAP_FAILED) {
+            if (node >= 0)
+                lcevc_bind_memory(ptr, size, node);
+            block = ptr;
+            capacity = size;
+            huge = true;
+            return;
+        }
+    }
+#endif
+
+    size_t size = round_up(bytes, PAGE_SIZE_BYTES);
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (ptr == MAP_FAILED)
+        throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    if (size >= HUGE_PAGE_SIZE)
+        madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    if (node >= 0)
+        lcevc_bind_memory(ptr, size, node);
+    block = ptr;
+    capacity = size;
+    huge = false;
+}
+
+void *LcevcArena::allocate(size_t bytes, size_t align) {
+    size_t start = round_up(offset, align);
+
+    offset = start + bytes;
+    if (offset > capacity)
+        return nullptr;
+    return static_cast<char *>(block) + start;
+}
+
+void LcevcArena::release() {
+    if (block)
+        munmap(block, capacity);
+    block = nullptr;
+    capacity = 0;
+    offset = 0;
+    huge = false;
+}
@@ -0,0 +1,47 @@
+#ifndef __LCEVC_ARENA_H__
+#define __LCEVC_ARENA_H__
+
+#include <cstddef>
+
+// One block of memory handed out by bumping an offset, for buffers that
+// live exactly as long as each other. Nothing is freed on its own: rewind()
+// hands the whole block out again from the start.
+//
+// The block is mapped straight from the system, on huge pages when some are
+// set aside and otherwise as a transparent huge page candidate, so a large
+// arena costs few TLB entries and never goes through the heap. Its pages
+// can be bound to a NUMA node. Not thread safe.
+class LcevcArena {
+public:
+    LcevcArena() : block(nullptr), capacity(0), offset(0), huge(false) {}
+    ~LcevcArena() { release(); }
+
+    LcevcArena(const LcevcArena &) = delete;
+    LcevcArena &operator=(const LcevcArena &) = delete;
+
+    // Make the block hold at least bytes, forgetting what was handed out
+    // when it has to grow. A new block takes its pages from node, when not
+    // -1 and the system allows it. Throws std::bad_alloc.
+    void reserve(size_t bytes, int node = -1);
+
+    void rewind() { offset = 0; }
+
+    // Next bytes of the block, aligned to align, a power of two. Returns
+    // nullptr past the end of the block, but still counts them in used(),
+    // so a first pass can size the arena.
+    void *allocate(size_t bytes, size_t align);
+
+    size_t used() const { return offset; }
+    size_t size() const { return capacity; }
+    bool huge_pages() const { return huge; }
+
+private:
+    void release();
+
+    void *block;
+    size_t capacity;
+    size_t offset;
+    bool huge;      // explicit huge pages
+};
+
+#endif /* __LCEVC_ARENA_H__ */
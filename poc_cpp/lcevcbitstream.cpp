@@ -0,0 +1,98 @@
+#include "lcevcbitstream.h"
+
+void LcevcBitWriter::put_bits(uint32_t value, unsigned count) {
+    // Fewer than 8 bits are ever left in the cache, so 32 more always fit
+    cache = (cache << count) | (value & (uint32_t) ((1ull << count) - 1));
+    bits += count;
+    while (bits >= 8) {
+        bits -= 8;
+        out.push_back((uint8_t) (cache >> bits));
+    }
+}
+
+unsigned lcevc_multibyte_size(uint64_t value) {
+    unsigned groups = 1;
+    while (groups < 10 && (value >> (7 * groups)) != 0)
+        groups++;
+    return groups;
+}
+
+void LcevcBitWriter::put_multibyte(uint64_t value) {
+    unsigned groups = lcevc_multibyte_size(value);
+
+    for (unsigned g = groups; g > 0; g--) {
+        uint32_t byte = (uint32_t) (value >> (7 * (g - 1))) & 0x7f;
+        put_bits(g > 1 ? byte | 0x80 : byte, 8);
+    }
+}
+
+void LcevcBitWriter::align() {
+    if (bits)
+        put_bits(0, 8 - bits);
+}
+
+void lcevc_write_block_header(std::vector<uint8_t> &rbsp, LcevcBlockType type, size_t size) {
+    LcevcBitWriter writer(rbsp);
+
+    // payload_size_type 7 signals a multi-byte size after the header byte
+    if (size <= 6) {
+        writer.put_bits((uint32_t) size, 3);
+        writer.put_bits(type, 5);
+    } else {
+        writer.put_bits(7, 3);
+        writer.put_bits(type, 5);
+        writer.put_multibyte(size);
+    }
+}
+
+void lcevc_write_block(std::vector<uint8_t> &rbsp, LcevcBlockType type,
+                       const uint8_t *payload, size_t size) {
+    lcevc_write_block_header(rbsp, type, size);
+    rbsp.insert(rbsp.end(), payload, payload + size);
+}
+
+// Start code, NAL header and rbsp_trailing_bits
+#define NAL_OVERHEAD 6
+
+size_t lcevc_nal_size(const uint8_t *rbsp, size_t size) {
+    size_t escaped = 0;
+    unsigned zeros = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        if (zeros == 2 && rbsp[i] <= 0x03) {
+            escaped++;
+            zeros = 0;
+        }
+        zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+    }
+    return size + escaped + NAL_OVERHEAD;
+}
+
+size_t lcevc_write_nal(uint8_t *dst, bool idr, const uint8_t *rbsp, size_t size) {
+    uint8_t *p = dst;
+    unsigned zeros = 0;
+
+    // start code
+    *p++ = 0x00;
+    *p++ = 0x00;
+    *p++ = 0x01;
+
+    // forbidden_zero_bit, forbidden_one_bit, nal_unit_type, reserved_flag (all ones)
+    uint16_t header = (uint16_t) (0x4000 | ((idr ? LCEVC_NAL_IDR : LCEVC_NAL_NON_IDR) << 9) | 0x1ff);
+    *p++ = (uint8_t) (header >> 8);
+    *p++ = (uint8_t) header;
+
+    for (size_t i = 0; i < size; i++) {
+        if (zeros == 2 && rbsp[i] <= 0x03) {
+            *p++ = 0x03;
+            zeros = 0;
+        }
+        *p++ = rbsp[i];
+        zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+    }
+
+    // rbsp_trailing_bits
+    *p++ = 0x80;
+
+    return (size_t) (p - dst);
+}
@@ -0,0 +1,57 @@
+#ifndef __LCEVC_BITSTREAM_H__
+#define __LCEVC_BITSTREAM_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LCEVC NAL unit types
+#define LCEVC_NAL_NON_IDR 28
+#define LCEVC_NAL_IDR 29
+
+// Process block payload types carried in an LCEVC NAL unit
+enum LcevcBlockType {
+    LCEVC_BLOCK_SEQUENCE_CONFIG = 0,
+    LCEVC_BLOCK_GLOBAL_CONFIG = 1,
+    LCEVC_BLOCK_PICTURE_CONFIG = 2,
+    LCEVC_BLOCK_ENCODED_DATA = 3,
+};
+
+// MSB-first bit writer appending to a byte vector. Bytes are appended as
+// soon as they are complete, so the vector can be appended to directly
+// whenever the writer is byte aligned.
+class LcevcBitWriter {
+public:
+    explicit LcevcBitWriter(std::vector<uint8_t> &out) : out(out), cache(0), bits(0) {}
+
+    void put_bits(uint32_t value, unsigned count);
+    // LCEVC multi-byte value: 7 bits per byte, high bit set on all but the last
+    void put_multibyte(uint64_t value);
+    // Pad with zero bits up to the next byte boundary
+    void align();
+
+private:
+    std::vector<uint8_t> &out;
+    uint64_t cache;
+    unsigned bits;          // pending in the low bits of cache, always below 8
+};
+
+// Bytes taken by value as an LCEVC multi-byte value
+unsigned lcevc_multibyte_size(uint64_t value);
+
+// Append the payload type and size header of a process block
+void lcevc_write_block_header(std::vector<uint8_t> &rbsp, LcevcBlockType type, size_t size);
+
+// Append a process block: payload type and size header, then the payload
+void lcevc_write_block(std::vector<uint8_t> &rbsp, LcevcBlockType type,
+                       const uint8_t *payload, size_t size);
+
+// Size of rbsp once written as an LCEVC NAL unit
+size_t lcevc_nal_size(const uint8_t *rbsp, size_t size);
+
+// Write rbsp to dst as one LCEVC NAL unit: start code, two byte NAL header
+// and the payload with emulation prevention bytes inserted. dst must hold
+// lcevc_nal_size() bytes; returns the number of bytes written.
+size_t lcevc_write_nal(uint8_t *dst, bool idr, const uint8_t *rbsp, size_t size);
+
+#endif /* __LCEVC_BITSTREAM_H__ */
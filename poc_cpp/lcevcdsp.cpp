@@ -0,0 +1,207 @@
+#include "lcevcdsp.h"
+#include "lcevcdsp_impl.h"
+
+#include <cstdlib>
+#include <cstring>
+
+// LCEVC upsampling kernels, 14-bit fixed point
+static const LcevcUpsampleKernel upsample_kernels[] = {
+    { { 0, 16384, 0, 0 } },             // nearest
+    { { 0, 12288, 4096, 0 } },          // linear
+    { { -1382, 14285, 3942, -461 } },   // cubic
+    { { -2360, 15855, 4165, -1276 } },  // modified cubic
+};
+
+const LcevcUpsampleKernel *lcevc_upsample_kernel(LcevcUpsampleType type) {
+    return &upsample_kernels[type];
+}
+
+void lcevc_quantizer_init(LcevcQuantizer *quant, unsigned step_width) {
+    quant->step_width = (int32_t) step_width;
+    // A rounding offset below one half widens the zero bin
+    quant->rounding = (int32_t) (step_width * 3 / 8);
+    quant->inv_step_width = 1.0f / (float) step_width;
+}
+
+template <typename T>
+static void import_c(const LcevcSourcePlane &src, const LcevcSurface &dst,
+                     unsigned y0, unsigned y1) {
+    const unsigned last_col = src.width - 1;
+    const unsigned last_row = src.height - 1;
+
+    for (unsigned y = y0; y < y1; y++) {
+        const T *s = src.row<T>(lcevc_min_u(y, last_row));
+        int16_t *d = dst.row(y);
+
+        for (unsigned x = 0; x < dst.width; x++)
+            d[x] = (int16_t) (src.sample(s, lcevc_min_u(x, last_col)) << src.shift);
+    }
+}
+
+template <typename T>
+static void export_c(const LcevcSurface &src, const LcevcOutputPlane &dst,
+                     unsigned y0, unsigned y1) {
+    const int32_t rounding = dst.shift ? 1 << (dst.shift - 1) : 0;
+    const int32_t max = LCEVC_INTERNAL_MAX >> dst.shift;
+
+    for (unsigned y = y0; y < lcevc_min_u(y1, dst.height); y++) {
+        const int16_t *s = src.row(y);
+        T *d = dst.row<T>(y);
+
+        for (unsigned x = 0; x < dst.width; x++)
+            d[x] = (T) lcevc_clamp_int((s[x] + rounding) >> dst.shift, 0, max);
+    }
+}
+
+static void subtract_c(const LcevcSurface &a, const LcevcSurface &b,
+                       const LcevcSurface &dst, unsigned y0, unsigned y1) {
+    for (unsigned y = y0; y < y1; y++) {
+        const int16_t *pa = a.row(y);
+        const int16_t *pb = b.row(y);
+        int16_t *d = dst.row(y);
+
+        for (unsigned x = 0; x < dst.width; x++)
+            d[x] = lcevc_clamp_s16(pa[x] - pb[x]);
+    }
+}
+
+static void add_clamp_c(const LcevcSurface &a, const LcevcSurface &b,
+                        const LcevcSurface &dst, unsigned y0, unsigned y1) {
+    for (unsigned y = y0; y < y1; y++) {
+        const int16_t *pa = a.row(y);
+        const int16_t *pb = b.row(y);
+        int16_t *d = dst.row(y);
+
+        for (unsigned x = 0; x < dst.width; x++)
+            d[x] = (int16_t) lcevc_clamp_int(pa[x] + pb[x], 0, LCEVC_INTERNAL_MAX);
+    }
+}
+
+static void add_c(const LcevcSurface &a, const LcevcSurface &b,
+                  const LcevcSurface &dst, unsigned y0, unsigned y1) {
+    for (unsigned y = y0; y < y1; y++) {
+        const int16_t *pa = a.row(y);
+        const int16_t *pb = b.row(y);
+        int16_t *d = dst.row(y);
+
+        for (unsigned x = 0; x < dst.width; x++)
+            d[x] = lcevc_clamp_s16(pa[x] + pb[x]);
+    }
+}
+
+static unsigned find_nonzero_c(const int16_t *p, unsigned n) {
+    unsigned x = 0;
+
+    while (x < n && p[x] == 0)
+        x++;
+    return x;
+}
+
+static const LcevcDsp dsp_c = {
+    lcevc_downsample_plane<uint8_t, 2, LcevcDownsampleRowC>,
+    lcevc_downsample_plane<uint16_t, 2, LcevcDownsampleRowC>,
+    lcevc_downsample_plane<uint8_t, 1, LcevcDownsampleRowC>,
+    lcevc_downsample_plane<uint16_t, 1, LcevcDownsampleRowC>,
+    lcevc_upsample_residual_plane<uint8_t, 2, LcevcUpsampleRowC>,
+    lcevc_upsample_residual_plane<uint16_t, 2, LcevcUpsampleRowC>,
+    lcevc_upsample_residual_plane<uint8_t, 1, LcevcUpsampleRowC>,
+    lcevc_upsample_residual_plane<uint16_t, 1, LcevcUpsampleRowC>,
+    import_c<uint8_t>,
+    import_c<uint16_t>,
+    export_c<uint8_t>,
+    export_c<uint16_t>,
+    subtract_c,
+    add_clamp_c,
+    add_c,
+    { lcevc_transform_quantize_plane<2, LcevcTransformC>,
+      lcevc_transform_quantize_plane<4, LcevcTransformC> },
+    { lcevc_dequantize_inverse_plane<2, LcevcTransformC>,
+      lcevc_dequantize_inverse_plane<4, LcevcTransformC> },
+    find_nonzero_c,
+    lcevc_sad_plane<uint8_t, LcevcSadRowC>,
+    lcevc_sad_plane<uint16_t, LcevcSadRowC>,
+};
+
+#if defined(LCEVC_HAVE_SSE41) || defined(LCEVC_HAVE_AVX2) || defined(LCEVC_HAVE_AVX512)
+static bool cpu_has_sse41(void) {
+    return __builtin_cpu_supports("sse4.1");
+}
+
+static bool cpu_has_avx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+static bool cpu_has_avx512(void) {
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+}
+#endif
+
+#if defined(LCEVC_HAVE_NEON)
+static bool cpu_has_neon(void) {
+    return true;
+}
+#endif
+
+// SIMD variants built in, narrowest first. Each one only replaces some
+// kernels, so they are applied on top of each other.
+struct DspVariant {
+    const char *name;
+    bool (*supported)(void);
+    void (*init)(LcevcDsp *dsp);
+};
+
+static const DspVariant dsp_variants[] = {
+#if defined(LCEVC_HAVE_SSE41)
+    { "sse4.1", cpu_has_sse41, lcevc_dsp_init_sse41 },
+#endif
+#if defined(LCEVC_HAVE_AVX2)
+    { "avx2", cpu_has_avx2, lcevc_dsp_init_avx2 },
+#endif
+#if defined(LCEVC_HAVE_AVX512)
+    { "avx512", cpu_has_avx512, lcevc_dsp_init_avx512 },
+#endif
+#if defined(LCEVC_HAVE_NEON)
+    { "neon", cpu_has_neon, lcevc_dsp_init_neon },
+#endif
+    { nullptr, nullptr, nullptr }
+};
+
+// Apply the variants the CPU supports, up to isa when it is set. Returns the
+// name of the last one applied.
+static const char *dsp_init(LcevcDsp *dsp, const char *isa) {
+    const char *name = "c";
+
+    *dsp = dsp_c;
+    if (isa && strcmp(isa, name) == 0)
+        return name;
+
+    for (const DspVariant *v = dsp_variants; v->name && v->supported(); v++) {
+        v->init(dsp);
+        name = v->name;
+        if (isa && strcmp(isa, name) == 0)
+            break;
+    }
+    return name;
+}
+
+bool lcevc_dsp_init(LcevcDsp *dsp, const char *isa) {
+    return strcmp(dsp_init(dsp, isa), isa) == 0;
+}
+
+static const char *dsp_isa;
+
+static LcevcDsp dsp_get_init(void) {
+    LcevcDsp dsp;
+    dsp_isa = dsp_init(&dsp, getenv("LCEVC_DSP_ISA"));
+    return dsp;
+}
+
+const LcevcDsp *lcevc_dsp_get(void) {
+    static const LcevcDsp dsp = dsp_get_init();
+    return &dsp;
+}
+
+const char *lcevc_dsp_isa(void) {
+    lcevc_dsp_get();
+    return dsp_isa;
+}
@@ -0,0 +1,206 @@
+#ifndef __LCEVC_DSP_H__
+#define __LCEVC_DSP_H__
+
+#include "lcevcsurface.h"
+
+// Transform block sizes: DD works on 2x2 blocks, DDS on 4x4
+enum LcevcTransformType {
+    LCEVC_TRANSFORM_DD = 0,
+    LCEVC_TRANSFORM_DDS = 1
+};
+
+static inline unsigned lcevc_transform_block_size(LcevcTransformType type) {
+    return type == LCEVC_TRANSFORM_DDS ? 4 : 2;
+}
+
+static inline unsigned lcevc_transform_num_layers(LcevcTransformType type) {
+    return type == LCEVC_TRANSFORM_DDS ? 16 : 4;
+}
+
+// Scaling between LOQ-1 and LOQ-0: 2D halves both dimensions, 1D only the
+// width
+enum LcevcScalingMode {
+    LCEVC_SCALING_1D = 1,
+    LCEVC_SCALING_2D = 2
+};
+
+enum LcevcUpsampleType {
+    LCEVC_UPSAMPLE_NEAREST = 0,
+    LCEVC_UPSAMPLE_LINEAR = 1,
+    LCEVC_UPSAMPLE_CUBIC = 2,
+    LCEVC_UPSAMPLE_MODIFIED_CUBIC = 3
+};
+
+// Quantized coefficients are kept within what one RLE symbol pair can carry
+#define LCEVC_MAX_COEFFICIENT 4095
+
+struct LcevcQuantizer {
+    int32_t step_width;
+    int32_t rounding;       // added to |coefficient| before scaling, sets the dead zone
+    float inv_step_width;
+};
+
+void lcevc_quantizer_init(LcevcQuantizer *quant, unsigned step_width);
+
+// 4-tap upsampling kernel, 14-bit fixed point. Taps apply to samples
+// i-1 .. i+2 for the output a quarter sample right of i, and mirrored for
+// the output a quarter sample left of it.
+struct LcevcUpsampleKernel {
+    int32_t taps[4];
+};
+
+const LcevcUpsampleKernel *lcevc_upsample_kernel(LcevcUpsampleType type);
+
+// Processing stages of the enhancement encoder. All of them work on a range
+// of rows (or block rows) so they can be split into stripes; stripes only
+// read outside their range, never write.
+struct LcevcDsp {
+    // Downsample rows [y0, y1) of dst from the source plane, reading past its
+    // right and bottom edges as edge replication
+    void (*downsample_2d_8)(const LcevcSourcePlane &src, const LcevcSurface &dst,
+                            unsigned y0, unsigned y1);
+    void (*downsample_2d_16)(const LcevcSourcePlane &src, const LcevcSurface &dst,
+                             unsigned y0, unsigned y1);
+    void (*downsample_1d_8)(const LcevcSourcePlane &src, const LcevcSurface &dst,
+                            unsigned y0, unsigned y1);
+    void (*downsample_1d_16)(const LcevcSourcePlane &src, const LcevcSurface &dst,
+                             unsigned y0, unsigned y1);
+
+    // Upsample the LOQ-1 reconstruction src and subtract the prediction from
+    // the source plane, giving columns [x0, x1) of rows [y0, y1) of the LOQ-0
+    // residual dst. x0 is even. The upsampled plane is never stored. The
+    // source is read with edge replication.
+    void (*upsample_residual_2d_8)(const LcevcSurface &src, const LcevcSourcePlane &source,
+                                   const LcevcSurface &dst, unsigned x0, unsigned x1,
+                                   unsigned y0, unsigned y1,
+                                   const LcevcUpsampleKernel &kernel);
+    void (*upsample_residual_2d_16)(const LcevcSurface &src, const LcevcSourcePlane &source,
+                                    const LcevcSurface &dst, unsigned x0, unsigned x1,
+                                    unsigned y0, unsigned y1,
+                                    const LcevcUpsampleKernel &kernel);
+    void (*upsample_residual_1d_8)(const LcevcSurface &src, const LcevcSourcePlane &source,
+                                   const LcevcSurface &dst, unsigned x0, unsigned x1,
+                                   unsigned y0, unsigned y1,
+                                   const LcevcUpsampleKernel &kernel);
+    void (*upsample_residual_1d_16)(const LcevcSurface &src, const LcevcSourcePlane &source,
+                                    const LcevcSurface &dst, unsigned x0, unsigned x1,
+                                    unsigned y0, unsigned y1,
+                                    const LcevcUpsampleKernel &kernel);
+
+    // Rows [y0, y1) of dst from a picture plane at the same resolution,
+    // shifted to the internal depth and read with edge replication
+    void (*import_8)(const LcevcSourcePlane &src, const LcevcSurface &dst,
+                     unsigned y0, unsigned y1);
+    void (*import_16)(const LcevcSourcePlane &src, const LcevcSurface &dst,
+                      unsigned y0, unsigned y1);
+
+    // The reverse: rows [y0, y1) of src rounded to the depth of dst, skipping
+    // rows and columns past its edges
+    void (*export_8)(const LcevcSurface &src, const LcevcOutputPlane &dst,
+                     unsigned y0, unsigned y1);
+    void (*export_16)(const LcevcSurface &src, const LcevcOutputPlane &dst,
+                      unsigned y0, unsigned y1);
+
+    // dst = a - b for rows [y0, y1)
+    void (*subtract)(const LcevcSurface &a, const LcevcSurface &b,
+                     const LcevcSurface &dst, unsigned y0, unsigned y1);
+
+    // dst = clamp(a + b) to the internal sample range for rows [y0, y1)
+    void (*add_clamp)(const LcevcSurface &a, const LcevcSurface &b,
+                      const LcevcSurface &dst, unsigned y0, unsigned y1);
+
+    // dst = a + b, saturated to 16 bits, for rows [y0, y1)
+    void (*add)(const LcevcSurface &a, const LcevcSurface &b,
+                const LcevcSurface &dst, unsigned y0, unsigned y1);
+
+    // Transform and quantize block rows [by0, by1) of the residual into one
+    // surface per coefficient layer
+    void (*transform_quantize[2])(const LcevcSurface &residual, const LcevcSurface *layers,
+                                  unsigned by0, unsigned by1, const LcevcQuantizer &quant);
+
+    // Dequantize and inverse transform block rows [by0, by1) back into
+    // residuals, as the decoder will see them
+    void (*dequantize_inverse[2])(const LcevcSurface *layers, const LcevcSurface &residual,
+                                  unsigned by0, unsigned by1, const LcevcQuantizer &quant);
+
+    // Index of the first non-zero coefficient of p[0, n), or n. Drives the
+    // zero run scan of the entropy coder.
+    unsigned (*find_nonzero)(const int16_t *p, unsigned n);
+
+    // Sum of absolute differences between two width x height blocks of 8-bit
+    // or 16-bit samples, strides in bytes
+    uint32_t (*sad_8)(const uint8_t *a, ptrdiff_t stride_a, const uint8_t *b,
+                      ptrdiff_t stride_b, unsigned width, unsigned height);
+    uint32_t (*sad_16)(const uint8_t *a, ptrdiff_t stride_a, const uint8_t *b,
+                       ptrdiff_t stride_b, unsigned width, unsigned height);
+};
+
+// Kernels for the running CPU: the widest SIMD variant it supports, capped
+// by the LCEVC_DSP_ISA environment variable when set (c, sse4.1, avx2,
+// avx512 or neon). Every variant is bit-exact with the scalar one.
+const LcevcDsp *lcevc_dsp_get(void);
+
+// Instruction set picked by lcevc_dsp_get()
+const char *lcevc_dsp_isa(void);
+
+// Fill dsp with the kernels of up to the given instruction set. Returns
+// false, with the widest supported variant below it filled in, when the
+// build or the CPU lacks it.
+bool lcevc_dsp_init(LcevcDsp *dsp, const char *isa);
+
+static inline void lcevc_dsp_downsample(const LcevcDsp *dsp, LcevcScalingMode scaling,
+    const LcevcSourcePlane &src, const LcevcSurface &dst, unsigned y0, unsigned y1) {
+    if (scaling == LCEVC_SCALING_2D) {
+        if (src.bytes_per_sample == 1)
+            dsp->downsample_2d_8(src, dst, y0, y1);
+        else
+            dsp->downsample_2d_16(src, dst, y0, y1);
+    } else {
+        if (src.bytes_per_sample == 1)
+            dsp->downsample_1d_8(src, dst, y0, y1);
+        else
+            dsp->downsample_1d_16(src, dst, y0, y1);
+    }
+}
+
+static inline void lcevc_dsp_import(const LcevcDsp *dsp, const LcevcSourcePlane &src,
+    const LcevcSurface &dst, unsigned y0, unsigned y1) {
+    if (src.bytes_per_sample == 1)
+        dsp->import_8(src, dst, y0, y1);
+    else
+        dsp->import_16(src, dst, y0, y1);
+}
+
+static inline void lcevc_dsp_export(const LcevcDsp *dsp, const LcevcSurface &src,
+    const LcevcOutputPlane &dst, unsigned y0, unsigned y1) {
+    if (dst.bytes_per_sample == 1)
+        dsp->export_8(src, dst, y0, y1);
+    else
+        dsp->export_16(src, dst, y0, y1);
+}
+
+static inline void lcevc_dsp_upsample_residual(const LcevcDsp *dsp, LcevcScalingMode scaling,
+    const LcevcSurface &src, const LcevcSourcePlane &source, const LcevcSurface &dst,
+    unsigned x0, unsigned x1, unsigned y0, unsigned y1, const LcevcUpsampleKernel &kernel) {
+    if (scaling == LCEVC_SCALING_2D) {
+        if (source.bytes_per_sample == 1)
+            dsp->upsample_residual_2d_8(src, source, dst, x0, x1, y0, y1, kernel);
+        else
+            dsp->upsample_residual_2d_16(src, source, dst, x0, x1, y0, y1, kernel);
+    } else {
+        if (source.bytes_per_sample == 1)
+            dsp->upsample_residual_1d_8(src, source, dst, x0, x1, y0, y1, kernel);
+        else
+            dsp->upsample_residual_1d_16(src, source, dst, x0, x1, y0, y1, kernel);
+    }
+}
+
+static inline uint32_t lcevc_dsp_sad(const LcevcDsp *dsp, unsigned bytes_per_sample,
+    const uint8_t *a, ptrdiff_t stride_a, const uint8_t *b, ptrdiff_t stride_b,
+    unsigned width, unsigned height) {
+    if (bytes_per_sample == 1)
+        return dsp->sad_8(a, stride_a, b, stride_b, width, height);
+    return dsp->sad_16(a, stride_a, b, stride_b, width, height);
+}
+
+#endif /* __LCEVC_DSP_H__ */
@@ -0,0 +1,478 @@
+#include "lcevcdsp_impl.h"
+
+#include <immintrin.h>
+
+template <unsigned Rows>
+static unsigned downsample_row(const uint8_t *s0, const uint8_t *s1, int16_t *d,
+                               unsigned n, const LcevcSourcePlane &src) {
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i low = _mm256_set1_epi16(0xff);
+    const __m128i count = _mm_cvtsi32_si128((int) (src.shift - Rows));
+    unsigned x = 0;
+
+    if (src.shift < Rows)
+        return 0;
+
+    // Semi-planar chroma, see the SSE4.1 variant
+    if (src.step == 2) {
+        for (; x + 16 < n; x += 16) {
+            __m256i a = _mm256_and_si256(
+                _mm256_loadu_si256((const __m256i *) (s0 + 4 * x)), low);
+            __m256i b = _mm256_and_si256(
+                _mm256_loadu_si256((const __m256i *) (s0 + 4 * x + 32)), low);
+            if (Rows == 2) {
+                a = _mm256_add_epi16(a, _mm256_and_si256(
+                    _mm256_loadu_si256((const __m256i *) (s1 + 4 * x)), low));
+                b = _mm256_add_epi16(b, _mm256_and_si256(
+                    _mm256_loadu_si256((const __m256i *) (s1 + 4 * x + 32)), low));
+            }
+            __m256i sum = _mm256_permute4x64_epi64(_mm256_hadd_epi16(a, b),
+                                                   _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256((__m256i *) (d + x), _mm256_sll_epi16(sum, count));
+        }
+        return x;
+    }
+
+    // Pairs of horizontal neighbours summed by a multiply-add with ones
+    for (; x + 16 <= n; x += 16) {
+        __m256i sum = _mm256_maddubs_epi16(
+            _mm256_loadu_si256((const __m256i *) (s0 + 2 * x)), ones);
+        if (Rows == 2)
+            sum = _mm256_add_epi16(sum, _mm256_maddubs_epi16(
+                _mm256_loadu_si256((const __m256i *) (s1 + 2 * x)), ones));
+        _mm256_storeu_si256((__m256i *) (d + x), _mm256_sll_epi16(sum, count));
+    }
+    return x;
+}
+
+template <unsigned Rows>
+static unsigned downsample_row(const uint16_t *s0, const uint16_t *s1, int16_t *d,
+                               unsigned n, const LcevcSourcePlane &src) {
+    const __m128i drop = _mm_cvtsi32_si128((int) src.drop);
+    const __m128i count = _mm_cvtsi32_si128((int) (src.shift - Rows));
+    unsigned x = 0;
+
+    // The sums fit in 16 bits as long as there is a shift left to do
+    if (src.shift < Rows || src.step != 1)
+        return 0;
+
+    for (; x + 16 <= n; x += 16) {
+        __m256i a = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *) (s0 + 2 * x)), drop);
+        __m256i b = _mm256_srl_epi16(
+            _mm256_loadu_si256((const __m256i *) (s0 + 2 * x + 16)), drop);
+        if (Rows == 2) {
+            a = _mm256_add_epi16(a, _mm256_srl_epi16(
+                _mm256_loadu_si256((const __m256i *) (s1 + 2 * x)), drop));
+            b = _mm256_add_epi16(b, _mm256_srl_epi16(
+                _mm256_loadu_si256((const __m256i *) (s1 + 2 * x + 16)), drop));
+        }
+        // hadd works per 128-bit lane, put the quarters back in order
+        __m256i sum = _mm256_permute4x64_epi64(_mm256_hadd_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *) (d + x), _mm256_sll_epi16(sum, count));
+    }
+    return x;
+}
+
+struct DownsampleRowAvx2 {
+    template <typename T, unsigned Rows>
+    static unsigned row(const T *s0, const T *s1, int16_t *d, unsigned n,
+                        const LcevcSourcePlane &src) {
+        return downsample_row<Rows>(s0, s1, d, n, src);
+    }
+};
+
+// Vertical upsampling pass: pairs of rows interleaved and multiplied with
+// pairs of weights, 16 samples per iteration
+static unsigned upsample_vertical(const int16_t *const rows[], const int32_t weight[],
+                                  int32_t *out, unsigned n) {
+    const __m256i w01 = _mm256_unpacklo_epi16(_mm256_set1_epi16((int16_t) weight[0]),
+                                              _mm256_set1_epi16((int16_t) weight[1]));
+    const __m256i w23 = _mm256_unpacklo_epi16(_mm256_set1_epi16((int16_t) weight[2]),
+                                              _mm256_set1_epi16((int16_t) weight[3]));
+    const __m256i round = _mm256_set1_epi32(8192);
+    unsigned x = 0;
+
+    for (; x + 16 <= n; x += 16) {
+        __m256i r0 = _mm256_loadu_si256((const __m256i *) (rows[0] + x));
+        __m256i r1 = _mm256_loadu_si256((const __m256i *) (rows[1] + x));
+        __m256i r2 = _mm256_loadu_si256((const __m256i *) (rows[2] + x));
+        __m256i r3 = _mm256_loadu_si256((const __m256i *) (rows[3] + x));
+
+        __m256i lo = _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(r0, r1), w01),
+                             _mm256_madd_epi16(_mm256_unpacklo_epi16(r2, r3), w23)), round);
+        __m256i hi = _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(r0, r1), w01),
+                             _mm256_madd_epi16(_mm256_unpackhi_epi16(r2, r3), w23)), round);
+        lo = _mm256_srai_epi32(lo, 14);
+        hi = _mm256_srai_epi32(hi, 14);
+
+        // Unpacking works per 128-bit lane, put the quarters back in order
+        _mm256_storeu_si256((__m256i *) (out + x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *) (out + x + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return x;
+}
+
+static inline __m256i load_source(const uint8_t *s, unsigned step) {
+    if (step == 2)
+        return _mm256_and_si256(_mm256_loadu_si256((const __m256i *) s),
+                                _mm256_set1_epi16(0xff));
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) s));
+}
+
+static inline __m256i load_source(const uint16_t *s, unsigned) {
+    return _mm256_loadu_si256((const __m256i *) s);
+}
+
+// Saturate two vectors of values to 16 bits and interleave them. Gives the
+// upsampled pairs of eight intermediates, or the two samples of eight
+// blocks in one row.
+static inline __m256i interleave_s16(__m256i even, __m256i odd) {
+    const __m256i order = _mm256_setr_epi8(
+        0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
+        0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+    return _mm256_shuffle_epi8(_mm256_packs_epi32(even, odd), order);
+}
+
+// Horizontal upsampling pass and residual, 16 outputs per iteration: the
+// even and odd outputs of eight intermediates are computed separately from
+// five shifted loads, then interleaved and subtracted from the source
+template <typename T>
+static unsigned upsample_residual_row(const int32_t *in, const T *s, int16_t *d, unsigned n,
+                                      const LcevcUpsampleKernel &kernel,
+                                      const LcevcSourcePlane &source) {
+    const __m256i w0 = _mm256_set1_epi32(kernel.taps[0]);
+    const __m256i w1 = _mm256_set1_epi32(kernel.taps[1]);
+    const __m256i w2 = _mm256_set1_epi32(kernel.taps[2]);
+    const __m256i w3 = _mm256_set1_epi32(kernel.taps[3]);
+    const __m256i round = _mm256_set1_epi32(8192);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi32(LCEVC_INTERNAL_MAX);
+    const __m128i drop = _mm_cvtsi32_si128((int) source.drop);
+    const __m128i count = _mm_cvtsi32_si128((int) source.shift);
+    const unsigned margin = source.step - 1;
+    unsigned x = 0;
+
+    if (sizeof(T) == 2 && source.step != 1)
+        return 0;
+
+    for (; x + 16 + margin <= n; x += 16) {
+        const int32_t *p = in + x / 2;
+        __m256i a = _mm256_loadu_si256((const __m256i *) (p - 2));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (p - 1));
+        __m256i c = _mm256_loadu_si256((const __m256i *) p);
+        __m256i e = _mm256_loadu_si256((const __m256i *) (p + 1));
+        __m256i f = _mm256_loadu_si256((const __m256i *) (p + 2));
+
+        __m256i even = _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_mullo_epi32(a, w3), _mm256_mullo_epi32(b, w2)),
+            _mm256_add_epi32(_mm256_mullo_epi32(c, w1), _mm256_mullo_epi32(e, w0)));
+        __m256i odd = _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_mullo_epi32(b, w0), _mm256_mullo_epi32(c, w1)),
+            _mm256_add_epi32(_mm256_mullo_epi32(e, w2), _mm256_mullo_epi32(f, w3)));
+        even = _mm256_srai_epi32(_mm256_add_epi32(even, round), 14);
+        odd = _mm256_srai_epi32(_mm256_add_epi32(odd, round), 14);
+        even = _mm256_min_epi32(_mm256_max_epi32(even, zero), max);
+        odd = _mm256_min_epi32(_mm256_max_epi32(odd, zero), max);
+
+        __m256i value = _mm256_srl_epi16(load_source(s + x * source.step, source.step), drop);
+        _mm256_storeu_si256((__m256i *) (d + x), _mm256_sub_epi16(
+            _mm256_sll_epi16(value, count), interleave_s16(even, odd)));
+    }
+    return x;
+}
+
+struct UpsampleRowAvx2 {
+    static unsigned vertical(const int16_t *const rows[], const int32_t weight[], int32_t *out,
+                             unsigned n) {
+        return upsample_vertical(rows, weight, out, n);
+    }
+
+    template <typename T>
+    static unsigned horizontal_residual(const int32_t *in, const T *s, int16_t *d, unsigned n,
+                                        const LcevcUpsampleKernel &kernel,
+                                        const LcevcSourcePlane &source) {
+        return upsample_residual_row(in, s, d, n, kernel, source);
+    }
+};
+
+// Quantization constants broadcast once per block row
+struct QuantAvx2 {
+    __m256i rounding;
+    __m256i step_width;
+    __m256i max_level;
+    __m256 inv_step_width;
+
+    explicit QuantAvx2(const LcevcQuantizer &quant)
+        : rounding(_mm256_set1_epi32(quant.rounding)),
+          step_width(_mm256_set1_epi32(quant.step_width)),
+          max_level(_mm256_set1_epi32(LCEVC_MAX_COEFFICIENT)),
+          inv_step_width(_mm256_set1_ps(quant.inv_step_width)) {}
+};
+
+// Same arithmetic as lcevc_quantize(), eight coefficients at a time
+static inline __m256i quantize(__m256i coeff, const QuantAvx2 &q) {
+    __m256i magnitude = _mm256_add_epi32(_mm256_abs_epi32(coeff), q.rounding);
+    __m256i level = _mm256_cvttps_epi32(
+        _mm256_mul_ps(_mm256_cvtepi32_ps(magnitude), q.inv_step_width));
+    return _mm256_sign_epi32(_mm256_min_epi32(level, q.max_level), coeff);
+}
+
+static inline __m256i dequantize(const int16_t *p, const QuantAvx2 &q) {
+    __m256i level = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) p));
+    return _mm256_mullo_epi32(level, q.step_width);
+}
+
+static inline void store_levels(int16_t *p, __m256i level) {
+    _mm_storeu_si128((__m128i *) p, _mm_packs_epi32(_mm256_castsi256_si128(level),
+                                                    _mm256_extracti128_si256(level, 1)));
+}
+
+// Even and odd samples of 16, sign extended
+static inline void load_pairs(const int16_t *p, __m256i &even, __m256i &odd) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) p);
+    even = _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+    odd = _mm256_srai_epi32(v, 16);
+}
+
+// Directional decomposition of eight 2x2 blocks at once, same order as
+// lcevc_dd_forward(). The inverse has the same butterfly.
+static inline void dd(__m256i a, __m256i b, __m256i c, __m256i d, __m256i out[4]) {
+    __m256i ab = _mm256_add_epi32(a, b);
+    __m256i a_b = _mm256_sub_epi32(a, b);
+    __m256i cd = _mm256_add_epi32(c, d);
+    __m256i c_d = _mm256_sub_epi32(c, d);
+
+    out[0] = _mm256_add_epi32(ab, cd);
+    out[1] = _mm256_add_epi32(a_b, c_d);
+    out[2] = _mm256_sub_epi32(ab, cd);
+    out[3] = _mm256_sub_epi32(a_b, c_d);
+}
+
+// Eight blocks per iteration: the samples of a block row are split into
+// even and odd columns in 32-bit lanes, one block per lane
+static unsigned forward_dd(const int16_t *const rows[], int16_t *const layers[], unsigned n,
+                           const QuantAvx2 &q) {
+    unsigned bx = 0;
+
+    for (; bx + 8 <= n; bx += 8) {
+        __m256i a, b, c, d, coeffs[4];
+        load_pairs(rows[0] + 2 * bx, a, b);
+        load_pairs(rows[1] + 2 * bx, c, d);
+        dd(a, b, c, d, coeffs);
+
+        for (unsigned l = 0; l < 4; l++)
+            store_levels(layers[l] + bx, quantize(coeffs[l], q));
+    }
+    return bx;
+}
+
+static unsigned inverse_dd(const int16_t *const layers[], int16_t *const rows[], unsigned n,
+                           const QuantAvx2 &q) {
+    unsigned bx = 0;
+
+    for (; bx + 8 <= n; bx += 8) {
+        __m256i values[4];
+        dd(dequantize(layers[0] + bx, q), dequantize(layers[1] + bx, q),
+           dequantize(layers[2] + bx, q), dequantize(layers[3] + bx, q), values);
+
+        _mm256_storeu_si256((__m256i *) (rows[0] + 2 * bx),
+                            interleave_s16(_mm256_srai_epi32(values[0], 2),
+                                           _mm256_srai_epi32(values[1], 2)));
+        _mm256_storeu_si256((__m256i *) (rows[1] + 2 * bx),
+                            interleave_s16(_mm256_srai_epi32(values[2], 2),
+                                           _mm256_srai_epi32(values[3], 2)));
+    }
+    return bx;
+}
+
+// Inner DDs of four blocks, for the top (y = 0) or bottom (y = 2) quarters.
+// Lanes alternate between the left and right quarter of each block; the
+// outer DD is then the sum and difference of the top and bottom quarters,
+// followed by the sum and difference of neighbouring lanes.
+static inline void dds_half(const int16_t *const rows[], unsigned x, __m256i sum[4],
+                            __m256i diff[4]) {
+    __m256i a, b, c, d, top[4], bottom[4];
+
+    load_pairs(rows[0] + x, a, b);
+    load_pairs(rows[1] + x, c, d);
+    dd(a, b, c, d, top);
+    load_pairs(rows[2] + x, a, b);
+    load_pairs(rows[3] + x, c, d);
+    dd(a, b, c, d, bottom);
+
+    for (unsigned k = 0; k < 4; k++) {
+        sum[k] = _mm256_add_epi32(top[k], bottom[k]);
+        diff[k] = _mm256_sub_epi32(top[k], bottom[k]);
+    }
+}
+
+static unsigned forward_dds(const int16_t *const rows[], int16_t *const layers[], unsigned n,
+                            const QuantAvx2 &q) {
+    unsigned bx = 0;
+
+    for (; bx + 8 <= n; bx += 8) {
+        __m256i sum0[4], diff0[4], sum1[4], diff1[4];
+        dds_half(rows, 4 * bx, sum0, diff0);
+        dds_half(rows, 4 * bx + 16, sum1, diff1);
+
+        // hadd/hsub work per 128-bit lane, put the quarters back in order
+        for (unsigned c = 0; c < 4; c++) {
+            __m256i outer[4] = {
+                _mm256_hadd_epi32(sum0[c], sum1[c]),
+                _mm256_hsub_epi32(sum0[c], sum1[c]),
+                _mm256_hadd_epi32(diff0[c], diff1[c]),
+                _mm256_hsub_epi32(diff0[c], diff1[c]),
+            };
+            for (unsigned t = 0; t < 4; t++) {
+                __m256i coeffs = _mm256_permute4x64_epi64(outer[t], _MM_SHUFFLE(3, 1, 2, 0));
+                store_levels(layers[c * 4 + t] + bx, quantize(coeffs, q));
+            }
+        }
+    }
+    return bx;
+}
+
+static unsigned inverse_dds(const int16_t *const layers[], int16_t *const rows[], unsigned n,
+                            const QuantAvx2 &q) {
+    unsigned bx = 0;
+
+    for (; bx + 8 <= n; bx += 8) {
+        __m256i inner[4][4];
+        for (unsigned c = 0; c < 4; c++) {
+            __m256i outer[4];
+            dd(dequantize(layers[c * 4 + 0] + bx, q), dequantize(layers[c * 4 + 1] + bx, q),
+               dequantize(layers[c * 4 + 2] + bx, q), dequantize(layers[c * 4 + 3] + bx, q),
+               outer);
+            for (unsigned k = 0; k < 4; k++)
+                inner[k][c] = outer[k];
+        }
+
+        // Row pairs of each quarter, then the left and right quarters of
+        // each block side by side
+        __m256i pairs[4][2];
+        for (unsigned k = 0; k < 4; k++) {
+            __m256i values[4];
+            dd(inner[k][0], inner[k][1], inner[k][2], inner[k][3], values);
+            for (unsigned r = 0; r < 2; r++)
+                pairs[k][r] = interleave_s16(_mm256_srai_epi32(values[2 * r], 4),
+                                             _mm256_srai_epi32(values[2 * r + 1], 4));
+        }
+
+        for (unsigned y = 0; y < 4; y++) {
+            __m256i left = pairs[(y >> 1) * 2][y & 1];
+            __m256i right = pairs[(y >> 1) * 2 + 1][y & 1];
+            __m256i lo = _mm256_unpacklo_epi32(left, right);
+            __m256i hi = _mm256_unpackhi_epi32(left, right);
+
+            _mm256_storeu_si256((__m256i *) (rows[y] + 4 * bx),
+                                _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i *) (rows[y] + 4 * bx + 16),
+                                _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+    }
+    return bx;
+}
+
+struct TransformAvx2 {
+    template <unsigned BlockSize>
+    static unsigned forward(const int16_t *const rows[], int16_t *const layers[], unsigned n,
+                            const LcevcQuantizer &quant) {
+        const QuantAvx2 q(quant);
+        return BlockSize == 2 ? forward_dd(rows, layers, n, q) : forward_dds(rows, layers, n, q);
+    }
+
+    template <unsigned BlockSize>
+    static unsigned inverse(const int16_t *const layers[], int16_t *const rows[], unsigned n,
+                            const LcevcQuantizer &quant) {
+        const QuantAvx2 q(quant);
+        return BlockSize == 2 ? inverse_dd(layers, rows, n, q) : inverse_dds(layers, rows, n, q);
+    }
+};
+
+// Thirty-two coefficients per iteration: a compare with zero, then the
+// first clear bit of the byte mask
+static unsigned find_nonzero(const int16_t *p, unsigned n) {
+    const __m256i zero = _mm256_setzero_si256();
+    unsigned x = 0;
+
+    for (; x + 32 <= n; x += 32) {
+        __m256i a = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *) (p + x)), zero);
+        __m256i b = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *) (p + x + 16)), zero);
+        // packs works per 128-bit lane, put the quarters back in order
+        __m256i eq = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(eq);
+        if (mask != 0xffffffff)
+            return x + (unsigned) __builtin_ctz(~mask);
+    }
+    while (x < n && p[x] == 0)
+        x++;
+    return x;
+}
+
+// Thirty-two samples per iteration, as in the SSE4.1 variant
+static unsigned sad_row(const uint8_t *a, const uint8_t *b, unsigned n, uint32_t *sum) {
+    __m256i acc = _mm256_setzero_si256();
+    unsigned x = 0;
+
+    for (; x + 32 <= n; x += 32)
+        acc = _mm256_add_epi64(acc,
+            _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *) (a + x)),
+                            _mm256_loadu_si256((const __m256i *) (b + x))));
+
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    *sum += (uint32_t) (_mm_cvtsi128_si64(half) + _mm_extract_epi64(half, 1));
+    return x;
+}
+
+static unsigned sad_row(const uint16_t *a, const uint16_t *b, unsigned n, uint32_t *sum) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+    unsigned x = 0;
+
+    for (; x + 32 <= n; x += 32) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *) (a + x));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *) (b + x));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *) (a + x + 16));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *) (b + x + 16));
+        __m256i d0 = _mm256_or_si256(_mm256_subs_epu16(a0, b0), _mm256_subs_epu16(b0, a0));
+        __m256i d1 = _mm256_or_si256(_mm256_subs_epu16(a1, b1), _mm256_subs_epu16(b1, a1));
+
+        acc = _mm256_add_epi32(acc, _mm256_add_epi32(_mm256_unpacklo_epi16(d0, zero),
+                                                     _mm256_unpackhi_epi16(d0, zero)));
+        acc = _mm256_add_epi32(acc, _mm256_add_epi32(_mm256_unpacklo_epi16(d1, zero),
+                                                     _mm256_unpackhi_epi16(d1, zero)));
+    }
+
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    *sum += (uint32_t) _mm_cvtsi128_si32(half);
+    return x;
+}
+
+struct SadRowAvx2 {
+    template <typename T>
+    static unsigned row(const T *a, const T *b, unsigned n, uint32_t *sum) {
+        return sad_row(a, b, n, sum);
+    }
+};
+
+void lcevc_dsp_init_avx2(LcevcDsp *dsp) {
+    dsp->downsample_2d_8 = lcevc_downsample_plane<uint8_t, 2, DownsampleRowAvx2>;
+    dsp->downsample_2d_16 = lcevc_downsample_plane<uint16_t, 2, DownsampleRowAvx2>;
+    dsp->downsample_1d_8 = lcevc_downsample_plane<uint8_t, 1, DownsampleRowAvx2>;
+    dsp->downsample_1d_16 = lcevc_downsample_plane<uint16_t, 1, DownsampleRowAvx2>;
+    dsp->upsample_residual_2d_8 = lcevc_upsample_residual_plane<uint8_t, 2, UpsampleRowAvx2>;
+    dsp->upsample_residual_2d_16 = lcevc_upsample_residual_plane<uint16_t, 2, UpsampleRowAvx2>;
+    dsp->upsample_residual_1d_8 = lcevc_upsample_residual_plane<uint8_t, 1, UpsampleRowAvx2>;
+    dsp->upsample_residual_1d_16 = lcevc_upsample_residual_plane<uint16_t, 1, UpsampleRowAvx2>;
+    dsp->transform_quantize[LCEVC_TRANSFORM_DD] = lcevc_transform_quantize_plane<2, TransformAvx2>;
+    dsp->transform_quantize[LCEVC_TRANSFORM_DDS] = lcevc_transform_quantize_plane<4, TransformAvx2>;
+    dsp->dequantize_inverse[LCEVC_TRANSFORM_DD] = lcevc_dequantize_inverse_plane<2, TransformAvx2>;
+    dsp->dequantize_inverse[LCEVC_TRANSFORM_DDS] = lcevc_dequantize_inverse_plane<4, TransformAvx2>;
+    dsp->find_nonzero = find_nonzero;
+    dsp->sad_8 = lcevc_sad_plane<uint8_t, SadRowAvx2>;
+    dsp->sad_16 = lcevc_sad_plane<uint16_t, SadRowAvx2>;
+}
@@ -0,0 +1,549 @@
+#include "lcevcdsp_impl.h"
+
+#include <immintrin.h>
+
+// GCC 12 warns that the _mm512_undefined_*() pass-through of the unmasked
+// forms of these intrinsics may be used uninitialized. Their zero-masked
+// forms with every lane selected build the same instructions without one.
+static const __mmask16 all_lanes = 0xffff;
+
+static inline __m512i srai_epi32(__m512i v, unsigned count) {
+    return _mm512_maskz_srai_epi32(all_lanes, v, count);
+}
+
+static inline __m512i slli_epi32(__m512i v, unsigned count) {
+    return _mm512_maskz_slli_epi32(all_lanes, v, count);
+}
+
+static inline __m512i cvtepi16_epi32(__m256i v) {
+    return _mm512_maskz_cvtepi16_epi32(all_lanes, v);
+}
+
+static inline __m512i abs_epi32(__m512i v) {
+    return _mm512_maskz_abs_epi32(all_lanes, v);
+}
+
+static inline __m512i broadcast_i32x4(__m128i v) {
+    return _mm512_maskz_broadcast_i32x4(all_lanes, v);
+}
+
+static inline __m512i unpacklo_epi32(__m512i a, __m512i b) {
+    return _mm512_maskz_unpacklo_epi32(all_lanes, a, b);
+}
+
+static inline __m512i unpackhi_epi32(__m512i a, __m512i b) {
+    return _mm512_maskz_unpackhi_epi32(all_lanes, a, b);
+}
+
+static inline __m512i min_epi32(__m512i a, __m512i b) {
+    return _mm512_maskz_min_epi32(all_lanes, a, b);
+}
+
+static inline __m512i max_epi32(__m512i a, __m512i b) {
+    return _mm512_maskz_max_epi32(all_lanes, a, b);
+}
+
+static inline __m512i cvttps_epi32(__m512 v) {
+    return _mm512_maskz_cvttps_epi32(all_lanes, v);
+}
+
+static inline __m512 cvtepi32_ps(__m512i v) {
+    return _mm512_maskz_cvtepi32_ps(all_lanes, v);
+}
+
+// Sums of every lane, as _mm512_reduce_add_epi64() and _epi32() whose upper
+// half extraction has the same pass-through
+static inline uint64_t reduce_add_epi64(__m512i v) {
+    __m256i sum = _mm256_add_epi64(_mm512_maskz_extracti64x4_epi64(0xf, v, 0),
+                                   _mm512_maskz_extracti64x4_epi64(0xf, v, 1));
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    return (uint64_t) (_mm_cvtsi128_si64(half) + _mm_extract_epi64(half, 1));
+}
+
+static inline uint32_t reduce_add_epi32(__m512i v) {
+    __m256i sum = _mm256_add_epi32(_mm512_maskz_extracti64x4_epi64(0xf, v, 0),
+                                   _mm512_maskz_extracti64x4_epi64(0xf, v, 1));
+    __m128i quarter = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                    _mm256_extracti128_si256(sum, 1));
+    quarter = _mm_add_epi32(quarter, _mm_shuffle_epi32(quarter, 0x4e));
+    quarter = _mm_add_epi32(quarter, _mm_shuffle_epi32(quarter, 0xb1));
+    return (uint32_t) _mm_cvtsi128_si32(quarter);
+}
+
+// Low 16 bits of every 32-bit lane of two vectors
+static const int16_t even_words[32] = {
+     0,  2,  4,  6,  8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30,
+    32, 34, 36, 38, 40, 42, 44, 46, 48, 50, 52, 54, 56, 58, 60, 62,
+};
+
+template <unsigned Rows>
+static unsigned downsample_row(const uint8_t *s0, const uint8_t *s1, int16_t *d,
+                               unsigned n, const LcevcSourcePlane &src) {
+    const __m512i ones = _mm512_set1_epi8(1);
+    const __m128i count = _mm_cvtsi32_si128((int) (src.shift - Rows));
+    unsigned x = 0;
+
+    if (src.shift < Rows)
+        return 0;
+
+    // Semi-planar chroma: the bytes of the other plane are masked out, then
+    // pairs of words are summed as in the 16-bit kernel. The loads read one
+    // byte past the last sample they use.
+    if (src.step == 2) {
+        const __m512i low = _mm512_set1_epi16(0xff);
+        const __m512i pairs = _mm512_set1_epi16(1);
+        const __m512i even = _mm512_loadu_si512(even_words);
+
+        for (; x + 32 < n; x += 32) {
+            __m512i a = _mm512_and_si512(_mm512_loadu_si512(s0 + 4 * x), low);
+            __m512i b = _mm512_and_si512(_mm512_loadu_si512(s0 + 4 * x + 64), low);
+            if (Rows == 2) {
+                a = _mm512_add_epi16(a, _mm512_and_si512(_mm512_loadu_si512(s1 + 4 * x), low));
+                b = _mm512_add_epi16(b,
+                    _mm512_and_si512(_mm512_loadu_si512(s1 + 4 * x + 64), low));
+            }
+            __m512i sum = _mm512_permutex2var_epi16(_mm512_madd_epi16(a, pairs), even,
+                                                    _mm512_madd_epi16(b, pairs));
+            _mm512_storeu_si512(d + x, _mm512_sll_epi16(sum, count));
+        }
+        return x;
+    }
+
+    // Pairs of horizontal neighbours summed by a multiply-add with ones
+    for (; x + 32 <= n; x += 32) {
+        __m512i sum = _mm512_maddubs_epi16(_mm512_loadu_si512(s0 + 2 * x), ones);
+        if (Rows == 2)
+            sum = _mm512_add_epi16(sum, _mm512_maddubs_epi16(_mm512_loadu_si512(s1 + 2 * x), ones));
+        _mm512_storeu_si512(d + x, _mm512_sll_epi16(sum, count));
+    }
+    return x;
+}
+
+template <unsigned Rows>
+static unsigned downsample_row(const uint16_t *s0, const uint16_t *s1, int16_t *d,
+                               unsigned n, const LcevcSourcePlane &src) {
+    const __m512i ones = _mm512_set1_epi16(1);
+    const __m512i even = _mm512_loadu_si512(even_words);
+    const __m128i drop = _mm_cvtsi32_si128((int) src.drop);
+    const __m128i count = _mm_cvtsi32_si128((int) (src.shift - Rows));
+    unsigned x = 0;
+
+    // The sums fit in 16 bits as long as there is a shift left to do
+    if (src.shift < Rows || src.step != 1)
+        return 0;
+
+    // Neighbour pairs are summed into 32-bit lanes by a multiply-add with
+    // ones, then the low halves of two vectors are gathered back
+    for (; x + 32 <= n; x += 32) {
+        __m512i a = _mm512_srl_epi16(_mm512_loadu_si512(s0 + 2 * x), drop);
+        __m512i b = _mm512_srl_epi16(_mm512_loadu_si512(s0 + 2 * x + 32), drop);
+        if (Rows == 2) {
+            a = _mm512_add_epi16(a, _mm512_srl_epi16(_mm512_loadu_si512(s1 + 2 * x), drop));
+            b = _mm512_add_epi16(b, _mm512_srl_epi16(_mm512_loadu_si512(s1 + 2 * x + 32), drop));
+        }
+        __m512i sum = _mm512_permutex2var_epi16(_mm512_madd_epi16(a, ones), even,
+                                                _mm512_madd_epi16(b, ones));
+        _mm512_storeu_si512(d + x, _mm512_sll_epi16(sum, count));
+    }
+    return x;
+}
+
+struct DownsampleRowAvx512 {
+    template <typename T, unsigned Rows>
+    static unsigned row(const T *s0, const T *s1, int16_t *d, unsigned n,
+                        const LcevcSourcePlane &src) {
+        return downsample_row<Rows>(s0, s1, d, n, src);
+    }
+};
+
+// 128-bit lanes of two vectors interleaved, first and second half. Puts
+// the results of in-lane unpacking back in order.
+static const int64_t lanes_lo[8] = { 0, 1, 8, 9, 2, 3, 10, 11 };
+static const int64_t lanes_hi[8] = { 4, 5, 12, 13, 6, 7, 14, 15 };
+
+// Vertical upsampling pass: pairs of rows interleaved and multiplied with
+// pairs of weights, 32 samples per iteration
+static unsigned upsample_vertical(const int16_t *const rows[], const int32_t weight[],
+                                  int32_t *out, unsigned n) {
+    const __m512i w01 = _mm512_unpacklo_epi16(_mm512_set1_epi16((int16_t) weight[0]),
+                                              _mm512_set1_epi16((int16_t) weight[1]));
+    const __m512i w23 = _mm512_unpacklo_epi16(_mm512_set1_epi16((int16_t) weight[2]),
+                                              _mm512_set1_epi16((int16_t) weight[3]));
+    const __m512i round = _mm512_set1_epi32(8192);
+    const __m512i first = _mm512_loadu_si512(lanes_lo);
+    const __m512i last = _mm512_loadu_si512(lanes_hi);
+    unsigned x = 0;
+
+    for (; x + 32 <= n; x += 32) {
+        __m512i r0 = _mm512_loadu_si512(rows[0] + x);
+        __m512i r1 = _mm512_loadu_si512(rows[1] + x);
+        __m512i r2 = _mm512_loadu_si512(rows[2] + x);
+        __m512i r3 = _mm512_loadu_si512(rows[3] + x);
+
+        __m512i lo = _mm512_add_epi32(
+            _mm512_add_epi32(_mm512_madd_epi16(_mm512_unpacklo_epi16(r0, r1), w01),
+                             _mm512_madd_epi16(_mm512_unpacklo_epi16(r2, r3), w23)), round);
+        __m512i hi = _mm512_add_epi32(
+            _mm512_add_epi32(_mm512_madd_epi16(_mm512_unpackhi_epi16(r0, r1), w01),
+                             _mm512_madd_epi16(_mm512_unpackhi_epi16(r2, r3), w23)), round);
+        lo = srai_epi32(lo, 14);
+        hi = srai_epi32(hi, 14);
+
+        _mm512_storeu_si512(out + x, _mm512_permutex2var_epi64(lo, first, hi));
+        _mm512_storeu_si512(out + x + 16, _mm512_permutex2var_epi64(lo, last, hi));
+    }
+    return x;
+}
+
+static inline __m512i load_source(const uint8_t *s, unsigned step) {
+    if (step == 2)
+        return _mm512_and_si512(_mm512_loadu_si512(s), _mm512_set1_epi16(0xff));
+    return _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *) s));
+}
+
+static inline __m512i load_source(const uint16_t *s, unsigned) {
+    return _mm512_loadu_si512(s);
+}
+
+// Saturate two vectors of values to 16 bits and interleave them. Gives the
+// upsampled pairs of sixteen intermediates, or the two samples of sixteen
+// blocks in one row.
+static inline __m512i interleave_s16(__m512i even, __m512i odd) {
+    const __m512i order = broadcast_i32x4(_mm_setr_epi8(
+        0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15));
+    return _mm512_shuffle_epi8(_mm512_packs_epi32(even, odd), order);
+}
+
+// Horizontal upsampling pass and residual, 32 outputs per iteration, see
+// the AVX2 variant
+template <typename T>
+static unsigned upsample_residual_row(const int32_t *in, const T *s, int16_t *d, unsigned n,
+                                      const LcevcUpsampleKernel &kernel,
+                                      const LcevcSourcePlane &source) {
+    const __m512i w0 = _mm512_set1_epi32(kernel.taps[0]);
+    const __m512i w1 = _mm512_set1_epi32(kernel.taps[1]);
+    const __m512i w2 = _mm512_set1_epi32(kernel.taps[2]);
+    const __m512i w3 = _mm512_set1_epi32(kernel.taps[3]);
+    const __m512i round = _mm512_set1_epi32(8192);
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i max = _mm512_set1_epi32(LCEVC_INTERNAL_MAX);
+    const __m128i drop = _mm_cvtsi32_si128((int) source.drop);
+    const __m128i count = _mm_cvtsi32_si128((int) source.shift);
+    const unsigned margin = source.step - 1;
+    unsigned x = 0;
+
+    if (sizeof(T) == 2 && source.step != 1)
+        return 0;
+
+    for (; x + 32 + margin <= n; x += 32) {
+        const int32_t *p = in + x / 2;
+        __m512i a = _mm512_loadu_si512(p - 2);
+        __m512i b = _mm512_loadu_si512(p - 1);
+        __m512i c = _mm512_loadu_si512(p);
+        __m512i e = _mm512_loadu_si512(p + 1);
+        __m512i f = _mm512_loadu_si512(p + 2);
+
+        __m512i even = _mm512_add_epi32(
+            _mm512_add_epi32(_mm512_mullo_epi32(a, w3), _mm512_mullo_epi32(b, w2)),
+            _mm512_add_epi32(_mm512_mullo_epi32(c, w1), _mm512_mullo_epi32(e, w0)));
+        __m512i odd = _mm512_add_epi32(
+            _mm512_add_epi32(_mm512_mullo_epi32(b, w0), _mm512_mullo_epi32(c, w1)),
+            _mm512_add_epi32(_mm512_mullo_epi32(e, w2), _mm512_mullo_epi32(f, w3)));
+        even = srai_epi32(_mm512_add_epi32(even, round), 14);
+        odd = srai_epi32(_mm512_add_epi32(odd, round), 14);
+        even = min_epi32(max_epi32(even, zero), max);
+        odd = min_epi32(max_epi32(odd, zero), max);
+
+        __m512i value = _mm512_srl_epi16(load_source(s + x * source.step, source.step), drop);
+        _mm512_storeu_si512(d + x, _mm512_sub_epi16(_mm512_sll_epi16(value, count),
+                                                     interleave_s16(even, odd)));
+    }
+    return x;
+}
+
+struct UpsampleRowAvx512 {
+    static unsigned vertical(const int16_t *const rows[], const int32_t weight[], int32_t *out,
+                             unsigned n) {
+        return upsample_vertical(rows, weight, out, n);
+    }
+
+    template <typename T>
+    static unsigned horizontal_residual(const int32_t *in, const T *s, int16_t *d, unsigned n,
+                                        const LcevcUpsampleKernel &kernel,
+                                        const LcevcSourcePlane &source) {
+        return upsample_residual_row(in, s, d, n, kernel, source);
+    }
+};
+
+// Quantization constants broadcast once per block row
+struct QuantAvx512 {
+    __m512i rounding;
+    __m512i step_width;
+    __m512i max_level;
+    __m512 inv_step_width;
+
+    explicit QuantAvx512(const LcevcQuantizer &quant)
+        : rounding(_mm512_set1_epi32(quant.rounding)),
+          step_width(_mm512_set1_epi32(quant.step_width)),
+          max_level(_mm512_set1_epi32(LCEVC_MAX_COEFFICIENT)),
+          inv_step_width(_mm512_set1_ps(quant.inv_step_width)) {}
+};
+
+// Same arithmetic as lcevc_quantize(), sixteen coefficients at a time
+static inline __m512i quantize(__m512i coeff, const QuantAvx512 &q) {
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i magnitude = _mm512_add_epi32(abs_epi32(coeff), q.rounding);
+    __m512i level = cvttps_epi32(
+        _mm512_mul_ps(cvtepi32_ps(magnitude), q.inv_step_width));
+    level = min_epi32(level, q.max_level);
+    return _mm512_mask_sub_epi32(level, _mm512_cmplt_epi32_mask(coeff, zero), zero, level);
+}
+
+static inline __m512i dequantize(const int16_t *p, const QuantAvx512 &q) {
+    __m512i level = cvtepi16_epi32(_mm256_loadu_si256((const __m256i *) p));
+    return _mm512_mullo_epi32(level, q.step_width);
+}
+
+static inline void store_levels(int16_t *p, __m512i level) {
+    _mm512_mask_cvtsepi32_storeu_epi16(p, 0xffff, level);
+}
+
+// Even and odd samples of 32, sign extended
+static inline void load_pairs(const int16_t *p, __m512i &even, __m512i &odd) {
+    __m512i v = _mm512_loadu_si512(p);
+    even = srai_epi32(slli_epi32(v, 16), 16);
+    odd = srai_epi32(v, 16);
+}
+
+// Directional decomposition of sixteen 2x2 blocks at once, same order as
+// lcevc_dd_forward(). The inverse has the same butterfly.
+static inline void dd(__m512i a, __m512i b, __m512i c, __m512i d, __m512i out[4]) {
+    __m512i ab = _mm512_add_epi32(a, b);
+    __m512i a_b = _mm512_sub_epi32(a, b);
+    __m512i cd = _mm512_add_epi32(c, d);
+    __m512i c_d = _mm512_sub_epi32(c, d);
+
+    out[0] = _mm512_add_epi32(ab, cd);
+    out[1] = _mm512_add_epi32(a_b, c_d);
+    out[2] = _mm512_sub_epi32(ab, cd);
+    out[3] = _mm512_sub_epi32(a_b, c_d);
+}
+
+static unsigned forward_dd(const int16_t *const rows[], int16_t *const layers[], unsigned n,
+                           const QuantAvx512 &q) {
+    unsigned bx = 0;
+
+    for (; bx + 16 <= n; bx += 16) {
+        __m512i a, b, c, d, coeffs[4];
+        load_pairs(rows[0] + 2 * bx, a, b);
+        load_pairs(rows[1] + 2 * bx, c, d);
+        dd(a, b, c, d, coeffs);
+
+        for (unsigned l = 0; l < 4; l++)
+            store_levels(layers[l] + bx, quantize(coeffs[l], q));
+    }
+    return bx;
+}
+
+static unsigned inverse_dd(const int16_t *const layers[], int16_t *const rows[], unsigned n,
+                           const QuantAvx512 &q) {
+    unsigned bx = 0;
+
+    for (; bx + 16 <= n; bx += 16) {
+        __m512i values[4];
+        dd(dequantize(layers[0] + bx, q), dequantize(layers[1] + bx, q),
+           dequantize(layers[2] + bx, q), dequantize(layers[3] + bx, q), values);
+
+        _mm512_storeu_si512(rows[0] + 2 * bx,
+                            interleave_s16(srai_epi32(values[0], 2),
+                                           srai_epi32(values[1], 2)));
+        _mm512_storeu_si512(rows[1] + 2 * bx,
+                            interleave_s16(srai_epi32(values[2], 2),
+                                           srai_epi32(values[3], 2)));
+    }
+    return bx;
+}
+
+// Inner DDs of eight blocks, see the AVX2 variant
+static inline void dds_half(const int16_t *const rows[], unsigned x, __m512i sum[4],
+                            __m512i diff[4]) {
+    __m512i a, b, c, d, top[4], bottom[4];
+
+    load_pairs(rows[0] + x, a, b);
+    load_pairs(rows[1] + x, c, d);
+    dd(a, b, c, d, top);
+    load_pairs(rows[2] + x, a, b);
+    load_pairs(rows[3] + x, c, d);
+    dd(a, b, c, d, bottom);
+
+    for (unsigned k = 0; k < 4; k++) {
+        sum[k] = _mm512_add_epi32(top[k], bottom[k]);
+        diff[k] = _mm512_sub_epi32(top[k], bottom[k]);
+    }
+}
+
+// Even and odd 32-bit lanes of two vectors
+static const int32_t even_dwords[16] = {
+    0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30,
+};
+static const int32_t odd_dwords[16] = {
+    1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31,
+};
+
+static unsigned forward_dds(const int16_t *const rows[], int16_t *const layers[], unsigned n,
+                            const QuantAvx512 &q) {
+    const __m512i even = _mm512_loadu_si512(even_dwords);
+    const __m512i odd = _mm512_loadu_si512(odd_dwords);
+    unsigned bx = 0;
+
+    for (; bx + 16 <= n; bx += 16) {
+        __m512i sum0[4], diff0[4], sum1[4], diff1[4];
+        dds_half(rows, 4 * bx, sum0, diff0);
+        dds_half(rows, 4 * bx + 32, sum1, diff1);
+
+        // No horizontal add at this width: gather the left and right
+        // quarters of the sixteen blocks, then add and subtract
+        for (unsigned c = 0; c < 4; c++) {
+            __m512i sl = _mm512_permutex2var_epi32(sum0[c], even, sum1[c]);
+            __m512i sr = _mm512_permutex2var_epi32(sum0[c], odd, sum1[c]);
+            __m512i dl = _mm512_permutex2var_epi32(diff0[c], even, diff1[c]);
+            __m512i dr = _mm512_permutex2var_epi32(diff0[c], odd, diff1[c]);
+
+            store_levels(layers[c * 4 + 0] + bx, quantize(_mm512_add_epi32(sl, sr), q));
+            store_levels(layers[c * 4 + 1] + bx, quantize(_mm512_sub_epi32(sl, sr), q));
+            store_levels(layers[c * 4 + 2] + bx, quantize(_mm512_add_epi32(dl, dr), q));
+            store_levels(layers[c * 4 + 3] + bx, quantize(_mm512_sub_epi32(dl, dr), q));
+        }
+    }
+    return bx;
+}
+
+static unsigned inverse_dds(const int16_t *const layers[], int16_t *const rows[], unsigned n,
+                            const QuantAvx512 &q) {
+    const __m512i first = _mm512_loadu_si512(lanes_lo);
+    const __m512i last = _mm512_loadu_si512(lanes_hi);
+    unsigned bx = 0;
+
+    for (; bx + 16 <= n; bx += 16) {
+        __m512i inner[4][4];
+        for (unsigned c = 0; c < 4; c++) {
+            __m512i outer[4];
+            dd(dequantize(layers[c * 4 + 0] + bx, q), dequantize(layers[c * 4 + 1] + bx, q),
+               dequantize(layers[c * 4 + 2] + bx, q), dequantize(layers[c * 4 + 3] + bx, q),
+               outer);
+            for (unsigned k = 0; k < 4; k++)
+                inner[k][c] = outer[k];
+        }
+
+        __m512i pairs[4][2];
+        for (unsigned k = 0; k < 4; k++) {
+            __m512i values[4];
+            dd(inner[k][0], inner[k][1], inner[k][2], inner[k][3], values);
+            for (unsigned r = 0; r < 2; r++)
+                pairs[k][r] = interleave_s16(srai_epi32(values[2 * r], 4),
+                                             srai_epi32(values[2 * r + 1], 4));
+        }
+
+        for (unsigned y = 0; y < 4; y++) {
+            __m512i left = pairs[(y >> 1) * 2][y & 1];
+            __m512i right = pairs[(y >> 1) * 2 + 1][y & 1];
+            __m512i lo = unpacklo_epi32(left, right);
+            __m512i hi = unpackhi_epi32(left, right);
+
+            _mm512_storeu_si512(rows[y] + 4 * bx, _mm512_permutex2var_epi64(lo, first, hi));
+            _mm512_storeu_si512(rows[y] + 4 * bx + 32, _mm512_permutex2var_epi64(lo, last, hi));
+        }
+    }
+    return bx;
+}
+
+struct TransformAvx512 {
+    template <unsigned BlockSize>
+    static unsigned forward(const int16_t *const rows[], int16_t *const layers[], unsigned n,
+                            const LcevcQuantizer &quant) {
+        const QuantAvx512 q(quant);
+        return BlockSize == 2 ? forward_dd(rows, layers, n, q) : forward_dds(rows, layers, n, q);
+    }
+
+    template <unsigned BlockSize>
+    static unsigned inverse(const int16_t *const layers[], int16_t *const rows[], unsigned n,
+                            const LcevcQuantizer &quant) {
+        const QuantAvx512 q(quant);
+        return BlockSize == 2 ? inverse_dd(layers, rows, n, q) : inverse_dds(layers, rows, n, q);
+    }
+};
+
+// Sixty-four coefficients per iteration, tested straight into masks
+static unsigned find_nonzero(const int16_t *p, unsigned n) {
+    unsigned x = 0;
+
+    for (; x + 64 <= n; x += 64) {
+        __m512i a = _mm512_loadu_si512(p + x);
+        __m512i b = _mm512_loadu_si512(p + x + 32);
+        uint64_t mask = (uint64_t) _mm512_test_epi16_mask(a, a) |
+                        (uint64_t) _mm512_test_epi16_mask(b, b) << 32;
+        if (mask)
+            return x + (unsigned) __builtin_ctzll(mask);
+    }
+    while (x < n && p[x] == 0)
+        x++;
+    return x;
+}
+
+// Sixty-four 8-bit or thirty-two 16-bit samples per iteration
+static unsigned sad_row(const uint8_t *a, const uint8_t *b, unsigned n, uint32_t *sum) {
+    __m512i acc = _mm512_setzero_si512();
+    unsigned x = 0;
+
+    for (; x + 64 <= n; x += 64)
+        acc = _mm512_add_epi64(acc, _mm512_sad_epu8(_mm512_loadu_si512(a + x),
+                                                    _mm512_loadu_si512(b + x)));
+    *sum += (uint32_t) reduce_add_epi64(acc);
+    return x;
+}
+
+static unsigned sad_row(const uint16_t *a, const uint16_t *b, unsigned n, uint32_t *sum) {
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i acc = _mm512_setzero_si512();
+    unsigned x = 0;
+
+    for (; x + 32 <= n; x += 32) {
+        __m512i va = _mm512_loadu_si512(a + x);
+        __m512i vb = _mm512_loadu_si512(b + x);
+        __m512i d = _mm512_or_si512(_mm512_subs_epu16(va, vb), _mm512_subs_epu16(vb, va));
+
+        acc = _mm512_add_epi32(acc, _mm512_add_epi32(_mm512_unpacklo_epi16(d, zero),
+                                                     _mm512_unpackhi_epi16(d, zero)));
+    }
+    *sum += reduce_add_epi32(acc);
+    return x;
+}
+
+struct SadRowAvx512 {
+    template <typename T>
+    static unsigned row(const T *a, const T *b, unsigned n, uint32_t *sum) {
+        return sad_row(a, b, n, sum);
+    }
+};
+
+void lcevc_dsp_init_avx512(LcevcDsp *dsp) {
+    dsp->downsample_2d_8 = lcevc_downsample_plane<uint8_t, 2, DownsampleRowAvx512>;
+    dsp->downsample_2d_16 = lcevc_downsample_plane<uint16_t, 2, DownsampleRowAvx512>;
+    dsp->downsample_1d_8 = lcevc_downsample_plane<uint8_t, 1, DownsampleRowAvx512>;
+    dsp->downsample_1d_16 = lcevc_downsample_plane<uint16_t, 1, DownsampleRowAvx512>;
+    dsp->upsample_residual_2d_8 = lcevc_upsample_residual_plane<uint8_t, 2, UpsampleRowAvx512>;
+    dsp->upsample_residual_2d_16 = lcevc_upsample_residual_plane<uint16_t, 2, UpsampleRowAvx512>;
+    dsp->upsample_residual_1d_8 = lcevc_upsample_residual_plane<uint8_t, 1, UpsampleRowAvx512>;
+    dsp->upsample_residual_1d_16 = lcevc_upsample_residual_plane<uint16_t, 1, UpsampleRowAvx512>;
+    dsp->transform_quantize[LCEVC_TRANSFORM_DD] =
+        lcevc_transform_quantize_plane<2, TransformAvx512>;
+    dsp->transform_quantize[LCEVC_TRANSFORM_DDS] =
+        lcevc_transform_quantize_plane<4, TransformAvx512>;
+    dsp->dequantize_inverse[LCEVC_TRANSFORM_DD] =
+        lcevc_dequantize_inverse_plane<2, TransformAvx512>;
+    dsp->dequantize_inverse[LCEVC_TRANSFORM_DDS] =
+        lcevc_dequantize_inverse_plane<4, TransformAvx512>;
+    dsp->find_nonzero = find_nonzero;
+    dsp->sad_8 = lcevc_sad_plane<uint8_t, SadRowAvx512>;
+    dsp->sad_16 = lcevc_sad_plane<uint16_t, SadRowAvx512>;
+}
@@ -0,0 +1,401 @@
+#ifndef __LCEVC_DSP_IMPL_H__
+#define __LCEVC_DSP_IMPL_H__
+
+// Shared between the scalar kernels in lcevcdsp.cpp and the SIMD variants,
+// which are built as separate objects with their own instruction set flags.
+// Only include it from those files.
+
+#include "lcevcdsp.h"
+
+#include <cstdlib>
+#include <vector>
+
+// Each variant overrides the entries it implements and leaves the others
+void lcevc_dsp_init_sse41(LcevcDsp *dsp);
+void lcevc_dsp_init_avx2(LcevcDsp *dsp);
+void lcevc_dsp_init_avx512(LcevcDsp *dsp);
+void lcevc_dsp_init_neon(LcevcDsp *dsp);
+
+static inline unsigned lcevc_min_u(unsigned a, unsigned b) {
+    return a < b ? a : b;
+}
+
+static inline int lcevc_clamp_int(int value, int low, int high) {
+    return value < low ? low : (value > high ? high : value);
+}
+
+static inline int16_t lcevc_clamp_s16(int32_t value) {
+    return (int16_t) lcevc_clamp_int(value, -32768, 32767);
+}
+
+// The SIMD variants must reproduce this exactly: one float multiply,
+// truncated towards zero
+static inline int16_t lcevc_quantize(int32_t coeff, const LcevcQuantizer &quant) {
+    int32_t magnitude = coeff < 0 ? -coeff : coeff;
+    int32_t level = (int32_t) ((float) (magnitude + quant.rounding) * quant.inv_step_width);
+
+    if (level > LCEVC_MAX_COEFFICIENT)
+        level = LCEVC_MAX_COEFFICIENT;
+    return (int16_t) (coeff < 0 ? -level : level);
+}
+
+static inline int32_t lcevc_dequantize(int16_t level, const LcevcQuantizer &quant) {
+    return (int32_t) level * quant.step_width;
+}
+
+// Downsampling: box filter over the 2x2 (Rows = 2) or 2x1 (Rows = 1)
+// source footprint. The sum is shifted straight to the internal depth,
+// so nothing is lost for sources of up to 15 - Rows bits.
+template <typename T, unsigned Rows>
+static inline int16_t lcevc_downsample_sample(const T *s0, const T *s1, unsigned x0,
+                                              unsigned x1, const LcevcSourcePlane &src) {
+    const unsigned shift = src.shift;
+    int32_t sum = src.sample(s0, x0) + src.sample(s0, x1);
+    if (Rows == 2)
+        sum += src.sample(s1, x0) + src.sample(s1, x1);
+
+    if (shift >= Rows)
+        return (int16_t) (sum << (shift - Rows));
+    return (int16_t) ((sum + (1 << (Rows - shift - 1))) >> (Rows - shift));
+}
+
+// Run a downsampling row kernel over rows [y0, y1) of dst.
+// Kernel::row<T, Rows>() handles a prefix of the first n samples of a row,
+// whose footprint lies inside the source, and returns how many it wrote;
+// the rest are done here with edge replication. Kernels return 0 for the
+// sample layouts of src they have no fast path for.
+template <typename T, unsigned Rows, typename Kernel>
+static void lcevc_downsample_plane(const LcevcSourcePlane &src, const LcevcSurface &dst,
+                                   unsigned y0, unsigned y1) {
+    const unsigned last_col = src.width - 1;
+    const unsigned last_row = src.height - 1;
+    const unsigned inner = lcevc_min_u(dst.width, src.width / 2);
+
+    for (unsigned y = y0; y < y1; y++) {
+        const T *s0 = src.row<T>(lcevc_min_u(Rows * y, last_row));
+        const T *s1 = src.row<T>(lcevc_min_u(Rows * y + Rows - 1, last_row));
+        int16_t *d = dst.row(y);
+        unsigned x = Kernel::template row<T, Rows>(s0, s1, d, inner, src);
+
+        for (; x < dst.width; x++)
+            d[x] = lcevc_downsample_sample<T, Rows>(s0, s1, lcevc_min_u(2 * x, last_col),
+                                                    lcevc_min_u(2 * x + 1, last_col), src);
+    }
+}
+
+struct LcevcDownsampleRowC {
+    template <typename T, unsigned Rows>
+    static unsigned row(const T *s0, const T *s1, int16_t *d, unsigned n,
+                        const LcevcSourcePlane &src) {
+        for (unsigned x = 0; x < n; x++)
+            d[x] = lcevc_downsample_sample<T, Rows>(s0, s1, 2 * x, 2 * x + 1, src);
+        return n;
+    }
+};
+
+// Upsampling runs a vertical pass over the four source rows into a row of
+// 32-bit intermediates, then the horizontal pass. Each upsampled sample is
+// subtracted from the source as soon as it is computed. The intermediate
+// row is padded with edge replication on both sides, so the horizontal pass
+// needs no bounds checks.
+#define LCEVC_UPSAMPLE_PAD 2
+
+// Source positions and weights of the four taps for output 2 * i + odd
+static inline void lcevc_upsample_taps(const LcevcUpsampleKernel &kernel, unsigned odd,
+                                       int i, int last, int pos[4], int32_t weight[4]) {
+    for (int t = 0; t < 4; t++) {
+        pos[t] = lcevc_clamp_int(odd ? i - 1 + t : i - 2 + t, 0, last);
+        weight[t] = odd ? kernel.taps[t] : kernel.taps[3 - t];
+    }
+}
+
+static inline int32_t lcevc_upsample_vertical(const int16_t *const rows[], const int32_t weight[],
+                                              unsigned x) {
+    int32_t sum = weight[0] * rows[0][x] + weight[1] * rows[1][x] +
+                  weight[2] * rows[2][x] + weight[3] * rows[3][x];
+    return (sum + 8192) >> 14;
+}
+
+// Output x of the horizontal pass over a padded intermediate row
+static inline int16_t lcevc_upsample_horizontal(const int32_t *in,
+                                                const LcevcUpsampleKernel &kernel, unsigned x) {
+    const int32_t *p = in + (x >> 1);
+    int32_t sum;
+
+    if (x & 1)
+        sum = kernel.taps[0] * p[-1] + kernel.taps[1] * p[0] +
+              kernel.taps[2] * p[1] + kernel.taps[3] * p[2];
+    else
+        sum = kernel.taps[3] * p[-2] + kernel.taps[2] * p[-1] +
+              kernel.taps[1] * p[0] + kernel.taps[0] * p[1];
+    return (int16_t) lcevc_clamp_int((sum + 8192) >> 14, 0, LCEVC_INTERNAL_MAX);
+}
+
+// Upsample src and subtract it from the source plane into columns [x0, x1)
+// of rows [y0, y1) of dst. Dims is 2 for 2D scaling; 1D scaling runs the
+// same vertical pass with the pass-through nearest kernel. Kernel::vertical()
+// and Kernel::horizontal_residual() handle a prefix of the first n samples
+// of a row and return how many they did; the rest are done here. The source
+// row handed to horizontal_residual() starts at sample x0. Only the
+// intermediates the columns need go through the vertical pass, and the
+// padding is only edge replication at the edges of src.
+template <typename T, unsigned Dims, typename Kernel>
+static void lcevc_upsample_residual_plane(const LcevcSurface &src,
+                                          const LcevcSourcePlane &source,
+                                          const LcevcSurface &dst, unsigned x0, unsigned x1,
+                                          unsigned y0, unsigned y1,
+                                          const LcevcUpsampleKernel &kernel) {
+    const LcevcUpsampleKernel &vertical = Dims == 2 ? kernel :
+        *lcevc_upsample_kernel(LCEVC_UPSAMPLE_NEAREST);
+    const unsigned last_col = source.width - 1;
+    const unsigned last_row = source.height - 1;
+    const unsigned inner = lcevc_min_u(x1, source.width);
+    const unsigned sx0 = x0 / 2 > LCEVC_UPSAMPLE_PAD ? x0 / 2 - LCEVC_UPSAMPLE_PAD : 0;
+    const unsigned sx1 = lcevc_min_u((x1 + 1) / 2 + LCEVC_UPSAMPLE_PAD, src.width);
+    // One intermediate row per thread, kept from call to call
+    static thread_local std::vector<int32_t> tmp;
+    if (tmp.size() < src.width + 2 * LCEVC_UPSAMPLE_PAD)
+        tmp.resize(src.width + 2 * LCEVC_UPSAMPLE_PAD);
+    int32_t *in = tmp.data() + LCEVC_UPSAMPLE_PAD;
+
+    for (unsigned y = y0; y < y1; y++) {
+        const int16_t *rows[4];
+        int pos[4];
+        int32_t weight[4];
+
+        if (Dims == 2)
+            lcevc_upsample_taps(vertical, y & 1, (int) (y >> 1), (int) src.height - 1, pos, weight);
+        else
+            lcevc_upsample_taps(vertical, 0, (int) y, (int) src.height - 1, pos, weight);
+        for (unsigned t = 0; t < 4; t++)
+            rows[t] = src.row(pos[t]) + sx0;
+
+        unsigned x = sx0 + Kernel::vertical(rows, weight, in + sx0, sx1 - sx0);
+        for (; x < sx1; x++)
+            in[x] = lcevc_upsample_vertical(rows, weight, x - sx0);
+        for (int p = 1; p <= LCEVC_UPSAMPLE_PAD; p++) {
+            if (sx0 == 0)
+                in[-p] = in[0];
+            if (sx1 == src.width)
+                in[src.width - 1 + p] = in[src.width - 1];
+        }
+
+        const T *s = source.row<T>(lcevc_min_u(y, last_row));
+        int16_t *d = dst.row(y);
+
+        x = x0;
+        if (inner > x0)
+            x += Kernel::template horizontal_residual<T>(in + x0 / 2, s + x0 * source.step,
+                                                         d + x0, inner - x0, kernel, source);
+        for (; x < x1; x++)
+            d[x] = (int16_t) ((source.sample(s, lcevc_min_u(x, last_col)) << source.shift) -
+                              lcevc_upsample_horizontal(in, kernel, x));
+    }
+}
+
+struct LcevcUpsampleRowC {
+    static unsigned vertical(const int16_t *const rows[], const int32_t weight[], int32_t *out,
+                             unsigned n) {
+        for (unsigned x = 0; x < n; x++)
+            out[x] = lcevc_upsample_vertical(rows, weight, x);
+        return n;
+    }
+
+    template <typename T>
+    static unsigned horizontal_residual(const int32_t *in, const T *s, int16_t *d, unsigned n,
+                                        const LcevcUpsampleKernel &kernel,
+                                        const LcevcSourcePlane &source) {
+        for (unsigned x = 0; x < n; x++)
+            d[x] = (int16_t) ((source.sample(s, x) << source.shift) -
+                              lcevc_upsample_horizontal(in, kernel, x));
+        return n;
+    }
+};
+
+// Sum of absolute differences over a block. Kernel::row<T>() handles a
+// prefix of the first n samples of a row, adding to sum, and returns how
+// many it did; the rest are done here.
+template <typename T, typename Kernel>
+static uint32_t lcevc_sad_plane(const uint8_t *a, ptrdiff_t stride_a, const uint8_t *b,
+                                ptrdiff_t stride_b, unsigned width, unsigned height) {
+    uint32_t sum = 0;
+
+    for (unsigned y = 0; y < height; y++) {
+        const T *pa = reinterpret_cast<const T *>(a + (ptrdiff_t) y * stride_a);
+        const T *pb = reinterpret_cast<const T *>(b + (ptrdiff_t) y * stride_b);
+        unsigned x = Kernel::template row<T>(pa, pb, width, &sum);
+
+        for (; x < width; x++)
+            sum += (uint32_t) abs((int32_t) pa[x] - (int32_t) pb[x]);
+    }
+    return sum;
+}
+
+struct LcevcSadRowC {
+    template <typename T>
+    static unsigned row(const T *a, const T *b, unsigned n, uint32_t *sum) {
+        uint32_t row_sum = 0;
+
+        for (unsigned x = 0; x < n; x++)
+            row_sum += (uint32_t) abs((int32_t) a[x] - (int32_t) b[x]);
+        *sum += row_sum;
+        return n;
+    }
+};
+
+// Directional decomposition of a 2x2 block (a b / c d) into average,
+// horizontal, vertical and diagonal components
+static inline void lcevc_dd_forward(int32_t a, int32_t b, int32_t c, int32_t d, int32_t out[4]) {
+    out[0] = a + b + c + d;
+    out[1] = a - b + c - d;
+    out[2] = a + b - c - d;
+    out[3] = a - b - c + d;
+}
+
+// Inverse of lcevc_dd_forward, up to a factor of 4
+static inline void lcevc_dd_inverse(int32_t A, int32_t H, int32_t V, int32_t D, int32_t out[4]) {
+    out[0] = A + H + V + D;
+    out[1] = A - H + V - D;
+    out[2] = A + H - V - D;
+    out[3] = A - H - V + D;
+}
+
+// Transform and quantize block bx of a block row. BlockSize 2 is DD,
+// BlockSize 4 is DDS: a DD on each 2x2 quarter of the 4x4 block, then a DD
+// across the quarters for each component. The layer index is then
+// component * 4 + quarter term.
+template <unsigned BlockSize>
+static inline void lcevc_transform_quantize_block(const int16_t *const rows[],
+                                                  int16_t *const layers[], unsigned bx,
+                                                  const LcevcQuantizer &quant) {
+    if (BlockSize == 2) {
+        int32_t coeffs[4];
+        lcevc_dd_forward(rows[0][2 * bx], rows[0][2 * bx + 1],
+                         rows[1][2 * bx], rows[1][2 * bx + 1], coeffs);
+
+        for (unsigned l = 0; l < 4; l++)
+            layers[l][bx] = lcevc_quantize(coeffs[l], quant);
+        return;
+    }
+
+    int32_t inner[4][4];
+    for (unsigned q = 0; q < 4; q++) {
+        unsigned x = 4 * bx + (q & 1) * 2;
+        unsigned y = (q >> 1) * 2;
+        lcevc_dd_forward(rows[y][x], rows[y][x + 1], rows[y + 1][x], rows[y + 1][x + 1],
+                         inner[q]);
+    }
+
+    for (unsigned c = 0; c < 4; c++) {
+        int32_t outer[4];
+        lcevc_dd_forward(inner[0][c], inner[1][c], inner[2][c], inner[3][c], outer);
+
+        for (unsigned t = 0; t < 4; t++)
+            layers[c * 4 + t][bx] = lcevc_quantize(outer[t], quant);
+    }
+}
+
+template <unsigned BlockSize>
+static inline void lcevc_dequantize_inverse_block(const int16_t *const layers[],
+                                                  int16_t *const rows[], unsigned bx,
+                                                  const LcevcQuantizer &quant) {
+    if (BlockSize == 2) {
+        int32_t values[4];
+        lcevc_dd_inverse(lcevc_dequantize(layers[0][bx], quant),
+                         lcevc_dequantize(layers[1][bx], quant),
+                         lcevc_dequantize(layers[2][bx], quant),
+                         lcevc_dequantize(layers[3][bx], quant), values);
+
+        rows[0][2 * bx] = lcevc_clamp_s16(values[0] >> 2);
+        rows[0][2 * bx + 1] = lcevc_clamp_s16(values[1] >> 2);
+        rows[1][2 * bx] = lcevc_clamp_s16(values[2] >> 2);
+        rows[1][2 * bx + 1] = lcevc_clamp_s16(values[3] >> 2);
+        return;
+    }
+
+    int32_t inner[4][4];
+    for (unsigned c = 0; c < 4; c++) {
+        int32_t outer[4];
+        lcevc_dd_inverse(lcevc_dequantize(layers[c * 4 + 0][bx], quant),
+                         lcevc_dequantize(layers[c * 4 + 1][bx], quant),
+                         lcevc_dequantize(layers[c * 4 + 2][bx], quant),
+                         lcevc_dequantize(layers[c * 4 + 3][bx], quant), outer);
+        for (unsigned q = 0; q < 4; q++)
+            inner[q][c] = outer[q];
+    }
+
+    for (unsigned q = 0; q < 4; q++) {
+        int32_t values[4];
+        unsigned x = 4 * bx + (q & 1) * 2;
+        unsigned y = (q >> 1) * 2;
+        lcevc_dd_inverse(inner[q][0], inner[q][1], inner[q][2], inner[q][3], values);
+
+        rows[y][x] = lcevc_clamp_s16(values[0] >> 4);
+        rows[y][x + 1] = lcevc_clamp_s16(values[1] >> 4);
+        rows[y + 1][x] = lcevc_clamp_s16(values[2] >> 4);
+        rows[y + 1][x + 1] = lcevc_clamp_s16(values[3] >> 4);
+    }
+}
+
+// Run a transform kernel over block rows [by0, by1). Kernel::forward<>()
+// and Kernel::inverse<>() handle a prefix of the n blocks of a block row
+// and return how many they did; the rest are done here one block at a time.
+template <unsigned BlockSize, typename Kernel>
+static void lcevc_transform_quantize_plane(const LcevcSurface &residual,
+                                           const LcevcSurface *layers, unsigned by0,
+                                           unsigned by1, const LcevcQuantizer &quant) {
+    const unsigned num_layers = BlockSize * BlockSize;
+
+    for (unsigned by = by0; by < by1; by++) {
+        const int16_t *rows[BlockSize];
+        int16_t *out[num_layers];
+        for (unsigned r = 0; r < BlockSize; r++)
+            rows[r] = residual.row(BlockSize * by + r);
+        for (unsigned l = 0; l < num_layers; l++)
+            out[l] = layers[l].row(by);
+
+        unsigned bx = Kernel::template forward<BlockSize>(rows, out, layers[0].width, quant);
+        for (; bx < layers[0].width; bx++)
+            lcevc_transform_quantize_block<BlockSize>(rows, out, bx, quant);
+    }
+}
+
+template <unsigned BlockSize, typename Kernel>
+static void lcevc_dequantize_inverse_plane(const LcevcSurface *layers,
+                                           const LcevcSurface &residual, unsigned by0,
+                                           unsigned by1, const LcevcQuantizer &quant) {
+    const unsigned num_layers = BlockSize * BlockSize;
+
+    for (unsigned by = by0; by < by1; by++) {
+        const int16_t *in[num_layers];
+        int16_t *rows[BlockSize];
+        for (unsigned l = 0; l < num_layers; l++)
+            in[l] = layers[l].row(by);
+        for (unsigned r = 0; r < BlockSize; r++)
+            rows[r] = residual.row(BlockSize * by + r);
+
+        unsigned bx = Kernel::template inverse<BlockSize>(in, rows, layers[0].width, quant);
+        for (; bx < layers[0].width; bx++)
+            lcevc_dequantize_inverse_block<BlockSize>(in, rows, bx, quant);
+    }
+}
+
+struct LcevcTransformC {
+    template <unsigned BlockSize>
+    static unsigned forward(const int16_t *const rows[], int16_t *const layers[], unsigned n,
+                            const LcevcQuantizer &quant) {
+        for (unsigned bx = 0; bx < n; bx++)
+            lcevc_transform_quantize_block<BlockSize>(rows, layers, bx, quant);
+        return n;
+    }
+
+    template <unsigned BlockSize>
+    static unsigned inverse(const int16_t *const layers[], int16_t *const rows[], unsigned n,
+                            const LcevcQuantizer &quant) {
+        for (unsigned bx = 0; bx < n; bx++)
+            lcevc_dequantize_inverse_block<BlockSize>(layers, rows, bx, quant);
+        return n;
+    }
+};
+
+#endif /* __LCEVC_DSP_IMPL_H__ */
@@ -0,0 +1,103 @@
+#include "lcevcdsp_impl.h"
+
+#include <arm_neon.h>
+
+template <unsigned Rows>
+static unsigned downsample_row(const uint8_t *s0, const uint8_t *s1, int16_t *d,
+                               unsigned n, const LcevcSourcePlane &src) {
+    const int16x8_t count = vdupq_n_s16((int16_t) (src.shift - Rows));
+    unsigned x = 0;
+
+    if (src.shift < Rows)
+        return 0;
+
+    // Semi-planar chroma: de-interleaving loads, which read one byte past
+    // the last sample they use
+    if (src.step == 2) {
+        for (; x + 8 < n; x += 8) {
+            uint16x8_t sum = vpaddlq_u8(vld2q_u8(s0 + 4 * x).val[0]);
+            if (Rows == 2)
+                sum = vpadalq_u8(sum, vld2q_u8(s1 + 4 * x).val[0]);
+            vst1q_s16(d + x, vreinterpretq_s16_u16(vshlq_u16(sum, count)));
+        }
+        return x;
+    }
+
+    // Pairwise widening adds of horizontal neighbours
+    for (; x + 8 <= n; x += 8) {
+        uint16x8_t sum = vpaddlq_u8(vld1q_u8(s0 + 2 * x));
+        if (Rows == 2)
+            sum = vpadalq_u8(sum, vld1q_u8(s1 + 2 * x));
+        vst1q_s16(d + x, vreinterpretq_s16_u16(vshlq_u16(sum, count)));
+    }
+    return x;
+}
+
+template <unsigned Rows>
+static unsigned downsample_row(const uint16_t *s0, const uint16_t *s1, int16_t *d,
+                               unsigned n, const LcevcSourcePlane &src) {
+    const int16x8_t drop = vdupq_n_s16((int16_t) -(int) src.drop);
+    const int16x8_t count = vdupq_n_s16((int16_t) (src.shift - Rows));
+    unsigned x = 0;
+
+    // The sums fit in 16 bits as long as there is a shift left to do
+    if (src.shift < Rows || src.step != 1)
+        return 0;
+
+    for (; x + 8 <= n; x += 8) {
+        uint16x8_t a = vshlq_u16(vld1q_u16(s0 + 2 * x), drop);
+        uint16x8_t b = vshlq_u16(vld1q_u16(s0 + 2 * x + 8), drop);
+        if (Rows == 2) {
+            a = vaddq_u16(a, vshlq_u16(vld1q_u16(s1 + 2 * x), drop));
+            b = vaddq_u16(b, vshlq_u16(vld1q_u16(s1 + 2 * x + 8), drop));
+        }
+        vst1q_s16(d + x, vreinterpretq_s16_u16(vshlq_u16(vpaddq_u16(a, b), count)));
+    }
+    return x;
+}
+
+struct DownsampleRowNeon {
+    template <typename T, unsigned Rows>
+    static unsigned row(const T *s0, const T *s1, int16_t *d, unsigned n,
+                        const LcevcSourcePlane &src) {
+        return downsample_row<Rows>(s0, s1, d, n, src);
+    }
+};
+
+// Absolute differences widened pairwise into 32-bit sums, sixteen 8-bit or
+// eight 16-bit samples per iteration
+static unsigned sad_row(const uint8_t *a, const uint8_t *b, unsigned n, uint32_t *sum) {
+    uint32x4_t acc = vdupq_n_u32(0);
+    unsigned x = 0;
+
+    for (; x + 16 <= n; x += 16)
+        acc = vpadalq_u16(acc, vpaddlq_u8(vabdq_u8(vld1q_u8(a + x), vld1q_u8(b + x))));
+    *sum += vaddvq_u32(acc);
+    return x;
+}
+
+static unsigned sad_row(const uint16_t *a, const uint16_t *b, unsigned n, uint32_t *sum) {
+    uint32x4_t acc = vdupq_n_u32(0);
+    unsigned x = 0;
+
+    for (; x + 8 <= n; x += 8)
+        acc = vpadalq_u16(acc, vabdq_u16(vld1q_u16(a + x), vld1q_u16(b + x)));
+    *sum += vaddvq_u32(acc);
+    return x;
+}
+
+struct SadRowNeon {
+    template <typename T>
+    static unsigned row(const T *a, const T *b, unsigned n, uint32_t *sum) {
+        return sad_row(a, b, n, sum);
+    }
+};
+
+void lcevc_dsp_init_neon(LcevcDsp *dsp) {
+    dsp->downsample_2d_8 = lcevc_downsample_plane<uint8_t, 2, DownsampleRowNeon>;
+    dsp->downsample_2d_16 = lcevc_downsample_plane<uint16_t, 2, DownsampleRowNeon>;
+    dsp->downsample_1d_8 = lcevc_downsample_plane<uint8_t, 1, DownsampleRowNeon>;
+    dsp->downsample_1d_16 = lcevc_downsample_plane<uint16_t, 1, DownsampleRowNeon>;
+    dsp->sad_8 = lcevc_sad_plane<uint8_t, SadRowNeon>;
+    dsp->sad_16 = lcevc_sad_plane<uint16_t, SadRowNeon>;
+}
@@ -0,0 +1,257 @@
+#include "lcevcdsp_impl.h"
+
+#include <smmintrin.h>
+
+template <unsigned Rows>
+static unsigned downsample_row(const uint8_t *s0, const uint8_t *s1, int16_t *d,
+                               unsigned n, const LcevcSourcePlane &src) {
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i low = _mm_set1_epi16(0xff);
+    const __m128i count = _mm_cvtsi32_si128((int) (src.shift - Rows));
+    unsigned x = 0;
+
+    if (src.shift < Rows)
+        return 0;
+
+    // Semi-planar chroma: the bytes of the other plane are masked out and
+    // pairs of the remaining words summed. The loads read one byte past the
+    // last sample they use, so the last block is left to the caller.
+    if (src.step == 2) {
+        for (; x + 8 < n; x += 8) {
+            __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i *) (s0 + 4 * x)), low);
+            __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i *) (s0 + 4 * x + 16)), low);
+            if (Rows == 2) {
+                a = _mm_add_epi16(a,
+                    _mm_and_si128(_mm_loadu_si128((const __m128i *) (s1 + 4 * x)), low));
+                b = _mm_add_epi16(b,
+                    _mm_and_si128(_mm_loadu_si128((const __m128i *) (s1 + 4 * x + 16)), low));
+            }
+            _mm_storeu_si128((__m128i *) (d + x), _mm_sll_epi16(_mm_hadd_epi16(a, b), count));
+        }
+        return x;
+    }
+
+    // Pairs of horizontal neighbours summed by a multiply-add with ones
+    for (; x + 8 <= n; x += 8) {
+        __m128i sum = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i *) (s0 + 2 * x)), ones);
+        if (Rows == 2)
+            sum = _mm_add_epi16(sum,
+                _mm_maddubs_epi16(_mm_loadu_si128((const __m128i *) (s1 + 2 * x)), ones));
+        _mm_storeu_si128((__m128i *) (d + x), _mm_sll_epi16(sum, count));
+    }
+    return x;
+}
+
+template <unsigned Rows>
+static unsigned downsample_row(const uint16_t *s0, const uint16_t *s1, int16_t *d,
+                               unsigned n, const LcevcSourcePlane &src) {
+    const __m128i drop = _mm_cvtsi32_si128((int) src.drop);
+    const __m128i count = _mm_cvtsi32_si128((int) (src.shift - Rows));
+    unsigned x = 0;
+
+    // The sums fit in 16 bits as long as there is a shift left to do
+    if (src.shift < Rows || src.step != 1)
+        return 0;
+
+    for (; x + 8 <= n; x += 8) {
+        __m128i a = _mm_srl_epi16(_mm_loadu_si128((const __m128i *) (s0 + 2 * x)), drop);
+        __m128i b = _mm_srl_epi16(_mm_loadu_si128((const __m128i *) (s0 + 2 * x + 8)), drop);
+        if (Rows == 2) {
+            a = _mm_add_epi16(a,
+                _mm_srl_epi16(_mm_loadu_si128((const __m128i *) (s1 + 2 * x)), drop));
+            b = _mm_add_epi16(b,
+                _mm_srl_epi16(_mm_loadu_si128((const __m128i *) (s1 + 2 * x + 8)), drop));
+        }
+        _mm_storeu_si128((__m128i *) (d + x), _mm_sll_epi16(_mm_hadd_epi16(a, b), count));
+    }
+    return x;
+}
+
+struct DownsampleRowSse41 {
+    template <typename T, unsigned Rows>
+    static unsigned row(const T *s0, const T *s1, int16_t *d, unsigned n,
+                        const LcevcSourcePlane &src) {
+        return downsample_row<Rows>(s0, s1, d, n, src);
+    }
+};
+
+// Vertical upsampling pass: pairs of rows interleaved and multiplied with
+// pairs of weights, 8 samples per iteration
+static unsigned upsample_vertical(const int16_t *const rows[], const int32_t weight[],
+                                  int32_t *out, unsigned n) {
+    const __m128i w01 = _mm_unpacklo_epi16(_mm_set1_epi16((int16_t) weight[0]),
+                                           _mm_set1_epi16((int16_t) weight[1]));
+    const __m128i w23 = _mm_unpacklo_epi16(_mm_set1_epi16((int16_t) weight[2]),
+                                           _mm_set1_epi16((int16_t) weight[3]));
+    const __m128i round = _mm_set1_epi32(8192);
+    unsigned x = 0;
+
+    for (; x + 8 <= n; x += 8) {
+        __m128i r0 = _mm_loadu_si128((const __m128i *) (rows[0] + x));
+        __m128i r1 = _mm_loadu_si128((const __m128i *) (rows[1] + x));
+        __m128i r2 = _mm_loadu_si128((const __m128i *) (rows[2] + x));
+        __m128i r3 = _mm_loadu_si128((const __m128i *) (rows[3] + x));
+
+        __m128i lo = _mm_add_epi32(
+            _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r0, r1), w01),
+                          _mm_madd_epi16(_mm_unpacklo_epi16(r2, r3), w23)), round);
+        __m128i hi = _mm_add_epi32(
+            _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r0, r1), w01),
+                          _mm_madd_epi16(_mm_unpackhi_epi16(r2, r3), w23)), round);
+        _mm_storeu_si128((__m128i *) (out + x), _mm_srai_epi32(lo, 14));
+        _mm_storeu_si128((__m128i *) (out + x + 4), _mm_srai_epi32(hi, 14));
+    }
+    return x;
+}
+
+// Eight samples of a row widened to 16 bits. Interleaved 8-bit samples are
+// read as words with the other plane's byte masked out.
+static inline __m128i load_source(const uint8_t *s, unsigned step) {
+    if (step == 2)
+        return _mm_and_si128(_mm_loadu_si128((const __m128i *) s), _mm_set1_epi16(0xff));
+    return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) s));
+}
+
+static inline __m128i load_source(const uint16_t *s, unsigned) {
+    return _mm_loadu_si128((const __m128i *) s);
+}
+
+// Horizontal upsampling pass and residual, 8 outputs per iteration: the
+// even and odd outputs of four intermediates are computed separately from
+// five shifted loads, then interleaved and subtracted from the source
+template <typename T>
+static unsigned upsample_residual_row(const int32_t *in, const T *s, int16_t *d, unsigned n,
+                                      const LcevcUpsampleKernel &kernel,
+                                      const LcevcSourcePlane &source) {
+    const __m128i w0 = _mm_set1_epi32(kernel.taps[0]);
+    const __m128i w1 = _mm_set1_epi32(kernel.taps[1]);
+    const __m128i w2 = _mm_set1_epi32(kernel.taps[2]);
+    const __m128i w3 = _mm_set1_epi32(kernel.taps[3]);
+    const __m128i round = _mm_set1_epi32(8192);
+    const __m128i drop = _mm_cvtsi32_si128((int) source.drop);
+    const __m128i count = _mm_cvtsi32_si128((int) source.shift);
+    // Interleaved loads read one byte past the last sample they use
+    const unsigned margin = source.step - 1;
+    unsigned x = 0;
+
+    if (sizeof(T) == 2 && source.step != 1)
+        return 0;
+
+    for (; x + 8 + margin <= n; x += 8) {
+        const int32_t *p = in + x / 2;
+        __m128i a = _mm_loadu_si128((const __m128i *) (p - 2));
+        __m128i b = _mm_loadu_si128((const __m128i *) (p - 1));
+        __m128i c = _mm_loadu_si128((const __m128i *) p);
+        __m128i e = _mm_loadu_si128((const __m128i *) (p + 1));
+        __m128i f = _mm_loadu_si128((const __m128i *) (p + 2));
+
+        __m128i even = _mm_add_epi32(
+            _mm_add_epi32(_mm_mullo_epi32(a, w3), _mm_mullo_epi32(b, w2)),
+            _mm_add_epi32(_mm_mullo_epi32(c, w1), _mm_mullo_epi32(e, w0)));
+        __m128i odd = _mm_add_epi32(
+            _mm_add_epi32(_mm_mullo_epi32(b, w0), _mm_mullo_epi32(c, w1)),
+            _mm_add_epi32(_mm_mullo_epi32(e, w2), _mm_mullo_epi32(f, w3)));
+        even = _mm_srai_epi32(_mm_add_epi32(even, round), 14);
+        odd = _mm_srai_epi32(_mm_add_epi32(odd, round), 14);
+
+        // Unsigned saturation clamps to [0, LCEVC_INTERNAL_MAX] except at
+        // the top, done after interleaving
+        __m128i pred = _mm_unpacklo_epi16(_mm_packus_epi32(even, even),
+                                          _mm_packus_epi32(odd, odd));
+        pred = _mm_min_epu16(pred, _mm_set1_epi16(LCEVC_INTERNAL_MAX));
+
+        __m128i value = _mm_srl_epi16(load_source(s + x * source.step, source.step), drop);
+        _mm_storeu_si128((__m128i *) (d + x), _mm_sub_epi16(_mm_sll_epi16(value, count), pred));
+    }
+    return x;
+}
+
+struct UpsampleRowSse41 {
+    static unsigned vertical(const int16_t *const rows[], const int32_t weight[], int32_t *out,
+                             unsigned n) {
+        return upsample_vertical(rows, weight, out, n);
+    }
+
+    template <typename T>
+    static unsigned horizontal_residual(const int32_t *in, const T *s, int16_t *d, unsigned n,
+                                        const LcevcUpsampleKernel &kernel,
+                                        const LcevcSourcePlane &source) {
+        return upsample_residual_row(in, s, d, n, kernel, source);
+    }
+};
+
+// Sixteen coefficients per iteration: a compare with zero, then the first
+// clear bit of the byte mask
+static unsigned find_nonzero(const int16_t *p, unsigned n) {
+    const __m128i zero = _mm_setzero_si128();
+    unsigned x = 0;
+
+    for (; x + 16 <= n; x += 16) {
+        __m128i a = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *) (p + x)), zero);
+        __m128i b = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *) (p + x + 8)), zero);
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_packs_epi16(a, b));
+        if (mask != 0xffff)
+            return x + (unsigned) __builtin_ctz(~mask);
+    }
+    while (x < n && p[x] == 0)
+        x++;
+    return x;
+}
+
+// Sixteen samples per iteration: psadbw for 8-bit samples, saturating
+// differences both ways for 16-bit ones, widened before they are summed
+static unsigned sad_row(const uint8_t *a, const uint8_t *b, unsigned n, uint32_t *sum) {
+    __m128i acc = _mm_setzero_si128();
+    unsigned x = 0;
+
+    for (; x + 16 <= n; x += 16)
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (a + x)),
+                                              _mm_loadu_si128((const __m128i *) (b + x))));
+    *sum += (uint32_t) (_mm_cvtsi128_si64(acc) + _mm_extract_epi64(acc, 1));
+    return x;
+}
+
+static unsigned sad_row(const uint16_t *a, const uint16_t *b, unsigned n, uint32_t *sum) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    unsigned x = 0;
+
+    for (; x + 16 <= n; x += 16) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *) (a + x));
+        __m128i b0 = _mm_loadu_si128((const __m128i *) (b + x));
+        __m128i a1 = _mm_loadu_si128((const __m128i *) (a + x + 8));
+        __m128i b1 = _mm_loadu_si128((const __m128i *) (b + x + 8));
+        __m128i d0 = _mm_or_si128(_mm_subs_epu16(a0, b0), _mm_subs_epu16(b0, a0));
+        __m128i d1 = _mm_or_si128(_mm_subs_epu16(a1, b1), _mm_subs_epu16(b1, a1));
+
+        acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(d0, zero),
+                                               _mm_unpackhi_epi16(d0, zero)));
+        acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(d1, zero),
+                                               _mm_unpackhi_epi16(d1, zero)));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    *sum += (uint32_t) _mm_cvtsi128_si32(acc);
+    return x;
+}
+
+struct SadRowSse41 {
+    template <typename T>
+    static unsigned row(const T *a, const T *b, unsigned n, uint32_t *sum) {
+        return sad_row(a, b, n, sum);
+    }
+};
+
+void lcevc_dsp_init_sse41(LcevcDsp *dsp) {
+    dsp->downsample_2d_8 = lcevc_downsample_plane<uint8_t, 2, DownsampleRowSse41>;
+    dsp->downsample_2d_16 = lcevc_downsample_plane<uint16_t, 2, DownsampleRowSse41>;
+    dsp->downsample_1d_8 = lcevc_downsample_plane<uint8_t, 1, DownsampleRowSse41>;
+    dsp->downsample_1d_16 = lcevc_downsample_plane<uint16_t, 1, DownsampleRowSse41>;
+    dsp->upsample_residual_2d_8 = lcevc_upsample_residual_plane<uint8_t, 2, UpsampleRowSse41>;
+    dsp->upsample_residual_2d_16 = lcevc_upsample_residual_plane<uint16_t, 2, UpsampleRowSse41>;
+    dsp->upsample_residual_1d_8 = lcevc_upsample_residual_plane<uint8_t, 1, UpsampleRowSse41>;
+    dsp->upsample_residual_1d_16 = lcevc_upsample_residual_plane<uint16_t, 1, UpsampleRowSse41>;
+    dsp->find_nonzero = find_nonzero;
+    dsp->sad_8 = lcevc_sad_plane<uint8_t, SadRowSse41>;
+    dsp->sad_16 = lcevc_sad_plane<uint16_t, SadRowSse41>;
+}
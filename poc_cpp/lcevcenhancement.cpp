@@ -0,0 +1,777 @@
+#include "lcevcenhancement.h"
+#include "lcevcbitstream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+// LOQ-1 samples around a tile the upsampling of its LOQ-0 prediction reads
+#define RECONSTRUCTION_MARGIN 2
+
+static unsigned round_up(unsigned value, unsigned multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+static unsigned depth_type(unsigned depth) {
+    return depth <= 8 ? 0 : depth <= 10 ? 1 : depth <= 12 ? 2 : 3;
+}
+
+// Quantizer of a step width in units of the enhancement depth, for the
+// residuals at the internal depth
+static void init_quantizer(LcevcQuantizer *quant, unsigned step_width, unsigned shift) {
+    lcevc_quantizer_init(quant, step_width << shift);
+}
+
+// Sum of absolute differences between a block of an interleaved source
+// plane and the same block kept contiguous
+template <typename T>
+static uint64_t sad_interleaved(const LcevcSourcePlane &src, unsigned x0, unsigned y0,
+                                const uint8_t *kept, ptrdiff_t kept_stride, unsigned width,
+                                unsigned height) {
+    uint64_t sum = 0;
+
+    for (unsigned y = 0; y < height; y++) {
+        const T *s = src.row<T>(y0 + y) + x0 * src.step;
+        const T *k = reinterpret_cast<const T *>(kept + (ptrdiff_t) y * kept_stride);
+
+        for (unsigned x = 0; x < width; x++)
+            sum += (uint64_t) abs((int32_t) s[x * src.step] - (int32_t) k[x]);
+    }
+    return sum;
+}
+
+// Copy a block of an interleaved source plane to a contiguous one
+template <typename T>
+static void copy_interleaved(const LcevcSourcePlane &src, unsigned x0, unsigned y,
+                             uint8_t *dst, unsigned width) {
+    const T *s = src.row<T>(y) + x0 * src.step;
+    T *d = reinterpret_cast<T *>(dst);
+
+    for (unsigned x = 0; x < width; x++)
+        d[x] = s[x * src.step];
+}
+
+// Columns [x0, x1) of a surface
+static LcevcSurface column_view(const LcevcSurface &surface, unsigned x0, unsigned x1) {
+    LcevcSurface view = surface;
+
+    view.data += x0;
+    view.width = x1 - x0;
+    return view;
+}
+
+// Charges the time since the previous lap to a stage
+class LcevcEnhancementEncoder::StageClock {
+public:
+    explicit StageClock(uint64_t *times) : times(times), last(now()) {}
+
+    void lap(LcevcEncodeStage stage) {
+        uint64_t t = now();
+
+        times[stage] += t - last;
+        last = t;
+    }
+
+private:
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t *times;
+    uint64_t last;
+};
+
+LcevcEnhancementEncoder::LcevcEnhancementEncoder(const LcevcEnhancementConfig &config,
+                                                 LcevcWorkerPool *pool)
+    : pool(pool), dsp(lcevc_dsp_get()) {
+    configure(config);
+}
+
+void LcevcEnhancementEncoder::configure(const LcevcEnhancementConfig &config) {
+    cfg = config;
+    num_skipped = 0;
+    nal_idr = false;
+    nal_bytes = 0;
+    std::fill(stage_ns, stage_ns + LCEVC_NUM_STAGES, 0);
+    block_size = lcevc_transform_block_size(cfg.transform);
+    num_layers = lcevc_transform_num_layers(cfg.transform);
+    quant_shift = LCEVC_INTERNAL_DEPTH - (8 + 2 * depth_type(cfg.enhancement_depth));
+    init_quantizer(&quant[0], cfg.step_width_loq0, quant_shift);
+    init_quantizer(&quant[1], cfg.step_width_loq1, quant_shift);
+    init_quantizer(&analysis_quant, LCEVC_ANALYSIS_STEP_WIDTH, quant_shift);
+
+    // Every surface of the context is in the arena, on the node of the pool
+    // threads. When it is too small the first layout only measures what it
+    // takes.
+    lay_out_planes();
+    if (arena.used() > arena.size()) {
+        arena.reserve(arena.used(), pool->placement().node);
+        lay_out_planes();
+    }
+
+    size_t max_tasks = std::max(stripes[0].size(), (size_t) cfg.num_planes * 2 * num_layers);
+    task_times.resize(std::max(max_tasks, tile_rows.size()));
+}
+
+// Plane sizes, surfaces in the arena, stripes and tile rows of cfg
+void LcevcEnhancementEncoder::lay_out_planes() {
+    // Enough stripes per plane to keep every thread busy, but never thinner
+    // than one row of blocks
+    unsigned stripes_per_plane = pool->num_threads() * 4;
+
+    arena.rewind();
+    stripes[0].clear();
+    stripes[1].clear();
+    tile_rows.clear();
+    for (unsigned p = 0; p < cfg.num_planes; p++) {
+        Plane &plane = planes[p];
+        unsigned shift_x = p ? cfg.chroma_shift_x : 0;
+        unsigned shift_y = p ? cfg.chroma_shift_y : 0;
+        unsigned src_width = (cfg.width + (1 << shift_x) - 1) >> shift_x;
+        unsigned src_height = (cfg.height + (1 << shift_y) - 1) >> shift_y;
+
+        // LOQ-0 is padded so that both it and its downsampled LOQ-1 are made
+        // of whole transform blocks
+        plane.width[0] = round_up(src_width, 2 * block_size);
+        plane.width[1] = plane.width[0] / 2;
+        if (cfg.scaling == LCEVC_SCALING_2D) {
+            plane.height[0] = round_up(src_height, 2 * block_size);
+            plane.height[1] = plane.height[0] / 2;
+        } else {
+            plane.height[0] = round_up(src_height, block_size);
+            plane.height[1] = plane.height[0];
+        }
+
+        // The decoder sees each LOQ at its own resolution, covered by as few
+        // transform units as it takes
+        unsigned loq1_height = cfg.scaling == LCEVC_SCALING_2D ? (src_height + 1) / 2 : src_height;
+        plane.coded_width[0] = (src_width + block_size - 1) / block_size;
+        plane.coded_height[0] = (src_height + block_size - 1) / block_size;
+        plane.coded_width[1] = ((src_width + 1) / 2 + block_size - 1) / block_size;
+        plane.coded_height[1] = (loq1_height + block_size - 1) / block_size;
+
+        plane.intermediate.allocate(plane.width[1], plane.height[1], arena);
+        plane.base.allocate(plane.width[1], plane.height[1], arena);
+        plane.reconstruction.allocate(plane.width[1], plane.height[1], arena);
+
+        for (unsigned loq = 0; loq < 2; loq++) {
+            unsigned block_rows = plane.height[loq] / block_size;
+
+            plane.residual[loq].allocate(plane.width[loq], plane.height[loq], arena);
+            plane.layer_buffers[loq].resize(num_layers);
+            plane.encoded[loq].resize(num_layers);
+            plane.layers[loq].clear();
+            for (unsigned l = 0; l < num_layers; l++)
+                plane.layers[loq].push_back(plane.layer_buffers[loq][l].allocate(
+                    plane.width[loq] / block_size, block_rows, arena));
+
+            unsigned count = block_rows < stripes_per_plane ? block_rows : stripes_per_plane;
+            for (unsigned s = 0; s < count; s++) {
+                Stripe stripe = { p, block_rows * s / count, block_rows * (s + 1) / count };
+                stripes[loq].push_back(stripe);
+            }
+        }
+
+        if (!cfg.temporal_enabled)
+            continue;
+
+        unsigned bytes_per_sample = cfg.bit_depth > 8 || cfg.internal_source ? 2 : 1;
+        unsigned tiles_y = (plane.height[0] + LCEVC_TEMPORAL_TILE - 1) / LCEVC_TEMPORAL_TILE;
+        unsigned block_rows = plane.height[0] / block_size;
+
+        plane.temporal.allocate(plane.width[0], plane.height[0], arena);
+        plane.previous_stride = (ptrdiff_t) src_width * bytes_per_sample;
+        size_t previous_size = (size_t) plane.previous_stride * src_height;
+        plane.previous = static_cast<uint8_t *>(arena.allocate(previous_size,
+                                                               LCEVC_SURFACE_ALIGN));
+        if (plane.previous)
+            memset(plane.previous, 0, previous_size);
+        plane.previous_reconstruction.allocate(plane.width[1], plane.height[1], arena);
+        plane.tiles_x = (plane.width[0] + LCEVC_TEMPORAL_TILE - 1) / LCEVC_TEMPORAL_TILE;
+        plane.static_tiles.assign(plane.tiles_x * tiles_y, 0);
+        for (unsigned ty = 0; ty < tiles_y; ty++) {
+            unsigned by0 = ty * LCEVC_TEMPORAL_TILE / block_size;
+            unsigned by1 = (ty + 1) * LCEVC_TEMPORAL_TILE / block_size;
+            Stripe tile_row = { p, by0, by1 < block_rows ? by1 : block_rows };
+            tile_rows.push_back(tile_row);
+        }
+    }
+}
+
+// Run count tasks on the pool, each timing its stages in a slot of its own,
+// and add them up into stage_ns
+template <typename F> void LcevcEnhancementEncoder::run_timed(unsigned count, F task) {
+    std::fill(task_times.begin(), task_times.begin() + count, TaskTimes());
+    pool->run(count, [&](unsigned index) {
+        task(index, task_times[index].ns);
+    });
+    for (unsigned i = 0; i < count; i++) {
+        for (unsigned stage = 0; stage < LCEVC_NUM_STAGES; stage++)
+            stage_ns[stage] += task_times[i].ns[stage];
+    }
+}
+
+// Residual energy and coefficient classes of a stripe, whose layers hold
+// levels at the analysis step width
+void LcevcEnhancementEncoder::gather_stats(unsigned loq, const Stripe &stripe,
+                                           LcevcEnhancementStats *stats) {
+    const Plane &plane = planes[stripe.plane];
+    const LcevcSurface &residual = plane.residual[loq].view();
+    uint64_t energy = 0;
+
+    for (unsigned y = stripe.by0 * block_size; y < stripe.by1 * block_size; y++) {
+        const int16_t *r = residual.row(y);
+        uint32_t sum = 0;
+
+        for (unsigned x = 0; x < residual.width; x++)
+            sum += (uint32_t) abs(r[x]);
+        energy += sum;
+    }
+    stats->residual_energy[loq] += energy;
+
+    // Count the levels of at least 2^k for every class k, in loops the
+    // compiler vectorises, then take the classes as the differences
+    uint32_t at_least[LCEVC_COEFFICIENT_CLASSES + 1] = { 0 };
+
+    for (const LcevcSurface &layer : plane.layers[loq]) {
+        for (unsigned y = stripe.by0; y < stripe.by1; y++) {
+            const int16_t *row = layer.row(y);
+
+            for (unsigned k = 0; k < LCEVC_COEFFICIENT_CLASSES; k++) {
+                const int threshold = 1 << k;
+                uint32_t count = 0;
+
+                for (unsigned x = 0; x < layer.width; x++)
+                    count += abs(row[x]) >= threshold;
+                at_least[k] += count;
+            }
+        }
+    }
+    for (unsigned k = 0; k < LCEVC_COEFFICIENT_CLASSES; k++)
+        stats->coefficients[loq][k] += at_least[k] - at_least[k + 1];
+}
+
+// Intermediate picture of a plane: the one handed in with the picture, cut
+// to the size of ours, or ours
+LcevcSurface LcevcEnhancementEncoder::intermediate_view(const LcevcPicture &picture,
+                                                        unsigned p) const {
+    LcevcSurface view = planes[p].intermediate.view();
+
+    if (picture.has_intermediate) {
+        view.data = picture.intermediate[p].data;
+        view.stride = picture.intermediate[p].stride;
+    }
+    return view;
+}
+
+// Downsample, then code the difference between the intermediate picture and
+// the base. Without a decoded base picture the base is the intermediate
+// picture itself.
+void LcevcEnhancementEncoder::encode_loq1_stripe(const LcevcPicture &picture,
+                                                 const Stripe &stripe,
+                                                 LcevcEnhancementStats *stats,
+                                                 uint64_t *times) {
+    Plane &plane = planes[stripe.plane];
+    const LcevcSurface intermediate = intermediate_view(picture, stripe.plane);
+    const LcevcSurface &base = picture.has_base ? plane.base.view() : intermediate;
+    const LcevcSurface &residual = plane.residual[1].view();
+    unsigned y0 = stripe.by0 * block_size;
+    unsigned y1 = stripe.by1 * block_size;
+    StageClock clock(times);
+
+    if (!picture.has_intermediate)
+        lcevc_dsp_downsample(dsp, cfg.scaling, picture.planes[stripe.plane], intermediate,
+                             y0, y1);
+    if (picture.has_base)
+        lcevc_dsp_import(dsp, picture.base[stripe.plane], base, y0, y1);
+    clock.lap(LCEVC_STAGE_DOWNSAMPLE);
+    dsp->subtract(intermediate, base, residual, y0, y1);
+    clock.lap(LCEVC_STAGE_RESIDUAL);
+
+    if (stats) {
+        dsp->transform_quantize[cfg.transform](residual, plane.layers[1].data(),
+                                               stripe.by0, stripe.by1, analysis_quant);
+        gather_stats(1, stripe, stats);
+    }
+    dsp->transform_quantize[cfg.transform](residual, plane.layers[1].data(),
+                                           stripe.by0, stripe.by1, quant[1]);
+    dsp->dequantize_inverse[cfg.transform](plane.layers[1].data(), residual,
+                                           stripe.by0, stripe.by1, quant[1]);
+    clock.lap(LCEVC_STAGE_TRANSFORM);
+    dsp->add_clamp(base, residual, plane.reconstruction.view(), y0, y1);
+    clock.lap(LCEVC_STAGE_RESIDUAL);
+}
+
+void LcevcEnhancementEncoder::encode_loq0_stripe(const LcevcPicture &picture,
+                                                 const Stripe &stripe,
+                                                 LcevcEnhancementStats *stats,
+                                                 uint64_t *times) {
+    Plane &plane = planes[stripe.plane];
+    const LcevcSurface &residual = plane.residual[0].view();
+    const LcevcUpsampleKernel &kernel = *lcevc_upsample_kernel(cfg.upsample);
+    unsigned y0 = stripe.by0 * block_size;
+    unsigned y1 = stripe.by1 * block_size;
+    StageClock clock(times);
+
+    lcevc_dsp_upsample_residual(dsp, cfg.scaling, plane.reconstruction.view(),
+                                picture.planes[stripe.plane], residual, 0, residual.width,
+                                y0, y1, kernel);
+    clock.lap(LCEVC_STAGE_UPSAMPLE);
+    dsp->transform_quantize[cfg.transform](residual, plane.layers[0].data(),
+                                           stripe.by0, stripe.by1,
+                                           stats ? analysis_quant : quant[0]);
+    if (stats)
+        gather_stats(0, stripe, stats);
+    clock.lap(LCEVC_STAGE_TRANSFORM);
+}
+
+// LOQ-1 rectangle of the LOQ-0 samples [x0, x1) x [y0, y1), grown by the
+// upsampling margin and clipped to the plane
+static void loq1_rect(LcevcScalingMode scaling, const LcevcSurface &loq1, unsigned x0,
+                      unsigned x1, unsigned y0, unsigned y1, unsigned rect[4]) {
+    unsigned dy = scaling == LCEVC_SCALING_2D ? 1 : 0;
+
+    rect[0] = x0 / 2 > RECONSTRUCTION_MARGIN ? x0 / 2 - RECONSTRUCTION_MARGIN : 0;
+    rect[1] = std::min((x1 + 1) / 2 + RECONSTRUCTION_MARGIN, loq1.width);
+    rect[2] = (y0 >> dy) > RECONSTRUCTION_MARGIN ? (y0 >> dy) - RECONSTRUCTION_MARGIN : 0;
+    rect[3] = std::min(((y1 + dy) >> dy) + RECONSTRUCTION_MARGIN, loq1.height);
+}
+
+// A tile is static when neither its source samples nor the LOQ-1
+// reconstruction its prediction is upsampled from moved further than the
+// threshold from what they were when it was last coded. Its LOQ-0 residual
+// is then the one the temporal buffer already holds.
+void LcevcEnhancementEncoder::find_static_tiles(const LcevcPicture &picture,
+                                                const Stripe &tile_row, bool refresh) {
+    Plane &plane = planes[tile_row.plane];
+    const LcevcSourcePlane &src = picture.planes[tile_row.plane];
+    const LcevcSurface &recon = plane.reconstruction.view();
+    const LcevcSurface &previous_recon = plane.previous_reconstruction.view();
+    const unsigned depth = LCEVC_INTERNAL_DEPTH - src.shift + src.drop;    // as stored
+    const unsigned src_shift = depth > 8 ? depth - 8 : 0;
+    const unsigned recon_shift = LCEVC_INTERNAL_DEPTH - 8;
+    const unsigned y0 = tile_row.by0 * block_size;
+    const unsigned y1 = tile_row.by1 * block_size;
+    const unsigned src_y1 = std::min(y1, src.height);
+    uint8_t *tiles = &plane.static_tiles[y0 / LCEVC_TEMPORAL_TILE * plane.tiles_x];
+
+    for (unsigned tx = 0; tx < plane.tiles_x; tx++) {
+        unsigned x0 = tx * LCEVC_TEMPORAL_TILE;
+        unsigned x1 = std::min(x0 + LCEVC_TEMPORAL_TILE, plane.width[0]);
+        unsigned src_x1 = std::min(x1, src.width);
+
+        tiles[tx] = 0;
+        if (refresh || x0 >= src_x1 || y0 >= src_y1)
+            continue;
+
+        uint64_t area = (uint64_t) (src_x1 - x0) * (src_y1 - y0);
+        const uint8_t *kept =
+            &plane.previous[(size_t) y0 * plane.previous_stride + x0 * src.bytes_per_sample];
+        uint64_t sad;
+        if (src.step != 1 && src.bytes_per_sample == 1)
+            sad = sad_interleaved<uint8_t>(src, x0, y0, kept, plane.previous_stride,
+                                           src_x1 - x0, src_y1 - y0);
+        else if (src.step != 1)
+            sad = sad_interleaved<uint16_t>(src, x0, y0, kept, plane.previous_stride,
+                                            src_x1 - x0, src_y1 - y0);
+        else
+            sad = lcevc_dsp_sad(dsp, src.bytes_per_sample,
+                src.data + (ptrdiff_t) y0 * src.stride + x0 * src.bytes_per_sample, src.stride,
+                kept, plane.previous_stride, src_x1 - x0, src_y1 - y0);
+
+        if (sad * 16 > ((cfg.static_threshold * area) << src_shift))
+            continue;
+
+        unsigned rect[4];
+        loq1_rect(cfg.scaling, recon, x0, x1, y0, y1, rect);
+        area = (uint64_t) (rect[1] - rect[0]) * (rect[3] - rect[2]);
+        sad = dsp->sad_16(reinterpret_cast<const uint8_t *>(recon.row(rect[2]) + rect[0]),
+            recon.stride * (ptrdiff_t) sizeof(int16_t),
+            reinterpret_cast<const uint8_t *>(previous_recon.row(rect[2]) + rect[0]),
+            previous_recon.stride * (ptrdiff_t) sizeof(int16_t),
+            rect[1] - rect[0], rect[3] - rect[2]);
+        tiles[tx] = sad * 16 <= ((cfg.static_threshold * area) << recon_shift);
+    }
+}
+
+// Keep the source and reconstruction of the tiles coded in this picture,
+// which the next one is compared with. Runs once every tile row has been
+// classified, as the margins overlap.
+void LcevcEnhancementEncoder::update_previous(const LcevcPicture &picture,
+                                              const Stripe &tile_row) {
+    Plane &plane = planes[tile_row.plane];
+    const LcevcSourcePlane &src = picture.planes[tile_row.plane];
+    const LcevcSurface &recon = plane.reconstruction.view();
+    const LcevcSurface &previous_recon = plane.previous_reconstruction.view();
+    const unsigned y0 = tile_row.by0 * block_size;
+    const unsigned y1 = tile_row.by1 * block_size;
+    const uint8_t *tiles = &plane.static_tiles[y0 / LCEVC_TEMPORAL_TILE * plane.tiles_x];
+    const unsigned dy = cfg.scaling == LCEVC_SCALING_2D ? 1 : 0;
+
+    for (unsigned tx = 0; tx < plane.tiles_x; tx++) {
+        unsigned x0 = tx * LCEVC_TEMPORAL_TILE;
+        unsigned x1 = std::min(x0 + LCEVC_TEMPORAL_TILE, plane.width[0]);
+        unsigned src_x1 = std::min(x1, src.width);
+
+        if (tiles[tx])
+            continue;
+        for (unsigned y = y0; y < std::min(y1, src.height) && x0 < src_x1; y++) {
+            uint8_t *kept = &plane.previous[(size_t) y * plane.previous_stride +
+                                            x0 * src.bytes_per_sample];
+
+            if (src.step != 1 && src.bytes_per_sample == 1)
+                copy_interleaved<uint8_t>(src, x0, y, kept, src_x1 - x0);
+            else if (src.step != 1)
+                copy_interleaved<uint16_t>(src, x0, y, kept, src_x1 - x0);
+            else
+                memcpy(kept, src.data + (ptrdiff_t) y * src.stride + x0 * src.bytes_per_sample,
+                       (src_x1 - x0) * src.bytes_per_sample);
+        }
+        for (unsigned y = y0 >> dy; y < std::min(y1 >> dy, recon.height); y++)
+            memcpy(previous_recon.row(y) + x0 / 2, recon.row(y) + x0 / 2,
+                   (x1 / 2 - x0 / 2) * sizeof(int16_t));
+    }
+}
+
+// Code LOQ-0 columns [x0, x1) of rows [y0, y1) against the temporal buffer,
+// then add to the buffer what the decoder will
+void LcevcEnhancementEncoder::code_temporal_tiles(const LcevcPicture &picture, unsigned p,
+                                                  unsigned x0, unsigned x1,
+                                                  unsigned y0, unsigned y1,
+                                                  StageClock &clock) {
+    Plane &plane = planes[p];
+    const LcevcSurface residual = column_view(plane.residual[0].view(), x0, x1);
+    const LcevcSurface temporal = column_view(plane.temporal.view(), x0, x1);
+    LcevcSurface layers[16];
+
+    for (unsigned l = 0; l < num_layers; l++)
+        layers[l] = column_view(plane.layers[0][l], x0 / block_size, x1 / block_size);
+
+    lcevc_dsp_upsample_residual(dsp, cfg.scaling, plane.reconstruction.view(), picture.planes[p],
+                                plane.residual[0].view(), x0, x1, y0, y1,
+                                *lcevc_upsample_kernel(cfg.upsample));
+    clock.lap(LCEVC_STAGE_UPSAMPLE);
+    dsp->subtract(residual, temporal, residual, y0, y1);
+    clock.lap(LCEVC_STAGE_RESIDUAL);
+    dsp->transform_quantize[cfg.transform](residual, layers, y0 / block_size, y1 / block_size,
+                                           quant[0]);
+    dsp->dequantize_inverse[cfg.transform](layers, residual, y0 / block_size, y1 / block_size,
+                                           quant[0]);
+    clock.lap(LCEVC_STAGE_TRANSFORM);
+    dsp->add(temporal, residual, temporal, y0, y1);
+    clock.lap(LCEVC_STAGE_RESIDUAL);
+}
+
+// LOQ-0 with temporal prediction, in runs of tiles that are all static or
+// all coded. Static tiles only clear their coefficients.
+void LcevcEnhancementEncoder::encode_loq0_temporal_stripe(const LcevcPicture &picture,
+                                                          const Stripe &stripe, bool refresh,
+                                                          uint64_t *times) {
+    Plane &plane = planes[stripe.plane];
+    const LcevcSurface &temporal = plane.temporal.view();
+    unsigned y0 = stripe.by0 * block_size;
+    unsigned y1 = stripe.by1 * block_size;
+    StageClock clock(times);
+
+    // A refresh empties the buffer before the picture is added to it
+    if (refresh) {
+        for (unsigned y = y0; y < y1; y++)
+            memset(temporal.row(y), 0, temporal.width * sizeof(int16_t));
+        clock.lap(LCEVC_STAGE_RESIDUAL);
+    }
+
+    for (unsigned y = y0; y < y1;) {
+        unsigned ty = y / LCEVC_TEMPORAL_TILE;
+        unsigned band_end = std::min((ty + 1) * LCEVC_TEMPORAL_TILE, y1);
+        const uint8_t *tiles = &plane.static_tiles[ty * plane.tiles_x];
+
+        for (unsigned tx = 0; tx < plane.tiles_x;) {
+            unsigned run_end = tx + 1;
+
+            while (run_end < plane.tiles_x && tiles[run_end] == tiles[tx])
+                run_end++;
+
+            unsigned x0 = tx * LCEVC_TEMPORAL_TILE;
+            unsigned x1 = std::min(run_end * LCEVC_TEMPORAL_TILE, plane.width[0]);
+
+            if (!tiles[tx]) {
+                code_temporal_tiles(picture, stripe.plane, x0, x1, y, band_end, clock);
+            } else {
+                for (const LcevcSurface &layer : plane.layers[0]) {
+                    for (unsigned by = y / block_size; by < band_end / block_size; by++)
+                        memset(layer.row(by) + x0 / block_size, 0,
+                               (x1 - x0) / block_size * sizeof(int16_t));
+                }
+                clock.lap(LCEVC_STAGE_TRANSFORM);
+            }
+            tx = run_end;
+        }
+        y = band_end;
+    }
+}
+
+void LcevcEnhancementEncoder::entropy_code_layer(unsigned index, uint64_t *times) {
+    unsigned layer = index % num_layers;
+    unsigned loq = (index / num_layers) % 2;
+    Plane &plane = planes[index / (2 * num_layers)];
+    LcevcSurface coded = plane.layers[loq][layer];
+    StageClock clock(times);
+
+    coded.width = plane.coded_width[loq];
+    coded.height = plane.coded_height[loq];
+    lcevc_entropy_encode_layer(dsp, coded, block_size, &plane.encoded[loq][layer]);
+    clock.lap(LCEVC_STAGE_ENTROPY);
+}
+
+void LcevcEnhancementEncoder::set_step_widths(unsigned loq0, unsigned loq1) {
+    cfg.step_width_loq0 = loq0;
+    cfg.step_width_loq1 = loq1;
+    init_quantizer(&quant[0], loq0, quant_shift);
+    init_quantizer(&quant[1], loq1, quant_shift);
+}
+
+void LcevcEnhancementEncoder::encode(const LcevcPicture &picture, bool idr,
+                                     const std::function<void()> &intermediate_ready) {
+    std::fill(stage_ns, stage_ns + LCEVC_NUM_STAGES, 0);
+    if (!cfg.enhancement_enabled && intermediate_ready)
+        intermediate_ready();
+    if (cfg.enhancement_enabled) {
+        run_timed((unsigned) stripes[1].size(), [&](unsigned s, uint64_t *times) {
+            encode_loq1_stripe(picture, stripes[1][s], nullptr, times);
+        });
+        if (intermediate_ready)
+            intermediate_ready();
+        if (cfg.temporal_enabled) {
+            run_timed((unsigned) tile_rows.size(), [&](unsigned r, uint64_t *times) {
+                StageClock clock(times);
+
+                find_static_tiles(picture, tile_rows[r], idr);
+                clock.lap(LCEVC_STAGE_RESIDUAL);
+            });
+            run_timed((unsigned) tile_rows.size(), [&](unsigned r, uint64_t *times) {
+                StageClock clock(times);
+
+                update_previous(picture, tile_rows[r]);
+                clock.lap(LCEVC_STAGE_RESIDUAL);
+            });
+            num_skipped = 0;
+            for (unsigned p = 0; p < cfg.num_planes; p++) {
+                for (uint8_t tile : planes[p].static_tiles)
+                    num_skipped += tile;
+            }
+            run_timed((unsigned) stripes[0].size(), [&](unsigned s, uint64_t *times) {
+                encode_loq0_temporal_stripe(picture, stripes[0][s], idr, times);
+            });
+        } else {
+            run_timed((unsigned) stripes[0].size(), [&](unsigned s, uint64_t *times) {
+                encode_loq0_stripe(picture, stripes[0][s], nullptr, times);
+            });
+        }
+        run_timed(cfg.num_planes * 2 * num_layers, [&](unsigned index, uint64_t *times) {
+            entropy_code_layer(index, times);
+        });
+    }
+
+    StageClock clock(stage_ns);
+
+    rbsp.clear();
+    if (idr) {
+        write_sequence_config(rbsp);
+        write_global_config(rbsp);
+    }
+    write_picture_config(rbsp, idr);
+    if (cfg.enhancement_enabled)
+        write_encoded_data(rbsp, idr);
+
+    nal_idr = idr;
+    nal_bytes = lcevc_nal_size(rbsp.data(), rbsp.size());
+    clock.lap(LCEVC_STAGE_ENTROPY);
+}
+
+void LcevcEnhancementEncoder::analyse(const LcevcPicture &picture,
+                                      LcevcEnhancementStats *stats) {
+    // One set of stats per stripe, merged at the end. LOQ-0 has at least as
+    // many stripes as LOQ-1.
+    stripe_stats.assign(stripes[0].size(), LcevcEnhancementStats());
+    std::fill(stage_ns, stage_ns + LCEVC_NUM_STAGES, 0);
+    run_timed((unsigned) stripes[1].size(), [&](unsigned s, uint64_t *times) {
+        encode_loq1_stripe(picture, stripes[1][s], &stripe_stats[s], times);
+    });
+    run_timed((unsigned) stripes[0].size(), [&](unsigned s, uint64_t *times) {
+        encode_loq0_stripe(picture, stripes[0][s], &stripe_stats[s], times);
+    });
+
+    *stats = LcevcEnhancementStats();
+    for (const LcevcEnhancementStats &part : stripe_stats) {
+        for (unsigned loq = 0; loq < 2; loq++) {
+            stats->residual_energy[loq] += part.residual_energy[loq];
+            for (unsigned k = 0; k < LCEVC_COEFFICIENT_CLASSES; k++)
+                stats->coefficients[loq][k] += part.coefficients[loq][k];
+        }
+    }
+}
+
+void LcevcEnhancementEncoder::write_base(const LcevcPicture &picture,
+                                         const LcevcOutputPlane *base) {
+    pool->run((unsigned) stripes[1].size(), [&](unsigned s) {
+        const Stripe &stripe = stripes[1][s];
+        const LcevcSurface intermediate = intermediate_view(picture, stripe.plane);
+        unsigned y0 = stripe.by0 * block_size;
+        unsigned y1 = stripe.by1 * block_size;
+
+        // Without enhancement encode() leaves the intermediate picture alone
+        if (!cfg.enhancement_enabled && !picture.has_intermediate)
+            lcevc_dsp_downsample(dsp, cfg.scaling, picture.planes[stripe.plane],
+                                 intermediate, y0, y1);
+        lcevc_dsp_export(dsp, intermediate, base[stripe.plane], y0, y1);
+    });
+}
+
+size_t LcevcEnhancementEncoder::loq_bytes(unsigned loq) const {
+    // The flags of the LOQ, two bits per layer
+    size_t size = (cfg.num_planes * num_layers * 2 + 7) / 8;
+
+    if (!cfg.enhancement_enabled)
+        return 0;
+    for (unsigned p = 0; p < cfg.num_planes; p++) {
+        for (const LcevcEncodedLayer &layer : planes[p].encoded[loq]) {
+            if (layer.entropy_enabled)
+                size += lcevc_multibyte_size(layer.data.size()) + layer.data.size();
+        }
+    }
+    return size;
+}
+
+void LcevcEnhancementEncoder::write_nal(uint8_t *dst) const {
+    lcevc_write_nal(dst, nal_idr, rbsp.data(), rbsp.size());
+}
+
+void LcevcEnhancementEncoder::write_sequence_config(std::vector<uint8_t> &rbsp) {
+    LcevcBitWriter writer(block);
+    bool chroma_444 = cfg.num_planes > 1 && !cfg.chroma_shift_x && !cfg.chroma_shift_y;
+    unsigned samples_per_second = cfg.width * cfg.height * 60;
+
+    block.clear();
+    writer.put_bits(chroma_444 ? 1 : 0, 4);                        // profile_idc
+    writer.put_bits(samples_per_second <= 1920 * 1080 * 60 ? 2 : 3, 4);   // level_idc
+    writer.put_bits(1, 2);                                         // sublevel_idc
+    writer.put_bits(0, 1);                                         // conformance_window_flag
+    writer.put_bits(0, 5);                                         // reserved
+    lcevc_write_block(rbsp, LCEVC_BLOCK_SEQUENCE_CONFIG, block.data(), block.size());
+}
+
+void LcevcEnhancementEncoder::write_global_config(std::vector<uint8_t> &rbsp) {
+    LcevcBitWriter writer(block);
+    unsigned chroma_type = cfg.num_planes == 1 ? 0 :
+        cfg.chroma_shift_y ? 1 : cfg.chroma_shift_x ? 2 : 3;
+    unsigned enhancement_depth_type = depth_type(cfg.enhancement_depth);
+
+    block.clear();
+    writer.put_bits(cfg.num_planes > 1, 1);             // processed_planes_type_flag
+    writer.put_bits(63, 6);                             // resolution_type: custom
+    writer.put_bits(cfg.transform, 1);                  // transform_type
+    writer.put_bits(chroma_type, 2);                    // chroma_sampling_type
+    writer.put_bits(depth_type(cfg.base_depth), 2);     // base_depth_type
+    writer.put_bits(enhancement_depth_type, 2);         // enhancement_depth_type
+    writer.put_bits(0, 1);                              // temporal_step_width_modifier_signalled
+    writer.put_bits(0, 1);                              // predicted_residual_mode_flag
+    writer.put_bits(0, 1);                              // temporal_tile_intra_signalling_enabled
+    writer.put_bits(cfg.temporal_enabled, 1);           // temporal_enabled_flag
+    writer.put_bits(cfg.upsample, 3);                   // upsample_type
+    writer.put_bits(0, 1);                              // level1_filtering_signalled
+    writer.put_bits(0, 2);                              // scaling_mode_level1: none
+    writer.put_bits(cfg.scaling, 2);                    // scaling_mode_level2
+    writer.put_bits(0, 2);                              // tile_dimensions_type
+    writer.put_bits(0, 2);                              // user_data_enabled
+    writer.put_bits(1, 1);                              // level1_depth_flag: both LOQs at
+                                                        // the enhancement depth
+    writer.put_bits(0, 1);                              // chroma_step_width_flag
+    if (cfg.num_planes > 1) {
+        writer.put_bits(1, 4);                          // planes_type: luma and chroma
+        writer.put_bits(0, 4);                          // reserved_zeros_4bit
+    }
+    writer.put_bits(cfg.width, 16);                     // custom_resolution_width
+    writer.put_bits(cfg.height, 16);                    // custom_resolution_height
+    lcevc_write_block(rbsp, LCEVC_BLOCK_GLOBAL_CONFIG, block.data(), block.size());
+}
+
+void LcevcEnhancementEncoder::write_picture_config(std::vector<uint8_t> &rbsp, bool idr) {
+    LcevcBitWriter writer(block);
+
+    block.clear();
+    writer.put_bits(!cfg.enhancement_enabled, 1);       // no_enhancement_bit_flag
+    if (cfg.enhancement_enabled) {
+        writer.put_bits(0, 3);                          // quant_matrix_mode
+        writer.put_bits(0, 1);                          // dequant_offset_signalled_flag
+        writer.put_bits(0, 1);                          // picture_type_bit_flag: frame
+        writer.put_bits(idr, 1);                        // temporal_refresh_bit_flag
+        writer.put_bits(1, 1);                          // step_width_sublayer1_enabled_flag
+        writer.put_bits(cfg.step_width_loq0, 15);       // step_width_sublayer2
+        writer.put_bits(0, 1);                          // dithering_control_flag
+        writer.put_bits(cfg.step_width_loq1, 15);       // step_width_sublayer1
+        writer.put_bits(0, 1);                          // level1_filtering_enabled_flag
+    } else {
+        writer.put_bits(0, 4);                          // reserved_zeros_4bit
+        writer.put_bits(0, 1);                          // picture_type_bit_flag
+        writer.put_bits(idr, 1);                        // temporal_refresh_bit_flag
+        writer.put_bits(0, 1);                          // temporal_signalling_present_flag
+    }
+    writer.align();
+    lcevc_write_block(rbsp, LCEVC_BLOCK_PICTURE_CONFIG, block.data(), block.size());
+}
+
+// Layers of every plane, LOQ-1 first: the entropy_enabled and rle_only
+// flags of all of them, byte aligned, then the size and data of each
+// enabled layer. The payload size is known up front, so layers go straight
+// into the rbsp.
+//
+// With temporal signalling present, on every picture but a refresh, the
+// flags of the temporal layer of each plane follow those of the residual
+// layers. It is never entropy coded, which makes every transform unit add
+// to the temporal buffer.
+void LcevcEnhancementEncoder::write_encoded_data(std::vector<uint8_t> &rbsp, bool idr) {
+    LcevcBitWriter writer(rbsp);
+    bool temporal_signalling = cfg.temporal_enabled && !idr;
+    unsigned num_flags = cfg.num_planes * (2 * num_layers + (temporal_signalling ? 1 : 0));
+    size_t size = (2 * num_flags + 7) / 8;
+
+    for (unsigned p = 0; p < cfg.num_planes; p++) {
+        for (unsigned loq = 0; loq < 2; loq++) {
+            for (const LcevcEncodedLayer &layer : planes[p].encoded[loq]) {
+                if (layer.entropy_enabled)
+                    size += lcevc_multibyte_size(layer.data.size()) + layer.data.size();
+            }
+        }
+    }
+
+    lcevc_write_block_header(rbsp, LCEVC_BLOCK_ENCODED_DATA, size);
+    rbsp.reserve(rbsp.size() + size);
+    for (unsigned p = 0; p < cfg.num_planes; p++) {
+        for (int loq = 1; loq >= 0; loq--) {
+            for (unsigned l = 0; l < num_layers; l++) {
+                writer.put_bits(planes[p].encoded[loq][l].entropy_enabled, 1);
+                writer.put_bits(1, 1);                  // rle_only_flag
+            }
+        }
+    }
+    if (temporal_signalling) {
+        for (unsigned p = 0; p < cfg.num_planes; p++) {
+            writer.put_bits(0, 1);                      // entropy_enabled_flag
+            writer.put_bits(1, 1);                      // rle_only_flag
+        }
+    }
+    writer.align();
+
+    for (unsigned p = 0; p < cfg.num_planes; p++) {
+        for (int loq = 1; loq >= 0; loq--) {
+            for (const LcevcEncodedLayer &layer : planes[p].encoded[loq]) {
+                if (layer.entropy_enabled) {
+                    writer.put_multibyte(layer.data.size());
+                    rbsp.insert(rbsp.end(), layer.data.begin(), layer.data.end());
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,222 @@
+#ifndef __LCEVC_ENHANCEMENT_H__
+#define __LCEVC_ENHANCEMENT_H__
+
+#include "lcevcdsp.h"
+#include "lcevcentropy.h"
+#include "lcevcsurface.h"
+#include "lcevcworkers.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#define LCEVC_MAX_PLANES 3
+
+// Step width coefficients are quantized with by analyse()
+#define LCEVC_ANALYSIS_STEP_WIDTH 16
+
+// Magnitude classes of analysed coefficients: class k counts the levels in
+// [2^k, 2^(k+1)), up to LCEVC_MAX_COEFFICIENT
+#define LCEVC_COEFFICIENT_CLASSES 12
+
+// Side of the square tiles static content is found on with temporal
+// prediction, in LOQ-0 samples of each plane
+#define LCEVC_TEMPORAL_TILE 32
+
+struct LcevcEnhancementConfig {
+    unsigned width;             // source (LOQ-0) resolution
+    unsigned height;
+    unsigned num_planes;
+    unsigned chroma_shift_x;    // log2 chroma subsampling
+    unsigned chroma_shift_y;
+    unsigned bit_depth;         // of the source samples
+    unsigned base_depth;
+    unsigned enhancement_depth; // step widths apply at, signalled rounded up to 8, 10, 12 or 14
+    LcevcTransformType transform;
+    LcevcScalingMode scaling;
+    LcevcUpsampleType upsample;
+    unsigned step_width_loq0;
+    unsigned step_width_loq1;
+    bool temporal_enabled;
+    bool enhancement_enabled;
+    unsigned static_threshold;  // largest mean difference of a static tile, 1/16 of an 8-bit step
+    bool internal_source;       // source samples at the internal depth, as in an LcevcPyramid
+};
+
+// Source picture handed to the encoder, one view per plane. When has_base is
+// set, base holds the decoded base picture at the LOQ-1 resolution and the
+// LOQ-1 residual is coded against it. When has_intermediate is set,
+// intermediate holds the source already downsampled, at least as large as
+// the padded LOQ-1 of each plane, and the encoder does not downsample it.
+struct LcevcPicture {
+    LcevcSourcePlane planes[LCEVC_MAX_PLANES];
+    LcevcSourcePlane base[LCEVC_MAX_PLANES];
+    LcevcSurface intermediate[LCEVC_MAX_PLANES];
+    bool has_base;
+    bool has_intermediate;
+};
+
+// Residual statistics of one picture, per LOQ
+struct LcevcEnhancementStats {
+    uint64_t residual_energy[2];    // sum of absolute residuals
+    uint32_t coefficients[2][LCEVC_COEFFICIENT_CLASSES];
+};
+
+// Stages of the enhancement encode, timed per picture
+enum LcevcEncodeStage {
+    LCEVC_STAGE_DOWNSAMPLE,     // downsampling, and import of the decoded base
+    LCEVC_STAGE_UPSAMPLE,       // upsampled prediction, which gives the LOQ-0 residual
+    LCEVC_STAGE_RESIDUAL,       // LOQ-1 residual and reconstruction, static tiles
+    LCEVC_STAGE_TRANSFORM,      // transform and quantization, and their inverse
+    LCEVC_STAGE_ENTROPY,        // entropy coding and NAL serialisation
+    LCEVC_NUM_STAGES
+};
+
+// Native enhancement encoder: downsampling, the LOQ-1 and LOQ-0 residual,
+// transform and quantization stages, entropy coding and NAL serialisation.
+//
+// The per-LOQ stages run as horizontal stripes of transform blocks on the
+// worker pool. Stripes only depend on each other through the LOQ-1
+// reconstruction, which is complete before the LOQ-0 stripes start.
+//
+// With temporal prediction LOQ-0 codes the difference with the temporal
+// buffer the decoder keeps. Tiles whose source and LOQ-1 reconstruction
+// have not changed since they were last coded are static: they code no
+// coefficients, which leaves the buffer as it is, and skip the LOQ-0
+// stages altogether.
+class LcevcEnhancementEncoder {
+public:
+    LcevcEnhancementEncoder(const LcevcEnhancementConfig &config, LcevcWorkerPool *pool);
+
+    const LcevcEnhancementConfig &config() const { return cfg; }
+
+    // Start over with a new configuration, as a new encoder would. The
+    // surfaces keep their memory when it is large enough for the new one.
+    void configure(const LcevcEnhancementConfig &config);
+
+    // Memory of the surfaces, set aside by configure(). Encoding only reuses
+    // it, and allocates nothing once the coded layers have grown to size.
+    const LcevcArena &surface_arena() const { return arena; }
+
+    // Step widths of the pictures encoded from now on, signalled in each
+    // picture configuration
+    void set_step_widths(unsigned loq0, unsigned loq1);
+
+    // Encode the enhancement of one picture. The result is kept until the
+    // next call, see nal_size() and write_nal(). When given, intermediate_ready
+    // is called once the downsampled picture is complete, before the LOQ-0
+    // stages, and may call write_base().
+    void encode(const LcevcPicture &picture, bool idr,
+                const std::function<void()> &intermediate_ready = nullptr);
+
+    // Run the residual and transform stages of encode() without entropy
+    // coding, quantizing at LCEVC_ANALYSIS_STEP_WIDTH to gather stats. LOQ-1
+    // is still reconstructed at its own step width, so LOQ-0 sees the
+    // residual encode() would code. The last encoded NAL unit is kept.
+    void analyse(const LcevcPicture &picture, LcevcEnhancementStats *stats);
+
+    // Write the downsampled picture, rounded to the depth of each plane, as
+    // the input of a base encoder. Call after encode() with the same picture,
+    // or from its intermediate_ready, as it reuses the intermediate picture.
+    void write_base(const LcevcPicture &picture, const LcevcOutputPlane *base);
+
+    // LOQ-0 tiles of the last encoded picture skipped as static
+    unsigned skipped_tiles() const { return num_skipped; }
+
+    // Nanoseconds spent in a stage by the last encode() or analyse(), summed
+    // over the threads it ran on
+    uint64_t stage_time(LcevcEncodeStage stage) const { return stage_ns[stage]; }
+
+    // Bytes of the coded layers of one LOQ in the last encoded picture
+    size_t loq_bytes(unsigned loq) const;
+
+    // Size of the LCEVC NAL unit of the last encoded picture
+    size_t nal_size() const { return nal_bytes; }
+
+    // Write the NAL unit of the last encoded picture to dst, which must hold
+    // nal_size() bytes
+    void write_nal(uint8_t *dst) const;
+
+private:
+    // LOQ indices: 0 is the full resolution, 1 the intermediate one
+    struct Plane {
+        unsigned width[2];      // padded to whole transform blocks
+        unsigned height[2];
+        unsigned coded_width[2];    // transform units the bitstream carries, the rest is padding
+        unsigned coded_height[2];
+        LcevcSurfaceBuffer intermediate;     // downsampled source
+        LcevcSurfaceBuffer base;             // decoded base picture, when given
+        LcevcSurfaceBuffer reconstruction;   // base plus decoded LOQ-1 residuals
+        LcevcSurfaceBuffer residual[2];
+        std::vector<LcevcSurfaceBuffer> layer_buffers[2];
+        std::vector<LcevcSurface> layers[2];
+        std::vector<LcevcEncodedLayer> encoded[2];
+
+        // Temporal prediction
+        LcevcSurfaceBuffer temporal;            // the decoder's temporal buffer
+        uint8_t *previous;                      // source the tiles were last coded from
+        ptrdiff_t previous_stride;
+        LcevcSurfaceBuffer previous_reconstruction;
+        unsigned tiles_x;
+        std::vector<uint8_t> static_tiles;      // 1 for a tile skipped in this picture
+    };
+
+    struct Stripe {
+        unsigned plane;
+        unsigned by0;           // block rows [by0, by1)
+        unsigned by1;
+    };
+
+    // Stage times of one task, see run_timed()
+    struct TaskTimes {
+        uint64_t ns[LCEVC_NUM_STAGES];
+    };
+
+    class StageClock;
+
+    void lay_out_planes();
+    LcevcSurface intermediate_view(const LcevcPicture &picture, unsigned p) const;
+
+    template <typename F> void run_timed(unsigned count, F task);
+
+    void encode_loq1_stripe(const LcevcPicture &picture, const Stripe &stripe,
+                            LcevcEnhancementStats *stats, uint64_t *times);
+    void encode_loq0_stripe(const LcevcPicture &picture, const Stripe &stripe,
+                            LcevcEnhancementStats *stats, uint64_t *times);
+    void encode_loq0_temporal_stripe(const LcevcPicture &picture, const Stripe &stripe,
+                                     bool refresh, uint64_t *times);
+    void code_temporal_tiles(const LcevcPicture &picture, unsigned p, unsigned x0, unsigned x1,
+                             unsigned y0, unsigned y1, StageClock &clock);
+    void find_static_tiles(const LcevcPicture &picture, const Stripe &tile_row, bool refresh);
+    void update_previous(const LcevcPicture &picture, const Stripe &tile_row);
+    void gather_stats(unsigned loq, const Stripe &stripe, LcevcEnhancementStats *stats);
+    void entropy_code_layer(unsigned index, uint64_t *times);
+
+    void write_sequence_config(std::vector<uint8_t> &rbsp);
+    void write_global_config(std::vector<uint8_t> &rbsp);
+    void write_picture_config(std::vector<uint8_t> &rbsp, bool idr);
+    void write_encoded_data(std::vector<uint8_t> &rbsp, bool idr);
+
+    LcevcEnhancementConfig cfg;
+    LcevcWorkerPool *pool;
+    const LcevcDsp *dsp;
+    unsigned block_size;
+    unsigned num_layers;
+    unsigned quant_shift;                   // from the enhancement depth up to the internal one
+    LcevcQuantizer quant[2];
+    LcevcQuantizer analysis_quant;
+    LcevcArena arena;                       // every surface of the planes
+    Plane planes[LCEVC_MAX_PLANES];
+    std::vector<Stripe> stripes[2];
+    std::vector<Stripe> tile_rows;          // LOQ-0 block rows of each row of tiles
+    unsigned num_skipped;
+    std::vector<LcevcEnhancementStats> stripe_stats;
+    std::vector<TaskTimes> task_times;      // one slot per task of a pool run
+    uint64_t stage_ns[LCEVC_NUM_STAGES];
+    std::vector<uint8_t> rbsp;
+    std::vector<uint8_t> block;
+    bool nal_idr;
+    size_t nal_bytes;
+};
+
+#endif /* __LCEVC_ENHANCEMENT_H__ */
@@ -0,0 +1,118 @@
+#include "lcevcentropy.h"
+
+// Room for one coefficient and the zero run after it
+#define MAX_SYMBOL_BYTES 16
+
+// Coefficient symbols for every value in [-LCEVC_MAX_COEFFICIENT,
+// LCEVC_MAX_COEFFICIENT]: the LSB and optional MSB symbol in the low two
+// bytes, without the run flag, and the symbol count above them
+class CoefficientCodes {
+public:
+    CoefficientCodes() {
+        for (int value = -LCEVC_MAX_COEFFICIENT; value <= LCEVC_MAX_COEFFICIENT; value++) {
+            uint32_t code;
+
+            if (value >= -32 && value < 32) {
+                code = 1u << 16 | (uint32_t) (value + 32) << 1;
+            } else {
+                uint32_t biased = (uint32_t) (value + 4096);
+
+                code = 2u << 16 | (biased >> 6) << 8 | (biased & 63) << 1 | 1;
+            }
+            codes[value + LCEVC_MAX_COEFFICIENT] = code;
+        }
+    }
+
+    uint32_t operator[](int16_t value) const { return codes[value + LCEVC_MAX_COEFFICIENT]; }
+
+private:
+    uint32_t codes[2 * LCEVC_MAX_COEFFICIENT + 1];
+};
+
+static const CoefficientCodes coefficient_codes;
+
+static inline uint8_t *put_zero_run(uint8_t *p, uint64_t run) {
+    unsigned bits = run ? 64 - (unsigned) __builtin_clzll(run) : 1;
+    unsigned groups = (bits + 6) / 7;
+
+    for (unsigned g = groups; g > 0; g--) {
+        uint8_t byte = (uint8_t) ((run >> (7 * (g - 1))) & 0x7f);
+        *p++ = g > 1 ? byte | 0x80 : byte;
+    }
+    return p;
+}
+
+// Both symbol bytes are stored unconditionally, the run flag goes on the
+// last one
+static inline uint8_t *put_coefficient(uint8_t *p, int16_t value, bool zeros_follow) {
+    uint32_t code = coefficient_codes[value];
+    unsigned count = code >> 16;
+
+    p[0] = (uint8_t) code;
+    p[1] = (uint8_t) (code >> 8);
+    p[count - 1] |= zeros_follow ? 0x80 : 0x00;
+    return p + count;
+}
+
+// A coefficient and the zero run after it, if any
+static inline uint8_t *put_symbols(uint8_t *p, int16_t value, uint64_t run) {
+    p = put_coefficient(p, value, run > 0);
+    return run > 0 ? put_zero_run(p, run) : p;
+}
+
+void lcevc_entropy_encode_layer(const LcevcDsp *dsp, const LcevcSurface &layer,
+                                unsigned block_size, LcevcEncodedLayer *encoded) {
+    std::vector<uint8_t> &out = encoded->data;
+    const unsigned units = LCEVC_SCAN_BLOCK / block_size;
+    uint64_t run = 0;
+    bool pending = false;   // a coefficient is waiting for its run flag
+    int16_t last = 0;
+    size_t size = 0;
+
+    out.resize(out.capacity() < 4096 ? 4096 : out.capacity());
+
+    for (unsigned by = 0; by < layer.height; by += units) {
+        unsigned y1 = by + units < layer.height ? by + units : layer.height;
+
+        for (unsigned bx = 0; bx < layer.width; bx += units) {
+            unsigned width = bx + units < layer.width ? units : layer.width - bx;
+
+            for (unsigned y = by; y < y1; y++) {
+                const int16_t *row = layer.row(y) + bx;
+                unsigned x = 0;
+
+                for (;;) {
+                    unsigned next = x + dsp->find_nonzero(row + x, width - x);
+
+                    run += next - x;
+                    if (next == width)
+                        break;
+
+                    if (out.size() - size < MAX_SYMBOL_BYTES)
+                        out.resize(2 * out.size());
+
+                    uint8_t *p = out.data() + size;
+                    if (pending)
+                        p = put_symbols(p, last, run);
+                    else if (run > 0)
+                        p = put_symbols(p, 0, run - 1);     // the layer starts on a coefficient
+                    size = (size_t) (p - out.data());
+
+                    last = row[next];
+                    pending = true;
+                    run = 0;
+                    x = next + 1;
+                }
+            }
+        }
+    }
+
+    if (pending) {
+        if (out.size() - size < MAX_SYMBOL_BYTES)
+            out.resize(2 * out.size());
+        size = (size_t) (put_symbols(out.data() + size, last, run) - out.data());
+    }
+
+    encoded->entropy_enabled = pending;
+    out.resize(pending ? size : 0);
+}
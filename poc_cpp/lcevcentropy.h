@@ -0,0 +1,41 @@
+#ifndef __LCEVC_ENTROPY_H__
+#define __LCEVC_ENTROPY_H__
+
+#include "lcevcdsp.h"
+#include "lcevcsurface.h"
+
+#include <cstdint>
+#include <vector>
+
+// Side of the blocks transform units are scanned in, in samples of the LOQ
+#define LCEVC_SCAN_BLOCK 32
+
+// Run-length coding of a coefficient layer, the rle_only entropy coding of
+// LCEVC. Every layer is sent with rle_only set.
+//
+// Transform units are scanned in blocks of LCEVC_SCAN_BLOCK samples, the
+// blocks in raster order and the units of a block in raster order, clipped
+// at the right and bottom edges of the layer.
+//
+// The decoder starts on a coefficient. A coefficient v is an LSB symbol
+// (bit 0: an MSB symbol follows, bits 1-6: v + 32, or the low 6 bits of
+// v + 4096 with an MSB symbol) optionally followed by an MSB symbol (bits
+// 0-6: the high 7 bits of v + 4096). The high bit of the last symbol of a
+// coefficient tells whether a zero run comes next. Zero runs are written in
+// 7-bit groups, most significant first, with the high bit set while more
+// groups follow, and are always followed by a coefficient. A layer starting
+// with zeros codes the first of them as a coefficient; trailing zeros end
+// the layer with a run.
+
+struct LcevcEncodedLayer {
+    std::vector<uint8_t> data;
+    bool entropy_enabled;   // false when the layer is all zeros and nothing is sent
+};
+
+// Code one layer, of transform units block_size samples wide, into
+// encoded->data, replacing its previous contents. Zero runs are found with
+// dsp->find_nonzero().
+void lcevc_entropy_encode_layer(const LcevcDsp *dsp, const LcevcSurface &layer,
+                                unsigned block_size, LcevcEncodedLayer *encoded);
+
+#endif /* __LCEVC_ENTROPY_H__ */
@@ -0,0 +1,154 @@
+#include "lcevclookahead.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// A frame is a scene cut when the previous frame predicts it worse than
+// neighbouring samples do, and by more than this
+#define SCENECUT_MIN_COST (4 * 16)
+
+// Largest mean difference of a static tile, in 1/16 of an 8-bit step
+#define STATIC_MAX_COST 8
+
+LcevcLookahead::LcevcLookahead(unsigned width, unsigned height) : have_prev(false) {
+    thumb_w = (width + LCEVC_LOOKAHEAD_SCALE - 1) / LCEVC_LOOKAHEAD_SCALE;
+    thumb_h = (height + LCEVC_LOOKAHEAD_SCALE - 1) / LCEVC_LOOKAHEAD_SCALE;
+    tiles_w = (thumb_w + LCEVC_LOOKAHEAD_TILE - 1) / LCEVC_LOOKAHEAD_TILE;
+    tiles_h = (thumb_h + LCEVC_LOOKAHEAD_TILE - 1) / LCEVC_LOOKAHEAD_TILE;
+    row_sums.resize(thumb_w * LCEVC_LOOKAHEAD_SCALE);
+    thumb.resize(thumb_w * thumb_h);
+    prev.resize(thumb_w * thumb_h);
+}
+
+// Box filter down to the thumbnail: rows of the block are summed first, in
+// a loop the compiler vectorises, then the columns. The source is read past
+// its edges as edge replication.
+template <typename T>
+void LcevcLookahead::make_thumbnail(const LcevcSourcePlane &luma) {
+    const unsigned depth = LCEVC_INTERNAL_DEPTH - luma.shift + luma.drop;
+    const unsigned shift = 6 + (depth > 8 ? depth - 8 : 0);     // 8x8 average at 8 bits
+    const unsigned width = luma.width;
+    const unsigned padded = thumb_w * LCEVC_LOOKAHEAD_SCALE;
+    uint32_t *sums = row_sums.data();
+
+    for (unsigned ty = 0; ty < thumb_h; ty++) {
+        std::fill(row_sums.begin(), row_sums.end(), 0);
+        for (unsigned r = 0; r < LCEVC_LOOKAHEAD_SCALE; r++) {
+            unsigned y = std::min(ty * LCEVC_LOOKAHEAD_SCALE + r, luma.height - 1);
+            const T *s = luma.row<T>(y);
+
+            for (unsigned x = 0; x < width; x++)
+                sums[x] += s[x];
+            for (unsigned x = width; x < padded; x++)
+                sums[x] += s[width - 1];
+        }
+
+        uint8_t *t = &thumb[ty * thumb_w];
+        for (unsigned tx = 0; tx < thumb_w; tx++) {
+            const uint32_t *p = sums + tx * LCEVC_LOOKAHEAD_SCALE;
+            uint32_t sum = 0;
+
+            for (unsigned i = 0; i < LCEVC_LOOKAHEAD_SCALE; i++)
+                sum += p[i];
+            t[tx] = (uint8_t) std::min<uint32_t>((sum + (1u << (shift - 1))) >> shift, 255);
+        }
+    }
+}
+
+// Fine detail the thumbnail averages away, which is roughly what the LOQ-0
+// residual holds: the mean deviation of 2x2 blocks from their average, on the
+// first two rows of each block row of the thumbnail
+template <typename T>
+uint32_t LcevcLookahead::measure_detail(const LcevcSourcePlane &luma) const {
+    const unsigned depth = LCEVC_INTERNAL_DEPTH - luma.shift + luma.drop;
+    const unsigned shift = depth > 8 ? depth - 8 : 0;
+    const unsigned width = luma.width & ~1u;
+    uint64_t sum = 0;
+
+    if (!width)
+        return 0;
+
+    for (unsigned ty = 0; ty < thumb_h; ty++) {
+        unsigned y = ty * LCEVC_LOOKAHEAD_SCALE;
+        const T *s = luma.row<T>(y);
+        const T *below = luma.row<T>(std::min(y + 1, luma.height - 1));
+        uint32_t row = 0;
+
+        for (unsigned x = 0; x < width; x += 2) {
+            int a = s[x], b = s[x + 1], c = below[x], d = below[x + 1];
+            int sum4 = a + b + c + d;
+
+            row += abs(4 * a - sum4) + abs(4 * b - sum4) + abs(4 * c - sum4) + abs(4 * d - sum4);
+        }
+        sum += row;
+    }
+    // Deviations are 16 times too large, which is the cost unit
+    return (uint32_t) ((sum >> shift) / ((uint64_t) thumb_h * width * 2));
+}
+
+void LcevcLookahead::analyse(const LcevcSourcePlane &luma, LcevcFrameAnalysis *result) {
+    if (luma.bytes_per_sample == 1) {
+        make_thumbnail<uint8_t>(luma);
+        result->detail_cost = measure_detail<uint8_t>(luma);
+    } else {
+        make_thumbnail<uint16_t>(luma);
+        result->detail_cost = measure_detail<uint16_t>(luma);
+    }
+
+    uint64_t intra = 0;
+    for (unsigned y = 0; y < thumb_h; y++) {
+        const uint8_t *t = &thumb[y * thumb_w];
+        const uint8_t *below = y + 1 < thumb_h ? t + thumb_w : t;
+
+        for (unsigned x = 0; x < thumb_w; x++) {
+            unsigned right = x + 1 < thumb_w ? x + 1 : x;
+            intra += abs(t[right] - t[x]) + abs(below[x] - t[x]);
+        }
+    }
+    result->intra_cost = (uint32_t) (intra * 16 / thumb.size());
+
+    result->static_map.assign(tiles_w * tiles_h, 0);
+    result->static_tiles = 0;
+    if (!have_prev) {
+        result->inter_cost = result->intra_cost;
+        result->scene_cut = true;
+    } else {
+        uint64_t inter = 0;
+
+        for (unsigned ty = 0; ty < tiles_h; ty++) {
+            for (unsigned tx = 0; tx < tiles_w; tx++) {
+                unsigned x0 = tx * LCEVC_LOOKAHEAD_TILE;
+                unsigned y0 = ty * LCEVC_LOOKAHEAD_TILE;
+                unsigned x1 = std::min(x0 + LCEVC_LOOKAHEAD_TILE, thumb_w);
+                unsigned y1 = std::min(y0 + LCEVC_LOOKAHEAD_TILE, thumb_h);
+                uint32_t sad = 0;
+
+                for (unsigned y = y0; y < y1; y++) {
+                    const uint8_t *t = &thumb[y * thumb_w];
+                    const uint8_t *p = &prev[y * thumb_w];
+
+                    for (unsigned x = x0; x < x1; x++)
+                        sad += abs(t[x] - p[x]);
+                }
+                inter += sad;
+                if (sad * 16 <= STATIC_MAX_COST * (x1 - x0) * (y1 - y0)) {
+                    result->static_map[ty * tiles_w + tx] = 1;
+                    result->static_tiles++;
+                }
+            }
+        }
+        result->inter_cost = (uint32_t) (inter * 16 / thumb.size());
+        result->scene_cut = result->inter_cost > SCENECUT_MIN_COST &&
+            result->inter_cost > result->intra_cost;
+    }
+
+    thumb.swap(prev);
+    have_prev = true;
+}
+
+LcevcFrameDecision lcevc_lookahead_decide(const LcevcFrameAnalysis *const *frames, unsigned n) {
+    LcevcFrameDecision decision;
+
+    decision.refresh = frames[0]->scene_cut && !(n > 1 && frames[1]->scene_cut);
+    return decision;
+}
@@ -0,0 +1,70 @@
+#ifndef __LCEVC_LOOKAHEAD_H__
+#define __LCEVC_LOOKAHEAD_H__
+
+#include "lcevcsurface.h"
+
+#include <cstdint>
+#include <vector>
+
+// Cheap analysis of upcoming frames for the frame type decisions.
+//
+// Each frame is reduced to a luma thumbnail, LCEVC_LOOKAHEAD_SCALE times
+// smaller in both directions and at 8 bits, and compared with the thumbnail
+// of the frame before it. Costs are mean absolute values per thumbnail
+// sample, in 1/16 of an 8-bit step.
+
+#define LCEVC_LOOKAHEAD_SCALE 8
+
+// Thumbnail samples per side of a static map tile, which is
+// LCEVC_LOOKAHEAD_SCALE times larger in the source
+#define LCEVC_LOOKAHEAD_TILE 8
+
+struct LcevcFrameAnalysis {
+    uint32_t intra_cost;        // gradient energy of the frame itself
+    uint32_t inter_cost;        // difference with the previous frame
+    uint32_t detail_cost;       // full resolution detail, on a subset of rows
+    bool scene_cut;             // the previous frame does not predict this one
+    unsigned static_tiles;      // number of set entries in static_map
+    std::vector<uint8_t> static_map;    // per tile, 1 where nothing moved
+};
+
+struct LcevcFrameDecision {
+    bool refresh;               // temporal refresh and base keyframe
+};
+
+class LcevcLookahead {
+public:
+    LcevcLookahead(unsigned width, unsigned height);
+
+    // Static map dimensions, in tiles
+    unsigned tiles_x() const { return tiles_w; }
+    unsigned tiles_y() const { return tiles_h; }
+
+    // Analyse the luma plane of the next frame in input order
+    void analyse(const LcevcSourcePlane &luma, LcevcFrameAnalysis *result);
+
+    // Forget the previous frame; the next one is a scene cut
+    void reset() { have_prev = false; }
+
+private:
+    template <typename T>
+    void make_thumbnail(const LcevcSourcePlane &luma);
+    template <typename T>
+    uint32_t measure_detail(const LcevcSourcePlane &luma) const;
+
+    unsigned thumb_w;
+    unsigned thumb_h;
+    unsigned tiles_w;
+    unsigned tiles_h;
+    std::vector<uint32_t> row_sums;
+    std::vector<uint8_t> thumb;
+    std::vector<uint8_t> prev;
+    bool have_prev;
+};
+
+// Decide for frames[0] knowing frames[1, n), the ones behind it in the
+// lookahead. A scene cut only triggers a refresh once the picture settles,
+// so a flash or a run of cuts gets a single refresh on its last frame.
+LcevcFrameDecision lcevc_lookahead_decide(const LcevcFrameAnalysis *const *frames, unsigned n);
+
+#endif /* __LCEVC_LOOKAHEAD_H__ */
@@ -0,0 +1,180 @@
+#include "lcevcmetrics.h"
+
+#include <cmath>
+#include <cstdio>
+
+unsigned LcevcHistogram::bucket(uint64_t value) {
+    if (value >> LCEVC_HISTOGRAM_MAX_BITS)
+        return num_buckets - 1;
+    if (value < sub_buckets)
+        return (unsigned) value;
+
+    unsigned shift = 63 - (unsigned) __builtin_clzll(value) - LCEVC_HISTOGRAM_SUB_BITS;
+    return (shift + 1) * sub_buckets + (unsigned) (value >> shift) - sub_buckets;
+}
+
+uint64_t LcevcHistogram::bucket_end(unsigned index) {
+    if (index < sub_buckets)
+        return index;
+
+    unsigned shift = index / sub_buckets - 1;
+    uint64_t mantissa = sub_buckets + index % sub_buckets;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LcevcHistogram::record(uint64_t value) {
+    buckets[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    accumulated.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = largest.load(std::memory_order_relaxed);
+    while (value > current &&
+           !largest.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        ;
+}
+
+void LcevcHistogram::reset() {
+    for (std::atomic<uint64_t> &b : buckets)
+        b.store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    accumulated.store(0, std::memory_order_relaxed);
+    largest.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LcevcHistogram::mean() const {
+    uint64_t n = count();
+    return n ? sum() / n : 0;
+}
+
+uint64_t LcevcHistogram::percentile(double q) const {
+    uint64_t n = count();
+    if (!n)
+        return 0;
+
+    // The buckets may have moved on since n was read; whatever they hold
+    // past it is not looked at
+    uint64_t rank = (uint64_t) std::ceil(q * n);
+    rank = rank < 1 ? 1 : rank > n ? n : rank;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < num_buckets; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank && i < num_buckets - 1) {
+            uint64_t end = bucket_end(i);
+            return end < max() ? end : max();
+        }
+    }
+    return max();
+}
+
+void LcevcEncoderMetrics::reset() {
+    latency.reset();
+    frames_encoded.store(0, std::memory_order_relaxed);
+    frames_dropped.store(0, std::memory_order_relaxed);
+    pool_misses.store(0, std::memory_order_relaxed);
+    copy_fallbacks.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint64_t> &bytes : bytes_out)
+        bytes.store(0, std::memory_order_relaxed);
+}
+
+// Label values are quoted, with backslashes, quotes and newlines escaped
+static std::string label_value(const std::string &value) {
+    std::string escaped;
+
+    for (char c : value) {
+        if (c == '\\' || c == '"')
+            escaped += '\\';
+        if (c == '\n')
+            escaped += "\\n";
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+static void add_header(std::string &out, const char *name, const char *type, const char *help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+// One sample; extra holds labels of its own, starting with a comma
+static void add_sample(std::string &out, const char *name, const std::string &instance,
+                       const char *extra, double value) {
+    char line[64];
+
+    snprintf(line, sizeof(line), "} %.9g\n", value);
+    out += name;
+    out += "{instance=\"";
+    out += instance;
+    out += '"';
+    out += extra;
+    out += line;
+}
+
+std::string LcevcEncoderMetrics::exposition(const std::string &instance) const {
+    static const char *layer_names[LCEVC_METRICS_NUM_LAYERS] = { "loq0", "loq1", "base" };
+    const std::string label = label_value(instance);
+    std::string out;
+
+    add_header(out, "lcevcenc_frames_encoded_total", "counter", "Frames output");
+    add_sample(out, "lcevcenc_frames_encoded_total", label, "",
+               (double) frames_encoded.load(std::memory_order_relaxed));
+    add_header(out, "lcevcenc_frames_dropped_total", "counter",
+               "Frames that could not be encoded");
+    add_sample(out, "lcevcenc_frames_dropped_total", label, "",
+               (double) frames_dropped.load(std::memory_order_relaxed));
+    add_header(out, "lcevcenc_pool_misses_total", "counter",
+               "Output buffers allocated outside of the buffer pool");
+    add_sample(out, "lcevcenc_pool_misses_total", label, "",
+               (double) pool_misses.load(std::memory_order_relaxed));
+    add_header(out, "lcevcenc_copy_fallbacks_total", "counter",
+               "Input frames copied on ingest");
+    add_sample(out, "lcevcenc_copy_fallbacks_total", label, "",
+               (double) copy_fallbacks.load(std::memory_order_relaxed));
+
+    add_header(out, "lcevcenc_bytes_out_total", "counter", "Bytes output per layer");
+    for (unsigned l = 0; l < LCEVC_METRICS_NUM_LAYERS; l++) {
+        std::string layer = std::string(",layer=\"") + layer_names[l] + "\"";
+        add_sample(out, "lcevcenc_bytes_out_total", label, layer.c_str(),
+                   (double) bytes_out[l].load(std::memory_order_relaxed));
+    }
+
+    add_header(out, "lcevcenc_encode_latency_seconds", "summary",
+               "Time from a frame coming in to it going out");
+    add_sample(out, "lcevcenc_encode_latency_seconds", label, ",quantile=\"0.5\"",
+               latency.percentile(0.5) / 1e9);
+    add_sample(out, "lcevcenc_encode_latency_seconds", label, ",quantile=\"0.99\"",
+               latency.percentile(0.99) / 1e9);
+    add_sample(out, "lcevcenc_encode_latency_seconds_sum", label, "",
+               latency.sum() / 1e9);
+    add_sample(out, "lcevcenc_encode_latency_seconds_count", label, "",
+               (double) latency.count());
+    add_header(out, "lcevcenc_encode_latency_max_seconds", "gauge",
+               "Longest time from a frame coming in to it going out");
+    add_sample(out, "lcevcenc_encode_latency_max_seconds", label, "", latency.max() / 1e9);
+
+    return out;
+}
+
+bool lcevc_metrics_write_file(const std::string &path, const std::string &text) {
+    std::string tmp = path + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "w");
+
+    if (!file)
+        return false;
+
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = fclose(file) == 0 && ok;
+    if (ok)
+        ok = rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok)
+        remove(tmp.c_str());
+    return ok;
+}
@@ -0,0 +1,79 @@
+#ifndef __LCEVC_METRICS_H__
+#define __LCEVC_METRICS_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Latency histogram in the manner of HdrHistogram: each power of two is
+// split in 2^LCEVC_HISTOGRAM_SUB_BITS linear buckets, so a value is known to
+// within 1/32 of itself. Values from 2^LCEVC_HISTOGRAM_MAX_BITS on are
+// counted in the last bucket, their maximum stays exact.
+//
+// Recording is lock-free and may race with reads, which see every counter
+// as it was at some point during the read.
+#define LCEVC_HISTOGRAM_SUB_BITS 5
+#define LCEVC_HISTOGRAM_MAX_BITS 40     // about 18 minutes in nanoseconds
+
+class LcevcHistogram {
+public:
+    LcevcHistogram() { reset(); }
+
+    void record(uint64_t value);
+    void reset();
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return accumulated.load(std::memory_order_relaxed); }
+    uint64_t max() const { return largest.load(std::memory_order_relaxed); }
+    uint64_t mean() const;
+
+    // Smallest value at or below which a fraction q of the values fall, to
+    // the precision of the buckets. 0 when nothing was recorded.
+    uint64_t percentile(double q) const;
+
+private:
+    static const unsigned sub_buckets = 1 << LCEVC_HISTOGRAM_SUB_BITS;
+    static const unsigned num_buckets =
+        (LCEVC_HISTOGRAM_MAX_BITS - LCEVC_HISTOGRAM_SUB_BITS + 1) * sub_buckets;
+
+    static unsigned bucket(uint64_t value);
+    static uint64_t bucket_end(unsigned index);     // largest value in the bucket
+
+    std::atomic<uint64_t> buckets[num_buckets];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> accumulated;
+    std::atomic<uint64_t> largest;
+};
+
+// Layers of the output, indexed like the LOQs of the enhancement
+enum LcevcMetricsLayer {
+    LCEVC_METRICS_LOQ0,
+    LCEVC_METRICS_LOQ1,
+    LCEVC_METRICS_BASE,
+    LCEVC_METRICS_NUM_LAYERS
+};
+
+// Counters of one encoder, updated from any thread without locks. They
+// only ever grow until reset().
+struct LcevcEncoderMetrics {
+    LcevcHistogram latency;                 // ns from a frame coming in to it going out
+    std::atomic<uint64_t> frames_encoded;
+    std::atomic<uint64_t> frames_dropped;
+    std::atomic<uint64_t> pool_misses;      // output buffers allocated outside the pool
+    std::atomic<uint64_t> copy_fallbacks;   // input frames copied on ingest
+    std::atomic<uint64_t> bytes_out[LCEVC_METRICS_NUM_LAYERS];
+
+    LcevcEncoderMetrics() { reset(); }
+
+    void reset();
+
+    // The counters in the Prometheus text exposition format, every sample
+    // labelled with the instance name
+    std::string exposition(const std::string &instance) const;
+};
+
+// Replace the file at path with text, through a temporary file renamed over
+// it so readers never see it partly written
+bool lcevc_metrics_write_file(const std::string &path, const std::string &text);
+
+#endif /* __LCEVC_METRICS_H__ */
@@ -0,0 +1,190 @@
+#include "lcevcplacement.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Memory policy of set_mempolicy(2) and mbind(2), which have no wrapper
+// without libnuma
+#define MPOL_PREFERRED_MODE 1
+#define MAX_NODES 1024
+
+bool lcevc_parse_cpu_list(const std::string &list, std::vector<unsigned> *cpus) {
+    std::string trimmed = list.substr(0, list.find_last_not_of(" \n") + 1);
+    const char *p = trimmed.c_str();
+
+    cpus->clear();
+    while (*p) {
+        char *end;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+
+        if (end == p)
+            return false;
+        p = end;
+        if (*p == '-') {
+            last = strtoul(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+                return false;
+            p = end;
+        }
+        if (last >= 65536)
+            return false;
+        for (unsigned long cpu = first; cpu <= last; cpu++)
+            cpus->push_back((unsigned) cpu);
+
+        if (*p == ',')
+            p++;
+        else if (*p)
+            return false;
+    }
+
+    std::sort(cpus->begin(), cpus->end());
+    cpus->erase(std::unique(cpus->begin(), cpus->end()), cpus->end());
+    return !cpus->empty();
+}
+
+std::string lcevc_format_cpu_list(const std::vector<unsigned> &cpus) {
+    std::string out;
+
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        char range[32];
+
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            j++;
+        if (j > i)
+            snprintf(range, sizeof(range), "%s%u-%u", out.empty() ? "" : ",", cpus[i], cpus[j]);
+        else
+            snprintf(range, sizeof(range), "%s%u", out.empty() ? "" : ",", cpus[i]);
+        out += range;
+        i = j + 1;
+    }
+    return out;
+}
+
+#ifdef __linux__
+
+static bool read_line(const char *path, std::string *line) {
+    FILE *file = fopen(path, "r");
+    char buffer[4096];
+
+    if (!file)
+        return false;
+    bool ok = fgets(buffer, sizeof(buffer), file) != nullptr;
+    fclose(file);
+    if (ok)
+        *line = buffer;
+    return ok;
+}
+
+bool lcevc_node_cpus(int node, std::vector<unsigned> *cpus) {
+    char path[64];
+    std::string line;
+
+    if (node < 0)
+        return false;
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    return read_line(path, &line) && lcevc_parse_cpu_list(line, cpus);
+}
+
+static int cpu_node(unsigned cpu) {
+    std::string line;
+    std::vector<unsigned> nodes;
+
+    if (!read_line("/sys/devices/system/node/online", &line) ||
+        !lcevc_parse_cpu_list(line, &nodes))
+        return -1;
+    for (unsigned node : nodes) {
+        std::vector<unsigned> cpus;
+
+        if (lcevc_node_cpus((int) node, &cpus) &&
+            std::binary_search(cpus.begin(), cpus.end(), cpu))
+            return (int) node;
+    }
+    return -1;
+}
+
+bool lcevc_current_placement(LcevcPlacement *placement) {
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return false;
+
+    placement->cpus.clear();
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set))
+            placement->cpus.push_back(cpu);
+    }
+
+    int cpu = sched_getcpu();
+    placement->node = cpu >= 0 ? cpu_node((unsigned) cpu) : -1;
+    return true;
+}
+
+static bool node_mask(int node, unsigned long *mask, size_t words) {
+    const size_t bits = 8 * sizeof(unsigned long);
+
+    if (node < 0 || (size_t) node >= words * bits)
+        return false;
+    memset(mask, 0, words * sizeof(unsigned long));
+    mask[node / bits] |= 1ul << (node % bits);
+    return true;
+}
+
+bool lcevc_apply_placement(const LcevcPlacement &placement) {
+    bool ok = true;
+
+    if (!placement.cpus.empty()) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        for (unsigned cpu : placement.cpus) {
+            if (cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+        ok = sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+
+    unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))];
+    if (node_mask(placement.node, mask, sizeof(mask) / sizeof(mask[0])))
+        ok = syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, mask, MAX_NODES + 1) == 0 && ok;
+
+    return ok;
+}
+
+bool lcevc_bind_memory(void *ptr, size_t size, int node) {
+    unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))];
+
+    if (!node_mask(node, mask, sizeof(mask) / sizeof(mask[0])))
+        return false;
+    return syscall(SYS_mbind, ptr, size, MPOL_PREFERRED_MODE, mask, MAX_NODES + 1, 0) == 0;
+}
+
+#else
+
+bool lcevc_node_cpus(int, std::vector<unsigned> *) {
+    return false;
+}
+
+bool lcevc_current_placement(LcevcPlacement *) {
+    return false;
+}
+
+bool lcevc_apply_placement(const LcevcPlacement &) {
+    return false;
+}
+
+bool lcevc_bind_memory(void *, size_t, int) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __LCEVC_PLACEMENT_H__
+#define __LCEVC_PLACEMENT_H__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Where threads run and where their memory comes from: a set of CPUs and a
+// NUMA node. Linux only; elsewhere nothing is read or pinned and the calls
+// below fail.
+struct LcevcPlacement {
+    std::vector<unsigned> cpus;     // sorted, empty to run anywhere
+    int node;                       // -1 for no preference
+
+    LcevcPlacement() : node(-1) {}
+
+    bool empty() const { return cpus.empty() && node < 0; }
+};
+
+// Parse a CPU list in the format of cpusets and sysfs, "0-3,8,10-11"
+bool lcevc_parse_cpu_list(const std::string &list, std::vector<unsigned> *cpus);
+
+std::string lcevc_format_cpu_list(const std::vector<unsigned> &cpus);
+
+// CPUs of a NUMA node
+bool lcevc_node_cpus(int node, std::vector<unsigned> *cpus);
+
+// The CPUs the calling thread may run on, and the node of the one it runs on
+bool lcevc_current_placement(LcevcPlacement *placement);
+
+// Pin the calling thread to the CPUs of placement, and make the pages it
+// touches first come from its node
+bool lcevc_apply_placement(const LcevcPlacement &placement);
+
+// Make the pages of a mapping come from node when they are first touched,
+// whichever thread touches them
+bool lcevc_bind_memory(void *ptr, size_t size, int node);
+
+#endif /* __LCEVC_PLACEMENT_H__ */
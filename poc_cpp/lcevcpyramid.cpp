@@ -0,0 +1,123 @@
+#include "lcevcpyramid.h"
+
+// LOQ-0 padding of the largest transform, two 4x4 blocks: a level is the
+// intermediate picture of encoders of either transform at the level below
+#define PYRAMID_PADDING 8
+
+// Row stripes of each plane per thread of the pool, when building a level
+#define STRIPES_PER_THREAD 2
+
+static unsigned round_up(unsigned value, unsigned multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+LcevcPyramid::LcevcPyramid()
+    : dsp(lcevc_dsp_get()), src_width(0), src_height(0), planes(0), shift_x(0), shift_y(0),
+      levels(0), bytes(0) {}
+
+void LcevcPyramid::configure(unsigned width, unsigned height, unsigned num_planes,
+                             unsigned chroma_shift_x, unsigned chroma_shift_y,
+                             unsigned num_levels) {
+    src_width = width;
+    src_height = height;
+    planes = num_planes;
+    shift_x = chroma_shift_x;
+    shift_y = chroma_shift_y;
+    levels = num_levels;
+    bytes = 0;
+    offsets.clear();
+    strides.clear();
+
+    for (unsigned level = 1; level <= levels; level++) {
+        for (unsigned p = 0; p < planes; p++) {
+            LcevcSurface padded = surface(nullptr, level, p);
+            ptrdiff_t align = LCEVC_SURFACE_ALIGN / sizeof(int16_t);
+            ptrdiff_t stride = ((ptrdiff_t) padded.width + align - 1) / align * align;
+
+            offsets.push_back(bytes);
+            strides.push_back(stride);
+            bytes += (size_t) stride * padded.height * sizeof(int16_t);
+        }
+    }
+}
+
+unsigned LcevcPyramid::plane_width(unsigned level, unsigned p) const {
+    unsigned shift = p ? shift_x : 0;
+    unsigned width = (src_width + (1 << shift) - 1) >> shift;
+
+    for (unsigned l = 0; l < level; l++)
+        width = (width + 1) / 2;
+    return width;
+}
+
+unsigned LcevcPyramid::plane_height(unsigned level, unsigned p) const {
+    unsigned shift = p ? shift_y : 0;
+    unsigned height = (src_height + (1 << shift) - 1) >> shift;
+
+    for (unsigned l = 0; l < level; l++)
+        height = (height + 1) / 2;
+    return height;
+}
+
+// Surface of a level above the source, padded like the LOQ-1 of the level
+// below. Only its dimensions are set without a block.
+LcevcSurface LcevcPyramid::surface(uint8_t *block, unsigned level, unsigned p) const {
+    LcevcSurface view;
+    size_t index = (size_t) (level - 1) * planes + p;
+
+    view.width = round_up(plane_width(level - 1, p), PYRAMID_PADDING) / 2;
+    view.height = round_up(plane_height(level - 1, p), PYRAMID_PADDING) / 2;
+    view.data = block ? reinterpret_cast<int16_t *>(block + offsets[index]) : nullptr;
+    view.stride = block ? strides[index] : 0;
+    return view;
+}
+
+// Plane of a level as an encoder reads its source: the source itself, or
+// the samples of the level surface at the internal depth
+LcevcSourcePlane LcevcPyramid::source_plane(const LcevcSourcePlane *source, uint8_t *block,
+                                            unsigned level, unsigned p) const {
+    if (level == 0)
+        return source[p];
+
+    LcevcSurface level_surface = surface(block, level, p);
+    LcevcSourcePlane plane;
+
+    plane.data = reinterpret_cast<const uint8_t *>(level_surface.data);
+    plane.stride = level_surface.stride * (ptrdiff_t) sizeof(int16_t);
+    plane.width = plane_width(level, p);
+    plane.height = plane_height(level, p);
+    plane.bytes_per_sample = 2;
+    plane.shift = 0;
+    plane.step = 1;
+    plane.drop = 0;
+    return plane;
+}
+
+void LcevcPyramid::build(const LcevcSourcePlane *source, uint8_t *block,
+                         LcevcWorkerPool *pool) const {
+    unsigned count = pool->num_threads() * STRIPES_PER_THREAD;
+
+    // Each level reads the whole of the one below it
+    for (unsigned level = 1; level <= levels; level++) {
+        pool->run(planes * count, [&](unsigned index) {
+            unsigned p = index / count;
+            unsigned s = index % count;
+            LcevcSurface dst = surface(block, level, p);
+            unsigned y0 = dst.height * s / count;
+            unsigned y1 = dst.height * (s + 1) / count;
+
+            if (y0 < y1)
+                lcevc_dsp_downsample(dsp, LCEVC_SCALING_2D,
+                                     source_plane(source, block, level - 1, p), dst, y0, y1);
+        });
+    }
+}
+
+void LcevcPyramid::picture(const LcevcSourcePlane *source, uint8_t *block, unsigned level,
+                           LcevcPicture *picture) const {
+    for (unsigned p = 0; p < planes; p++) {
+        picture->planes[p] = source_plane(source, block, level, p);
+        picture->intermediate[p] = surface(block, level + 1, p);
+    }
+    picture->has_intermediate = true;
+}
@@ -0,0 +1,67 @@
+#ifndef __LCEVC_PYRAMID_H__
+#define __LCEVC_PYRAMID_H__
+
+#include "lcevcenhancement.h"
+#include "lcevcworkers.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Dyadic pyramid of a source picture, for a ladder of renditions encoded
+// from one source. Level 0 is the source itself and every level above it
+// the 2D downsampling of the one below, exactly as the enhancement encoder
+// of that level would compute its LOQ-1. A rendition at level L encodes
+// level L with level L + 1 as its intermediate picture, so each level is
+// downsampled once however many renditions read it.
+//
+// The levels above the source are kept at the internal depth, in a block
+// the caller provides, so that the pyramids of frames in flight can come
+// from a buffer pool. Levels are padded for either transform.
+class LcevcPyramid {
+public:
+    LcevcPyramid();
+
+    // Lay out levels 1 to num_levels above pictures of width x height
+    void configure(unsigned width, unsigned height, unsigned num_planes,
+                   unsigned chroma_shift_x, unsigned chroma_shift_y, unsigned num_levels);
+
+    unsigned num_levels() const { return levels; }
+
+    // Bytes of a block holding every level, whose start must be aligned to
+    // LCEVC_SURFACE_ALIGN
+    size_t size() const { return bytes; }
+
+    // Luma resolution of a level
+    unsigned width(unsigned level) const { return plane_width(level, 0); }
+    unsigned height(unsigned level) const { return plane_height(level, 0); }
+
+    // Downsample source, level by level, into block
+    void build(const LcevcSourcePlane *source, uint8_t *block, LcevcWorkerPool *pool) const;
+
+    // Picture of a rendition at level, below num_levels: the planes of that
+    // level, from source or block, with the level above as the intermediate
+    // picture. The base picture is left alone.
+    void picture(const LcevcSourcePlane *source, uint8_t *block, unsigned level,
+                 LcevcPicture *picture) const;
+
+private:
+    unsigned plane_width(unsigned level, unsigned p) const;
+    unsigned plane_height(unsigned level, unsigned p) const;
+    LcevcSurface surface(uint8_t *block, unsigned level, unsigned p) const;
+    LcevcSourcePlane source_plane(const LcevcSourcePlane *source, uint8_t *block,
+                                  unsigned level, unsigned p) const;
+
+    const LcevcDsp *dsp;
+    unsigned src_width;
+    unsigned src_height;
+    unsigned planes;
+    unsigned shift_x;
+    unsigned shift_y;
+    unsigned levels;
+    size_t bytes;
+    std::vector<size_t> offsets;            // of each level and plane above the source
+    std::vector<ptrdiff_t> strides;         // in samples
+};
+
+#endif /* __LCEVC_PYRAMID_H__ */
@@ -0,0 +1,279 @@
+#include "lcevcratecontrol.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define MIN_STEP_WIDTH 1
+#define MAX_STEP_WIDTH 32767
+
+// Seconds over which ABR pays back a difference with the bitrate
+#define ABR_WINDOW 2.0
+
+// Starting exponent of the model, and the range fitting keeps it in
+#define DEFAULT_EXPONENT 0.8
+#define MIN_EXPONENT 0.2
+#define MAX_EXPONENT 2.0
+
+// Buffer fullness at the start, and the margin frames leave in it
+#define VBV_INIT 0.9
+#define VBV_MARGIN 0.1
+
+// Second pass model: starting cost of a coefficient, and the bits of a frame
+// with none, headers and layer flags
+#define DEFAULT_BITS_PER_COEFFICIENT 12.0
+#define FRAME_OVERHEAD_BITS 1024.0
+
+// Step widths of the second pass plan, spaced evenly on a log scale
+#define PLAN_GRID_SIZE 64
+
+static double clamp_double(double value, double min, double max) {
+    return std::min(std::max(value, min), max);
+}
+
+static unsigned clamp_step_width(double value) {
+    return (unsigned) clamp_double(std::floor(value + 0.5), MIN_STEP_WIDTH, MAX_STEP_WIDTH);
+}
+
+LcevcRateControl::LcevcRateControl(const LcevcRateControlConfig &config,
+                                   const LcevcStatsReader *stats)
+    : cfg(config), log_scale(0), exponent(DEFAULT_EXPONENT), have_model(false),
+      have_last(false), last_log_ratio(0), last_log_bits(0), frames_done(0), bits_done(0),
+      in_flight(0), bits_in_flight(0), underflows(0), stats(stats), frames_started(0),
+      total_bits(0), bits_per_coefficient(DEFAULT_BITS_PER_COEFFICIENT) {
+    set_rates();
+    vbv_fill = vbv_size * VBV_INIT;
+
+    if (!stats)
+        return;
+
+    total_bits = frame_bits * (double) stats->num_frames();
+    grid.resize(PLAN_GRID_SIZE);
+    grid_coefficients.assign(PLAN_GRID_SIZE, 0);
+    for (unsigned g = 0; g < PLAN_GRID_SIZE; g++)
+        grid[g] = std::pow((double) MAX_STEP_WIDTH, (double) g / (PLAN_GRID_SIZE - 1));
+    for (uint64_t i = 0; i < stats->num_frames(); i++) {
+        for (unsigned g = 0; g < PLAN_GRID_SIZE; g++)
+            grid_coefficients[g] += expected_coefficients(stats->frame(i), grid[g]);
+    }
+}
+
+// Per frame shares of the bitrate and the buffer model of cfg
+void LcevcRateControl::set_rates() {
+    double fps = cfg.fps > 0 ? cfg.fps : 30.0;
+    unsigned max_bitrate = cfg.vbv_max_bitrate ? cfg.vbv_max_bitrate : cfg.bitrate;
+    unsigned buffer_size = cfg.vbv_buffer_size;
+
+    if (cfg.mode == LCEVC_RATE_CONTROL_CBR) {
+        max_bitrate = cfg.bitrate;
+        if (!buffer_size)
+            buffer_size = cfg.bitrate;
+    }
+
+    cfg.fps = fps;
+    frame_bits = cfg.bitrate * 1000.0 / fps;
+    vbv_size = buffer_size * 1000.0;
+    vbv_input = max_bitrate * 1000.0 / fps;
+    loq1_ratio = (double) std::max(cfg.step_width_loq1, 1u) /
+        std::max(cfg.step_width_loq0, 1u);
+}
+
+void LcevcRateControl::reconfigure(const LcevcRateControlConfig &config) {
+    LcevcRateControlMode mode = cfg.mode;
+    double old_frame_bits = frame_bits;
+    double old_vbv_size = vbv_size;
+
+    // What the frames done so far are off by at the old bitrate is carried
+    // over, to be paid back at the new one
+    double debt = old_frame_bits * (double) frames_done - bits_done;
+    double budget_left = total_bits - bits_done;
+
+    cfg = config;
+    cfg.mode = mode;
+    set_rates();
+
+    frames_done = 0;
+    bits_done = -debt;
+    if (stats)
+        total_bits = bits_done + budget_left * frame_bits / old_frame_bits;
+
+    // The buffer stays as full, relative to its size
+    vbv_fill = old_vbv_size > 0 ? vbv_fill * vbv_size / old_vbv_size : vbv_size * VBV_INIT;
+}
+
+double LcevcRateControl::expected_coefficients(const LcevcStatsRecord &record,
+                                               double step_width) const {
+    unsigned analysis = stats->header().analysis_step_width;
+    double loq1 = std::min(step_width * loq1_ratio, (double) MAX_STEP_WIDTH);
+
+    return lcevc_stats_coefficients(record.coefficients[0], analysis, step_width) +
+        lcevc_stats_coefficients(record.coefficients[1], analysis, loq1);
+}
+
+double LcevcRateControl::frame_target() const {
+    // Pay back what the frames so far, done or predicted, are off by
+    double expected = frame_bits * (double) (frames_done + in_flight);
+    double spent = bits_done + bits_in_flight;
+    double target = frame_bits + (expected - spent) / (ABR_WINDOW * cfg.fps);
+
+    target = clamp_double(target, frame_bits / 8, frame_bits * 8);
+    if (vbv_size <= 0)
+        return target;
+
+    // Below half full, spend less to fill the buffer back up
+    double fill = vbv_fill + in_flight * vbv_input - bits_in_flight;
+    double half = vbv_size / 2;
+
+    if (fill < half)
+        target *= std::max(fill / half, 0.1);
+    return vbv_limit(target);
+}
+
+// Fit target in the buffer as it will be once the frames in flight are done
+double LcevcRateControl::vbv_limit(double target) const {
+    double fill = vbv_fill + in_flight * vbv_input - bits_in_flight;
+
+    target = std::min(target, fill + vbv_input - vbv_size * VBV_MARGIN);
+
+    // At a constant bitrate, room the buffer cannot hold is wasted
+    if (cfg.mode == LCEVC_RATE_CONTROL_CBR)
+        target = std::max(target, fill + vbv_input - vbv_size);
+
+    return std::max(target, frame_bits / 16);
+}
+
+// Second pass: the step width that spends what is left of the budget on the
+// frames left, raised if the buffer cannot hold the frame. Returns false past
+// the end of the first pass.
+bool LcevcRateControl::plan_frame(LcevcRateControlFrame *frame) {
+    if (!stats || frames_started >= stats->num_frames())
+        return false;
+
+    const LcevcStatsRecord &record = stats->frame(frames_started);
+    double frames_left = (double) (stats->num_frames() - frames_started);
+    double budget = total_bits - bits_done - bits_in_flight - FRAME_OVERHEAD_BITS * frames_left;
+    double step_width = grid.back();
+
+    for (unsigned g = 0; g < PLAN_GRID_SIZE; g++) {
+        double bits = bits_per_coefficient * grid_coefficients[g];
+
+        if (bits > budget)
+            continue;
+        step_width = grid[g];
+        if (g > 0 && bits > 0) {
+            // Interpolate on a log scale from the grid point just over budget
+            double over = bits_per_coefficient * grid_coefficients[g - 1];
+            double f = std::log(over / budget) / std::log(over / bits);
+
+            step_width = grid[g - 1] * std::pow(grid[g] / grid[g - 1], f);
+        }
+        break;
+    }
+
+    double coefficients = expected_coefficients(record, step_width);
+    double predicted = bits_per_coefficient * coefficients + FRAME_OVERHEAD_BITS;
+
+    if (vbv_size > 0) {
+        double limit = vbv_limit(predicted);
+
+        for (unsigned g = 0; g < PLAN_GRID_SIZE && predicted > limit; g++) {
+            if (grid[g] <= step_width)
+                continue;
+            step_width = grid[g];
+            coefficients = expected_coefficients(record, step_width);
+            predicted = bits_per_coefficient * coefficients + FRAME_OVERHEAD_BITS;
+        }
+    }
+
+    for (unsigned g = 0; g < PLAN_GRID_SIZE; g++) {
+        grid_coefficients[g] -= expected_coefficients(record, grid[g]);
+        grid_coefficients[g] = std::max(grid_coefficients[g], 0.0);
+    }
+
+    frame->step_width_loq0 = clamp_step_width(step_width);
+    frame->step_width_loq1 = clamp_step_width(frame->step_width_loq0 * loq1_ratio);
+    frame->coefficients = coefficients;
+    frame->predicted_bits = predicted;
+    return true;
+}
+
+void LcevcRateControl::frame_start(uint32_t detail, LcevcRateControlFrame *frame) {
+    frame->detail = detail;
+    frame->coefficients = 0;
+
+    if (!plan_frame(frame)) {
+        double log_detail = std::log((double) std::max(detail, 1u));
+        double step_width = cfg.step_width_loq0;
+
+        if (have_model)
+            step_width = std::exp(log_detail - (std::log(frame_target()) - log_scale) / exponent);
+
+        frame->step_width_loq0 = clamp_step_width(step_width);
+        frame->step_width_loq1 = clamp_step_width(frame->step_width_loq0 * loq1_ratio);
+        frame->predicted_bits = have_model ?
+            std::exp(log_scale + exponent * (log_detail - std::log(frame->step_width_loq0))) :
+            frame_bits;
+    }
+
+    frames_started++;
+    in_flight++;
+    bits_in_flight += frame->predicted_bits;
+}
+
+void LcevcRateControl::frame_done(const LcevcRateControlFrame &frame, size_t size) {
+    double bits = size * 8.0;
+
+    if (in_flight > 0) {
+        in_flight--;
+        bits_in_flight = in_flight ? bits_in_flight - frame.predicted_bits : 0;
+    }
+    frames_done++;
+    bits_done += bits;
+
+    if (vbv_size > 0) {
+        vbv_fill += vbv_input - bits;
+        if (vbv_fill < 0) {
+            underflows++;
+            vbv_fill = 0;
+        }
+        vbv_fill = std::min(vbv_fill, vbv_size);
+    }
+
+    if (!size)
+        return;
+
+    // The second pass model only has the cost of a coefficient to fit
+    if (frame.coefficients >= 1 && bits > FRAME_OVERHEAD_BITS) {
+        double observed = (bits - FRAME_OVERHEAD_BITS) / frame.coefficients;
+
+        observed = clamp_double(observed, bits_per_coefficient / 2, bits_per_coefficient * 2);
+        bits_per_coefficient += (observed - bits_per_coefficient) / 8;
+    }
+
+    // Fit the exponent on consecutive frames far enough apart on the model
+    // curve, then the scale on this frame
+    double log_ratio = std::log((double) std::max(frame.detail, 1u) / frame.step_width_loq0);
+    double log_bits = std::log(bits);
+
+    if (have_last && std::fabs(log_ratio - last_log_ratio) > 0.1) {
+        double slope = (log_bits - last_log_bits) / (log_ratio - last_log_ratio);
+        exponent += (clamp_double(slope, MIN_EXPONENT, MAX_EXPONENT) - exponent) / 4;
+    }
+
+    double log_observed = log_bits - exponent * log_ratio;
+    if (!have_model) {
+        log_scale = log_observed;
+        have_model = true;
+    } else {
+        log_scale += clamp_double(log_observed - log_scale, -std::log(4.0), std::log(4.0)) / 2;
+    }
+
+    have_last = true;
+    last_log_ratio = log_ratio;
+    last_log_bits = log_bits;
+}
+
+void LcevcRateControl::flush() {
+    in_flight = 0;
+    bits_in_flight = 0;
+    have_last = false;
+}
@@ -0,0 +1,114 @@
+#ifndef __LCEVC_RATE_CONTROL_H__
+#define __LCEVC_RATE_CONTROL_H__
+
+#include "lcevcstats.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Rate control of the enhancement layer.
+//
+// The LOQ-0 step width of each frame is chosen from a model of the frame
+// size, bits = scale * (detail / step_width)^exponent, where detail is the
+// cheap estimate of the residual magnitude from the lookahead analysis.
+// scale and exponent are fitted on the frames encoded so far. The LOQ-1
+// step width follows LOQ-0 with the configured ratio between the two.
+//
+// In a second pass the whole first pass is planned at once instead: the
+// bitrate is spread over all of its frames at a single step width, the one
+// whose expected coefficient counts add up to the budget, with
+// bits = bits_per_coefficient * coefficients + overhead.
+//
+// Frames are started in coding order and may be encoded in parallel; the
+// bits of the ones still in flight are taken as predicted until they are
+// done, which must also happen in coding order. Not thread safe.
+
+enum LcevcRateControlMode {
+    LCEVC_RATE_CONTROL_ABR,     // average bitrate, buffer model optional
+    LCEVC_RATE_CONTROL_CBR,     // constant bitrate, always buffer constrained
+};
+
+struct LcevcRateControlConfig {
+    LcevcRateControlMode mode;
+    unsigned bitrate;           // kbit/s
+    unsigned vbv_max_bitrate;   // kbit/s, 0 = bitrate
+    unsigned vbv_buffer_size;   // kbit, 0 = none in ABR, one second in CBR
+    double fps;
+    unsigned step_width_loq0;   // starting point, and LOQ-1 to LOQ-0 ratio
+    unsigned step_width_loq1;
+};
+
+// Decision for one frame, to be handed back to frame_done()
+struct LcevcRateControlFrame {
+    unsigned step_width_loq0;
+    unsigned step_width_loq1;
+    uint32_t detail;
+    double coefficients;        // expected, 0 outside of a second pass
+    double predicted_bits;
+};
+
+class LcevcRateControl {
+public:
+    // stats, when given, is the first pass of a second pass. It must outlive
+    // the rate control.
+    LcevcRateControl(const LcevcRateControlConfig &config, const LcevcStatsReader *stats);
+
+    const LcevcRateControlConfig &config() const { return cfg; }
+
+    // Take the bitrate, buffer model, frame rate and step widths of config
+    // from the next frame started on, keeping the fitted model and the
+    // buffer fullness. The mode cannot change and is kept.
+    void reconfigure(const LcevcRateControlConfig &config);
+
+    // Choose the step widths of the next frame in coding order
+    void frame_start(uint32_t detail, LcevcRateControlFrame *frame);
+
+    // Account for the enhancement of a started frame, in coding order.
+    // size is 0 for a frame that was dropped.
+    void frame_done(const LcevcRateControlFrame &frame, size_t size);
+
+    // Forget the frames in flight, which will never be done
+    void flush();
+
+    // Frames that did not fit in the buffer model so far
+    uint64_t vbv_underflows() const { return underflows; }
+
+private:
+    void set_rates();
+    double frame_target() const;
+    double vbv_limit(double target) const;
+    double expected_coefficients(const LcevcStatsRecord &record, double step_width) const;
+    bool plan_frame(LcevcRateControlFrame *frame);
+
+    LcevcRateControlConfig cfg;
+    double frame_bits;          // bitrate share of one frame
+    double vbv_size;            // 0 without a buffer model
+    double vbv_input;           // buffer refill per frame
+    double vbv_fill;            // bits available in the buffer
+    double loq1_ratio;
+
+    // Model, fitted in the log domain
+    double log_scale;
+    double exponent;
+    bool have_model;
+    bool have_last;
+    double last_log_ratio;      // log(detail / step_width) of the last frame done
+    double last_log_bits;
+
+    uint64_t frames_done;       // since the bitrate last changed
+    double bits_done;
+    unsigned in_flight;
+    double bits_in_flight;      // predicted
+    uint64_t underflows;
+
+    // Second pass
+    const LcevcStatsReader *stats;
+    uint64_t frames_started;
+    double total_bits;          // budget over the frames of the first pass
+    double bits_per_coefficient;
+    std::vector<double> grid;   // step widths the plan is searched on
+    std::vector<double> grid_coefficients;  // of the frames not started, per step width
+};
+
+#endif /* __LCEVC_RATE_CONTROL_H__ */
@@ -0,0 +1,122 @@
+#include "lcevcstats.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+double lcevc_stats_coefficients(const uint32_t *classes, unsigned analysis_step_width,
+                                double step_width) {
+    // A coefficient survives step_width when its magnitude reaches 5/8 of it,
+    // the rounding offset being 3/8. In analysed levels that is t.
+    double t = (0.625 * step_width) / analysis_step_width + 0.375;
+    double count = 0;
+
+    if (t <= 1) {
+        for (unsigned k = 0; k < LCEVC_COEFFICIENT_CLASSES; k++)
+            count += classes[k];
+        return count;
+    }
+
+    double log_t = std::log2(t);
+    unsigned first = (unsigned) log_t;
+
+    if (first >= LCEVC_COEFFICIENT_CLASSES)
+        return 0;
+    count = classes[first] * (first + 1 - log_t);
+    for (unsigned k = first + 1; k < LCEVC_COEFFICIENT_CLASSES; k++)
+        count += classes[k];
+    return count;
+}
+
+LcevcStatsWriter::~LcevcStatsWriter() {
+    if (file)
+        fclose(file);
+}
+
+bool LcevcStatsWriter::open(const char *path, const LcevcStatsHeader &h) {
+    header = h;
+    memcpy(header.magic, LCEVC_STATS_MAGIC, sizeof(header.magic));
+    header.version = LCEVC_STATS_VERSION;
+    header.header_size = sizeof(LcevcStatsHeader);
+    header.record_size = sizeof(LcevcStatsRecord);
+    header.num_frames = 0;
+
+    file = fopen(path, "wb");
+    if (!file)
+        return false;
+    return fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+bool LcevcStatsWriter::append(const LcevcStatsRecord &record) {
+    if (!file || fwrite(&record, sizeof(record), 1, file) != 1)
+        return false;
+    header.num_frames++;
+    return true;
+}
+
+bool LcevcStatsWriter::close() {
+    bool ok = file && fseek(file, 0, SEEK_SET) == 0 &&
+        fwrite(&header, sizeof(header), 1, file) == 1;
+
+    if (file && fclose(file) != 0)
+        ok = false;
+    file = nullptr;
+    return ok;
+}
+
+LcevcStatsReader::~LcevcStatsReader() {
+    if (map)
+        munmap(map, map_size);
+}
+
+bool LcevcStatsReader::open(const char *path, std::string *error) {
+    int fd = ::open(path, O_RDONLY);
+    struct stat st;
+
+    if (fd < 0) {
+        *error = std::string("cannot open: ") + strerror(errno);
+        return false;
+    }
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(LcevcStatsHeader)) {
+        *error = "not a stats file";
+        ::close(fd);
+        return false;
+    }
+
+    map_size = (size_t) st.st_size;
+    map = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        map = nullptr;
+        *error = std::string("cannot map: ") + strerror(errno);
+        return false;
+    }
+
+    hdr = static_cast<const LcevcStatsHeader *>(map);
+    if (memcmp(hdr->magic, LCEVC_STATS_MAGIC, sizeof(hdr->magic)) != 0) {
+        *error = "not a stats file";
+    } else if (hdr->version != LCEVC_STATS_VERSION ||
+               hdr->header_size != sizeof(LcevcStatsHeader) ||
+               hdr->record_size != sizeof(LcevcStatsRecord)) {
+        *error = "unsupported stats file version";
+    } else if (hdr->num_frames == 0) {
+        *error = "incomplete stats file";
+    } else if (hdr->num_frames > (map_size - hdr->header_size) / hdr->record_size) {
+        *error = "truncated stats file";
+    } else {
+        records = reinterpret_cast<const LcevcStatsRecord *>(
+            static_cast<const uint8_t *>(map) + hdr->header_size);
+        madvise(map, map_size, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    munmap(map, map_size);
+    map = nullptr;
+    hdr = nullptr;
+    return false;
+}
@@ -0,0 +1,99 @@
+#ifndef __LCEVC_STATS_H__
+#define __LCEVC_STATS_H__
+
+#include "lcevcenhancement.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// First pass stats file: a header, then one fixed size record per frame in
+// coding order, so the file can be mapped and indexed in place. Fields are
+// in host byte order; a file from a host of the other order reads as an
+// unknown version and is rejected like one.
+
+#define LCEVC_STATS_MAGIC "LCEVCSTS"
+#define LCEVC_STATS_VERSION 1
+
+struct LcevcStatsHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps_n;
+    uint32_t fps_d;
+    uint32_t analysis_step_width;
+    uint32_t step_width_loq0;   // LOQ-1 to LOQ-0 ratio of the first pass
+    uint32_t step_width_loq1;
+    uint64_t num_frames;        // 0 until the first pass is complete
+    uint32_t reserved[2];
+};
+
+// Set in LcevcStatsRecord::flags
+#define LCEVC_STATS_REFRESH (1 << 0)
+
+struct LcevcStatsRecord {
+    uint64_t pts;               // nanoseconds, all ones when unknown
+    uint32_t flags;
+    uint32_t detail_cost;       // from the lookahead analysis
+    uint32_t intra_cost;
+    uint32_t inter_cost;
+    uint64_t residual_energy[2];
+    uint32_t coefficients[2][LCEVC_COEFFICIENT_CLASSES];
+};
+
+static_assert(sizeof(LcevcStatsHeader) == 64, "stats header layout");
+static_assert(sizeof(LcevcStatsRecord) == 136, "stats record layout");
+
+// Nonzero coefficients expected at step_width, from the classes of the
+// levels analysed at analysis_step_width. Magnitudes are taken as spread
+// evenly on a log scale within a class.
+double lcevc_stats_coefficients(const uint32_t *classes, unsigned analysis_step_width,
+                                double step_width);
+
+class LcevcStatsWriter {
+public:
+    LcevcStatsWriter() : file(nullptr), header() {}
+    ~LcevcStatsWriter();
+
+    // Create path and write header, whose magic, version, sizes and frame
+    // count are filled in here
+    bool open(const char *path, const LcevcStatsHeader &header);
+    bool append(const LcevcStatsRecord &record);
+
+    // Write the frame count, which marks the file complete, and close it
+    bool close();
+
+private:
+    LcevcStatsWriter(const LcevcStatsWriter &) = delete;
+    LcevcStatsWriter &operator=(const LcevcStatsWriter &) = delete;
+
+    FILE *file;
+    LcevcStatsHeader header;
+};
+
+class LcevcStatsReader {
+public:
+    LcevcStatsReader() : map(nullptr), map_size(0), hdr(nullptr), records(nullptr) {}
+    ~LcevcStatsReader();
+
+    // Map a complete stats file. On failure error says why.
+    bool open(const char *path, std::string *error);
+
+    const LcevcStatsHeader &header() const { return *hdr; }
+    uint64_t num_frames() const { return hdr->num_frames; }
+    const LcevcStatsRecord &frame(uint64_t index) const { return records[index]; }
+
+private:
+    LcevcStatsReader(const LcevcStatsReader &) = delete;
+    LcevcStatsReader &operator=(const LcevcStatsReader &) = delete;
+
+    void *map;
+    size_t map_size;
+    const LcevcStatsHeader *hdr;
+    const LcevcStatsRecord *records;
+};
+
+#endif /* __LCEVC_STATS_H__ */
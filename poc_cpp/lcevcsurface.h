@@ -0,0 +1,143 @@
+#ifndef __LCEVC_SURFACE_H__
+#define __LCEVC_SURFACE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "lcevcarena.h"
+
+// Precision of the intermediate surfaces: samples of any input depth are
+// shifted up to 15 bits, residuals and coefficients are signed 16-bit
+#define LCEVC_INTERNAL_DEPTH 15
+#define LCEVC_INTERNAL_MAX ((1 << LCEVC_INTERNAL_DEPTH) - 1)
+
+// Surface rows start on this boundary, which suits every SIMD width we use
+#define LCEVC_SURFACE_ALIGN 64
+
+// View on a signed 16-bit plane. Surfaces never own their memory.
+struct LcevcSurface {
+    int16_t *data;
+    unsigned width;
+    unsigned height;
+    ptrdiff_t stride;   // in samples
+
+    int16_t *row(unsigned y) const { return data + (ptrdiff_t) y * stride; }
+};
+
+// Read-only view on a plane of the source picture, 8-bit or 16-bit samples.
+// The chroma planes of semi-planar formats interleave their samples with
+// those of the other plane: step is 2 for them. 16-bit samples are shifted
+// right by drop first, for MSB-aligned formats and depths above the internal
+// one; 8-bit ones never are.
+struct LcevcSourcePlane {
+    const uint8_t *data;
+    ptrdiff_t stride;   // in bytes
+    unsigned width;
+    unsigned height;
+    unsigned bytes_per_sample;
+    unsigned shift;     // up to LCEVC_INTERNAL_DEPTH
+    unsigned step;      // in samples, 1 or 2
+    unsigned drop;
+
+    // Sample x of a row, at shift bits below the internal depth
+    template <typename T>
+    int32_t sample(const T *row, unsigned x) const {
+        return (int32_t) (row[x * step] >> drop);
+    }
+
+    template <typename T>
+    const T *row(unsigned y) const {
+        return reinterpret_cast<const T *>(data + (ptrdiff_t) y * stride);
+    }
+};
+
+// Writable view on a plane of a picture the encoder hands out, 8-bit or
+// 16-bit samples
+struct LcevcOutputPlane {
+    uint8_t *data;
+    ptrdiff_t stride;   // in bytes
+    unsigned width;
+    unsigned height;
+    unsigned bytes_per_sample;
+    unsigned shift;     // down from LCEVC_INTERNAL_DEPTH
+
+    template <typename T>
+    T *row(unsigned y) const {
+        return reinterpret_cast<T *>(data + (ptrdiff_t) y * stride);
+    }
+};
+
+template <typename T>
+struct LcevcAlignedAllocator {
+    typedef T value_type;
+
+    LcevcAlignedAllocator() {}
+    template <typename U>
+    LcevcAlignedAllocator(const LcevcAlignedAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        void *ptr = nullptr;
+        if (posix_memalign(&ptr, LCEVC_SURFACE_ALIGN, n * sizeof(T)) != 0)
+            throw std::bad_alloc();
+        return static_cast<T *>(ptr);
+    }
+    void deallocate(T *ptr, size_t) { free(ptr); }
+
+    template <typename U>
+    bool operator==(const LcevcAlignedAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const LcevcAlignedAllocator<U> &) const { return false; }
+};
+
+// Storage for one surface, rows padded to LCEVC_SURFACE_ALIGN. Allocating
+// again only reallocates when the surface grows.
+class LcevcSurfaceBuffer {
+public:
+    LcevcSurfaceBuffer() : surface() {}
+
+    const LcevcSurface &allocate(unsigned width, unsigned height) {
+        ptrdiff_t stride = aligned_stride(width);
+
+        storage.assign((size_t) stride * height, 0);
+        return set_view(storage.data(), width, height, stride);
+    }
+
+    // Place the surface in arena instead, which must outlive it. The surface
+    // has no data when it does not fit in the arena.
+    const LcevcSurface &allocate(unsigned width, unsigned height, LcevcArena &arena) {
+        ptrdiff_t stride = aligned_stride(width);
+        size_t bytes = (size_t) stride * height * sizeof(int16_t);
+        int16_t *data = static_cast<int16_t *>(arena.allocate(bytes, LCEVC_SURFACE_ALIGN));
+
+        std::vector<int16_t, LcevcAlignedAllocator<int16_t>>().swap(storage);
+        if (data)
+            memset(data, 0, bytes);
+        return set_view(data, width, height, stride);
+    }
+
+    const LcevcSurface &view() const { return surface; }
+
+private:
+    static ptrdiff_t aligned_stride(unsigned width) {
+        ptrdiff_t align = LCEVC_SURFACE_ALIGN / sizeof(int16_t);
+        return ((ptrdiff_t) width + align - 1) / align * align;
+    }
+
+    const LcevcSurface &set_view(int16_t *data, unsigned width, unsigned height,
+                                 ptrdiff_t stride) {
+        surface.data = data;
+        surface.width = width;
+        surface.height = height;
+        surface.stride = stride;
+        return surface;
+    }
+
+    std::vector<int16_t, LcevcAlignedAllocator<int16_t>> storage;
+    LcevcSurface surface;
+};
+
+#endif /* __LCEVC_SURFACE_H__ */
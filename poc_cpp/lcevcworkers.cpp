@@ -0,0 +1,103 @@
+#include "lcevcworkers.h"
+
+#include <algorithm>
+
+LcevcWorkerPool::LcevcWorkerPool(unsigned num_threads)
+    : stopping(false), place_serial(0) {
+    for (unsigned i = 1; i < num_threads; i++)
+        workers.push_back(std::thread(&LcevcWorkerPool::worker_main, this));
+}
+
+LcevcWorkerPool::~LcevcWorkerPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    work_cond.notify_all();
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+// Take the next job index of a batch, with the lock held. The batch leaves
+// the pending list once its last job has been handed out.
+unsigned LcevcWorkerPool::take_job(Batch *batch) {
+    unsigned index = batch->next++;
+
+    if (batch->next == batch->num_jobs)
+        batches.erase(std::find(batches.begin(), batches.end(), batch));
+
+    return index;
+}
+
+void LcevcWorkerPool::worker_main() {
+    std::unique_lock<std::mutex> guard(lock);
+    unsigned placed = 0;
+
+    while (true) {
+        while (!stopping && batches.empty() && placed == place_serial)
+            work_cond.wait(guard);
+        if (stopping)
+            return;
+
+        if (placed != place_serial) {
+            LcevcPlacement target = place;
+
+            placed = place_serial;
+            guard.unlock();
+            lcevc_apply_placement(target);
+            guard.lock();
+            continue;
+        }
+
+        Batch *batch = batches.front();
+        unsigned index = take_job(batch);
+
+        guard.unlock();
+        (*batch->job)(index);
+        guard.lock();
+
+        if (++batch->done == batch->num_jobs)
+            done_cond.notify_all();
+    }
+}
+
+void LcevcWorkerPool::run(unsigned num_jobs, const std::function<void(unsigned)> &job) {
+    if (num_jobs == 0)
+        return;
+
+    if (workers.empty() || num_jobs == 1) {
+        for (unsigned i = 0; i < num_jobs; i++)
+            job(i);
+        return;
+    }
+
+    Batch batch = { &job, num_jobs, 0, 0 };
+    std::unique_lock<std::mutex> guard(lock);
+
+    batches.push_back(&batch);
+    work_cond.notify_all();
+
+    // The caller works on its own batch instead of just waiting for it
+    while (batch.next < batch.num_jobs) {
+        unsigned index = take_job(&batch);
+
+        guard.unlock();
+        job(index);
+        guard.lock();
+
+        batch.done++;
+    }
+
+    while (batch.done < batch.num_jobs)
+        done_cond.wait(guard);
+}
+
+void LcevcWorkerPool::set_placement(const LcevcPlacement &placement) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        place = placement;
+        place_serial++;
+    }
+    work_cond.notify_all();
+}
@@ -0,0 +1,60 @@
+#ifndef __LCEVC_WORKERS_H__
+#define __LCEVC_WORKERS_H__
+
+#include "lcevcplacement.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads owned by the element.
+//
+// run() splits a batch into jobs picked up by the workers and by the calling
+// thread, and returns once all of them are done. Several threads may run
+// batches on the same pool at the same time.
+class LcevcWorkerPool {
+public:
+    // num_threads counts the calling thread, so a pool of 1 has no workers
+    explicit LcevcWorkerPool(unsigned num_threads);
+    ~LcevcWorkerPool();
+
+    unsigned num_threads() const { return (unsigned) workers.size() + 1; }
+
+    // Call job(i) for every i in [0, num_jobs)
+    void run(unsigned num_jobs, const std::function<void(unsigned)> &job);
+
+    // Move the threads of the pool to placement, see lcevc_apply_placement().
+    // Each thread applies it itself, so its own allocations follow. Callers
+    // of run() place themselves.
+    void set_placement(const LcevcPlacement &placement);
+
+    // Placement of the threads, as last set from the thread owning the pool
+    const LcevcPlacement &placement() const { return place; }
+
+private:
+    struct Batch {
+        const std::function<void(unsigned)> *job;
+        unsigned num_jobs;
+        unsigned next;
+        unsigned done;
+    };
+
+    LcevcWorkerPool(const LcevcWorkerPool &) = delete;
+    LcevcWorkerPool &operator=(const LcevcWorkerPool &) = delete;
+
+    void worker_main();
+    unsigned take_job(Batch *batch);
+
+    std::mutex lock;
+    std::condition_variable work_cond;
+    std::condition_variable done_cond;
+    std::vector<Batch *> batches;
+    std::vector<std::thread> workers;
+    bool stopping;
+    LcevcPlacement place;
+    unsigned place_serial;      // bumped by set_placement()
+};
+
+#endif /* __LCEVC_WORKERS_H__ */
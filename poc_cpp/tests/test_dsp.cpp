@@ -0,0 +1,430 @@
+// Every SIMD variant of the kernels against the scalar ones: each kernel of
+// lcevc_dsp_init(isa) is run on the same random input as the kernel of
+// lcevc_dsp_init("c"), and the outputs must match to the bit. Sources cover
+// every depth from 8 to 16 bits, interleaved chroma and the MSB-aligned P010
+// and P016 layouts, at widths that leave a tail for the scalar code.
+
+#include "lcevcdsp.h"
+#include "lcevcsurface.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char *isa_names[] = { "sse4.1", "avx2", "avx512", "neon" };
+
+static const struct {
+    unsigned width;
+    unsigned height;
+} sizes[] = {
+    { 16, 16 },
+    { 33, 21 },
+    { 67, 38 },
+    { 130, 17 },
+    { 259, 35 },
+};
+
+// Layout of a source plane: samples of depth bits, one or two bytes each,
+// MSB-aligned in 16 bits or not, step samples apart
+struct Format {
+    const char *name;
+    unsigned depth;
+    unsigned bytes_per_sample;
+    bool msb_aligned;
+    unsigned step;
+};
+
+static const Format formats[] = {
+    { "8bit", 8, 1, false, 1 },
+    { "8bit-interleaved", 8, 1, false, 2 },
+    { "9bit", 9, 2, false, 1 },
+    { "10bit", 10, 2, false, 1 },
+    { "11bit", 11, 2, false, 1 },
+    { "12bit", 12, 2, false, 1 },
+    { "13bit", 13, 2, false, 1 },
+    { "14bit", 14, 2, false, 1 },
+    { "15bit", 15, 2, false, 1 },
+    { "16bit", 16, 2, false, 1 },
+    { "p010", 10, 2, true, 1 },
+    { "p010-interleaved", 10, 2, true, 2 },
+    { "p016", 16, 2, true, 1 },
+    { "p016-interleaved", 16, 2, true, 2 },
+};
+
+static const LcevcUpsampleType upsample_types[] = {
+    LCEVC_UPSAMPLE_NEAREST,
+    LCEVC_UPSAMPLE_LINEAR,
+    LCEVC_UPSAMPLE_CUBIC,
+    LCEVC_UPSAMPLE_MODIFIED_CUBIC,
+};
+
+static const unsigned step_widths[] = { 1, 7, 200, 1500, 32767 };
+
+static uint32_t seed = 1;
+
+static uint32_t random_u32(void) {
+    seed = seed * 1664525 + 1013904223;
+    return seed >> 8;
+}
+
+static int16_t random_s16(int min, int max) {
+    return (int16_t) (min + (int) (random_u32() % (uint32_t) (max - min + 1)));
+}
+
+static unsigned round_up(unsigned value, unsigned multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// Source plane of random samples. The samples between those of an
+// interleaved plane belong to the other plane and are random as well.
+struct SourcePlane {
+    std::vector<uint8_t> data;
+    LcevcSourcePlane view;
+
+    SourcePlane(const Format &format, unsigned width, unsigned height) {
+        unsigned excess = format.depth > LCEVC_INTERNAL_DEPTH ?
+            format.depth - LCEVC_INTERNAL_DEPTH : 0;
+        unsigned samples = width * format.step;
+        unsigned padding = 16 - format.depth;
+
+        view.stride = (ptrdiff_t) round_up(samples + 3, 8) * format.bytes_per_sample;
+        data.resize((size_t) view.stride * height);
+        for (unsigned y = 0; y < height; y++) {
+            uint8_t *row = &data[(size_t) y * view.stride];
+
+            for (unsigned x = 0; x < samples; x++) {
+                uint32_t value = random_u32() & ((1u << format.depth) - 1);
+
+                if (format.bytes_per_sample == 1) {
+                    row[x] = (uint8_t) value;
+                } else {
+                    if (format.msb_aligned)
+                        value <<= padding;
+                    reinterpret_cast<uint16_t *>(row)[x] = (uint16_t) value;
+                }
+            }
+        }
+        view.data = data.data();
+        view.width = width;
+        view.height = height;
+        view.bytes_per_sample = format.bytes_per_sample;
+        view.drop = (format.msb_aligned ? padding : 0) + excess;
+        view.shift = LCEVC_INTERNAL_DEPTH - (format.depth - excess);
+        view.step = format.step;
+    }
+};
+
+// A pair of identical surfaces, one written by the scalar kernels and the
+// other by the kernels under test
+struct SurfacePair {
+    LcevcSurfaceBuffer buffers[2];
+
+    SurfacePair(unsigned width, unsigned height, int min, int max) {
+        buffers[0].allocate(width, height);
+        buffers[1].allocate(width, height);
+        for (unsigned y = 0; y < height; y++) {
+            for (unsigned x = 0; x < width; x++)
+                buffers[0].view().row(y)[x] = random_s16(min, max);
+        }
+        copy();
+    }
+
+    const LcevcSurface &operator[](unsigned i) const { return buffers[i].view(); }
+
+    void copy() {
+        const LcevcSurface &a = buffers[0].view();
+        memcpy(buffers[1].view().data, a.data, (size_t) a.stride * a.height * sizeof(int16_t));
+    }
+
+    bool same() const {
+        const LcevcSurface &a = buffers[0].view();
+        const LcevcSurface &b = buffers[1].view();
+
+        for (unsigned y = 0; y < a.height; y++) {
+            if (memcmp(a.row(y), b.row(y), a.width * sizeof(int16_t)) != 0)
+                return false;
+        }
+        return true;
+    }
+};
+
+struct Checker {
+    const char *isa;
+    unsigned cases;
+    unsigned failures;
+
+    void check(bool same, const std::string &name) {
+        cases++;
+        if (same)
+            return;
+        failures++;
+        printf("%s: %s differs from c\n", isa, name.c_str());
+    }
+};
+
+static std::string case_name(const char *kernel, const char *variant, unsigned width,
+                             unsigned height) {
+    char name[128];
+    snprintf(name, sizeof(name), "%s %s %ux%u", kernel, variant, width, height);
+    return name;
+}
+
+// Downsampling, import and export of every layout of source plane
+static void check_planes(const LcevcDsp *c, const LcevcDsp *dsp, Checker *checker,
+                         unsigned width, unsigned height) {
+    for (const Format &format : formats) {
+        SourcePlane source(format, width, height);
+
+        for (unsigned dims = 1; dims <= 2; dims++) {
+            LcevcScalingMode scaling = dims == 2 ? LCEVC_SCALING_2D : LCEVC_SCALING_1D;
+            unsigned dst_height = dims == 2 ? (height + 1) / 2 + 3 : height + 3;
+            SurfacePair dst((width + 1) / 2 + 3, dst_height, -32768, 32767);
+
+            lcevc_dsp_downsample(c, scaling, source.view, dst[0], 0, dst_height);
+            lcevc_dsp_downsample(dsp, scaling, source.view, dst[1], 0, dst_height);
+            checker->check(dst.same(), case_name(dims == 2 ? "downsample_2d" : "downsample_1d",
+                                                 format.name, width, height));
+        }
+
+        SurfacePair imported(width + 5, height + 2, -32768, 32767);
+        lcevc_dsp_import(c, source.view, imported[0], 1, height + 2);
+        lcevc_dsp_import(dsp, source.view, imported[1], 1, height + 2);
+        checker->check(imported.same(), case_name("import", format.name, width, height));
+
+        // Export only goes down from the internal depth
+        if (format.depth > LCEVC_INTERNAL_DEPTH || format.msb_aligned || format.step != 1)
+            continue;
+
+        SurfacePair src(width + 3, height + 1, -2048, LCEVC_INTERNAL_MAX);
+        std::vector<uint8_t> out[2];
+        LcevcOutputPlane plane;
+
+        plane.stride = (ptrdiff_t) round_up(width + 1, 8) * format.bytes_per_sample;
+        plane.width = width;
+        plane.height = height;
+        plane.bytes_per_sample = format.bytes_per_sample;
+        plane.shift = LCEVC_INTERNAL_DEPTH - format.depth;
+        for (unsigned i = 0; i < 2; i++) {
+            out[i].assign((size_t) plane.stride * height, 0xa5);
+            plane.data = out[i].data();
+            lcevc_dsp_export(i ? dsp : c, src[i], plane, 0, height + 1);
+        }
+        checker->check(out[0] == out[1], case_name("export", format.name, width, height));
+    }
+}
+
+// Upsampling with every kernel, and the residual against every layout of
+// source plane, over the whole plane and over a band of columns and rows
+static void check_upsample(const LcevcDsp *c, const LcevcDsp *dsp, Checker *checker,
+                           unsigned width, unsigned height) {
+    const unsigned padded_width = round_up(width, 4);
+    const unsigned padded_height = round_up(height, 4);
+
+    for (const Format &format : formats) {
+        SourcePlane source(format, width, height);
+
+        for (unsigned dims = 1; dims <= 2; dims++) {
+            LcevcScalingMode scaling = dims == 2 ? LCEVC_SCALING_2D : LCEVC_SCALING_1D;
+            unsigned src_height = dims == 2 ? padded_height / 2 : padded_height;
+            SurfacePair src(padded_width / 2, src_height, 0, LCEVC_INTERNAL_MAX);
+
+            for (LcevcUpsampleType type : upsample_types) {
+                const LcevcUpsampleKernel &kernel = *lcevc_upsample_kernel(type);
+                const unsigned x0 = padded_width >= 16 ? 6 : 0;
+                const unsigned x1 = padded_width >= 16 ? padded_width - 4 : padded_width;
+                const unsigned y0 = padded_height / 3;
+                char variant[64];
+
+                snprintf(variant, sizeof(variant), "%s kernel %d", format.name, (int) type);
+                SurfacePair dst(padded_width, padded_height, -32768, 32767);
+                for (unsigned i = 0; i < 2; i++) {
+                    lcevc_dsp_upsample_residual(i ? dsp : c, scaling, src[i], source.view,
+                                                dst[i], 0, padded_width, 0, padded_height,
+                                                kernel);
+                }
+                checker->check(dst.same(), case_name(dims == 2 ? "upsample_residual_2d" :
+                                                     "upsample_residual_1d", variant,
+                                                     width, height));
+
+                SurfacePair band(padded_width, padded_height, -32768, 32767);
+                for (unsigned i = 0; i < 2; i++) {
+                    lcevc_dsp_upsample_residual(i ? dsp : c, scaling, src[i], source.view,
+                                                band[i], x0, x1, y0,
+                                                padded_height, kernel);
+                }
+                checker->check(band.same(), case_name(dims == 2 ? "upsample_residual_2d band" :
+                                                      "upsample_residual_1d band", variant,
+                                                      width, height));
+            }
+        }
+    }
+}
+
+// Transform and quantization, both ways, of residuals spanning the whole
+// 16-bit range and of small ones, at step widths from 1 up
+static void check_transform(const LcevcDsp *c, const LcevcDsp *dsp, Checker *checker,
+                            unsigned width, unsigned height) {
+    for (unsigned t = 0; t < 2; t++) {
+        LcevcTransformType type = (LcevcTransformType) t;
+        const unsigned block_size = lcevc_transform_block_size(type);
+        const unsigned num_layers = lcevc_transform_num_layers(type);
+        const unsigned blocks_x = round_up(width, block_size) / block_size;
+        const unsigned blocks_y = round_up(height, block_size) / block_size;
+        const char *tname = type == LCEVC_TRANSFORM_DDS ? "dds" : "dd";
+
+        for (unsigned range = 0; range < 2; range++) {
+            const int limit = range ? 32767 : 255;
+
+            for (unsigned step_width : step_widths) {
+                LcevcQuantizer quant;
+                std::vector<SurfacePair *> layers;
+                std::vector<LcevcSurface> views[2];
+                char variant[64];
+
+                lcevc_quantizer_init(&quant, step_width);
+                snprintf(variant, sizeof(variant), "%s residuals within %d step %u", tname,
+                         limit, step_width);
+
+                SurfacePair residual(blocks_x * block_size, blocks_y * block_size,
+                                     -limit, limit);
+                for (unsigned l = 0; l < num_layers; l++) {
+                    layers.push_back(new SurfacePair(blocks_x, blocks_y, -32768, 32767));
+                    views[0].push_back((*layers.back())[0]);
+                    views[1].push_back((*layers.back())[1]);
+                }
+
+                c->transform_quantize[type](residual[0], views[0].data(), 0, blocks_y, quant);
+                dsp->transform_quantize[type](residual[1], views[1].data(), 0, blocks_y, quant);
+                bool same = true;
+                for (SurfacePair *layer : layers)
+                    same = same && layer->same();
+                checker->check(same, case_name("transform_quantize", variant, width, height));
+
+                // Levels of any value the entropy coder carries
+                for (SurfacePair *layer : layers) {
+                    for (unsigned y = 0; y < blocks_y; y++) {
+                        for (unsigned x = 0; x < blocks_x; x++) {
+                            (*layer)[0].row(y)[x] = random_u32() % 4 ? 0 :
+                                random_s16(-LCEVC_MAX_COEFFICIENT, LCEVC_MAX_COEFFICIENT);
+                        }
+                    }
+                    layer->copy();
+                }
+                c->dequantize_inverse[type](views[0].data(), residual[0], 1, blocks_y, quant);
+                dsp->dequantize_inverse[type](views[1].data(), residual[1], 1, blocks_y, quant);
+                checker->check(residual.same(), case_name("dequantize_inverse", variant,
+                                                          width, height));
+
+                for (SurfacePair *layer : layers)
+                    delete layer;
+            }
+        }
+    }
+}
+
+// Arithmetic on surfaces, near and past the limits of 16 bits
+static void check_arithmetic(const LcevcDsp *c, const LcevcDsp *dsp, Checker *checker,
+                             unsigned width, unsigned height) {
+    SurfacePair a(width, height, -32768, 32767);
+    SurfacePair b(width, height, -32768, 32767);
+    SurfacePair dst(width, height, 0, 0);
+
+    c->subtract(a[0], b[0], dst[0], 0, height);
+    dsp->subtract(a[1], b[1], dst[1], 0, height);
+    checker->check(dst.same(), case_name("subtract", "", width, height));
+
+    c->add(a[0], b[0], dst[0], 0, height);
+    dsp->add(a[1], b[1], dst[1], 0, height);
+    checker->check(dst.same(), case_name("add", "", width, height));
+
+    c->add_clamp(a[0], b[0], dst[0], 0, height);
+    dsp->add_clamp(a[1], b[1], dst[1], 0, height);
+    checker->check(dst.same(), case_name("add_clamp", "", width, height));
+}
+
+// Zero run scans from every alignment, over runs ending anywhere
+static void check_find_nonzero(const LcevcDsp *c, const LcevcDsp *dsp, Checker *checker) {
+    LcevcSurfaceBuffer buffer;
+    const LcevcSurface &row = buffer.allocate(256, 1);
+    unsigned failures = 0;
+
+    for (unsigned offset = 0; offset < 32; offset++) {
+        for (unsigned nonzero = offset; nonzero <= 200; nonzero++) {
+            memset(row.data, 0, row.width * sizeof(int16_t));
+            if (nonzero < 200)
+                row.data[nonzero] = (int16_t) (nonzero & 1 ? -1 : nonzero);
+            row.data[210] = 1;
+            for (unsigned n = 0; n <= 200 - offset; n += 7) {
+                if (c->find_nonzero(row.data + offset, n) !=
+                    dsp->find_nonzero(row.data + offset, n))
+                    failures++;
+            }
+        }
+    }
+    checker->check(failures == 0, "find_nonzero");
+}
+
+// Sums of absolute differences of blocks at any alignment
+static void check_sad(const LcevcDsp *c, const LcevcDsp *dsp, Checker *checker) {
+    static const unsigned block_sizes[][2] = {
+        { 1, 1 }, { 3, 5 }, { 8, 8 }, { 16, 16 }, { 17, 9 }, { 32, 32 }, { 64, 64 }, { 71, 3 },
+    };
+    const ptrdiff_t stride = 160;
+    std::vector<uint8_t> a(stride * 66);
+    std::vector<uint8_t> b(stride * 66);
+    unsigned failures = 0;
+
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = (uint8_t) random_u32();
+        b[i] = (uint8_t) random_u32();
+    }
+    for (const auto &size : block_sizes) {
+        for (unsigned offset = 0; offset < 4; offset++) {
+            const uint8_t *pa = a.data() + offset;
+            const uint8_t *pb = b.data() + 2 * offset + 1;
+
+            if (c->sad_8(pa, stride, pb, stride, size[0], size[1]) !=
+                dsp->sad_8(pa, stride, pb, stride, size[0], size[1]))
+                failures++;
+
+            // 16-bit samples keep their natural alignment
+            pa = a.data() + 2 * offset;
+            pb = b.data() + 2 * offset + 2;
+            if (c->sad_16(pa, stride, pb, stride, size[0], size[1]) !=
+                dsp->sad_16(pa, stride, pb, stride, size[0], size[1]))
+                failures++;
+        }
+    }
+    checker->check(failures == 0, "sad");
+}
+
+int main() {
+    LcevcDsp c;
+    unsigned failures = 0;
+
+    lcevc_dsp_init(&c, "c");
+    for (const char *isa : isa_names) {
+        LcevcDsp dsp;
+        Checker checker = { isa, 0, 0 };
+
+        if (!lcevc_dsp_init(&dsp, isa)) {
+            printf("%s: not supported, skipped\n", isa);
+            continue;
+        }
+        for (const auto &size : sizes) {
+            check_planes(&c, &dsp, &checker, size.width, size.height);
+            check_upsample(&c, &dsp, &checker, size.width, size.height);
+            check_transform(&c, &dsp, &checker, size.width, size.height);
+            check_arithmetic(&c, &dsp, &checker, size.width, size.height);
+        }
+        check_find_nonzero(&c, &dsp, &checker);
+        check_sad(&c, &dsp, &checker);
+        printf("%s: %u of %u cases bit-exact\n", isa, checker.cases - checker.failures,
+               checker.cases);
+        failures += checker.failures;
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+// Ingest of input split over several memories without a GstVideoMeta: the
+// element copies such a frame into its padded ingest pool, and must come out
+// with the same bitstream as for the frame in a single memory, which it reads
+// in place. An I420 picture 854 samples wide has rows that are not a multiple
+// of the pool alignment, so a copy that misses the strides shears it.
+// The plugin is looked up in GST_PLUGIN_PATH.
+
+#include <gst/gst.h>
+#include <gst/check/gstharness.h>
+#include <gst/video/video.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#define WIDTH 854
+#define HEIGHT 480
+
+// Rows that differ from each other, so that any shift of a row shows
+static std::vector<uint8_t> draw_frame(const GstVideoInfo *info) {
+    std::vector<uint8_t> frame(GST_VIDEO_INFO_SIZE(info));
+
+    for (guint c = 0; c < GST_VIDEO_INFO_N_COMPONENTS(info); c++) {
+        uint8_t *plane = frame.data() + GST_VIDEO_INFO_COMP_OFFSET(info, c);
+
+        for (gint y = 0; y < GST_VIDEO_INFO_COMP_HEIGHT(info, c); y++) {
+            uint8_t *row = plane + (gsize) y * GST_VIDEO_INFO_COMP_STRIDE(info, c);
+
+            for (gint x = 0; x < GST_VIDEO_INFO_COMP_WIDTH(info, c); x++)
+                row[x] = (uint8_t) ((x * 7 + y * 13 + c * 50 + (x / 8 + y / 8) % 2 * 64) & 0xff);
+        }
+    }
+    return frame;
+}
+
+// The frame in a single memory, or in two split in the middle of the chroma
+static GstBuffer *frame_buffer(const std::vector<uint8_t> &frame, gsize split) {
+    GstBuffer *buffer = gst_buffer_new();
+
+    if (!split) {
+        gst_buffer_append_memory(buffer,
+            gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY, (gpointer) frame.data(),
+                                   frame.size(), 0, frame.size(), nullptr, nullptr));
+    } else {
+        gst_buffer_append_memory(buffer,
+            gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY, (gpointer) frame.data(),
+                                   split, 0, split, nullptr, nullptr));
+        gst_buffer_append_memory(buffer,
+            gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY, (gpointer) (frame.data() + split),
+                                   frame.size() - split, 0, frame.size() - split,
+                                   nullptr, nullptr));
+    }
+    GST_BUFFER_PTS(buffer) = 0;
+    GST_BUFFER_DURATION(buffer) = GST_SECOND / 30;
+    return buffer;
+}
+
+// Bitstream of the frame alone, without a base encoder
+static std::vector<uint8_t> encode(const GstVideoInfo *info, GstBuffer *buffer) {
+    GstHarness *h = gst_harness_new("lcevcenc");
+    std::vector<uint8_t> bitstream;
+
+    g_object_set(h->element, "encode-base", FALSE, nullptr);
+    gst_harness_set_src_caps(h, gst_video_info_to_caps(info));
+
+    if (gst_harness_push(h, buffer) == GST_FLOW_OK) {
+        gst_harness_push_event(h, gst_event_new_eos());
+        GstBuffer *out = gst_harness_pull(h);
+        if (out) {
+            bitstream.resize(gst_buffer_get_size(out));
+            gst_buffer_extract(out, 0, bitstream.data(), bitstream.size());
+            gst_buffer_unref(out);
+        }
+    }
+    gst_harness_teardown(h);
+    return bitstream;
+}
+
+int main(int argc, char **argv) {
+    GstVideoInfo info;
+
+    gst_init(&argc, &argv);
+    gst_video_info_set_format(&info, GST_VIDEO_FORMAT_I420, WIDTH, HEIGHT);
+    GST_VIDEO_INFO_FPS_N(&info) = 30;
+    GST_VIDEO_INFO_FPS_D(&info) = 1;
+
+    std::vector<uint8_t> frame = draw_frame(&info);
+    gsize split = GST_VIDEO_INFO_PLANE_OFFSET(&info, 1) +
+        GST_VIDEO_INFO_PLANE_STRIDE(&info, 1) * 100 + 3;
+
+    std::vector<uint8_t> in_place = encode(&info, frame_buffer(frame, 0));
+    std::vector<uint8_t> copied = encode(&info, frame_buffer(frame, split));
+
+    printf("%ux%u I420: %zu bytes in place, %zu bytes from two memories\n",
+           WIDTH, HEIGHT, in_place.size(), copied.size());
+    if (in_place.empty() || in_place != copied) {
+        printf("bitstreams differ\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,278 @@
+// Round trip through the LCEVCdec reference decoder: a few pictures of a
+// moving test pattern are encoded with each transform, with and without
+// temporal prediction, and decoded on top of the downsampled pictures as a
+// lossless base. Every picture must decode as enhanced, and come out closer
+// to the source than the same base decoded without enhancement, which is
+// what the decoder falls back to when it cannot parse a layer.
+
+#include "lcevcenhancement.h"
+#include "lcevcworkers.h"
+
+#include <LCEVC/lcevc_dec.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define NUM_PICTURES 4
+
+// Least improvement over the base alone, in dB of luma PSNR
+#define MIN_GAIN_DB 3.0
+
+struct Picture {
+    unsigned width[3];
+    unsigned height[3];
+    std::vector<uint8_t> planes[3];
+};
+
+static void alloc_picture(Picture *picture, unsigned width, unsigned height) {
+    for (unsigned p = 0; p < 3; p++) {
+        picture->width[p] = p ? (width + 1) / 2 : width;
+        picture->height[p] = p ? (height + 1) / 2 : height;
+        picture->planes[p].assign(picture->width[p] * picture->height[p], 0);
+    }
+}
+
+// Gradients with a sharp checkerboard moving over them, which the
+// downsampling loses and the enhancement has to restore
+static void draw_pattern(Picture *picture, unsigned frame) {
+    for (unsigned p = 0; p < 3; p++) {
+        for (unsigned y = 0; y < picture->height[p]; y++) {
+            for (unsigned x = 0; x < picture->width[p]; x++) {
+                unsigned value = (x * 3 + y * 2 + p * 40) & 0xff;
+
+                if (((x + frame * 3) / 4 + y / 4) % 2 && x > picture->width[p] / 3)
+                    value = value / 2 + 96;
+                picture->planes[p][y * picture->width[p] + x] = (uint8_t) value;
+            }
+        }
+    }
+}
+
+static LcevcPicture source_picture(const Picture &picture) {
+    LcevcPicture source = LcevcPicture();
+
+    for (unsigned p = 0; p < 3; p++) {
+        LcevcSourcePlane &plane = source.planes[p];
+
+        plane.data = picture.planes[p].data();
+        plane.stride = picture.width[p];
+        plane.width = picture.width[p];
+        plane.height = picture.height[p];
+        plane.bytes_per_sample = 1;
+        plane.shift = LCEVC_INTERNAL_DEPTH - 8;
+        plane.step = 1;
+        plane.drop = 0;
+    }
+    return source;
+}
+
+static LCEVC_ReturnCode send_enhancement(LCEVC_DecoderHandle decoder, int64_t pts,
+                                         const std::vector<uint8_t> &nal) {
+#ifdef LCEVC_DEC_DISCONTINUITY
+    return LCEVC_SendDecoderEnhancementData(decoder, pts, false, nal.data(),
+                                            (uint32_t) nal.size());
+#else
+    return LCEVC_SendDecoderEnhancementData(decoder, pts, nal.data(), (uint32_t) nal.size());
+#endif
+}
+
+static LCEVC_ReturnCode send_base(LCEVC_DecoderHandle decoder, int64_t pts,
+                                  LCEVC_PictureHandle base) {
+#ifdef LCEVC_DEC_DISCONTINUITY
+    return LCEVC_SendDecoderBase(decoder, pts, false, base, UINT32_MAX, nullptr);
+#else
+    return LCEVC_SendDecoderBase(decoder, pts, base, UINT32_MAX, nullptr);
+#endif
+}
+
+// Copy between a picture of the decoder and ours, in either direction
+static bool copy_picture(LCEVC_DecoderHandle decoder, LCEVC_PictureHandle handle,
+                         Picture *picture, bool to_decoder) {
+    LCEVC_PictureLockHandle lock;
+
+    if (LCEVC_LockPicture(decoder, handle, to_decoder ? LCEVC_Access_Write : LCEVC_Access_Read,
+                          &lock) != LCEVC_Success)
+        return false;
+    for (unsigned p = 0; p < 3; p++) {
+        LCEVC_PicturePlaneDesc desc;
+
+        if (LCEVC_GetPictureLockPlaneDesc(decoder, lock, p, &desc) != LCEVC_Success) {
+            LCEVC_UnlockPicture(decoder, lock);
+            return false;
+        }
+        for (unsigned y = 0; y < picture->height[p]; y++) {
+            uint8_t *row = desc.firstSample + (size_t) y * desc.rowByteStride;
+            uint8_t *ours = &picture->planes[p][y * picture->width[p]];
+
+            if (to_decoder)
+                memcpy(row, ours, picture->width[p]);
+            else
+                memcpy(ours, row, picture->width[p]);
+        }
+    }
+    return LCEVC_UnlockPicture(decoder, lock) == LCEVC_Success;
+}
+
+static double luma_psnr(const Picture &a, const Picture &b) {
+    double sse = 0;
+
+    for (size_t i = 0; i < a.planes[0].size(); i++) {
+        double d = (double) a.planes[0][i] - b.planes[0][i];
+        sse += d * d;
+    }
+    if (sse == 0)
+        return 99.0;
+    return 10.0 * log10(255.0 * 255.0 * a.planes[0].size() / sse);
+}
+
+// Encode and decode NUM_PICTURES pictures, giving the luma PSNR of each
+static bool round_trip(const LcevcEnhancementConfig &config, LcevcWorkerPool *pool,
+                       std::vector<double> *psnr) {
+    LcevcEnhancementEncoder encoder(config, pool);
+    LCEVC_DecoderHandle decoder;
+    LCEVC_AccelContextHandle accel = {};
+    Picture source;
+    Picture base;
+    Picture output;
+    bool ok = true;
+
+    if (LCEVC_CreateDecoder(&decoder, accel) != LCEVC_Success)
+        return false;
+    if (LCEVC_InitializeDecoder(decoder) != LCEVC_Success) {
+        LCEVC_DestroyDecoder(decoder);
+        return false;
+    }
+
+    alloc_picture(&source, config.width, config.height);
+    alloc_picture(&base, (config.width + 1) / 2, (config.height + 1) / 2);
+    alloc_picture(&output, config.width, config.height);
+
+    for (unsigned frame = 0; frame < NUM_PICTURES && ok; frame++) {
+        int64_t pts = frame;
+        LcevcPicture picture;
+        LcevcOutputPlane base_planes[3];
+        std::vector<uint8_t> nal;
+
+        draw_pattern(&source, frame);
+        picture = source_picture(source);
+        encoder.encode(picture, frame == 0);
+        nal.resize(encoder.nal_size());
+        encoder.write_nal(nal.data());
+
+        for (unsigned p = 0; p < 3; p++) {
+            base_planes[p].data = base.planes[p].data();
+            base_planes[p].stride = base.width[p];
+            base_planes[p].width = base.width[p];
+            base_planes[p].height = base.height[p];
+            base_planes[p].bytes_per_sample = 1;
+            base_planes[p].shift = LCEVC_INTERNAL_DEPTH - 8;
+        }
+        encoder.write_base(picture, base_planes);
+
+        LCEVC_PictureDesc base_desc;
+        LCEVC_PictureDesc output_desc;
+        LCEVC_PictureHandle base_handle;
+        LCEVC_PictureHandle output_handle;
+        LCEVC_DecodeInformation info;
+        LCEVC_ReturnCode ret;
+
+        LCEVC_DefaultPictureDesc(&base_desc, LCEVC_I420_8, base.width[0], base.height[0]);
+        LCEVC_DefaultPictureDesc(&output_desc, LCEVC_I420_8, config.width, config.height);
+        if (send_enhancement(decoder, pts, nal) != LCEVC_Success ||
+            LCEVC_AllocPicture(decoder, &base_desc, &base_handle) != LCEVC_Success) {
+            ok = false;
+            break;
+        }
+        if (!copy_picture(decoder, base_handle, &base, true) ||
+            send_base(decoder, pts, base_handle) != LCEVC_Success ||
+            LCEVC_AllocPicture(decoder, &output_desc, &output_handle) != LCEVC_Success) {
+            LCEVC_FreePicture(decoder, base_handle);
+            ok = false;
+            break;
+        }
+        if (LCEVC_SendDecoderPicture(decoder, output_handle) != LCEVC_Success) {
+            LCEVC_FreePicture(decoder, output_handle);
+            ok = false;
+            break;
+        }
+
+        do {
+            ret = LCEVC_ReceiveDecoderPicture(decoder, &output_handle, &info);
+        } while (ret == LCEVC_Again);
+        ok = ret == LCEVC_Success && copy_picture(decoder, output_handle, &output, false);
+        if (ok && config.enhancement_enabled && !info.enhanced) {
+            fprintf(stderr, "picture %u not enhanced\n", frame);
+            ok = false;
+        }
+        if (ok)
+            psnr->push_back(luma_psnr(source, output));
+        LCEVC_FreePicture(decoder, output_handle);
+
+        while (LCEVC_ReceiveDecoderBase(decoder, &base_handle) == LCEVC_Success)
+            LCEVC_FreePicture(decoder, base_handle);
+    }
+
+    LCEVC_DestroyDecoder(decoder);
+    return ok;
+}
+
+int main() {
+    static const struct {
+        unsigned width;
+        unsigned height;
+    } sizes[] = {
+        { 352, 288 },
+        { 356, 204 },   // odd numbers of transform units in LOQ-0
+    };
+    LcevcWorkerPool pool(2);
+    unsigned failures = 0;
+
+    for (const auto &size : sizes) {
+        for (unsigned t = 0; t < 2; t++) {
+            for (unsigned temporal = 0; temporal < 2; temporal++) {
+                LcevcEnhancementConfig config = LcevcEnhancementConfig();
+                std::vector<double> enhanced;
+                std::vector<double> plain;
+
+                config.width = size.width;
+                config.height = size.height;
+                config.num_planes = 3;
+                config.chroma_shift_x = 1;
+                config.chroma_shift_y = 1;
+                config.bit_depth = 8;
+                config.base_depth = 8;
+                config.enhancement_depth = 8;
+                config.transform = (LcevcTransformType) t;
+                config.scaling = LCEVC_SCALING_2D;
+                config.upsample = LCEVC_UPSAMPLE_MODIFIED_CUBIC;
+                config.step_width_loq0 = 200;
+                config.step_width_loq1 = 200;
+                config.temporal_enabled = temporal != 0;
+                config.enhancement_enabled = true;
+
+                bool ok = round_trip(config, &pool, &enhanced);
+                config.enhancement_enabled = false;
+                ok = round_trip(config, &pool, &plain) && ok;
+                ok = ok && enhanced.size() == NUM_PICTURES && plain.size() == NUM_PICTURES;
+
+                for (size_t i = 0; ok && i < NUM_PICTURES; i++) {
+                    printf("%ux%u %s%s picture %zu: %.2f dB, %.2f dB without enhancement\n",
+                           size.width, size.height, t ? "dds" : "dd",
+                           temporal ? " temporal" : "", i, enhanced[i], plain[i]);
+                    if (enhanced[i] < plain[i] + MIN_GAIN_DB)
+                        ok = false;
+                }
+                if (!ok) {
+                    printf("%ux%u %s%s: FAILED\n", size.width, size.height, t ? "dds" : "dd",
+                           temporal ? " temporal" : "");
+                    failures++;
+                }
+            }
+        }
+    }
+
+    return failures ? 1 : 0;
+}